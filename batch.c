@@ -0,0 +1,467 @@
+#define DEBUG
+#include <assert.h>
+#include <ctype.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/wait.h>
+#endif
+
+#include "board.h"
+#include "debug.h"
+#include "engine.h"
+#include "mq.h"
+#include "timeinfo.h"
+#include "uct/uct.h"
+#include "batch.h"
+
+static pthread_mutex_t *output_lock = NULL;
+
+static void
+game_init(batch_game_t *g)
+{
+	memset(g, 0, sizeof(*g));
+	g->size = 19;
+	g->komi = 7.5;
+}
+
+static void
+game_add(batch_game_t *g, coord_t c, enum stone color, bool setup)
+{
+	if (g->moves == g->alloc) {
+		g->alloc = (g->alloc ? g->alloc * 2 : 512);
+		g->move = realloc(g->move, g->alloc * sizeof(move_t));
+		if (!g->move)  die("batch: out of memory\n");
+	}
+
+	move_t m = move(c, color);
+	if (!setup) {
+		g->move[g->moves++] = m;
+		return;
+	}
+
+	/* Keep setup stones ahead of game moves. */
+	memmove(&g->move[g->setup + 1], &g->move[g->setup], (g->moves - g->setup) * sizeof(move_t));
+	g->move[g->setup++] = m;
+	g->moves++;
+}
+
+/* New game starting: drop what we have so far (gtp clear_board, boardsize) */
+static void
+game_clear(batch_game_t *g)
+{
+	g->moves = g->setup = 0;
+	g->handicap = g->fixed_handicap = 0;
+}
+
+static char *
+read_file(char *filename)
+{
+	FILE *f = (strcmp(filename, "-") ? fopen(filename, "r") : stdin);
+	if (!f)  return NULL;
+
+	size_t len = 0, alloc = 65536;
+	char *s = cmalloc(alloc);
+	size_t n;
+	while ((n = fread(s + len, 1, alloc - len - 1, f)) > 0) {
+		len += n;
+		if (len + 1 == alloc) {
+			alloc *= 2;
+			s = realloc(s, alloc);
+			if (!s)  die("batch: out of memory\n");
+		}
+	}
+	s[len] = 0;
+	if (f != stdin)  fclose(f);
+	return s;
+}
+
+
+/**************************************************************************************************/
+/* Game records */
+
+/* Only the main variation is used: it is always the first one at each
+ * branch point so the first ')' ends it. */
+static void
+sgf_property(batch_game_t *g, char *id, char *val)
+{
+	if      (!strcmp(id, "SZ"))  g->size = atoi(val);
+	else if (!strcmp(id, "KM"))  g->komi = atof(val);
+	else if (!strcmp(id, "HA"))  g->handicap = atoi(val);
+	else if (!strcmp(id, "B") || !strcmp(id, "W") ||
+		 !strcmp(id, "AB") || !strcmp(id, "AW")) {
+		enum stone color = (id[strlen(id) - 1] == 'B' ? S_BLACK : S_WHITE);
+		bool setup = (id[0] == 'A');
+		coord_t c = sgf2coord_for(val, g->size);
+		if (is_resign(c) || (setup && is_pass(c)))  return;
+		game_add(g, c, color, setup);
+	}
+}
+
+static bool
+sgf_load(batch_game_t *g, char *s)
+{
+	char *p = strchr(s, '(');
+	if (!p)  return false;
+
+	char id[8] = "";
+	int  idlen = 0;
+	bool new_id = true;
+	char val[64];
+	for (p++; *p && *p != ')'; ) {
+		if (isupper(*p)) {
+			if (new_id)  {  idlen = 0;  new_id = false;  }
+			if (idlen < (int)sizeof(id) - 1)  id[idlen++] = *p;
+			id[idlen] = 0;
+			p++;
+		} else if (*p == '[') {
+			/* Property value, may span lines and contain escaped ']' */
+			int n = 0;
+			for (p++; *p && *p != ']'; p++) {
+				if (*p == '\\' && p[1])  p++;
+				if (n < (int)sizeof(val) - 1)  val[n++] = *p;
+			}
+			val[n] = 0;
+			if (*p)  p++;
+			sgf_property(g, id, val);
+			new_id = true;
+		} else {
+			if (*p == ';')  {  idlen = 0;  id[0] = 0;  new_id = true;  }
+			p++;
+		}
+	}
+
+	/* Kgs records free handicap stones as black moves. */
+	if (g->handicap > 1 && !g->setup)
+		while (g->setup < g->handicap && g->setup < g->moves &&
+		       g->move[g->setup].color == S_BLACK && !is_pass(g->move[g->setup].coord))
+			g->setup++;
+	return true;
+}
+
+static bool
+gtp_load(batch_game_t *g, char *s)
+{
+	for (char *line = strtok(s, "\n"); line; line = strtok(NULL, "\n")) {
+		char *comment = strchr(line, '#');
+		if (comment)  *comment = 0;
+
+		char *saveptr = NULL;
+		char *cmd = strtok_r(line, " \t\r", &saveptr);
+		if (cmd && isdigit(*cmd))  cmd = strtok_r(NULL, " \t\r", &saveptr);  /* gtp id */
+		if (!cmd)  continue;
+		char *arg = strtok_r(NULL, " \t\r", &saveptr);
+
+		if (!strcmp(cmd, "boardsize") && arg) {
+			g->size = atoi(arg);
+			game_clear(g);
+		} else if (!strcmp(cmd, "clear_board"))
+			game_clear(g);
+		else if (!strcmp(cmd, "komi") && arg)
+			g->komi = atof(arg);
+		else if (!strcmp(cmd, "fixed_handicap") && arg)
+			g->handicap = g->fixed_handicap = atoi(arg);
+		else if (!strcmp(cmd, "set_free_handicap")) {
+			for (; arg; arg = strtok_r(NULL, " \t\r", &saveptr)) {
+				game_add(g, str2coord_for(arg, g->size), S_BLACK, true);
+				g->handicap++;
+			}
+		} else if (!strcmp(cmd, "play") && arg) {
+			char *coord = strtok_r(NULL, " \t\r", &saveptr);
+			if (!coord)  continue;
+			game_add(g, str2coord_for(coord, g->size), str2stone(arg), false);
+		}
+	}
+	return true;
+}
+
+static bool
+is_sgf(char *filename)
+{
+	size_t len = strlen(filename);
+	return (len > 4 && !strcasecmp(filename + len - 4, ".sgf"));
+}
+
+static bool
+is_gtp(char *filename)
+{
+	size_t len = strlen(filename);
+	return (len > 4 && !strcasecmp(filename + len - 4, ".gtp"));
+}
+
+bool
+batch_game_load(batch_game_t *g, char *filename)
+{
+	game_init(g);
+	char *s = read_file(filename);
+	if (!s)  return false;
+
+	bool r = (is_sgf(filename) ? sgf_load(g, s) : gtp_load(g, s));
+	free(s);
+	return (r && g->size >= 2 && g->size <= BOARD_MAX_SIZE);
+}
+
+void
+batch_game_done(batch_game_t *g)
+{
+	free(g->move);
+	g->move = NULL;
+}
+
+void
+batch_game_setup(batch_game_t *g, board_t *b, char *filename)
+{
+	if (board_rsize(b) != g->size)
+		board_resize(b, g->size);
+	board_clear(b);
+	b->komi = g->komi;
+
+	if (g->fixed_handicap) {
+		move_queue_t q;  mq_init(&q);
+		board_handicap(b, g->fixed_handicap, &q);
+	}
+	for (int i = 0; i < g->setup; i++)
+		if (board_play(b, &g->move[i]) < 0 && DEBUGL(1))
+			fprintf(stderr, "batch: %s: illegal setup stone %s\n", filename, coord2sstr(g->move[i].coord));
+	b->handicap = g->handicap;
+}
+
+
+/**************************************************************************************************/
+/* Analysis */
+
+static void
+json_string(strbuf_t *buf, char *str)
+{
+	sbprintf(buf, "\"");
+	for (char *s = str; *s; s++) {
+		if      (*s == '"' || *s == '\\')  sbprintf(buf, "\\%c", *s);
+		else if ((unsigned char)*s < 0x20)  sbprintf(buf, "\\u%04x", *s);
+		else				   sbprintf(buf, "%c", *s);
+	}
+	sbprintf(buf, "\"");
+}
+
+/* Write one json line atomically: worker processes share stdout. */
+static void
+batch_output(char *prefix, char *json)
+{
+	if (output_lock)  pthread_mutex_lock(output_lock);
+	fputs(prefix, stdout);
+	fputs(json, stdout);
+	fflush(stdout);
+	if (output_lock)  pthread_mutex_unlock(output_lock);
+}
+
+/* Analyze position before game move @m.
+ * Output is uct_progress_json() final move output with extra fields
+ * telling which game and move it belongs to. */
+static void
+batch_analyze_move(char *filename, board_t *b, engine_t *e, time_info_t *ti, move_t *m)
+{
+	char *json = NULL;
+	size_t len = 0;
+	FILE *fh = open_memstream(&json, &len);
+	if (!fh)  fail("open_memstream");
+
+	time_info_t *ti_genmove = time_info_genmove(b, ti, m->color);
+	uct_analyze_json(e, b, ti_genmove, m->color, fh);
+	fclose(fh);
+	assert(json[0] == '{');
+
+	strbuf_t strbuf;
+	strbuf_t *buf = strbuf_init_alloc(&strbuf, strlen(filename) * 6 + 256);
+	sbprintf(buf, "{\"file\": ");
+	json_string(buf, filename);
+	sbprintf(buf, ", \"movenum\": %d, \"color\": \"%s\", \"played\": \"%s\", ",
+		 b->moves + 1, (m->color == S_BLACK ? "b" : "w"), coord2sstr(m->coord));
+
+	batch_output(buf->str, json + 1);
+	free(buf->str);
+	free(json);
+}
+
+/* Replay game and analyze every move. Returns number of positions analyzed. */
+static int
+batch_analyze_game(char *filename, board_t *b, engine_t *e, time_info_t *ti_default)
+{
+	batch_game_t game;
+	batch_game_t *g = &game;
+	if (!batch_game_load(g, filename)) {
+		if (DEBUGL(0))  fprintf(stderr, "batch: couldn't load %s, skipping\n", filename);
+		batch_game_done(g);
+		return 0;
+	}
+#ifdef BOARD_SIZE
+	if (g->size != BOARD_SIZE) {
+		if (DEBUGL(0))  fprintf(stderr, "batch: %s: this Pachi only plays on %ix%i, skipping\n",
+					filename, BOARD_SIZE, BOARD_SIZE);
+		batch_game_done(g);
+		return 0;
+	}
+#endif
+
+	batch_game_setup(g, b, filename);
+	engine_reset(e, b);
+
+	time_info_t ti[S_MAX];
+	ti[S_BLACK] = *ti_default;
+	ti[S_WHITE] = *ti_default;
+
+	int positions = 0;
+	for (int i = g->setup; i < g->moves; i++) {
+		move_t *m = &g->move[i];
+		if (is_resign(m->coord))  break;
+
+		batch_analyze_move(filename, b, e, ti, m);
+		positions++;
+
+		bool print = false;
+		if (e->notify_play)  e->notify_play(e, b, m, NULL, &print);
+		if (board_play(b, m) < 0) {
+			if (DEBUGL(0))  fprintf(stderr, "batch: %s: illegal move %s %s, skipping rest of game\n",
+						filename, stone2str(m->color), coord2sstr(m->coord));
+			break;
+		}
+	}
+
+	batch_game_done(g);
+	return positions;
+}
+
+static void
+batch_worker(char **files, int nfiles, int id, int jobs, board_t *b, engine_t *e, time_info_t *ti)
+{
+	int games = 0, positions = 0;
+	for (int i = id; i < nfiles; i += jobs, games++)
+		positions += batch_analyze_game(files[i], b, e, ti);
+
+	if (DEBUGL(1))  fprintf(stderr, "batch worker %d: %d games, %d positions\n", id, games, positions);
+}
+
+static bool
+is_absolute_path(char *filename)
+{
+#ifdef _WIN32
+	if (isalpha(filename[0]) && filename[1] == ':')  return true;
+	if (filename[0] == '\\')  return true;
+#endif
+	return (filename[0] == '/');
+}
+
+/* @filename relative to directory @dir */
+static char *
+batch_file_path(char *dir, char *filename)
+{
+	if (is_absolute_path(filename) || !strcmp(dir, "."))
+		return strdup(filename);
+
+	char *path = cmalloc(strlen(dir) + strlen(filename) + 2);
+	sprintf(path, "%s/%s", dir, filename);
+	return path;
+}
+
+char **
+batch_files(char *listfile, int *nfiles)
+{
+	if (is_sgf(listfile) || is_gtp(listfile)) {
+		char **files = calloc2(1, char*);
+		files[0] = strdup(listfile);
+		*nfiles = 1;
+		return files;
+	}
+
+	char *s = read_file(listfile);
+	if (!s)  die("batch: couldn't open %s\n", listfile);
+
+	/* Relative names are relative to the list file. */
+	char *listcopy = strdup(listfile);
+	char *dir = (strcmp(listfile, "-") ? dirname(listcopy) : ".");
+
+	int n = 0, alloc = 64;
+	char **files = calloc2(alloc, char*);
+	for (char *line = strtok(s, "\r\n"); line; line = strtok(NULL, "\r\n")) {
+		while (isspace(*line))  line++;
+		if (!*line || *line == '#')  continue;
+		if (n == alloc) {
+			alloc *= 2;
+			files = realloc(files, alloc * sizeof(char*));
+			if (!files)  die("batch: out of memory\n");
+		}
+		files[n++] = batch_file_path(dir, line);
+	}
+	free(listcopy);
+	free(s);
+
+	*nfiles = n;
+	return files;
+}
+
+void
+batch_files_free(char **files, int nfiles)
+{
+	for (int i = 0; i < nfiles; i++)
+		free(files[i]);
+	free(files);
+}
+
+int
+batch_analyze(char *listfile, int jobs, board_t *b, engine_t *e, time_info_t *ti)
+{
+	if (e->id != E_UCT)  die("--analyze-batch: only uct engine supported\n");
+
+	int nfiles;
+	char **files = batch_files(listfile, &nfiles);
+	if (jobs > nfiles)  jobs = nfiles;
+	if (jobs < 1)       jobs = 1;
+	if (DEBUGL(1))  fprintf(stderr, "batch: %d games, %d jobs\n", nfiles, jobs);
+
+#ifdef _WIN32
+	if (jobs > 1)  die("--analyze-jobs: not supported on windows\n");
+#endif
+
+	int r = 0;
+	if (jobs == 1)
+		batch_worker(files, nfiles, 0, 1, b, e, ti);
+#ifndef _WIN32
+	else {
+		/* Fork workers once everything is loaded: dictionaries (patterns,
+		 * joseki, dcnn) are read-only afterwards so pages stay shared. */
+		output_lock = mmap(NULL, sizeof(*output_lock), PROT_READ | PROT_WRITE,
+				   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		if (output_lock == MAP_FAILED)  fail("mmap");
+		pthread_mutexattr_t attr;
+		pthread_mutexattr_init(&attr);
+		pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+		pthread_mutex_init(output_lock, &attr);
+		pthread_mutexattr_destroy(&attr);
+
+		fflush(stdout);  fflush(stderr);
+		for (int id = 0; id < jobs; id++) {
+			pid_t pid = fork();
+			if (pid < 0)  fail("fork");
+			if (pid)  continue;
+
+			batch_worker(files, nfiles, id, jobs, b, e, ti);
+			fflush(stdout);  fflush(stderr);
+			_exit(0);
+		}
+
+		for (int id = 0; id < jobs; id++) {
+			int status;
+			if (wait(&status) < 0)  fail("wait");
+			if (!WIFEXITED(status) || WEXITSTATUS(status))  r = 1;
+		}
+		munmap(output_lock, sizeof(*output_lock));
+		output_lock = NULL;
+	}
+#endif
+
+	batch_files_free(files, nfiles);
+	return r;
+}
@@ -0,0 +1,38 @@
+#ifndef PACHI_BATCH_H
+#define PACHI_BATCH_H
+
+#include "engine.h"
+
+/* Game record: setup stones come first, then game moves. */
+typedef struct {
+	int        size;
+	floating_t komi;
+	int        handicap;
+	int        fixed_handicap;	/* gtp fixed_handicap: stones placed by board_handicap() */
+	int        setup;		/* Number of setup stones at beginning of @move */
+	int        moves;
+	int        alloc;
+	move_t    *move;
+} batch_game_t;
+
+/* Load sgf (main variation only) or gtp game record.
+ * Call batch_game_done() afterwards, even on failure. */
+bool batch_game_load(batch_game_t *g, char *filename);
+void batch_game_done(batch_game_t *g);
+/* Set up board for game @g: size, komi, handicap and setup stones. */
+void batch_game_setup(batch_game_t *g, board_t *b, char *filename);
+
+/* Game records listed in @listfile (one per line, relative to the list
+ * file's directory), or @listfile itself if it's a .sgf / .gtp file.
+ * Free with batch_files_free(). */
+char **batch_files(char *listfile, int *nfiles);
+void   batch_files_free(char **files, int nfiles);
+
+/* Batch analysis: replay every game listed in @listfile (one sgf/gtp
+ * file per line, or a single .sgf/.gtp file) and analyze each position
+ * with uct engine @e, streaming one json line per move on stdout.
+ * Games are spread over @jobs worker processes forked once engine and
+ * dictionaries are loaded, so they all share the same read-only data. */
+int batch_analyze(char *listfile, int jobs, board_t *b, engine_t *e, time_info_t *ti);
+
+#endif
@@ -6,12 +6,14 @@
 
 //#define DEBUG
 #include "board.h"
+#include "board_undo.h"
 #include "debug.h"
 #include "fbook.h"
 #include "mq.h"
 #include "random.h"
 #include "ownermap.h"
 #include "dcnn.h"
+#include "telemetry.h"
 
 #ifdef BOARD_PAT3
 #include "pattern3.h"
@@ -136,6 +138,17 @@ board_statics_init(board_t *board)
 		bs->coord[c][1] = c / stride;
 	} foreach_point_end;
 
+	/* Set up board transforms */
+	for (int t = 0; t < 8; t++)
+		foreach_point(board) {
+			int x = c % stride,  y = c / stride;
+			if (t & BOARD_VMIRROR)  y = stride - 1 - y;
+			if (t & BOARD_HMIRROR)  x = stride - 1 - x;
+			if (t & BOARD_XYFLIP)  {  int tmp = x;  x = y;  y = tmp;  }
+			bs->sym[t][c] = y * stride + x;
+			bs->unsym[t][y * stride + x] = c;
+		} foreach_point_end;
+
 	/* Initialize zobrist hashtable. */
 	/* We will need these to be stable across Pachi runs for certain kinds
 	 * of pattern matching, thus we do not use fast_random() for this. */
@@ -900,6 +913,8 @@ board_hash_update(board_t *board, coord_t coord, enum stone color)
 {
 	if (!playout_board(board)) {
 		board->hash ^= hash_at(coord, color);
+		for (int t = 0; t < 8; t++)
+			board->symhash[t] ^= hash_at(board_statics.sym[t][coord], color);
 		if (DEBUGL(8))
 			fprintf(stderr, "board_hash_update(%d,%d,%d) ^ %" PRIhash " -> %" PRIhash "\n", color, coord_x(coord), coord_y(coord), hash_at(coord, color), board->hash);
 	}
@@ -938,6 +953,12 @@ board_hash_commit(board_t *b)
 
 	if (DEBUGL(8)) fprintf(stderr, "board_hash_commit %" PRIhash "\n", b->hash);
 
+	b->canonical_sym = 0;
+	for (int t = 1; t < 8; t++)
+		if (b->symhash[t] < b->symhash[b->canonical_sym])
+			b->canonical_sym = t;
+	b->canonical_hash = b->symhash[b->canonical_sym];
+
 	for (int i = 0; i < BOARD_HASH_HISTORY; i++) {
 		if (b->hash_history[i] == b->hash) {
 			if (DEBUGL(5))  fprintf(stderr, "SUPERKO VIOLATION noted at %s\n", coord2sstr(last_move(b).coord));
@@ -1039,5 +1060,85 @@ board_play(board_t *b, move_t *m)
         assert(!b->quicked);
 #endif
 
+	telemetry_inc(TM_BOARD_PLAY);
 	return board_play_(b, m);
 }
+
+int
+board_full_play(board_t *b, move_t *m, board_full_undo_t *u)
+{
+#ifdef BOARD_UNDO_CHECKS
+        assert(!b->quicked);
+#endif
+
+	memcpy(u->captures, b->captures, sizeof(u->captures));
+	memcpy(u->last_moves, b->last_moves, sizeof(u->last_moves));
+	u->last_move_i = b->last_move_i;
+	u->free_i = (is_pass(m->coord) ? -1 : b->fmap[m->coord]);
+	u->free_len = b->flen;
+	u->hash = b->hash;
+	memcpy(u->symhash, b->symhash, sizeof(u->symhash));
+	u->canonical_hash = b->canonical_hash;
+	u->canonical_sym = b->canonical_sym;
+	u->hash_history_next = b->hash_history_next;
+	u->hash_history = b->hash_history[b->hash_history_next];
+	u->superko_violation = b->superko_violation;
+	u->symmetry = b->symmetry;
+#ifdef WANT_BOARD_C
+	u->ncapturable = b->clen;
+	memcpy(u->capturable, b->c, b->clen * sizeof(group_t));
+#endif
+#ifdef BOARD_PAT3
+	memcpy(u->pat3, b->pat3, sizeof(u->pat3));
+#endif
+
+	undo_init(b, m, &u->u);
+	b->u = &u->u;
+	telemetry_inc(TM_BOARD_PLAY);
+	int r = board_play_(b, m);
+	b->u = NULL;
+	return r;
+}
+
+void
+board_full_undo(board_t *b, move_t *m, board_full_undo_t *u)
+{
+	/* Core structures first, then everything quick_undo() doesn't know about. */
+#ifdef BOARD_UNDO_CHECKS
+	b->quicked++;
+#endif
+	board_quick_undo(b, m, &u->u);
+
+	memcpy(b->captures, u->captures, sizeof(b->captures));
+	memcpy(b->last_moves, u->last_moves, sizeof(b->last_moves));
+	b->last_move_i = u->last_move_i;
+	b->hash = u->hash;
+	memcpy(b->symhash, u->symhash, sizeof(b->symhash));
+	b->canonical_hash = u->canonical_hash;
+	b->canonical_sym = u->canonical_sym;
+	b->hash_history_next = u->hash_history_next;
+	b->hash_history[b->hash_history_next] = u->hash_history;
+	b->superko_violation = u->superko_violation;
+	b->symmetry = u->symmetry;
+#ifdef WANT_BOARD_C
+	b->clen = u->ncapturable;
+	memcpy(b->c, u->capturable, b->clen * sizeof(group_t));
+#endif
+#ifdef BOARD_PAT3
+	memcpy(b->pat3, u->pat3, sizeof(b->pat3));
+#endif
+
+	if (is_pass(m->coord))  return;
+
+	/* Captured stones were appended to f[], drop them and put move back
+	 * where board_rmf() took it from. */
+	int f = u->free_i;
+	b->flen = u->free_len;
+	if (f != b->flen - 1) {  /* Last item was moved there */
+		coord_t c = b->f[f];
+		b->f[b->flen - 1] = c;
+		b->fmap[c] = b->flen - 1;
+	}
+	b->f[f] = m->coord;
+	b->fmap[m->coord] = f;
+}
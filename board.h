@@ -26,6 +26,9 @@ struct ownermap;
 
 //#define BOARD_UNDO_CHECKS 1     /* Guard against invalid quick_play() / quick_undo() uses */
 
+//#define BOARD_LIBSETS           /* Liberty bitset for each group: exact liberty counts */
+                                  /* and shared liberties with popcount, but bigger board copies */
+
 #define BOARD_LAST_N 4            /* Previous moves. */
 
 #define BOARD_HASH_HISTORY 16
@@ -69,6 +72,18 @@ typedef uint32_t hash3_t;    /* 3x3 pattern hash */
 
 typedef coord_t group_t;     /* Note that "group" is only chain of stones that is solidly connected for us. */
 
+#ifdef BOARD_LIBSETS
+/* Set of liberties, one bit per coord. */
+#define LIBSET_WORDS ((BOARD_MAX_COORDS + 63) / 64)
+typedef struct {
+	uint64_t w[LIBSET_WORDS];
+} libset_t;
+
+#define libset_add(s_, c_)  ((s_)->w[(c_) >> 6] |=  (1ULL << ((c_) & 63)))
+#define libset_rm(s_, c_)   ((s_)->w[(c_) >> 6] &= ~(1ULL << ((c_) & 63)))
+#define libset_has(s_, c_)  (((s_)->w[(c_) >> 6] >> ((c_) & 63)) & 1)
+#endif
+
 
 typedef struct {              /* Keep track of only up to GROUP_KEEP_LIBS. over that, we don't care. */
 #define GROUP_KEEP_LIBS  10   /* _Combination_ of these two values can make some difference in performance. */
@@ -78,6 +93,9 @@ typedef struct {              /* Keep track of only up to GROUP_KEEP_LIBS. over
 			       * It denotes only number of items in lib[], thus you can rely
 			       * on it to store real liberties only up to <= GROUP_REFILL_LIBS. */
 	coord_t lib[GROUP_KEEP_LIBS];  
+#ifdef BOARD_LIBSETS
+	libset_t libset;      /* All liberties, always exact. */
+#endif
 } group_info_t;
 
 
@@ -134,6 +152,9 @@ typedef struct {
 	hash_t h[BOARD_MAX_COORDS][2];      /* Fixed zobrist hashes for all coords (black and white) */
 	
 	uint8_t coord[BOARD_MAX_COORDS][2]; /* Cached x-y coord info so we avoid division. */
+
+	coord_t sym[8][BOARD_MAX_COORDS];   /* Coord mapping for each board transform (see board_sym_coord()) */
+	coord_t unsym[8][BOARD_MAX_COORDS]; /* Inverse mappings */
 } board_statics_t;
 
 /* Only one board size in use at any given time so don't need array */
@@ -197,6 +218,9 @@ FB_ONLY(bool playout_board);
 FB_ONLY(board_symmetry_t symmetry);               /* Symmetry information */
 
 FB_ONLY(hash_t hash);                             /* Hash of current board position. */
+FB_ONLY(hash_t symhash)[8];                       /* Hashes of the 8 transformed positions (symhash[0] == hash) */
+FB_ONLY(hash_t canonical_hash);                   /* Smallest of symhash[], same for all symmetric positions */
+FB_ONLY(int canonical_sym);                       /* Transform giving canonical_hash */
 FB_ONLY(hash_t hash_history)[BOARD_HASH_HISTORY]; /* Last hashes encountered, for superko check. */
 	int    hash_history_next;                 /* (circular buffer) */
 
@@ -340,6 +364,16 @@ static bool board_playing_ko_threat(board_t *b);
 /* Determine number of stones in a group, up to @max stones. */
 static int group_stone_count(board_t *b, group_t group, int max);
 
+/* Exact number of liberties of a group (board_group_info().libs is only
+ * a lower bound). Cheap with BOARD_LIBSETS, walks the group otherwise.
+ * Tactics code (nlib.c, 2lib.c miai checks) doesn't need these: it only
+ * looks at groups with few liberties (moggy nlib_count, 4 by default),
+ * which lib[] tracks exactly up to GROUP_REFILL_LIBS, and walks stones
+ * to find neighbor groups, not to count liberties. */
+static int group_libs(board_t *b, group_t group);
+/* Number of liberties shared by two groups. */
+static int groups_shared_libs(board_t *b, group_t g1, group_t g2);
+
 #ifndef QUICK_BOARD_CODE
 /* Adjust symmetry information as if given coordinate has been played. */
 void board_symmetry_update(board_t *b, board_symmetry_t *symmetry, coord_t c);
@@ -348,6 +382,20 @@ void board_symmetry_update(board_t *b, board_symmetry_t *symmetry, coord_t c);
 bool board_coord_in_symmetry(board_t *b, coord_t c);
 #endif
 
+/* Board transforms: combination of these bits, applied in this order.
+ * Transform 0 is the identity. */
+#define BOARD_VMIRROR     1
+#define BOARD_HMIRROR     2
+#define BOARD_XYFLIP      4
+
+/* Map coord through transform @t / back. pass and resign are left alone. */
+#define board_sym_coord(c, t)    ((c) < 0 ? (c) : board_statics.sym[t][c])
+#define board_unsym_coord(c, t)  ((c) < 0 ? (c) : board_statics.unsym[t][c])
+
+/* Position lookups that should match rotated / mirrored positions as well
+ * can key on b->canonical_hash: map moves with board_sym_coord(c, b->canonical_sym)
+ * when storing and board_unsym_coord() when retrieving. */
+
 /* Returns true if given coordinate has all neighbors of given color or the edge. */
 static bool board_is_eyelike(board_t *b, coord_t coord, enum stone eye_color);
 /* Returns true if given coordinate could be a false eye; this check makes
@@ -519,5 +567,76 @@ group_stone_count(board_t *b, group_t group, int max)
 	return n;
 }
 
+#ifdef BOARD_LIBSETS
+
+static inline int
+group_libs(board_t *b, group_t group)
+{
+	libset_t *s = &board_group_info(b, group).libset;
+	int n = 0;
+	for (int i = 0; i < LIBSET_WORDS; i++)
+		n += __builtin_popcountll(s->w[i]);
+	return n;
+}
+
+static inline int
+groups_shared_libs(board_t *b, group_t g1, group_t g2)
+{
+	libset_t *s1 = &board_group_info(b, g1).libset;
+	libset_t *s2 = &board_group_info(b, g2).libset;
+	int n = 0;
+	for (int i = 0; i < LIBSET_WORDS; i++)
+		n += __builtin_popcountll(s1->w[i] & s2->w[i]);
+	return n;
+}
+
+#else
+
+static inline int
+group_libs(board_t *b, group_t group)
+{
+	/* lib[] has them all up to GROUP_REFILL_LIBS */
+	if (board_group_info(b, group).libs <= GROUP_REFILL_LIBS)
+		return board_group_info(b, group).libs;
+
+	bool seen[BOARD_MAX_COORDS] = { 0, };
+	int n = 0;
+	foreach_in_group(b, group) {
+		coord_t stone = c;
+		foreach_neighbor(b, stone, {
+			if (board_at(b, c) == S_NONE && !seen[c]) {
+				seen[c] = true;  n++;
+			}
+		});
+	} foreach_in_group_end;
+	return n;
+}
+
+static inline int
+groups_shared_libs(board_t *b, group_t g1, group_t g2)
+{
+	bool lib1[BOARD_MAX_COORDS] = { 0, };
+	foreach_in_group(b, g1) {
+		coord_t stone = c;
+		foreach_neighbor(b, stone, {
+			if (board_at(b, c) == S_NONE)
+				lib1[c] = true;
+		});
+	} foreach_in_group_end;
+
+	int n = 0;
+	foreach_in_group(b, g2) {
+		coord_t stone = c;
+		foreach_neighbor(b, stone, {
+			if (lib1[c]) {
+				lib1[c] = false;  n++;
+			}
+		});
+	} foreach_in_group_end;
+	return n;
+}
+
+#endif /* BOARD_LIBSETS */
+
 
 #endif
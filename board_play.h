@@ -1,5 +1,99 @@
 /* board_play() implementation */
 
+/* Undo info: always saved by board_quick_play(), board_play() only
+ * saves it for board_full_play(). */
+#ifdef BOARD_UNDO
+#define board_undo_on(b)  1
+#else
+#define board_undo_on(b)  unlikely((b)->u != NULL)
+#endif
+
+static void
+undo_init(board_t *b, move_t *m, board_undo_t *u)
+{
+	// Paranoid uninitialized mem test
+	// memset(u, 0xff, sizeof(*u));
+	
+	u->last_move2 = last_move2(b);
+	u->ko = b->ko;
+	u->last_ko = b->last_ko;
+	u->last_ko_age = b->last_ko_age;
+	u->captures_end = &u->captures[0];
+	u->ncaptures = 0;
+	
+	u->nmerged = u->nmerged_tmp = u->nenemies = 0;
+	for (int i = 0; i < 4; i++)
+		u->merged[i].group = u->enemies[i].group = 0;
+}
+
+
+static inline void
+undo_save_merge(board_t *b, board_undo_t *u, group_t g, coord_t c)
+{
+	if (g == u->merged[0].group || g == u->merged[1].group || 
+	    g == u->merged[2].group || g == u->merged[3].group)
+		return;
+	
+	int i = u->nmerged++;
+	if (!i) u->inserted = c;
+	u->merged[i].group = g;
+	u->merged[i].last = 0;   // can remove
+	u->merged[i].info = board_group_info(b, g);
+}
+
+static inline void
+undo_save_enemy(board_t *b, board_undo_t *u, group_t g)
+{
+	if (g == u->enemies[0].group || g == u->enemies[1].group ||
+	    g == u->enemies[2].group || g == u->enemies[3].group)
+		return;
+	
+	int i = u->nenemies++;
+	u->enemies[i].group = g;
+	u->enemies[i].info = board_group_info(b, g);
+	u->enemies[i].stones = NULL;
+	
+	if (board_group_info(b, g).libs <= 1) { // Will be captured
+		coord_t *stones = u->enemies[i].stones = u->captures_end;
+		int j = 0;
+		foreach_in_group(b, g) {
+			stones[j++] = c;
+		} foreach_in_group_end;
+		u->ncaptures += j;
+		stones[j++] = 0;
+		u->captures_end = &stones[j];
+	}
+}
+
+static void
+undo_save_group_info(board_t *b, coord_t coord, enum stone color, board_undo_t *u)
+{
+	u->next_at = groupnext_at(b, coord);
+
+	foreach_neighbor(b, coord, {			
+		group_t g = group_at(b, c);
+	
+		if (board_at(b, c) == color)
+			undo_save_merge(b, u, g, c);
+		else if (board_at(b, c) == stone_other(color)) 
+			undo_save_enemy(b, u, g);
+	});
+}		
+
+static void
+undo_save_suicide(board_t *b, coord_t coord, enum stone color, board_undo_t *u)
+{
+	foreach_neighbor(b, coord, {
+		if (board_at(b, c) == color) {
+			// Handle suicide as a capture ...
+			undo_save_enemy(b, u, group_at(b, c));
+			return;
+		}
+	});
+	assert(0);
+}
+
+
 static void
 board_group_addlib(board_t *board, group_t group, coord_t coord)
 {
@@ -9,6 +103,9 @@ board_group_addlib(board_t *board, group_t group, coord_t coord)
 			board_group_info(board, group).libs, coord2sstr(coord));
 
 	group_info_t *gi = &board_group_info(board, group);
+#ifdef BOARD_LIBSETS
+	libset_add(&gi->libset, coord);
+#endif
 	if (gi->libs < GROUP_KEEP_LIBS) {
 		for (int i = 0; i < GROUP_KEEP_LIBS; i++) {
 #if 0                   /* Seems extra branch just slows it down */
@@ -29,6 +126,18 @@ static void
 board_group_find_extra_libs(board_t *board, group_t group, group_info_t *gi, coord_t avoid)
 {
 	/* Add extra liberty from the board to our liberty list. */
+#ifdef BOARD_LIBSETS
+	/* We know them all already, no need to walk the group. */
+	libset_t s = gi->libset;
+	for (int i = 0; i < gi->libs; i++)
+		libset_rm(&s, gi->lib[i]);
+	for (int i = 0; i < LIBSET_WORDS; i++)
+		for (uint64_t w = s.w[i]; w; w &= w - 1) {
+			gi->lib[gi->libs++] = i * 64 + __builtin_ctzll(w);
+			if (unlikely(gi->libs >= GROUP_KEEP_LIBS))
+				return;
+		}
+#else
 	unsigned char watermark[board_max_coords(board) / 8];
 	memset(watermark, 0, sizeof(watermark));
 #define watermark_get(c)	(watermark[c >> 3] & (1 << (c & 7)))
@@ -51,6 +160,7 @@ board_group_find_extra_libs(board_t *board, group_t group, group_info_t *gi, coo
 	} foreach_in_group_end;
 #undef watermark_get
 #undef watermark_set
+#endif /* BOARD_LIBSETS */
 }
 
 static void
@@ -62,6 +172,9 @@ board_group_rmlib(board_t *board, group_t group, coord_t coord)
 			board_group_info(board, group).libs, coord2sstr(coord));
 
 	group_info_t *gi = &board_group_info(board, group);
+#ifdef BOARD_LIBSETS
+	libset_rm(&gi->libset, coord);
+#endif
 	for (int i = 0; i < GROUP_KEEP_LIBS; i++) {
 #if 0           /* Seems extra branch just slows it down */
 		if (!gi->lib[i]) break;
@@ -176,6 +289,11 @@ merge_groups(board_t *board, group_t group_to, group_t group_from)
 
 	if (DEBUGL(7))  fprintf(stderr,"---- (froml %d, tol %d)\n", gi_from->libs, gi_to->libs);
 
+#ifdef BOARD_LIBSETS
+	for (int i = 0; i < LIBSET_WORDS; i++)
+		gi_to->libset.w[i] |= gi_from->libset.w[i];
+#endif
+
 	if (gi_to->libs < GROUP_KEEP_LIBS) {
 		for (int i = 0; i < gi_from->libs; i++) {
 			for (int j = 0; j < gi_to->libs; j++)
@@ -202,10 +320,10 @@ next_from_lib:;
 		group_at(board, c) = group_to;
 	} foreach_in_group_end;
 
-#ifdef BOARD_UNDO
-	board_undo_t *u = board->u;
-	u->merged[++u->nmerged_tmp].last = last_in_group;
-#endif
+	if (board_undo_on(board)) {
+		board_undo_t *u = board->u;
+		u->merged[++u->nmerged_tmp].last = last_in_group;
+	}
 	groupnext_at(board, last_in_group) = groupnext_at(board, group_base(group_to));
 	groupnext_at(board, group_base(group_to)) = group_base(group_from);
 	memset(gi_from, 0, sizeof(group_info_t));
@@ -219,12 +337,16 @@ new_group(board_t *board, coord_t coord)
 	group_t group = coord;
 	group_info_t *gi = &board_group_info(board, group);
 	foreach_neighbor(board, coord, {
-		if (board_at(board, c) == S_NONE)
+		if (board_at(board, c) == S_NONE) {
+#ifdef BOARD_LIBSETS
+			libset_add(&gi->libset, c);
+#endif
 			/* board_group_addlib is ridiculously expensive for us */
 #if GROUP_KEEP_LIBS < 4
 			if (gi->libs < GROUP_KEEP_LIBS)
 #endif
 			gi->lib[gi->libs++] = c;
+		}
 	});
 
 	group_at(board, coord) = group;
@@ -287,9 +409,8 @@ board_play_outside(board_t *board, move_t *m, int f)
 	enum stone other_color = stone_other(color);
 	group_t group = 0;
 
-#ifdef BOARD_UNDO	
-	undo_save_group_info(board, coord, color, board->u);
-#endif
+	if (board_undo_on(board))
+		undo_save_group_info(board, coord, color, board->u);
 #ifdef FULL_BOARD	
 	board_rmf(board, f);
 #endif
@@ -353,9 +474,8 @@ board_play_in_eye(board_t *board, move_t *m, int f)
 #ifdef FULL_BOARD
 	board_rmf(board, f);
 #endif
-#ifdef BOARD_UNDO
-	undo_save_group_info(board, coord, color, board->u);
-#endif
+	if (board_undo_on(board))
+		undo_save_group_info(board, coord, color, board->u);
 
 	int ko_caps = 0;
 	coord_t cap_at = pass;
@@ -410,9 +530,8 @@ board_play_f(board_t *board, move_t *m, int f)
 		 * suicide might fail.) */
 		group_t group = board_play_outside(board, m, f);
 		if (unlikely(board_group_captured(board, group))) {
-#ifdef BOARD_UNDO
-			undo_save_suicide(board, m->coord, m->color, board->u);
-#endif
+			if (board_undo_on(board))
+				undo_save_suicide(board, m->coord, m->color, board->u);
 			board_group_capture(board, group);
 		}
 #ifdef FULL_BOARD
@@ -13,91 +13,6 @@
 /**********************************************************************************************/
 /* board_quick_play() implementation */
 
-static void
-undo_init(board_t *b, move_t *m, board_undo_t *u)
-{
-	// Paranoid uninitialized mem test
-	// memset(u, 0xff, sizeof(*u));
-	
-	u->last_move2 = last_move2(b);
-	u->ko = b->ko;
-	u->last_ko = b->last_ko;
-	u->last_ko_age = b->last_ko_age;
-	u->captures_end = &u->captures[0];
-	u->ncaptures = 0;
-	
-	u->nmerged = u->nmerged_tmp = u->nenemies = 0;
-	for (int i = 0; i < 4; i++)
-		u->merged[i].group = u->enemies[i].group = 0;
-}
-
-
-static inline void
-undo_save_merge(board_t *b, board_undo_t *u, group_t g, coord_t c)
-{
-	if (g == u->merged[0].group || g == u->merged[1].group || 
-	    g == u->merged[2].group || g == u->merged[3].group)
-		return;
-	
-	int i = u->nmerged++;
-	if (!i) u->inserted = c;
-	u->merged[i].group = g;
-	u->merged[i].last = 0;   // can remove
-	u->merged[i].info = board_group_info(b, g);
-}
-
-static inline void
-undo_save_enemy(board_t *b, board_undo_t *u, group_t g)
-{
-	if (g == u->enemies[0].group || g == u->enemies[1].group ||
-	    g == u->enemies[2].group || g == u->enemies[3].group)
-		return;
-	
-	int i = u->nenemies++;
-	u->enemies[i].group = g;
-	u->enemies[i].info = board_group_info(b, g);
-	u->enemies[i].stones = NULL;
-	
-	if (board_group_info(b, g).libs <= 1) { // Will be captured
-		coord_t *stones = u->enemies[i].stones = u->captures_end;
-		int j = 0;
-		foreach_in_group(b, g) {
-			stones[j++] = c;
-		} foreach_in_group_end;
-		u->ncaptures += j;
-		stones[j++] = 0;
-		u->captures_end = &stones[j];
-	}
-}
-
-static void
-undo_save_group_info(board_t *b, coord_t coord, enum stone color, board_undo_t *u)
-{
-	u->next_at = groupnext_at(b, coord);
-
-	foreach_neighbor(b, coord, {			
-		group_t g = group_at(b, c);
-	
-		if (board_at(b, c) == color)
-			undo_save_merge(b, u, g, c);
-		else if (board_at(b, c) == stone_other(color)) 
-			undo_save_enemy(b, u, g);
-	});
-}		
-
-static void
-undo_save_suicide(board_t *b, coord_t coord, enum stone color, board_undo_t *u)
-{
-	foreach_neighbor(b, coord, {
-		if (board_at(b, c) == color) {
-			// Handle suicide as a capture ...
-			undo_save_enemy(b, u, group_at(b, c));
-			return;
-		}
-	});
-	assert(0);
-}
-
 static void
 board_commit_move(board_t *b, move_t *m)
 {
@@ -54,6 +54,38 @@ typedef struct board_undo {
 int  board_quick_play(board_t *board, move_t *m, board_undo_t *u);
 void board_quick_undo(board_t *b, move_t *m, board_undo_t *u);
 
+/* Undoable board_play(): unlike quick_play() the full board is maintained
+ * (hash and superko, free positions, capturable groups, symmetry ...),
+ * so the board can be used for anything in between: copied, expanded
+ * in the tree etc. More expensive than quick_play() both ways though.
+ * Moves must be undone in reverse order. */
+typedef struct {
+	board_undo_t u;
+	int    captures[S_MAX];
+	move_t last_moves[BOARD_LAST_N];
+	int    last_move_i;
+	int    free_i;				/* Index of move in f[] */
+	int    free_len;
+	hash_t hash;
+	hash_t symhash[8];
+	hash_t canonical_hash;
+	int    canonical_sym;
+	hash_t hash_history;			/* History item overwritten */
+	int    hash_history_next;
+	bool   superko_violation;
+	board_symmetry_t symmetry;
+#ifdef WANT_BOARD_C
+	group_t capturable[BOARD_MAX_GROUPS];
+	int    ncapturable;
+#endif
+#ifdef BOARD_PAT3
+	hash3_t pat3[BOARD_MAX_COORDS];
+#endif
+} board_full_undo_t;
+
+int  board_full_play(board_t *b, move_t *m, board_full_undo_t *u);
+void board_full_undo(board_t *b, move_t *m, board_full_undo_t *u);
+
 /* quick_play() + quick_undo() combo.
  * Body is executed only if move is valid (silently ignored otherwise).
  * Can break out in body, but definitely *NOT* return / jump around !
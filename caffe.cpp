@@ -15,6 +15,7 @@ using namespace caffe;
 extern "C" {
 #include "debug.h"
 #include "util.h"
+#include "qnet.h"
 
 static shared_ptr<Net<float> > net;
 static int net_size = 0;		/* board size */
@@ -113,6 +114,72 @@ caffe_get_data(float *data, float *result, int size, int planes, int psize)
 	delete blob;
 }
 
+/* Evaluate @n positions in one forward pass.
+ * @data: n input blocks, @result: n * size * size outputs. */
+void
+caffe_get_data_batch(float *data, float *result, int n, int size, int planes, int psize)
+{
+	assert(net && net_size == size);
+	Blob<float> *input = net->input_blobs()[0];
+	input->Reshape(n, planes, psize, psize);
+	net->Reshape();
+	memcpy(input->mutable_cpu_data(), data, n * planes * psize * psize * sizeof(float));
+	const vector<Blob<float>*>& rr = net->Forward();
+	int stride = shape_size(rr[0]->shape()) / n;
+	assert(stride >= size * size);
+
+	for (int k = 0; k < n; k++)
+	for (int i = 0; i < size * size; i++) {
+		float r = rr[0]->cpu_data()[k * stride + i];
+		result[k * size * size + i] = (r < 0.00001 ? 0.00001 : r);
+	}
+
+	/* Back to single position input */
+	input->Reshape(1, planes, psize, psize);
+	net->Reshape();
+}
+
+/* Export weights for int8 quantization (see qnet.h). Only plain nets:
+ * same-padded convolutions + relu, softmax at the end. */
+qnet_t *
+caffe_export_qnet(void)
+{
+	assert(net);
+	const vector<shared_ptr<Layer<float> > >& layers = net->layers();
+	qnet_t *q = qnet_new(false);
+
+	for (unsigned int i = 0; i < layers.size(); i++) {
+		const LayerParameter& lp = layers[i]->layer_param();
+		const char *type = layers[i]->type();
+		const char *name = lp.name().c_str();
+
+		if (!strcmp(type, "Convolution")) {
+			const ConvolutionParameter& p = lp.convolution_param();
+			const vector<shared_ptr<Blob<float> > >& blobs = layers[i]->blobs();
+			Blob<float> *w = blobs[0].get();
+			int out_c = w->shape(0), in_c = w->shape(1), k = w->shape(2);
+			int pad = (p.pad_size() ? p.pad(0) : p.pad_h());
+			int stride = (p.stride_size() ? p.stride(0) : 1);
+			if (w->shape(3) != k || !(k & 1) || pad != k / 2 || stride != 1 || p.group() != 1)
+				die("dcnn quantize: layer %s: only same-padded square convolutions supported\n", name);
+			float *bias = (blobs.size() > 1 ? blobs[1]->mutable_cpu_data() : NULL);
+			qnet_add_layer(q, in_c, out_c, k, w->mutable_cpu_data(), bias, false);
+		}
+		else if (!strcmp(type, "ReLU")) {
+			if (!q->nlayers || lp.relu_param().negative_slope() != 0)
+				die("dcnn quantize: layer %s: unsupported relu\n", name);
+			q->layers[q->nlayers - 1].relu = true;
+		}
+		else if (!strcmp(type, "Softmax"))
+			q->softmax = true;
+		else if (strcmp(type, "Input") && strcmp(type, "Flatten") &&
+			 strcmp(type, "Reshape") && strcmp(type, "Split"))
+			die("dcnn quantize: layer %s: %s layers not supported\n", name, type);
+	}
+	if (!q->nlayers)  die("dcnn quantize: no convolution layers\n");
+	return q;
+}
+
 	
 } /* extern "C" */
 
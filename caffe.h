@@ -11,6 +11,9 @@ bool caffe_ready(void);
 void caffe_init(int size, char *model, char *weights, char *name, int default_size);
 void caffe_done(void);
 void caffe_get_data(float *data, float *result, int size, int planes, int psize);
+void caffe_get_data_batch(float *data, float *result, int n, int size, int planes, int psize);
+struct qnet;
+struct qnet *caffe_export_qnet(void);
 
 #ifdef DCNN
 void quiet_caffe(int argc, char *argv[]);
@@ -1,5 +1,8 @@
 #define DEBUG
 #include <assert.h>
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "debug.h"
@@ -8,9 +11,12 @@
 #include "uct/tree.h"
 #include "caffe.h"
 #include "dcnn.h"
+#include "qnet.h"
 #include "timeinfo.h"
+#include "telemetry.h"
 
-typedef void (*dcnn_evaluate_t)(board_t *b, enum stone color, float result[]);
+/* Fill network input planes for @b, @color to play ([planes][size][size], zeroed) */
+typedef void (*dcnn_get_planes_t)(board_t *b, enum stone color, float *data);
 typedef bool (*dcnn_supported_board_size_t)(board_t *b);
 
 typedef struct {
@@ -20,7 +26,8 @@ typedef struct {
 	char *weights_filename;
 	int  default_size;
 	dcnn_supported_board_size_t supported_board_size;
-	dcnn_evaluate_t             eval;
+	int                         planes;
+	dcnn_get_planes_t           get_planes;
 	int  *global_var;
 } dcnn_t;
 
@@ -31,32 +38,37 @@ static bool board_15x15(board_t *b)        {  return (board_rsize(b) == 15);  }
 static bool board_13x13_and_up(board_t *b) {  return (board_rsize(b) >= 13);  }
 
 #ifdef DCNN_DETLEF
-static void detlef54_dcnn_eval(board_t *b, enum stone color, float result[]);
-static void detlef44_dcnn_eval(board_t *b, enum stone color, float result[]);
+static void detlef54_dcnn_planes(board_t *b, enum stone color, float *planes);
+static void detlef44_dcnn_planes(board_t *b, enum stone color, float *planes);
 #endif
 #ifdef DCNN_DARKFOREST
-static void darkforest_dcnn_eval(board_t *b, enum stone color, float result[]);
+static void darkforest_dcnn_planes(board_t *b, enum stone color, float *planes);
 #endif
 
 int darkforest_dcnn = 0;
 
 static dcnn_t dcnns[] = {
 #ifdef DCNN_DETLEF
-{  "detlef",     "Detlef's 54%", "detlef54.prototxt",  "detlef54.trained", 19, board_13x13_and_up,   detlef54_dcnn_eval },
-{  "detlef54",   "Detlef's 54%", "detlef54.prototxt",  "detlef54.trained", 19, board_13x13_and_up,   detlef54_dcnn_eval },
-{  "detlef44",   "Detlef's 44%", "detlef44.prototxt",  "detlef44.trained", 19, board_19x19,          detlef44_dcnn_eval },
+{  "detlef",     "Detlef's 54%", "detlef54.prototxt",  "detlef54.trained", 19, board_13x13_and_up, 13, detlef54_dcnn_planes },
+{  "detlef54",   "Detlef's 54%", "detlef54.prototxt",  "detlef54.trained", 19, board_13x13_and_up, 13, detlef54_dcnn_planes },
+{  "detlef44",   "Detlef's 44%", "detlef44.prototxt",  "detlef44.trained", 19, board_19x19,         2, detlef44_dcnn_planes },
 #endif
 #ifdef DCNN_DARKFOREST
-{  "df",         "Darkforest",   "df2.prototxt",       "df2.trained",      19, board_19x19,          darkforest_dcnn_eval,  &darkforest_dcnn },
-{  "darkforest", "Darkforest",   "df2.prototxt",       "df2.trained",      19, board_19x19,          darkforest_dcnn_eval,  &darkforest_dcnn },
-{  "df",         "Darkforest",   "df2_15x15.prototxt", "df2.trained",      15, board_15x15,          darkforest_dcnn_eval,  &darkforest_dcnn },
-{  "darkforest", "Darkforest",   "df2_15x15.prototxt", "df2.trained",      15, board_15x15,          darkforest_dcnn_eval,  &darkforest_dcnn },
+{  "df",         "Darkforest",   "df2.prototxt",       "df2.trained",      19, board_19x19,        25, darkforest_dcnn_planes,  &darkforest_dcnn },
+{  "darkforest", "Darkforest",   "df2.prototxt",       "df2.trained",      19, board_19x19,        25, darkforest_dcnn_planes,  &darkforest_dcnn },
+{  "df",         "Darkforest",   "df2_15x15.prototxt", "df2.trained",      15, board_15x15,        25, darkforest_dcnn_planes,  &darkforest_dcnn },
+{  "darkforest", "Darkforest",   "df2_15x15.prototxt", "df2.trained",      15, board_15x15,        25, darkforest_dcnn_planes,  &darkforest_dcnn },
 #endif
 {  0, }
 };
 
 static dcnn_t *dcnn = NULL;
 
+static void dcnn_cache_clear(void);
+static void dcnn_eval(board_t *b, enum stone color, float result[]);
+static bool int8_ready(void);
+static void int8_init(void);
+
 #define dcnn_supported_board_size(b) (dcnn->supported_board_size(b))
 
 /* Find dcnn entry for @name (can also be model/weights filename). */
@@ -108,7 +120,7 @@ void require_dcnn(void)  {  dcnn_required = true;  }
 bool
 using_dcnn(board_t *b)
 {
-	bool r = dcnn_enabled && dcnn_supported_board_size(b) && caffe_ready();
+	bool r = dcnn_enabled && dcnn_supported_board_size(b) && (caffe_ready() || int8_ready());
 	if (dcnn_required && !r)  die("dcnn required but not used, aborting.\n");
 	return r;
 }
@@ -117,28 +129,431 @@ void
 dcnn_init(board_t *b)
 {
 	if (!dcnn)  dcnn = &dcnns[0];
-	if (dcnn_enabled && !dcnn_supported_board_size(b) && find_dcnn_for_board(b))
-		caffe_done();  /* Reload net */	
+	if (dcnn_enabled && !dcnn_supported_board_size(b) && find_dcnn_for_board(b)) {
+		caffe_done();  /* Reload net */
+		dcnn_cache_clear();
+	}
 	if (dcnn_enabled && dcnn_supported_board_size(b))
+		int8_init();
+	if (dcnn_enabled && dcnn_supported_board_size(b) && !int8_ready())
 		caffe_init(board_rsize(b), dcnn->model_filename, dcnn->weights_filename, dcnn->full_name, dcnn->default_size);
-	if (dcnn_required && !caffe_ready())  die("dcnn required, aborting.\n");
+	if (dcnn_required && !caffe_ready() && !int8_ready())  die("dcnn required, aborting.\n");
 }
 
 void
 dcnn_evaluate_quiet(board_t *b, enum stone color, float result[])
 {
-	dcnn->eval(b, color, result);
+	dcnn_eval(b, color, result);
 }
 
 void
 dcnn_evaluate(board_t *b, enum stone color, float result[])
 {
 	double time_start = time_now();	
-	dcnn->eval(b, color, result);
+	dcnn_eval(b, color, result);
 	if (DEBUGL(2))  fprintf(stderr, "dcnn in %.2fs\n", time_now() - time_start);	
 }
 
 
+/********************************************************************************************************/
+/* Evaluation cache */
+
+/* Policy outputs are cached by hash of the network input, so whatever the
+ * net looks at (stones, side to play, liberties, ko, history planes) is part
+ * of the key. Shared by all searches, survives tree resets, undo and
+ * analysis going back and forth. Hash is canonicalized over the 8 board
+ * symmetries: rotated / reflected positions hit as well and get the cached
+ * output rotated back (nets are only nearly symmetric, so that's the one
+ * case where we don't return what the net would say).
+ * Direct mapped, a new entry replaces whatever was there. */
+
+typedef struct {
+	hash_t hash;		/* 0: empty */
+	int    size;
+	float  result[BOARD_MAX_SIZE * BOARD_MAX_SIZE];	/* Canonical orientation */
+} dcnn_cache_entry_t;
+
+static int dcnn_cache_mb = 64;
+static dcnn_cache_entry_t *dcnn_cache = NULL;
+static size_t dcnn_cache_entries = 0;
+static pthread_mutex_t dcnn_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Stats for current game (protected by dcnn_cache_lock) */
+static int    cache_hits = 0;
+static int    cache_misses = 0;
+static double cache_miss_time = 0;	/* Time spent in dcnn for misses */
+
+void
+dcnn_cache_set_size(int mb)
+{
+	assert(mb >= 0);
+	pthread_mutex_lock(&dcnn_cache_lock);
+	free(dcnn_cache);  dcnn_cache = NULL;
+	dcnn_cache_entries = 0;
+	dcnn_cache_mb = mb;
+	pthread_mutex_unlock(&dcnn_cache_lock);
+}
+
+static void
+dcnn_cache_clear(void)
+{
+	pthread_mutex_lock(&dcnn_cache_lock);
+	if (dcnn_cache)  memset(dcnn_cache, 0, dcnn_cache_entries * sizeof(*dcnn_cache));
+	pthread_mutex_unlock(&dcnn_cache_lock);
+}
+
+void
+dcnn_cache_game_report(void)
+{
+	if (!cache_hits && !cache_misses)  return;
+	if (DEBUGL(2)) {
+		double avg = (cache_misses ? cache_miss_time / cache_misses : 0);
+		fprintf(stderr, "dcnn cache: %i hits / %i evals (%.0f%%), %.1fs saved\n",
+			cache_hits, cache_hits + cache_misses,
+			cache_hits * 100.0 / (cache_hits + cache_misses), cache_hits * avg);
+	}
+	cache_hits = cache_misses = 0;
+	cache_miss_time = 0;
+}
+
+/* Board symmetry @s applied to point (x, y) on @size board, returns index. */
+static inline int
+dcnn_sym_idx(int s, int x, int y, int size)
+{
+	if (s & 1)  x = size - 1 - x;
+	if (s & 2)  y = size - 1 - y;
+	if (s & 4)  {  int t = x;  x = y;  y = t;  }
+	return y * size + x;
+}
+
+static inline hash_t
+dcnn_hash_mix(hash_t z)
+{
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/* Input hash in canonical orientation, symmetry to get there in @sym. */
+static hash_t
+dcnn_cache_hash(float *data, int size, int planes, int *sym)
+{
+	hash_t h[8];
+	for (int s = 0; s < 8; s++)
+		h[s] = dcnn_hash_mix(size * 1000 + planes);
+
+	for (int p = 0; p < planes; p++)
+	for (int y = 0; y < size; y++)
+	for (int x = 0; x < size; x++) {
+		float v = data[(p * size + y) * size + x];
+		if (v == 0)  continue;
+		uint32_t bits;  memcpy(&bits, &v, sizeof(bits));
+		for (int s = 0; s < 8; s++) {
+			hash_t k = ((hash_t)(p * size * size + dcnn_sym_idx(s, x, y, size)) << 32) | bits;
+			h[s] ^= dcnn_hash_mix(k);
+		}
+	}
+
+	*sym = 0;
+	for (int s = 1; s < 8; s++)
+		if (h[s] < h[*sym])  *sym = s;
+	return (h[*sym] ? h[*sym] : 1);
+}
+
+static bool
+dcnn_cache_get(hash_t hash, int sym, int size, float *result)
+{
+	bool found = false;
+	pthread_mutex_lock(&dcnn_cache_lock);
+	dcnn_cache_entry_t *e = &dcnn_cache[hash % dcnn_cache_entries];
+	if (e->hash == hash && e->size == size) {
+		for (int y = 0; y < size; y++)
+		for (int x = 0; x < size; x++)
+			result[y * size + x] = e->result[dcnn_sym_idx(sym, x, y, size)];
+		found = true;
+		cache_hits++;
+	}
+	pthread_mutex_unlock(&dcnn_cache_lock);
+	return found;
+}
+
+static void
+dcnn_cache_put(hash_t hash, int sym, int size, float *result, double eval_time)
+{
+	pthread_mutex_lock(&dcnn_cache_lock);
+	cache_misses++;
+	cache_miss_time += eval_time;
+	dcnn_cache_entry_t *e = &dcnn_cache[hash % dcnn_cache_entries];
+	e->hash = hash;
+	e->size = size;
+	for (int y = 0; y < size; y++)
+	for (int x = 0; x < size; x++)
+		e->result[dcnn_sym_idx(sym, x, y, size)] = result[y * size + x];
+	pthread_mutex_unlock(&dcnn_cache_lock);
+}
+
+static void
+dcnn_cache_alloc(void)
+{
+	pthread_mutex_lock(&dcnn_cache_lock);
+	if (!dcnn_cache) {
+		dcnn_cache_entries = (size_t)dcnn_cache_mb * 1024 * 1024 / sizeof(*dcnn_cache);
+		if (!dcnn_cache_entries)  dcnn_cache_entries = 1;
+		dcnn_cache = calloc2(dcnn_cache_entries, dcnn_cache_entry_t);
+	}
+	pthread_mutex_unlock(&dcnn_cache_lock);
+}
+
+/********************************************************************************************************/
+/* Int8 inference */
+
+/* --dcnn-quantize: fp32 net exported from caffe is run alongside caffe to
+ * collect activation ranges, quantized and saved on exit. Agreement with
+ * fp32 is checked on the first calibration positions.
+ * --dcnn-int8: use quantized net instead of caffe.
+ * --dcnn-int8-check: run both and compare. */
+
+#define CALIB_CHECK_MAX 2000
+
+static char   *int8_file = NULL;
+static bool    int8_check = false;
+static qnet_t *int8_net = NULL;
+static char   *quantize_file = NULL;
+static qnet_t *calib_net = NULL;
+
+typedef struct {
+	int    evals;
+	int    top1, top5;		/* fp32 best move is int8 best / among int8 top 5 */
+	double fp32_time, int8_time;
+} int8_stats_t;
+static int8_stats_t int8_stats;
+
+/* Calibration positions kept for agreement check */
+static int    calib_n = 0, calib_size, calib_planes;
+static float *calib_data = NULL, *calib_result = NULL;
+static double calib_fp32_time = 0;	/* Caffe time for these */
+
+void dcnn_int8(char *file)          {  int8_file = strdup(file);  }
+void dcnn_int8_check(void)          {  int8_check = true;  }
+void dcnn_quantize(char *file)      {  quantize_file = strdup(file);  }
+
+static bool
+int8_ready(void)
+{
+	return (int8_net && !int8_check);
+}
+
+static void
+int8_init(void)
+{
+	if (int8_check && !int8_file)  die("--dcnn-int8-check needs --dcnn-int8\n");
+	if (int8_file && !int8_net) {
+		int8_net = qnet_load(int8_file);
+		if (DEBUGL(1))  fprintf(stderr, "Loaded %s int8 dcnn (%s)\n", int8_file, qnet_simd());
+	}
+}
+
+static void
+int8_stats_add(float *r32, float *r8, int size, double fp32_time, double int8_time)
+{
+	int best32 = 0, top8[5] = { -1, -1, -1, -1, -1 };  /* -1: empty slot */
+	for (int i = 0; i < size * size; i++) {
+		if (r32[i] > r32[best32])  best32 = i;
+		for (int k = 0; k < 5; k++)
+			if (top8[k] == -1 || r8[i] > r8[top8[k]]) {
+				memmove(&top8[k + 1], &top8[k], (4 - k) * sizeof(int));
+				top8[k] = i;
+				break;
+			}
+	}
+	int8_stats.evals++;
+	int8_stats.top1 += (best32 == top8[0]);
+	for (int k = 0; k < 5; k++)
+		if (best32 == top8[k]) {  int8_stats.top5++;  break;  }
+	int8_stats.fp32_time += fp32_time;
+	int8_stats.int8_time += int8_time;
+}
+
+static void
+int8_stats_print(char *title)
+{
+	int8_stats_t *s = &int8_stats;
+	if (!s->evals)  return;
+	fprintf(stderr, "%s: %i positions, top-1 agreement %.1f%%, top-5 %.1f%%, fp32 %.1fms int8 %.1fms (%s)\n",
+		title, s->evals, s->top1 * 100.0 / s->evals, s->top5 * 100.0 / s->evals,
+		s->fp32_time * 1000 / s->evals, s->int8_time * 1000 / s->evals, qnet_simd());
+}
+
+static void
+int8_clamp(float *result, int size)
+{
+	for (int i = 0; i < size * size; i++)
+		if (result[i] < 0.00001)  result[i] = 0.00001;
+}
+
+/* Single forward pass: caffe or int8 */
+static void
+dcnn_forward(float *data, float *result, int size, int planes)
+{
+	if (int8_ready()) {
+		qnet_forward(int8_net, data, size, result);
+		int8_clamp(result, size);
+		return;
+	}
+
+	double time_start = time_now();
+	caffe_get_data(data, result, size, planes, size);
+	double fp32_time = time_now() - time_start;
+
+	if (quantize_file) {  /* Calibrating */
+		if (!calib_net)  calib_net = caffe_export_qnet();
+		float r[size * size];
+		qnet_forward_fp32(calib_net, data, size, r, true);
+		if (!calib_n && DEBUGL(2)) {  /* Exported net should match caffe */
+			float maxdiff = 0;
+			for (int i = 0; i < size * size; i++)
+				if (fabs(r[i] - result[i]) > maxdiff)  maxdiff = fabs(r[i] - result[i]);
+			fprintf(stderr, "dcnn quantize: exported net max diff with caffe: %f\n", maxdiff);
+		}
+		if (calib_n < CALIB_CHECK_MAX) {
+			if (!calib_data) {
+				calib_size = size;  calib_planes = planes;
+				calib_data   = cmalloc((size_t)CALIB_CHECK_MAX * planes * size * size * sizeof(float));
+				calib_result = cmalloc((size_t)CALIB_CHECK_MAX * size * size * sizeof(float));
+			}
+			if (size == calib_size) {
+				memcpy(calib_data + (size_t)calib_n * planes * size * size, data, planes * size * size * sizeof(float));
+				memcpy(calib_result + (size_t)calib_n * size * size, result, size * size * sizeof(float));
+				calib_fp32_time += fp32_time;
+				calib_n++;
+			}
+		}
+	}
+
+	if (int8_check) {
+		float r8[size * size];
+		time_start = time_now();
+		qnet_forward(int8_net, data, size, r8);
+		int8_stats_add(result, r8, size, fp32_time, time_now() - time_start);
+	}
+}
+
+void
+dcnn_done(void)
+{
+	dcnn_cache_game_report();  /* Last game */
+
+	if (calib_net) {
+		qnet_quantize(calib_net);
+		qnet_save(calib_net, quantize_file);
+		if (DEBUGL(0))  fprintf(stderr, "dcnn quantize: saved int8 net to %s\n", quantize_file);
+
+		/* Agreement with fp32 on calibration positions (not a held out set). */
+		memset(&int8_stats, 0, sizeof(int8_stats));
+		int size = calib_size, isize = calib_planes * size * size;
+		for (int i = 0; i < calib_n; i++) {
+			float r8[size * size];
+			double time_start = time_now();
+			qnet_forward(calib_net, calib_data + (size_t)i * isize, size, r8);
+			int8_stats_add(calib_result + (size_t)i * size * size, r8, size,
+				       calib_fp32_time / calib_n, time_now() - time_start);
+		}
+		if (DEBUGL(0))  int8_stats_print("dcnn quantize");
+		qnet_delete(&calib_net);
+		free(calib_data);  free(calib_result);
+	}
+	if (int8_check && DEBUGL(0))
+		int8_stats_print("dcnn int8 check");
+	if (int8_net)  qnet_delete(&int8_net);
+}
+
+
+/********************************************************************************************************/
+
+/* caffe_get_data() through the cache. */
+static void
+dcnn_get_data(float *data, float *result, int size, int planes)
+{
+	if (!dcnn_cache_mb) {
+		dcnn_forward(data, result, size, planes);
+		return;
+	}
+
+	dcnn_cache_alloc();
+	int sym;
+	hash_t hash = dcnn_cache_hash(data, size, planes, &sym);
+	if (dcnn_cache_get(hash, sym, size, result)) {
+		telemetry_inc(TM_DCNN_CACHE_HITS);
+		return;
+	}
+
+	double time_start = time_now();
+	dcnn_forward(data, result, size, planes);
+	telemetry_inc(TM_DCNN_EVALS);
+	dcnn_cache_put(hash, sym, size, result, time_now() - time_start);
+}
+
+static void
+dcnn_eval(board_t *b, enum stone color, float result[])
+{
+	assert(dcnn_supported_board_size(b));
+	int size = board_rsize(b);
+	float data[dcnn->planes * size * size];
+	memset(data, 0, sizeof(data));
+	dcnn->get_planes(b, color, data);
+	dcnn_get_data(data, result, size, dcnn->planes);
+}
+
+/* Evaluate @n positions in one forward pass (positions found in cache
+ * are skipped). @result can be NULL to just fill the cache. */
+void
+dcnn_evaluate_batch(board_t *b[], enum stone color[], float *result[], int n)
+{
+	if (!n || (!result && !dcnn_cache_mb))  return;
+	dcnn_cache_alloc();
+	
+	double time_start = time_now();
+	int size = board_rsize(b[0]);
+	int planes = dcnn->planes;
+	int isize = planes * size * size;
+	float *data = calloc2(n * isize, float);
+	float *r    = calloc2(n * size * size, float);
+	hash_t hash[n];  int sym[n];  int eval[n];
+	int evals = 0;
+	for (int i = 0; i < n; i++) {
+		assert(board_rsize(b[i]) == size);
+		float *d = data + evals * isize;
+		dcnn->get_planes(b[i], color[i], d);
+		if (dcnn_cache_mb) {
+			hash[i] = dcnn_cache_hash(d, size, planes, &sym[i]);
+			float tmp[size * size];
+			if (dcnn_cache_get(hash[i], sym[i], size, (result ? result[i] : tmp))) {
+				memset(d, 0, isize * sizeof(float));
+				continue;
+			}
+		}
+		eval[evals++] = i;
+	}
+
+	if (evals && !int8_ready() && !int8_check && !quantize_file)
+		caffe_get_data_batch(data, r, evals, size, planes, size);
+	else  /* Int8 evals are cheap, no batching */
+		for (int k = 0; k < evals; k++)
+			dcnn_forward(data + k * isize, r + k * size * size, size, planes);
+	double eval_time = (evals ? (time_now() - time_start) / evals : 0);
+	for (int k = 0; k < evals; k++) {
+		int i = eval[k];
+		float *rk = r + k * size * size;
+		telemetry_inc(TM_DCNN_EVALS);
+		if (dcnn_cache_mb)  dcnn_cache_put(hash[i], sym[i], size, rk, eval_time);
+		if (result)         memcpy(result[i], rk, size * size * sizeof(float));
+	}
+	if (DEBUGL(3))  fprintf(stderr, "dcnn batch: %i positions, %i evaluated in %.2fs\n",
+				n, evals, time_now() - time_start);
+	free(data);  free(r);
+}
+
+
 #ifdef DCNN_DETLEF
 /********************************************************************************************************/
 /* Detlef's 54% dcnn */
@@ -148,13 +563,10 @@ dcnn_evaluate(board_t *b, enum stone color, float result[])
  * http://physik.de/CNNlast.tar.gz */
 
 static void
-detlef54_dcnn_eval(board_t *b, enum stone color, float result[])
+detlef54_dcnn_planes(board_t *b, enum stone color, float *planes)
 {
-	assert(dcnn_supported_board_size(b));
-
 	int size = board_rsize(b);
-	float data[13][size][size];
-	memset(data, 0, sizeof(data));
+	float (*data)[size][size] = (float (*)[size][size])planes;
 
 	for (int x = 0; x < size; x++)
 	for (int y = 0; y < size; y++) {
@@ -174,7 +586,6 @@ detlef54_dcnn_eval(board_t *b, enum stone color, float result[])
 		else if (c == last_move4(b).coord)   data[12][y][x] = 1.0;
 	}
 
-	caffe_get_data((float*)data, result, size, 13, size);
 }
 
 
@@ -186,13 +597,12 @@ detlef54_dcnn_eval(board_t *b, enum stone color, float result[])
  * http://physik.de/net.tgz */
 
 static void
-detlef44_dcnn_eval(board_t *b, enum stone color, float result[])
+detlef44_dcnn_planes(board_t *b, enum stone color, float *planes)
 {
 	enum stone other_color = stone_other(color);
 
 	int size = board_rsize(b);
-	float data[2][size][size];
-	memset(data, 0, sizeof(data));
+	float (*data)[size][size] = (float (*)[size][size])planes;
 
 	for (int y = 0; y < size; y++)
 	for (int x = 0; x < size; x++) {
@@ -201,7 +611,6 @@ detlef44_dcnn_eval(board_t *b, enum stone color, float result[])
 		if (board_at(b, c) == other_color)  data[1][y][x] = 1;			
 	}
 
-	caffe_get_data((float*)data, result, size, 2, size);
 }
 #endif /* DCNN_DETLEF */
 
@@ -259,12 +668,11 @@ df_board_history_decay(board_t *b, coord_t coord, enum stone color)
 }
 
 static void
-darkforest_dcnn_eval(board_t *b, enum stone color, float result[])
+darkforest_dcnn_planes(board_t *b, enum stone color, float *planes)
 {
 	enum stone other_color = stone_other(color);
 	int size = board_rsize(b);
-	float data[25][size][size];
-	memset(data, 0, sizeof(data));
+	float (*data)[size][size] = (float (*)[size][size])planes;
 	
 	float our_dist[size * size];
 	float opponent_dist[size * size];
@@ -326,7 +734,6 @@ darkforest_dcnn_eval(board_t *b, enum stone color, float result[])
 		data[24][y][x] = 1.0;
 	}
 
-	caffe_get_data((float*)data, result, size, 25, size);
 }
 #endif /* DCNN_DARKFOREST */
 
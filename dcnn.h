@@ -17,8 +17,21 @@ void disable_dcnn(void);
 
 void dcnn_evaluate(board_t *b, enum stone color, float result[]);
 void dcnn_evaluate_quiet(board_t *b, enum stone color, float result[]);
+/* Evaluate @n positions in one batch, @result can be NULL to just fill cache. */
+void dcnn_evaluate_batch(board_t *b[], enum stone color[], float *result[], int n);
 bool using_dcnn(board_t *b);
 void dcnn_init(board_t *b);
+/* Evaluation cache size in Mb (0: disabled) */
+void dcnn_cache_set_size(int mb);
+/* Print cache stats for the game (hits, time saved) and reset them. */
+void dcnn_cache_game_report(void);
+/* Int8 inference: use quantized net @file instead of caffe */
+void dcnn_int8(char *file);
+/* Run int8 and caffe side by side, report agreement and latency on exit */
+void dcnn_int8_check(void);
+/* Calibrate on positions evaluated this session, save int8 net to @file on exit */
+void dcnn_quantize(char *file);
+void dcnn_done(void);
 void get_dcnn_best_moves(board_t *b, float *r, coord_t *best_c, float *best_r, int nbest);
 void print_dcnn_best_moves(board_t *b, coord_t *best_c, float *best_r, int nbest);
 
@@ -47,6 +60,13 @@ coord2dcnn_idx(coord_t c)
 #define require_dcnn()  die("dcnn required but not compiled in, aborting.\n")
 #define using_dcnn(b)   0
 #define dcnn_init(b)    ((void)0)
+#define dcnn_cache_set_size(mb)    die("dcnn required but not compiled in, aborting.\n")
+#define dcnn_cache_game_report()   ((void)0)
+#define dcnn_evaluate_batch(b, color, result, n)  ((void)0)
+#define dcnn_done()     ((void)0)
+#define dcnn_int8(file)       die("dcnn required but not compiled in, aborting.\n")
+#define dcnn_int8_check()     die("dcnn required but not compiled in, aborting.\n")
+#define dcnn_quantize(file)   die("dcnn required but not compiled in, aborting.\n")
 
 
 #endif
@@ -1,7 +1,8 @@
 /* This is a master for the "distributed" engine. It receives connections
  * from slave machines, sends them gtp commands, then aggregates the
  * results. It can also act as a proxy for the logs of all slave machines.
- * The slave machines must run with engine "uct" (not "distributed").
+ * The slave machines must run with engine "uct" (not "distributed"),
+ * except relays (see below).
  * The master sends pachi-genmoves gtp commands regularly to each slave,
  * gets as replies a list of nodes, their number of playouts
  * and their value. The master then picks the most popular move
@@ -10,7 +11,7 @@
 /* With time control, the master waits for all slaves, except
  * when the allowed time is already passed. In this case the
  * master picks among the available replies, or waits for just
- * one reply if there is none yet.
+ * one reply with stats for this move if there is none yet.
  * Without time control, the master waits until the desired
  * number of games have been simulated. In this case the -t
  * parameter for the master should be the sum of the parameters
@@ -37,9 +38,25 @@
  * are not maintained across moves, so playouts from previous
  * moves would be lost.) */
 
+/* Genmoves are pipelined: each slave thread sends the next genmoves
+ * as soon as the previous reply has been processed, and the root
+ * stats of a reply (sent in binary form after the incremental stats)
+ * are added to the sums as it arrives. So the master only has to
+ * check the sums and update the genmoves args, and never waits for
+ * all slaves nor makes them wait. */
+
 /* The master-slave protocol has fault tolerance. If a slave is
  * out of sync, the master sends it the appropriate command history. */
 
+/* For large clusters a master can also run as relay: it is master to
+ * a subset of slaves and itself a slave of the upper master. Each
+ * genmoves from the upper master is forwarded to our slaves with the
+ * upper stats as binary args, then the relay replies with the summed
+ * root children stats of its slaves and the best shared_nodes
+ * increments from all of them, merged the same way the master does
+ * for each slave. So the upper master sees one slave per relay and
+ * its network and merge load no longer grow with the cluster size. */
+
 /* Pass me arguments like a=b,c=d,...
  * Supported arguments:
  * slave_port=SLAVE_PORT     slaves connect to this port; this parameter is mandatory.
@@ -47,6 +64,7 @@
  * shared_nodes=SHARED_NODES default 10K
  * stats_hbits=STATS_HBITS   default 21. 2^stats_bits = hash table size
  * slaves_quit=0|1           quit gtp command also sent to slaves, default false.
+ * relay                     act as slave of an upper master (run with -g).
  * proxy_port=PROXY_PORT     slaves optionally send their logs to this port.
  *    Warning: with proxy_port, the master stderr mixes the logs of all
  *    machines but you can separate them again:
@@ -64,6 +82,10 @@
  * If the master itself runs on a machine other than that running gogui,
  * gogui-twogtp, kgsGtp or cgosGtp, it can redirect its gtp port:
  *    pachi -e distributed -g 10000 slave_port=1234,proxy_port=1235
+ * With relays, each relay serving its own group of slaves:
+ *    pachi -e distributed slave_port=1234
+ *    pachi -e distributed -g masterhost:1234 slave_port=1236,relay
+ *    pachi -e uct -g relayhost:1236 slave
  */
 
 #include <assert.h>
@@ -96,6 +118,9 @@ typedef struct {
 	int shared_nodes;
 	int stats_hbits;
 	bool slaves_quit;
+	bool relay;
+	bool genmoves_running;
+	incr_stats_t *relay_buf;
 	move_t my_last_move;
 	move_stats_t my_last_stats;
 	int slaves;
@@ -115,6 +140,9 @@ typedef struct {
  * (all commands except pachi-genmoves and final_status_list). */
 #define MAX_FAST_CMD_WAIT 0.5
 
+/* Same for a relay, it must reply before the upper master gives up. */
+#define RELAY_FAST_CMD_WAIT 0.2
+
 /* Maximum time (seconds) to wait for answers to genmoves. */
 #define MAX_GENMOVES_WAIT 0.1 /* 100 ms */
 
@@ -205,6 +233,19 @@ distributed_notify(engine_t *e, board_t *b, int id, char *cmd, char *args, gtp_t
 	/* Pending undo ? Update board */
 	if (dist->undo_pending && strcasecmp(cmd, "undo"))
 		distributed_undo_commit(dist, b, gtp);
+
+	/* Relay: check that we are in sync with the upper master,
+	 * as a slave does (see uct/slave.c:uct_notify()). */
+	if (dist->relay && id != -1) {
+		if (move_number(id) != b->moves && !reply_disabled(id) && !is_reset(cmd)) {
+			protocol_lock();
+			relay_receive_stats(args, false);
+			protocol_unlock();
+			gtp_error_printf(gtp, "Out of sync, %d %s, move %d expected\n", id, cmd, b->moves);
+			return P_DONE_OK;
+		}
+		if (reply_disabled(id))  gtp->quiet = true;
+	}
 	
 	/* Commands that should not be sent to slaves.
 	 * time_left will be part of next pachi-genmoves,
@@ -217,6 +258,8 @@ distributed_notify(engine_t *e, board_t *b, int id, char *cmd, char *args, gtp_t
 
 	    /* and commands that will be sent to slaves later */
 	    || !strcasecmp(cmd, "genmove")
+	    || !strcasecmp(cmd, "pachi-genmoves")
+	    || !strcasecmp(cmd, "pachi-genmoves_cleanup")
 	    || !strcasecmp(cmd, "kgs-genmove_cleanup")
 	    || !strcasecmp(cmd, "final_score")
 	    || !strcasecmp(cmd, "final_status_list"))
@@ -226,6 +269,7 @@ distributed_notify(engine_t *e, board_t *b, int id, char *cmd, char *args, gtp_t
 
 	// Create a new command to be sent by the slave threads.
 	new_cmd(b, cmd, args);
+	dist->genmoves_running = false;
 
 	/* Wait for replies here. If we don't wait, we run the
 	 * risk of getting out of sync with most slaves and
@@ -233,12 +277,13 @@ distributed_notify(engine_t *e, board_t *b, int id, char *cmd, char *args, gtp_t
 	 * for all slaves otherwise we can lose on time because of
 	 * a single slow slave when replaying a whole game. */
 	int min_slaves = active_slaves > 1 ? 3 * active_slaves / 4 : 1;
-	get_replies(time_now() + MAX_FAST_CMD_WAIT, min_slaves);
+	double wait = (dist->relay ? RELAY_FAST_CMD_WAIT : MAX_FAST_CMD_WAIT);
+	get_replies(time_now() + wait, min_slaves);
 
 	protocol_unlock();
 
 	// At the beginning wait even more for late slaves.
-	if (b->moves == 0) sleep(1);
+	if (b->moves == 0 && !dist->relay) sleep(1);
 
 	/* Commands forwarded to slaves but we shouldn't run: */
 	if (!strcasecmp(cmd, "undo"))		  return distributed_undo(dist, b, gtp);
@@ -256,68 +301,110 @@ typedef struct {
 	floating_t value; // BLACK wins/playouts
 } large_stats_t;
 
+/* Sums of the last genmoves reply of each slave, updated by the slave
+ * threads as replies arrive (see root_stats_hook()) so that the main
+ * thread never has to go through all replies. Move stats are indexed
+ * by coord + 2 for pass and resign.
+ * Protected by slave_lock. */
+static struct {
+	int id;
+	int replies;
+	int info[4];		// played_own, playouts, threads, keep_looking
+	long playouts[MAX_ROOT_STATS];
+	double wins[MAX_ROOT_STATS];
+} root_sum;
+
+/* Add (sign = 1) or remove (sign = -1) the last reply of a slave. */
 static void
-large_stats_add_result(large_stats_t *s, floating_t result, long playouts)
+root_sum_update(slave_state_t *sstate, int sign)
 {
-	s->playouts += playouts;
-	s->value += (result - s->value) * playouts / s->playouts;
+	for (int i = 0; i < 4; i++)
+		root_sum.info[i] += sign * sstate->root_info[i];
+	for (int n = 0; n < sstate->root_count; n++) {
+		incr_stats_t *s = &sstate->root_stats[n];
+		root_sum.playouts[s->coord_path + 2] += sign * s->incr.playouts;
+		root_sum.wins[s->coord_path + 2] += sign * s->incr.playouts * (double)s->incr.value;
+	}
 }
 
-/* genmoves returns "=id played_own total_playouts threads keep_looking @size"
- * then a list of lines "coord playouts value" with absolute counts for
- * children of the root node, then a binary array of incr_stats structs.
+/* genmoves returns "=id played_own total_playouts threads keep_looking children @size"
+ * then a binary array of incr_stats structs, followed by absolute stats for
+ * children of the root node (see MAX_ROOT_STATS).
  * To simplify the code, we assume that master and slave have the same architecture
  * (store values identically).
- * Return the move with most playouts, and additional stats.
+ * Replace the previous reply of this slave in root_sum by this one and return
+ * the size of the incremental stats for the receive queue.
+ * Keep this code in sync with uct/slave.c:report_stats().
+ * slave_lock is held on entry and on return. */
+static int
+root_stats_hook(char *reply, void *buf, int size, int reply_id, slave_state_t *sstate)
+{
+	if (!strchr(reply, '@')) return size;
+
+	int id, info[4], children;
+	if (sscanf(reply, "=%d %d %d %d %d %d", &id, &info[0], &info[1],
+		   &info[2], &info[3], &children) != 6
+	    || children < 0 || children > MAX_ROOT_STATS
+	    || children * (int)sizeof(incr_stats_t) > size)
+		return 0;
+	size -= children * sizeof(incr_stats_t);
+
+	if (root_sum.id != reply_id) {
+		memset(&root_sum, 0, sizeof(root_sum));
+		root_sum.id = reply_id;
+	}
+	if (sstate->root_id == reply_id)
+		root_sum_update(sstate, -1);
+	else
+		root_sum.replies++;
+
+	if (!sstate->root_stats)
+		sstate->root_stats = calloc2(MAX_ROOT_STATS, incr_stats_t);
+	incr_stats_t *s = (incr_stats_t *)((char *)buf + size);
+	sstate->root_count = 0;
+	for (int n = 0; n < children; n++) {
+		if (s[n].coord_path < resign || s[n].coord_path >= MAX_ROOT_STATS - 2
+		    || s[n].incr.playouts < 0)
+			continue;
+		sstate->root_stats[sstate->root_count++] = s[n];
+	}
+	memcpy(sstate->root_info, info, sizeof(info));
+	sstate->root_id = reply_id;
+	root_sum_update(sstate, 1);
+	return size;
+}
+
+/* Return the move with most playouts, and additional stats,
+ * from the replies of all slaves summed in root_sum.
  * keep_looking is set from a majority vote of the slaves seen so far for this
  * move but should not be trusted if too few slaves have been seen.
- * Keep this code in sync with uct/slave.c:report_stats().
  * slave_lock is held on entry and on return. */
 static coord_t
 select_best_move(board_t *b, large_stats_t *stats, int *played,
 		 int *total_playouts, int *total_threads, bool *keep_looking)
 {
-	assert(reply_count > 0);
+	assert(reply_count > 0 && root_sum.replies > 0);
 
 	/* +2 for pass and resign */
 	memset(stats-2, 0, (board_max_coords(b)+2) * sizeof(*stats));
 
 	coord_t best_move = pass;
 	long best_playouts = 0;
-	*played = 0;
-	*total_playouts = 0;
-	*total_threads = 0;
-	int keep = 0;
-
-	for (int reply = 0; reply < reply_count; reply++) {
-		char *r = gtp_replies[reply];
-		int id, o, p, t, k;
-		if (sscanf(r, "=%d %d %d %d %d", &id, &o, &p, &t, &k) != 5) continue;
-		*played += o;
-		*total_playouts += p;
-		*total_threads += t;
-		keep += k;
-		// Skip the rest of the firt line in particular @size
-		r = strchr(r, '\n');
-
-		char move[64];
-		move_stats_t s;
-		while (r && sscanf(++r, "%63s %d " PRIfloating, move, &s.playouts, &s.value) == 3) {
-			coord_t c = str2coord(move);
-			assert (c >= resign && c < board_max_coords(b) && s.playouts >= 0);
-
-			large_stats_add_result(&stats[c], s.value, (long)s.playouts);
-
-			if (stats[c].playouts > best_playouts) {
-				best_playouts = stats[c].playouts;
-				best_move = c;
-			}
-			r = strchr(r, '\n');
+	for (coord_t c = resign; c < board_max_coords(b); c++) {
+		long playouts = root_sum.playouts[c + 2];
+		if (playouts <= 0) continue;
+
+		stats[c].playouts = playouts / root_sum.replies;
+		stats[c].value = root_sum.wins[c + 2] / playouts;
+		if (playouts > best_playouts) {
+			best_playouts = playouts;
+			best_move = c;
 		}
 	}
-	for (coord_t c = resign; c < board_max_coords(b); c++)
-		stats[c].playouts /= reply_count;
-	*keep_looking = keep > reply_count / 2;
+	*played = root_sum.info[0];
+	*total_playouts = root_sum.info[1];
+	*total_threads = root_sum.info[2];
+	*keep_looking = root_sum.info[3] > root_sum.replies / 2;
 	return best_move;
 }
 
@@ -403,7 +490,10 @@ distributed_genmove(engine_t *e, board_t *b, time_info_t *ti,
 		best = select_best_move(b, stats, &played, &playouts, &threads, &keep_looking);
 
 		if (ti->dim == TD_WALLTIME) {
-			if (now - ti->len.t.timer_start >= stop.worst.time) break;
+			/* Even out of time, first replies of a move may come
+			 * before slaves have any stats for it: wait for a move. */
+			bool have_move = (stats[best].playouts > 0);
+			if (have_move && now - ti->len.t.timer_start >= stop.worst.time) break;
 			if (!keep_looking && now - first >= MIN_EARLY_STOP_WAIT) break;
 		} else {
 			if (!keep_looking || playouts >= stop.worst.playouts) break;
@@ -422,8 +512,9 @@ distributed_genmove(engine_t *e, board_t *b, time_info_t *ti,
 				 (int)stats[best].playouts, playouts, reply_count, threads);
 			logline(NULL, "* ", buf);
 		}
-		/* Send the command with the same gtp id, to avoid discarding
-		 * a reply to a previous genmoves at the same move. */
+		/* Update the args with the same gtp id, to avoid discarding
+		 * a reply to a previous genmoves at the same move. Slaves
+		 * get them with their next pipelined genmoves. */
 		genmoves_args(args, color, played, ti, true);
 		update_cmd(b, cmd, args, false);
 	}
@@ -467,6 +558,71 @@ distributed_genmove(engine_t *e, board_t *b, time_info_t *ti,
 	return best;
 }
 
+/* Relay mode: answer a genmoves from the upper master. Forward it to
+ * our slaves with the stats received from the upper master, wait for
+ * a new reply, then return the combined stats of our slaves in the
+ * format of uct/slave.c:uct_genmoves(). Root children playouts are
+ * averaged over our slaves, like select_best_move() does. */
+static char *
+distributed_genmoves(engine_t *e, board_t *b, time_info_t *ti, enum stone color,
+		     char *args, bool pass_all_alive, void **stats_buf, int *stats_size)
+{
+	distributed_t *dist = (distributed_t*)e->data;
+	const char *cmd = pass_all_alive ? "pachi-genmoves_cleanup" : "pachi-genmoves";
+	char down_args[CMDS_SIZE];
+	*stats_size = 0;
+
+	/* Same args for our slaves, but the first genmoves at this move
+	 * is sent without stats and the binary size of the others is set
+	 * for each slave (see get_binary_arg()). */
+	snprintf(down_args, sizeof(down_args), "%s %s", stone2str(color), args);
+	char *s = down_args + strcspn(down_args, "@\n");
+	snprintf(s, down_args + sizeof(down_args) - s,
+		 dist->genmoves_running ? " @0\n" : "\n");
+
+	protocol_lock();
+	if (!dist->genmoves_running)
+		clear_receive_queue();
+	if (!relay_receive_stats(args, true)) {
+		protocol_unlock();
+		return NULL;
+	}
+	if (!dist->genmoves_running) {
+		new_cmd(b, cmd, down_args);
+		dist->genmoves_running = true;
+	} else
+		update_cmd(b, cmd, down_args, false);
+
+	get_replies(time_now() + MAX_GENMOVES_WAIT, 1);
+
+	large_stats_t stats_array[board_max_coords(b) + 2], *stats;
+	stats = &stats_array[2];
+	int played, playouts, threads;
+	bool keep_looking;
+	select_best_move(b, stats, &played, &playouts, &threads, &keep_looking);
+
+	*stats_size = relay_merge_stats(dist->relay_buf);
+	*stats_buf = dist->relay_buf;
+	protocol_unlock();
+
+	/* Root stats follow the merged increments.
+	 * Keep this code in sync with uct/slave.c:report_stats(). */
+	incr_stats_t *rs = (incr_stats_t *)((char *)dist->relay_buf + *stats_size);
+	int children = 0;
+	for (coord_t c = resign; c < board_max_coords(b); c++) {
+		if (!stats[c].playouts) continue;
+		rs[children].coord_path = c;
+		rs[children].incr.value = stats[c].value;
+		rs[children++].incr.playouts = (int)stats[c].playouts;
+	}
+	*stats_size += children * sizeof(*rs);
+
+	static char reply[128];
+	snprintf(reply, sizeof(reply), "%d %d %d %d %d @%d", played, playouts,
+		 threads, keep_looking, children, *stats_size);
+	return reply;
+}
+
 static char *
 distributed_chat(engine_t *e, board_t *b, bool opponent, char *from, char *cmd)
 {
@@ -549,6 +705,11 @@ distributed_setoption(engine_t *e, board_t *b, const char *optname, char *optval
 	else if (!strcasecmp(optname, "slaves_quit")) {  NEED_RESET
 		dist->slaves_quit = !optval || atoi(optval);
 	}
+	else if (!strcasecmp(optname, "relay")) {  NEED_RESET
+		/* Relay between an upper master and our slaves, for large
+		 * clusters. Use the same shared_nodes everywhere. */
+		dist->relay = !optval || atoi(optval);
+	}
 	else
 		option_error("Distributed: Invalid engine argument %s or missing value\n", optname);
 
@@ -579,7 +740,10 @@ distributed_state_init(engine_t *e, board_t *b)
 		die("distributed: missing slave_port\n");
 
 	merge_init(&default_sstate, dist->shared_nodes, dist->stats_hbits, dist->max_slaves);
-	protocol_init(dist->slave_port, dist->proxy_port, dist->max_slaves);
+	default_sstate.reply_hook = root_stats_hook;
+	protocol_init(dist->slave_port, dist->proxy_port, dist->max_slaves, dist->relay);
+	if (dist->relay)
+		dist->relay_buf = calloc2(dist->shared_nodes + 1 + MAX_ROOT_STATS, incr_stats_t);
 
 	return dist;
 }
@@ -598,9 +762,11 @@ engine_distributed_init(engine_t *e, board_t *b)
 	// Keep the threads and the open socket connections:
 	e->keep_on_clear = true;
 	e->setoption = distributed_setoption;
-	distributed_state_init(e, b);
+	distributed_t *dist = distributed_state_init(e, b);
+	if (dist->relay)
+		e->genmoves = distributed_genmoves;
 
-	if (DEBUGL(2))  fprintf(stderr, "distributed: master node\n");
+	if (DEBUGL(2))  fprintf(stderr, "distributed: %s node\n", dist->relay ? "relay" : "master");
 	if (DEBUGL(2) && !DEBUGL(3))
 		fprintf(stderr,
 			"distributed: pachi-genmoves subcommands not logged\n"
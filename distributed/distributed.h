@@ -70,7 +70,8 @@ typedef struct {
  * games/s each, a slave machine can do at most 30K games/s. */
 
 /* At 30K games/s a slave can output 270K nodes/s or 4.2 MB/s. The master
- * with a 100 MB/s network can thus support at most 24 slaves. */
+ * with a 100 MB/s network can thus support at most 24 slaves.
+ * Larger clusters must use relays, each with its own 24 slaves. */
 #define DEFAULT_MAX_SLAVES 24
 
 /* In a 30s move at 270K nodes/s a slave can send and receive at most
@@ -90,6 +91,12 @@ typedef struct {
 #define DEFAULT_SHARED_NODES 10240
 
 
+/* Genmoves replies end with absolute stats for the children of the
+ * root node, as incr_stats_t with the move coord as coord_path.
+ * At most one per board point plus pass and resign. */
+#define MAX_ROOT_STATS (BOARD_MAX_COORDS + 2)
+
+
 /* Maximum game length. Power of 10 jut to ease debugging. */
 #define DIST_GAMELEN 1000
 
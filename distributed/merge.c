@@ -252,8 +252,9 @@ output_stats(incr_stats_t *buf, slave_state_t *sstate,
 static int
 get_new_stats(incr_stats_t *buf, slave_state_t *sstate, int cmd_id)
 {
-	/* Process all valid buffers in receive_queue[min..max] */
-	int min = sstate->last_processed + 1;
+	/* Process all valid buffers in receive_queue[min..max]
+	 * The queue has been cleared if we have a new move. */
+	int min = (cmd_id == sstate->stats_id ? sstate->last_processed + 1 : 0);
 	int max = queue_length - 1;
 	if (max < min && cmd_id == sstate->stats_id) return 0;
 
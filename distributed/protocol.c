@@ -241,7 +241,7 @@ send_command(char *to_send, void *bin_buf, int *bin_size,
 	}
 
 	/* Reuse the buffers for the reply. */
-	*bin_size = sstate->max_buf_size;
+	*bin_size = sstate->max_buf_size + ROOT_STATS_SIZE;
 	int reply_id = get_reply(f, sstate->client, buf, bin_buf, bin_size);
 
 	pthread_mutex_lock(&slave_lock);
@@ -274,12 +274,13 @@ next_command(int cmd_id)
 
 /* Allocate buffers for a slave thread. The state should have been
  * initialized already as a copy of the default slave state.
+ * Buffers also have room for the root stats of genmoves replies.
  * slave_lock is not held on either entry or exit of this function. */
 static void
 slave_state_alloc(slave_state_t *sstate)
 {
 	for (int n = 0; n < BUFFERS_PER_SLAVE; n++) {
-		sstate->b[n].buf = cmalloc(sstate->max_buf_size);
+		sstate->b[n].buf = cmalloc(sstate->max_buf_size + ROOT_STATS_SIZE);
 		sstate->b[n].owner = sstate->thread_id;
 	}
 	if (sstate->alloc_hook) sstate->alloc_hook(sstate);
@@ -363,7 +364,8 @@ clear_receive_queue(void)
 }
 
 /* Process the reply received from a slave machine.
- * Copy the ascii part to reply_buf and insert the binary part
+ * Copy the ascii part to reply_buf, let the reply hook consume
+ * the root stats and insert the rest of the binary part
  * (if any) in the receive queue.
  * Return false if ok, true if the slave is out of sync.
  * slave_lock is held on both entry and exit of this function. */
@@ -394,6 +396,8 @@ process_reply(int reply_id, char *reply, char *reply_buf,
 		*reply_slot = reply_count++;
 	gtp_replies[*reply_slot] = reply_buf;
 
+	if (sstate->reply_hook)
+		bin_size = sstate->reply_hook(reply, bin_reply, bin_size, reply_id, sstate);
 	if (bin_size) insert_buf(sstate, bin_reply, bin_size);
 
 	pthread_cond_signal(&reply_cond);
@@ -435,9 +439,47 @@ get_binary_arg(slave_state_t *sstate, char *cmd, int cmd_size, int *bin_size)
 	return buf;
 }
 
+/* Genmoves are sent again to a slave as soon as its previous reply
+ * has been processed, but not more often than this (seconds), see
+ * MAX_GENMOVES_PER_SLAVE. */
+#define MIN_GENMOVES_INTERVAL 0.005
+
+/* Return true if the current command is a genmoves
+ * which was just answered by this slave thread.
+ * slave_lock is held on both entry and exit of this function. */
+static bool
+genmoves_pending(int last_reply_id)
+{
+	return atoi(gtp_cmd) == last_reply_id && strstr(gtp_cmd, " pachi-genmoves");
+}
+
+/* Wait for a new command, or until a genmoves can be sent again.
+ * slave_lock is held on both entry and exit of this function. */
+static void
+wait_next_command(int last_cmd_count, bool again, double last_sent)
+{
+	while (last_cmd_count == cmd_count) {
+		if (!again) {
+			pthread_cond_wait(&cmd_cond, &slave_lock);
+			continue;
+		}
+		double next = last_sent + MIN_GENMOVES_INTERVAL;
+		if (time_now() >= next) return;
+
+		struct timespec ts;
+		double sec;
+		ts.tv_nsec = (int)(modf(next, &sec)*1000000000.0);
+		ts.tv_sec = (int)sec;
+		pthread_cond_timedwait(&cmd_cond, &slave_lock, &ts);
+	}
+}
+
 /* Main loop of a slave thread.
  * Send the current command to the slave machine and wait for a reply.
  * Resend command history if the slave machine is out of sync.
+ * Genmoves are pipelined: they are sent again as soon as the reply
+ * is processed, with the latest args from the master, without
+ * waiting for the master to select a move.
  * Returns when the connection with the slave machine is cut.
  * slave_lock is held on both entry and exit of this function. */
 static void
@@ -447,14 +489,15 @@ slave_loop(FILE *f, char *reply_buf, slave_state_t *sstate, bool resend)
 	int last_cmd_count = 0;
 	int last_reply_id = -1;
 	int reply_slot = -1;
+	bool again = false;
+	double last_sent = 0;
 	for (;;) {
 		if (resend) {
 			/* Resend complete or partial history */
 			to_send = next_command(last_reply_id);
 		} else {
 			/* Wait for a new command. */
-			while (last_cmd_count == cmd_count)
-				pthread_cond_wait(&cmd_cond, &slave_lock);
+			wait_next_command(last_cmd_count, again, last_sent);
 			to_send = gtp_cmd;
 		}
 
@@ -473,6 +516,7 @@ slave_loop(FILE *f, char *reply_buf, slave_state_t *sstate, bool resend)
 		 * The slave machine sends "=id reply" or "?id reply"
 		 * with id == cmd_id if it is in sync. */
 		last_cmd_count = cmd_count;
+		last_sent = time_now();
 		char buf[CMDS_SIZE];
 		int reply_id = send_command(to_send, bin_buf, &bin_size, f,
 					    sstate, buf);
@@ -480,6 +524,7 @@ slave_loop(FILE *f, char *reply_buf, slave_state_t *sstate, bool resend)
 
 		resend = process_reply(reply_id, buf, reply_buf, bin_buf, bin_size,
 				       &last_reply_id, &reply_slot, sstate);
+		again = !resend && genmoves_pending(last_reply_id);
 	}
 }
 
@@ -652,19 +697,70 @@ get_replies(double time_limit, int min_replies)
 	assert(reply_count > 0);
 }
 
+/* Relay mode: state of the connection to the upper master, NULL
+ * otherwise. Stats received from the upper master are inserted in the
+ * receive queue with their own owner id, so they are sent down to all
+ * our slaves but never merged back into stats sent upwards. */
+static slave_state_t *relay_sstate = NULL;
+
+/* Read the binary args of a genmoves command sent by the upper master,
+ * @size bytes of incr_stats_t sorted by coord path, and insert them in
+ * the receive queue. If keep is false just discard them.
+ * Return false if error.
+ * slave_lock is held on both entry and exit of this function. */
+bool
+relay_receive_stats(char *args, bool keep)
+{
+	assert(relay_sstate);
+	char *s = strchr(args, '@');
+	int size = (s ? atoi(s+1) : 0);
+	if (!size) return true;
+	if (size % sizeof(incr_stats_t) || size > relay_sstate->max_buf_size)
+		keep = false;
+
+	void *buf = get_free_buf(relay_sstate);
+	pthread_mutex_unlock(&slave_lock);
+
+	int len, left = size;
+	char *p = buf;
+	while (left) {
+		int n = (left > relay_sstate->max_buf_size ? relay_sstate->max_buf_size : left);
+		if ((len = fread(p, 1, n, stdin)) <= 0) break;
+		left -= len;
+		if (keep) p += len;
+	}
+	pthread_mutex_lock(&slave_lock);
+
+	if (left) return false;
+	if (keep) insert_buf(relay_sstate, buf, size);
+	return keep;
+}
+
+/* Merge all stats received from our slaves since the last call and
+ * store in buf the best increments, to be sent to the upper master.
+ * Return the byte size of the resulting buffer.
+ * slave_lock is held on both entry and exit of this function. */
+int
+relay_merge_stats(void *buf)
+{
+	assert(relay_sstate);
+	return relay_sstate->args_hook(buf, relay_sstate, atoi(gtp_cmd));
+}
+
 /* In a 5mn move with at least 5ms per genmoves we get at most
  * 300*200=60000 genmoves per slave. */
 #define MAX_GENMOVES_PER_SLAVE 60000
 
 /* Allocate the receive queue, and create the slave and proxy threads.
  * max_buf_size and the merge-related fields of default_sstate must
- * already be initialized. */
+ * already be initialized. If relay is set, we are also a slave of an
+ * upper master which gets its own slave state (see relay_sstate). */
 void
-protocol_init(char *slave_port, char *proxy_port, int max_slaves)
+protocol_init(char *slave_port, char *proxy_port, int max_slaves, bool relay)
 {
 	start_time = time_now();
 
-	queue_max_length = max_slaves * MAX_GENMOVES_PER_SLAVE;
+	queue_max_length = (max_slaves + relay) * MAX_GENMOVES_PER_SLAVE;
 	receive_queue = calloc2(queue_max_length, buf_state_t*);
 
 	default_sstate.slave_sock = port_listen(slave_port, max_slaves);
@@ -674,6 +770,15 @@ protocol_init(char *slave_port, char *proxy_port, int max_slaves)
 		default_sstate.b[n].queue_index = -1;
 	}
 
+	if (relay) {
+		relay_sstate = malloc2(slave_state_t);
+		*relay_sstate = default_sstate;
+		relay_sstate->thread_id = max_slaves;
+		/* Merge stats from all slaves, not all but one. */
+		relay_sstate->max_merged_nodes += relay_sstate->max_buf_size / sizeof(incr_stats_t);
+		slave_state_alloc(relay_sstate);
+	}
+
 	pthread_t thread;
 	for (int id = 0; id < max_slaves; id++) {
 		pthread_create(&thread, NULL, slave_thread, (void *)(intptr_t)id);
@@ -24,6 +24,7 @@ typedef struct slave_state slave_state_t;
 typedef void (*buffer_hook)(void *buf, int size);
 typedef void (*state_alloc_hook)(struct slave_state *sstate);
 typedef int (*getargs_hook)(void *buf, struct slave_state *sstate, int cmd_id);
+typedef int (*reply_hook)(char *reply, void *buf, int size, int reply_id, struct slave_state *sstate);
 
 typedef struct {
 	void *buf;
@@ -42,6 +43,7 @@ struct slave_state {
 	state_alloc_hook alloc_hook;
 	buffer_hook insert_hook;
 	getargs_hook args_hook;
+	reply_hook reply_hook;
 
 	/* Index in received_queue of most recent processed
 	 * buffer, -1 if none processed yet. */
@@ -63,6 +65,15 @@ struct slave_state {
 	/* Hash indices updated by stats merge. */
 	int *merged;
 	int max_merged_nodes;
+
+	/* --- PRIVATE DATA for distributed.c --- */
+
+	/* Last genmoves reply for the current move: gtp id,
+	 * played_own, playouts, threads, keep_looking, root stats. */
+	int root_id;
+	int root_info[4];
+	incr_stats_t *root_stats;
+	int root_count;
 };
 extern slave_state_t default_sstate;
 
@@ -75,7 +86,10 @@ void clear_receive_queue(void);
 void update_cmd(board_t *b, const char *cmd, char *args, bool new_id);
 void new_cmd(board_t *b, const char *cmd, char *args);
 void get_replies(double time_limit, int min_replies);
-void protocol_init(char *slave_port, char *proxy_port, int max_slaves);
+void protocol_init(char *slave_port, char *proxy_port, int max_slaves, bool relay);
+
+bool relay_receive_stats(char *args, bool keep);
+int relay_merge_stats(void *buf);
 
 extern int reply_count;
 extern char **gtp_replies;
@@ -93,6 +107,9 @@ extern int queue_age;
  * of 30 chars each for the stats at last move. */
 #define CMDS_SIZE (60*MAX_GAMELEN + 30*100)
 
+/* Room for the root stats at the end of genmoves replies. */
+#define ROOT_STATS_SIZE (MAX_ROOT_STATS * (int)sizeof(incr_stats_t))
+
 /* Max size for one line of reply or slave log. */
 #define BSIZE 4096
 
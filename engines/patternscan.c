@@ -1,7 +1,11 @@
+#define DEBUG
 #include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "batch.h"
 #include "board.h"
 #include "debug.h"
 #include "engine.h"
@@ -10,6 +14,7 @@
 #include "pattern.h"
 #include "patternsp.h"
 #include "../random.h"
+#include "timeinfo.h"
 
 
 /* The engine has two modes:
@@ -20,6 +25,11 @@
  * - gen_spat_dict=0: generate output for mm tool
  *       each move is pattern matched into team of features which can be fed
  *       into mm tool to compute gammas.
+ *
+ * Games are normally fed as gtp stream, output goes to stdout as mm text
+ * format. For large collections use patternscan_harvest() instead (pachi
+ * --harvest): game records are read directly and scanned on multiple
+ * threads, mm output is written in binary team format.
  */
 
 /* Internal engine state. */
@@ -32,6 +42,9 @@ typedef struct {
 
 	bool gen_spat_dict;
 	bool mcowner_fast;
+	bool mm_header_done;
+	int threads;		  /* harvest threads */
+	char *output;		  /* harvest mm output file */
 	int spat_threshold;	  /* Minimal number of occurences for spatial to be saved. */	
 	int loaded_spatials;      /* Number of loaded spatials; checkpoint for saving new sids
 				   * in case gen_spat_dict is enabled. */
@@ -60,8 +73,9 @@ typedef struct {
 static patternscan_t *global_ps = 0;
 static feature_info_t *features = pattern_features;
 
-static void
-mm_print_feature(patternscan_t *ps, strbuf_t *buf, feature_t *f)
+/* mm gamma number for feature @f */
+static int
+mm_gamma(patternscan_t *ps, feature_t *f)
 {
 	int mm_number = ps->feature2mm[f->id];
 	assert(f->id >= 0 && f->id < FEAT_MAX);
@@ -71,20 +85,21 @@ mm_print_feature(patternscan_t *ps, strbuf_t *buf, feature_t *f)
 		spatial_t *s = &spat_dict->spatials[f->payload];
 		int spatial_id = s - spat_dict->spatials;
 		assert(s->dist == features[f->id].spatial);
-		mm_number += ps->spatial2mm[spatial_id];
-		sbprintf(buf, "%i", mm_number);
-#ifdef DEBUG_MM
-		sbprintf(buf, "(%s:%i=%i)", features[f->id].name, mm_number, f->payload);
-#endif
-		return;
+		return mm_number + ps->spatial2mm[spatial_id];
 	}
 
-	/* Regular feature */	
+	/* Regular feature */
 	assert(f->payload < feature_payloads(f->id));  /* Sanity check, payloads are 0-based */
-	mm_number += f->payload;
-	sbprintf(buf, "%i", mm_number);
+	return mm_number + f->payload;
+}
+
+static void
+mm_print_feature(patternscan_t *ps, strbuf_t *buf, feature_t *f)
+{
+	sbprintf(buf, "%i", mm_gamma(ps, f));
 #ifdef DEBUG_MM
-	sbprintf(buf, "(%s:%i)", features[f->id].name, f->payload);
+	if (f->id >= FEAT_SPATIAL)  sbprintf(buf, "(%s:%i=%i)", features[f->id].name, mm_gamma(ps, f), f->payload);
+	else			    sbprintf(buf, "(%s:%i)", features[f->id].name, f->payload);
 #endif
 }
 
@@ -181,9 +196,6 @@ patternscan_mm_init(patternscan_t *ps)
 		ps->spatial2mm[i] = nspatials_by_dist[d]++;
 	}
 
-	/* mm header */
-	mm_header(ps);
-	
 	/* write mm-pachi.table: feature to mm mapping */
 	mm_table(ps);
 }
@@ -227,6 +239,21 @@ mm_process_move(patternscan_t *ps, board_t *b, move_t *m, strbuf_t *buf,
 	else    mm_print_pattern(ps, buf, &p);
 }
 
+static void
+genspatial_count(patternscan_t *ps, unsigned int sid, int n)
+{
+#define SCOUNTS_ALLOC 1048576 // Allocate space in 1M*4 blocks.
+	if (sid >= ps->nscounts) {
+		int newnsc = (sid / SCOUNTS_ALLOC + 1) * SCOUNTS_ALLOC;
+		ps->scounts = (int*)realloc(ps->scounts, newnsc * sizeof(*ps->scounts));
+		memset(&ps->scounts[ps->nscounts], 0, (newnsc - ps->nscounts) * sizeof(*ps->scounts));
+		//ps->sgameno = realloc(ps->sgameno, newnsc * sizeof(*ps->sgameno));
+		//memset(&ps->sgameno[ps->nscounts], 0, (newnsc - ps->nscounts) * sizeof(*ps->sgameno));
+		ps->nscounts = newnsc;
+	}
+	ps->scounts[sid] += n;
+}
+
 /* Store the spatial configuration in dictionary if applicable. */
 static void
 genspatial_process_move(patternscan_t *ps, board_t *b, move_t *m, strbuf_t *buf,
@@ -250,22 +277,13 @@ genspatial_process_move(patternscan_t *ps, board_t *b, move_t *m, strbuf_t *buf,
 	for (int d = ps->pc.spat_min; d <= dmax; d++) {
 		s.dist = d;
 		unsigned int sid = spatial_dict_add(spat_dict, &s);
-#define SCOUNTS_ALLOC 1048576 // Allocate space in 1M*4 blocks.
-		if (sid >= ps->nscounts) {
-			int newnsc = (sid / SCOUNTS_ALLOC + 1) * SCOUNTS_ALLOC;
-			ps->scounts = (int*)realloc(ps->scounts, newnsc * sizeof(*ps->scounts));
-			memset(&ps->scounts[ps->nscounts], 0, (newnsc - ps->nscounts) * sizeof(*ps->scounts));
-			//ps->sgameno = realloc(ps->sgameno, newnsc * sizeof(*ps->sgameno));
-			//memset(&ps->sgameno[ps->nscounts], 0, (newnsc - ps->nscounts) * sizeof(*ps->sgameno));
-			ps->nscounts = newnsc;
-		}
 		
 		/* Show stats from time to time */
 		if (ps->debug_level > 1 && !fast_random(65536) && !fast_random(32))
 			fprintf(stderr, "%d spatials\n", spat_dict->nspatials);
 			
 		/* Global pattern count (including multiple hits per game) */
-		ps->scounts[sid]++;
+		genspatial_count(ps, sid, 1);
 			
 #ifdef DEBUG_GENSPATIAL
 		fprintf(stderr, "id=%u d=%i hits=%i %s\n\n", sid, s.dist, ps->scounts[sid], spatial2str(&s));
@@ -307,6 +325,10 @@ patternscan_play(engine_t *e, board_t *b, move_t *m, char *enginearg, bool *boar
 	if (ps->gen_spat_dict)
 		process_pattern(ps, b, m, true, genspatial_process_move, NULL);
 	else {
+		if (!ps->mm_header_done) {
+			mm_header(ps);
+			ps->mm_header_done = true;
+		}
 		ownermap_t ownermap;
 		if (ps->mcowner_fast)  mcowner_playouts_fast(b, m->color, &ownermap);
 		else		       mcowner_playouts(b, m->color, &ownermap); /* slooow */
@@ -385,8 +407,344 @@ patternscan_done(engine_t *e)
 
 	free(ps->spatial2mm);  ps->spatial2mm = NULL;	
 	free(ps->buf.str);     ps->buf.str = NULL;
+	free(ps->output);      ps->output = NULL;
+}
+
+
+/**************************************************************************************************/
+/* Harvest: scan game records directly on multiple threads */
+
+/* Growable output buffer */
+typedef struct {
+	unsigned char *data;
+	size_t len;
+	size_t alloc;
+} harvest_buf_t;
+
+/* Thread-local spatial counts (gen_spat_dict), merged into spat_dict at the end.
+ * Isomorphous spatials get separate entries here, spatial_dict_add() takes
+ * care of them when merging. */
+typedef struct {
+	hash_t hash;
+	spatial_t s;
+	int count;
+} harvest_spatial_t;
+
+typedef struct {
+	harvest_spatial_t *table;
+	unsigned int size;	/* power of 2 */
+	unsigned int n;
+} harvest_counts_t;
+
+typedef struct {
+	patternscan_t *ps;
+	char **files;
+	int nfiles;
+	volatile int next;	/* next game to scan */
+	int bsize;
+
+	pthread_mutex_t lock;	/* output */
+	FILE *out;
+} harvest_t;
+
+typedef struct {
+	harvest_t *h;
+	pthread_t thread;
+	unsigned long seed;
+	int games;
+	long positions;
+	harvest_buf_t out;
+	harvest_buf_t teams;
+	harvest_counts_t counts;
+} harvest_thread_t;
+
+#define HARVEST_FLUSH (1 << 20)
+
+static void
+harvest_write(harvest_buf_t *buf, const void *data, size_t n)
+{
+	if (buf->len + n > buf->alloc) {
+		buf->alloc = MAX(buf->alloc * 2, buf->len + n + 65536);
+		buf->data = realloc(buf->data, buf->alloc);
+		if (!buf->data)  die("harvest: out of memory\n");
+	}
+	memcpy(buf->data + buf->len, data, n);
+	buf->len += n;
+}
+
+/* Binary team format varint, see pattern/mm/mm.cpp */
+static void
+harvest_varint(harvest_buf_t *buf, unsigned int v)
+{
+	unsigned char tmp[5];
+	int n = 0;
+	for (; v >= 0x80; v >>= 7)
+		tmp[n++] = (v | 0x80);
+	tmp[n++] = v;
+	harvest_write(buf, tmp, n);
+}
+
+static void
+harvest_int32(harvest_buf_t *buf, int32_t v)
+{
+	harvest_write(buf, &v, sizeof(v));
+}
+
+static void
+mm_binary_header(patternscan_t *ps, harvest_buf_t *buf)
+{
+	harvest_write(buf, "MMTEAMS1", 8);
+	harvest_int32(buf, mm_gammas(ps));
+	harvest_int32(buf, FEAT_MAX);
+	for (int i = 0; i < FEAT_MAX; i++) {
+		harvest_int32(buf, feature_payloads(i));
+		harvest_int32(buf, strlen(features[i].name));
+		harvest_write(buf, features[i].name, strlen(features[i].name));
+	}
+}
+
+static void
+harvest_team(patternscan_t *ps, harvest_buf_t *buf, pattern_t *p)
+{
+	harvest_varint(buf, p->n);
+	for (int i = 0; i < p->n; i++)
+		harvest_varint(buf, mm_gamma(ps, &p->f[i]));
+}
+
+static void
+harvest_flush(harvest_thread_t *ht)
+{
+	harvest_t *h = ht->h;
+	if (!ht->out.len)  return;
+	pthread_mutex_lock(&h->lock);
+	if (fwrite(ht->out.data, 1, ht->out.len, h->out) != ht->out.len)
+		fail("harvest: write");
+	pthread_mutex_unlock(&h->lock);
+	ht->out.len = 0;
+}
+
+/* mm mode: game move is the winner, all other valid moves participants. */
+static void
+harvest_mm_move(harvest_thread_t *ht, board_t *b, move_t *m)
+{
+	patternscan_t *ps = ht->h->ps;
+	ownermap_t ownermap;
+	if (ps->mcowner_fast)  mcowner_playouts_fast(b, m->color, &ownermap);
+	else		       mcowner_playouts(b, m->color, &ownermap);
+
+	pattern_t p;
+	pattern_match(&ps->pc, &p, b, m, &ownermap, true);
+	ht->teams.len = 0;
+	harvest_team(ps, &ht->teams, &p);
+	harvest_team(ps, &ht->teams, &p);  /* mm needs winner team also in the participants */
+	int teams = 2;
+
+	foreach_free_point(b) {
+		move_t m2 = move(c, m->color);
+		if (c == m->coord)                                           continue;
+		if (!board_is_valid_play_no_suicide(b, m2.color, m2.coord))  continue;
+		pattern_match(&ps->pc, &p, b, &m2, &ownermap, true);
+		harvest_team(ps, &ht->teams, &p);
+		teams++;
+	} foreach_free_point_end;
+
+	harvest_varint(&ht->out, teams);
+	harvest_write(&ht->out, ht->teams.data, ht->teams.len);
+	if (ht->out.len >= HARVEST_FLUSH)
+		harvest_flush(ht);
+}
+
+static void
+harvest_count(harvest_counts_t *counts, spatial_t *s)
+{
+	if (counts->n * 2 >= counts->size) {  /* Grow */
+		harvest_counts_t old = *counts;
+		counts->size = (old.size ? old.size * 2 : 65536);
+		counts->table = calloc2(counts->size, harvest_spatial_t);
+		counts->n = 0;
+		for (unsigned int i = 0; i < old.size; i++)
+			if (old.table[i].count) {
+				harvest_spatial_t *e = &old.table[i];
+				unsigned int j = e->hash & (counts->size - 1);
+				while (counts->table[j].count)  j = (j + 1) & (counts->size - 1);
+				counts->table[j] = *e;
+				counts->n++;
+			}
+		free(old.table);
+	}
+
+	hash_t hash = spatial_hash(0, s) ^ s->dist;
+	unsigned int j = hash & (counts->size - 1);
+	for (; counts->table[j].count; j = (j + 1) & (counts->size - 1)) {
+		harvest_spatial_t *e = &counts->table[j];
+		if (e->hash == hash && e->s.dist == s->dist) {  e->count++;  return;  }
+	}
+	counts->table[j].hash = hash;
+	counts->table[j].s = *s;
+	counts->table[j].count = 1;
+	counts->n++;
+}
+
+/* gen_spat_dict mode: count spatials of played move. */
+static void
+harvest_spatial_move(harvest_thread_t *ht, board_t *b, move_t *m)
+{
+	patternscan_t *ps = ht->h->ps;
+	spatial_t s;
+	spatial_from_board(&ps->pc, &s, b, m);
+	int dmax = s.dist;
+	for (int d = ps->pc.spat_min; d <= dmax; d++) {
+		s.dist = d;
+		harvest_count(&ht->counts, &s);
+	}
 }
 
+static void
+harvest_game(harvest_thread_t *ht, board_t *b, char *filename)
+{
+	harvest_t *h = ht->h;
+	patternscan_t *ps = h->ps;
+	batch_game_t game;
+	batch_game_t *g = &game;
+	if (!batch_game_load(g, filename)) {
+		if (DEBUGL(0))  fprintf(stderr, "harvest: couldn't load %s, skipping\n", filename);
+		batch_game_done(g);
+		return;
+	}
+	/* Board statics are shared between threads, can't resize. */
+	if (g->size != h->bsize) {
+		if (DEBUGL(1))  fprintf(stderr, "harvest: %s: not %ix%i, skipping\n", filename, h->bsize, h->bsize);
+		batch_game_done(g);
+		return;
+	}
+
+	batch_game_setup(g, b, filename);
+	for (int i = g->setup; i < g->moves; i++) {
+		move_t *m = &g->move[i];
+		if (is_resign(m->coord))  break;
+		if (!is_pass(m->coord) && board_at(b, m->coord) != S_NONE)  break;  /* Broken game record */
+
+		if (!is_pass(m->coord) && (m->color & ps->color_mask)) {
+			if (ps->gen_spat_dict)  harvest_spatial_move(ht, b, m);
+			else			harvest_mm_move(ht, b, m);
+			ht->positions++;
+		}
+
+		if (board_play(b, m) < 0) {
+			if (DEBUGL(1))  fprintf(stderr, "harvest: %s: illegal move %s %s, skipping rest of game\n",
+						filename, stone2str(m->color), coord2sstr(m->coord));
+			break;
+		}
+	}
+	ht->games++;
+	batch_game_done(g);
+}
+
+static void *
+harvest_thread(void *data)
+{
+	harvest_thread_t *ht = (harvest_thread_t*)data;
+	harvest_t *h = ht->h;
+	board_t *b = board_new(h->bsize, NULL);
+	fast_srandom(ht->seed);
+
+	int i;
+	while ((i = __sync_fetch_and_add(&h->next, 1)) < h->nfiles) {
+		harvest_game(ht, b, h->files[i]);
+		if (DEBUGL(2))  fprintf(stderr, "[ %i / %i ] %s\n", i + 1, h->nfiles, h->files[i]);
+	}
+	harvest_flush(ht);
+
+	board_delete(&b);
+	return NULL;
+}
+
+/* Merge thread-local spatial counts into spatial dictionary. */
+static void
+harvest_merge_spatials(patternscan_t *ps, harvest_counts_t *counts)
+{
+	for (unsigned int i = 0; i < counts->size; i++) {
+		harvest_spatial_t *e = &counts->table[i];
+		if (!e->count)  continue;
+		unsigned int sid = spatial_dict_add(spat_dict, &e->s);
+		genspatial_count(ps, sid, e->count);
+	}
+}
+
+int
+patternscan_harvest(engine_t *e, board_t *b, char *listfile)
+{
+	patternscan_t *ps = (patternscan_t*)e->data;
+	if (e->id != E_PATTERNSCAN)  die("--harvest: patternscan engine required (-e patternscan)\n");
+
+	harvest_t harvest, *h = &harvest;
+	memset(h, 0, sizeof(*h));
+	h->ps = ps;
+	h->files = batch_files(listfile, &h->nfiles);
+
+	/* Board size is taken from first game, games of other sizes are skipped. */
+	h->bsize = board_rsize(b);
+	for (int i = 0; i < h->nfiles; i++) {
+		batch_game_t g;
+		bool ok = batch_game_load(&g, h->files[i]);
+		batch_game_done(&g);
+		if (!ok)  continue;
+		h->bsize = g.size;
+		break;
+	}
+	if (board_rsize(b) != h->bsize)
+		board_resize(b, h->bsize);
+	pthread_mutex_init(&h->lock, NULL);
+
+	if (!ps->gen_spat_dict) {
+		h->out = fopen(ps->output, "w");
+		if (!h->out)  die("harvest: couldn't open %s\n", ps->output);
+		harvest_buf_t header = { NULL, 0, 0 };
+		mm_binary_header(ps, &header);
+		if (fwrite(header.data, 1, header.len, h->out) != header.len)  fail("harvest: write");
+		free(header.data);
+	}
+
+	int threads = MAX(ps->threads, 1);
+	if (DEBUGL(1))  fprintf(stderr, "harvest: %i games, %i threads\n", h->nfiles, threads);
+
+	double time_start = time_now();
+	harvest_thread_t *ht = calloc2(threads, harvest_thread_t);
+	unsigned long seed = fast_getseed();  /* -s seed */
+	for (int i = 0; i < threads; i++) {
+		ht[i].h = h;
+		ht[i].seed = seed + i;
+		pthread_create(&ht[i].thread, NULL, harvest_thread, &ht[i]);
+	}
+
+	int games = 0;
+	long positions = 0;
+	for (int i = 0; i < threads; i++) {
+		pthread_join(ht[i].thread, NULL);
+		games += ht[i].games;
+		positions += ht[i].positions;
+		if (ps->gen_spat_dict)  harvest_merge_spatials(ps, &ht[i].counts);
+		free(ht[i].out.data);
+		free(ht[i].teams.data);
+		free(ht[i].counts.table);
+	}
+	double elapsed = time_now() - time_start;
+	ps->gameno += games;
+
+	if (h->out && fclose(h->out))  fail("harvest: close");
+	if (DEBUGL(1)) {
+		fprintf(stderr, "harvest: %i games, %li positions in %.1fs (%.0f positions/s, %i threads)\n",
+			games, positions, elapsed, positions / (elapsed + 0.000001), threads);
+		if (!ps->gen_spat_dict)  fprintf(stderr, "harvest: wrote %s\n", ps->output);
+	}
+
+	free(ht);
+	batch_files_free(h->files, h->nfiles);
+	pthread_mutex_destroy(&h->lock);
+	return 0;
+}
+
+
 #define NEED_RESET   ENGINE_SETOPTION_NEED_RESET
 #define option_error engine_setoption_error
 
@@ -437,6 +795,16 @@ patternscan_setoption(engine_t *e, board_t *b, const char *optname, char *optval
 		 * Default: mcowner_fast=1 */
 		ps->mcowner_fast = atoi(optval);
 	}
+	else if (!strcasecmp(optname, "threads") && optval) {
+		/* Number of threads for --harvest (default: #cores) */
+		ps->threads = atoi(optval);
+	}
+	else if (!strcasecmp(optname, "output") && optval) {
+		/* mm output file for --harvest, binary team format
+		 * (default: mm-input.bin) */
+		free(ps->output);
+		ps->output = strdup(optval);
+	}
 	else if (!strcasecmp(optname, "patterns") && optval) {  NEED_RESET
 		patterns_init(&ps->pc, optval, ps->gen_spat_dict, false);
 	}
@@ -461,6 +829,8 @@ patternscan_state_init(engine_t *e, board_t *b)
 	/* Default mode: match patterns and generate output for mm tool. */
 	ps->spat_split_sizes = 1;
 	ps->mcowner_fast = true;
+	ps->threads = get_nprocessors();
+	ps->output = strdup("mm-input.bin");
 
 	/* Process engine options. */
 	for (int i = 0; i < options->n; i++) {
@@ -5,4 +5,9 @@
 
 void engine_patternscan_init(engine_t *e, board_t *b);
 
+/* Scan game records listed in @listfile (see batch_files()) on multiple
+ * threads. mm mode writes binary team format for mm tool, gen_spat_dict
+ * mode adds spatials to the dictionary (written when engine is done). */
+int patternscan_harvest(engine_t *e, board_t *b, char *listfile);
+
 #endif
@@ -11,21 +11,6 @@
 #include "random.h"
 
 
-#define HASH_VMIRROR     1
-#define HASH_HMIRROR     2
-#define HASH_XYFLIP      4
-
-static coord_t
-coord_transform(board_t *b, coord_t coord, int i)
-{
-	int stride = board_stride(b);
-	int x = coord_x(coord);  int y = coord_y(coord);	
-	if (i & HASH_VMIRROR)  coord = coord_xy(x, stride - 1 - y);
-	if (i & HASH_HMIRROR)  coord = coord_xy(stride - 1 - x, y);
-	if (i & HASH_XYFLIP)   coord = coord_xy(y, x);
-	return coord;
-}
-
 /* Check if we can make a move along the fbook right away.
  * Otherwise return pass. */
 coord_t
@@ -33,23 +18,26 @@ fbook_check(board_t *board)
 {
 	if (!board->fbook) return pass;
 
-	hash_t hi = board->hash;
+	/* Book is keyed on canonical hashes, so rotated and
+	 * mirrored positions match as well. */
+	hash_t hash = board->canonical_hash;
+	hash_t hi = hash;
 	coord_t cf = pass;
 	while (!is_pass(board->fbook->moves[hi & fbook_hash_mask])) {
-		if (board->fbook->hashes[hi & fbook_hash_mask] == board->hash) {
-			cf = board->fbook->moves[hi & fbook_hash_mask];
+		if (board->fbook->hashes[hi & fbook_hash_mask] == hash) {
+			cf = board_unsym_coord(board->fbook->moves[hi & fbook_hash_mask], board->canonical_sym);
 			break;
 		}
 		hi++;
 	}
 	if (!is_pass(cf)) {
 		if (DEBUGL(1))
-			fprintf(stderr, "fbook match %" PRIhash ":%" PRIhash "\n", board->hash, board->hash & fbook_hash_mask);
+			fprintf(stderr, "fbook match %" PRIhash ":%" PRIhash "\n", hash, hash & fbook_hash_mask);
 	} else {
 		/* No match, also prevent further fbook usage
 		 * until the next clear_board. */
 		if (DEBUGL(4))
-			fprintf(stderr, "fbook out %" PRIhash ":%" PRIhash "\n", board->hash, board->hash & fbook_hash_mask);
+			fprintf(stderr, "fbook out %" PRIhash ":%" PRIhash "\n", hash, hash & fbook_hash_mask);
 		fbook_done(board->fbook);
 		board->fbook = NULL;
 	}
@@ -82,12 +70,11 @@ fbook_init(char *filename, board_t *b)
 	if (DEBUGL(1))
 		fprintf(stderr, "Loading opening fbook %s...\n", filename);
 
-	/* Scratch board where we lay out the sequence;
-	 * one for each transposition. */
-	board_t *bs[8];
-	for (int i = 0; i < 8; i++)
-		bs[i] = board_new(fbook->bsize, NULL);
-	
+	/* Scratch board where we lay out the sequence. Positions are
+	 * stored under their canonical hash so one entry covers all
+	 * transpositions. */
+	board_t *bs = board_new(fbook->bsize, NULL);
+
 	char linebuf[1024];
 	while (fgets(linebuf, sizeof(linebuf), f)) {
 		char *line = linebuf;
@@ -108,20 +95,15 @@ fbook_init(char *filename, board_t *b)
 			continue;
 		while (isspace(*line)) line++;
 
-		for (int i = 0; i < 8; i++) {
-			board_clear(bs[i]);
-			last_move(bs[i]).color = S_WHITE;
-		}
+		board_clear(bs);
+		last_move(bs).color = S_WHITE;
 
 		while (*line != '|') {
 			coord_t c = str2coord(line);
 
-			for (int i = 0; i < 8; i++) {
-				coord_t coord = coord_transform(b, c, i);
-				move_t m = move(coord, stone_other(last_move(bs[i]).color));
-				int ret = board_play(bs[i], &m);
-				assert(ret >= 0);
-			}
+			move_t m = move(c, stone_other(last_move(bs).color));
+			int ret = board_play(bs, &m);
+			assert(ret >= 0);
 
 			while (!isspace(*line)) line++;
 			while (isspace(*line)) line++;
@@ -139,35 +121,17 @@ fbook_init(char *filename, board_t *b)
 		}
 
 		coord_t c = str2coord(line);
-		for (int i = 0; i < 8; i++) {
-			coord_t coord = coord_transform(b, c, i);
-#if 0
-			char conflict = is_pass(fbook->moves[bs[i]->hash & fbook_hash_mask]) ? '+' : 'C';
-			if (conflict == 'C')
-				for (int j = 0; j < i; j++)
-					if (bs[i]->hash == bs[j]->hash)
-						conflict = '+';
-			if (conflict == 'C') {
-				hash_t hi = bs[i]->hash;
-				while (!is_pass(fbook->moves[hi & fbook_hash_mask]) && fbook->hashes[hi & fbook_hash_mask] != bs[i]->hash)
-					hi++;
-				if (fbook->hashes[hi & fbook_hash_mask] == bs[i]->hash)
-					hi = 'c';
-			}
-			fprintf(stderr, "%c %" PRIhash ":%" PRIhash " (<%d> %s)\n", conflict,
-			        bs[i]->hash & fbook_hash_mask, bs[i]->hash, i, linebuf);
-#endif
-			hash_t hi = bs[i]->hash;
-			while (!is_pass(fbook->moves[hi & fbook_hash_mask]) && fbook->hashes[hi & fbook_hash_mask] != bs[i]->hash)
-				hi++;
-			fbook->moves[hi & fbook_hash_mask] = coord;
-			fbook->hashes[hi & fbook_hash_mask] = bs[i]->hash;
-			fbook->movecnt++;
-		}
+		coord_t coord = board_sym_coord(c, bs->canonical_sym);
+		hash_t hash = bs->canonical_hash;
+		hash_t hi = hash;
+		while (!is_pass(fbook->moves[hi & fbook_hash_mask]) && fbook->hashes[hi & fbook_hash_mask] != hash)
+			hi++;
+		fbook->moves[hi & fbook_hash_mask] = coord;
+		fbook->hashes[hi & fbook_hash_mask] = hash;
+		fbook->movecnt++;
 	}
 
-	for (int i = 0; i < 8; i++)
-		board_delete(&bs[i]);
+	board_delete(&bs);
 
 	fclose(f);
 
@@ -23,6 +23,8 @@
 #include "t-predict/predict.h"
 #include "t-unit/test.h"
 #include "fifo.h"
+#include "telemetry.h"
+#include "dcnn.h"
 
 /* Sleep 5 seconds after a game ends to give time to kill the program. */
 #define GAME_OVER_SLEEP 5
@@ -89,7 +91,9 @@ gtp_error(gtp_t *gtp, const char *str)
 {
 	gtp->error = true;
 	
-	/* errors never quiet */
+	/* errors never quiet, but muted output must stay valid gtp:
+	 * log them then (distributed slave replaying history). */
+	if (gtp->quiet) {  fprintf(stderr, "gtp: %s: %s\n", gtp->cmd, str);  return;  }
 	gtp_prefix(gtp, '?');
 	fputs(str, stdout);
 	putchar('\n');
@@ -116,10 +120,16 @@ gtp_error_printf(gtp_t *gtp, const char *format, ...)
 {
 	gtp->error = true;
 	
-	/* errors never quiet */
+	/* errors never quiet, see gtp_error() */
 	va_list ap;
 	va_start(ap, format);
 
+	if (gtp->quiet) {
+		fprintf(stderr, "gtp: %s: ", gtp->cmd);
+		vfprintf(stderr, format, ap);
+		va_end(ap);
+		return;
+	}
 	gtp_prefix(gtp, '?');
 	vprintf(format, ap);
 	gtp_flush(gtp);   /* flush errors right away */
@@ -253,6 +263,8 @@ static enum parse_code
 cmd_quit(board_t *b, engine_t *e, time_info_t *ti, gtp_t *gtp)
 {
 	gtp_flush(gtp);
+	engine_done(e);
+	dcnn_done();
 	pachi_done();
 	exit(0);
 }
@@ -285,6 +297,8 @@ static enum parse_code
 cmd_clear_board(board_t *b, engine_t *e, time_info_t *ti, gtp_t *gtp)
 {
 	board_clear(b);
+	if (gtp->played_games)
+		dcnn_cache_game_report();
 	gtp->played_games++;
 	if (DEBUGL(3) && debug_boardprint)
 		board_print(b, stderr);
@@ -432,6 +446,9 @@ genmove(board_t *b, enum stone color, engine_t *e, time_info_t *ti, gtp_t *gtp,
 		move_t m = move(c, color);
 		if (gtp_board_play(gtp, b, &m) < 0)
 			die("Attempted to generate an illegal move: %s %s\n", stone2str(m.color), coord2sstr(m.coord));
+		/* Opponent's timer starts now, like in cmd_play(). Matters if
+		 * we generate moves for both colors: no play command then. */
+		time_start_timer(&ti[stone_other(color)]);
 	}
 	
 	char *str = coord2sstr(c);
@@ -716,6 +733,35 @@ cmd_pachi_getoption(board_t *b, engine_t *e, time_info_t *ti, gtp_t *gtp)
 	return P_OK;
 }
 
+/* Search telemetry:
+ *   pachi-telemetry          human readable summary
+ *   pachi-telemetry json     same as one json line
+ *   pachi-telemetry reset    clear all counters */
+static enum parse_code
+cmd_pachi_telemetry(board_t *b, engine_t *e, time_info_t *ti, gtp_t *gtp)
+{
+	char *arg;
+	gtp_arg_optional(arg);
+
+	if (!strcasecmp(arg, "reset")) {
+		telemetry_reset();
+		return P_OK;
+	}
+
+	telemetry_t tm;
+	telemetry_collect(&tm);
+	strbuf(buf, 8192);
+	if (!strcasecmp(arg, "json")) {
+		telemetry_print_json(buf, &tm);
+		gtp_reply(gtp, buf->str);
+	} else if (!*arg) {
+		telemetry_print(buf, &tm);
+		gtp_printf(gtp, "%s", buf->str);
+	} else
+		gtp_error(gtp, "unknown argument");
+	return P_OK;
+}
+
 static int
 cmd_final_status_list_dead(char *arg, board_t *b, engine_t *e, gtp_t *gtp)
 {
@@ -879,6 +925,7 @@ undo_reload_engine(gtp_t *gtp, board_t *b, engine_t *e, time_info_t *ti)
 static enum parse_code
 cmd_showboard(board_t *b, engine_t *e, time_info_t *ti, gtp_t *gtp)
 {
+	if (gtp->quiet)  return P_OK;
 	gtp_printf(gtp, "");
 	board_print(b, stdout);
 	gtp->flushed = 1;  // already ends with \n\n
@@ -1075,6 +1122,7 @@ static gtp_command_t gtp_commands[] =
 	{ "pachi-score_est",        cmd_pachi_score_est },
 	{ "pachi-setoption",	    cmd_pachi_setoption },  /* Set/change engine option */
 	{ "pachi-getoption",	    cmd_pachi_getoption },  /* Get engine option(s) */
+	{ "pachi-telemetry",        cmd_pachi_telemetry },
 
 	{ "lz-analyze",             cmd_lz_analyze },         /* Lizzie, Sabaki, etc */
 	{ "lz-genmove_analyze",     cmd_lz_genmove_analyze },
@@ -1178,11 +1226,13 @@ gtp_parse(gtp_t *gtp, board_t *b, engine_t *e, time_info_t *ti, char *buf)
 	if (gtp->undo_pending && strcasecmp(gtp->cmd, "undo"))
 		undo_reload_engine(gtp, b, e, ti);
 
-	/* Run handler */
+	/* Run handler. Engine notify() may silence this command only. */
+	bool quiet = gtp->quiet;
 	enum parse_code c = gtp_run_handler(gtp, b, e, ti, buf);
 	assert(c == P_OK || c == P_ENGINE_RESET || c == P_UNKNOWN_COMMAND);
 
 	/* Add final '\n' and empty reply if needed */
 	if (!gtp->flushed)  gtp_flush(gtp);
+	gtp->quiet = quiet;
 	return c;
 }
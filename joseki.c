@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -212,6 +213,14 @@ joseki_stats(joseki_dict_t *jd)
 		(float)entries / (buckets - empty), worst, (float)memht / (1024*1024));
 }
 
+/* Setup lookup table for joseki_list_moves_incremental(). */
+static void
+joseki_index_colors(joseki_dict_t *jd)
+{
+	forall_joseki_patterns(jd)
+		jd->colors[p->coord] |= 1 << p->color;
+}
+
 static char *abcd = "abcdefghjklmnopqrstuvwxyz";
 
 /* Hack: make 19x19 joseki work for other boardsizes.
@@ -289,6 +298,7 @@ joseki_load(int bsize)
 	}
 	engine_done(&e);
 	board_delete(&b);
+	joseki_index_colors(joseki_dict);
 	debug_level = saved_debug_level;
 	int variations = gtp.played_games;
 	
@@ -343,14 +353,128 @@ joseki_prev_matches(board_t *b, josekipat_t *prev)
 	return (prev->h == joseki_spatial_hash(b, prev->coord, prev->color));
 }
 
+/* Incremental matching: per-thread cache of joseki spatial hashes for each
+ * point of the last position seen (one cache for each color to play).
+ * On the next position hashes of points which see a changed stone are
+ * patched by xor, new points get hashed lazily. Dictionary lookups and
+ * previous moves checks are cheap in comparison and done every time. */
+
+/* More changes than that and we start over. */
+#define JOSEKI_CACHE_MAX_CHANGES 20
+
+typedef struct {
+	unsigned int gen;			/* Valid if same as cache generation */
+	hash_t h;				/* joseki_spatial_hash() */
+	hash_t h3;				/* joseki_3x3_spatial_hash() */
+} joseki_cache_point_t;
+
+typedef struct {
+	unsigned int gen;
+	int size;
+	joseki_dict_t *dict;
+	enum stone b[BOARD_MAX_COORDS];		/* Position cached points belong to */
+	joseki_cache_point_t p[BOARD_MAX_COORDS];
+} joseki_cache_t;
+
+static __thread joseki_cache_t *joseki_caches = NULL;	/* Black, white to play */
+static pthread_key_t  joseki_cache_key;
+static pthread_once_t joseki_cache_once = PTHREAD_ONCE_INIT;
+
+/* Same as outer_spatial_hash_from_board_rot_d() */
+static enum stone bt_black[4] = { S_NONE, S_BLACK, S_WHITE, S_OFFBOARD };
+static enum stone bt_white[4] = { S_NONE, S_WHITE, S_BLACK, S_OFFBOARD };
+
+static void
+joseki_cache_key_init(void)
+{
+	pthread_key_create(&joseki_cache_key, free);	/* Free on thread exit */
+}
+
+static joseki_cache_t *
+joseki_cache(enum stone color)
+{
+	if (unlikely(!joseki_caches)) {
+		pthread_once(&joseki_cache_once, joseki_cache_key_init);
+		joseki_caches = calloc2(2, joseki_cache_t);
+		pthread_setspecific(joseki_cache_key, joseki_caches);
+	}
+	return &joseki_caches[color == S_WHITE];
+}
+
+static void
+joseki_cache_reset(joseki_cache_t *jc, joseki_dict_t *jd, board_t *b)
+{
+	jc->gen++;
+	jc->size = board_rsize(b);
+	jc->dict = jd;
+	memcpy(jc->b, b->b, sizeof(jc->b));
+}
+
+/* Bring @color cache up to date with @b. */
+static joseki_cache_t *
+joseki_cache_update(joseki_dict_t *jd, board_t *b, enum stone color)
+{
+	joseki_cache_t *jc = joseki_cache(color);
+	if (jc->size != board_rsize(b) || jc->dict != jd) {
+		joseki_cache_reset(jc, jd, b);
+		return jc;
+	}
+
+	coord_t changed[JOSEKI_CACHE_MAX_CHANGES];
+	int n = 0;
+	foreach_point(b) {
+		if (jc->b[c] == board_at(b, c))  continue;
+		if (n == JOSEKI_CACHE_MAX_CHANGES) {  joseki_cache_reset(jc, jd, b);  return jc;  }
+		changed[n++] = c;
+	} foreach_point_end;
+
+	enum stone *bt = (color == S_WHITE ? bt_white : bt_black);
+	for (int i = 0; i < n; i++) {
+		coord_t c = changed[i];
+		int cx = coord_x(c), cy = coord_y(c);
+		for (unsigned int j = ptind[2]; j < ptind[JOSEKI_PATTERN_DIST + 1]; j++) {
+			/* Point which sees c at offset j */
+			int x = cx - ptcoords[j].x, y = cy - ptcoords[j].y;
+			if (x < 1 || x > jc->size || y < 1 || y > jc->size)  continue;
+			joseki_cache_point_t *p = &jc->p[coord_xy(x, y)];
+			if (p->gen != jc->gen)  continue;
+
+			hash_t delta = pthashes[0][j][bt[jc->b[c]]] ^ pthashes[0][j][bt[board_at(b, c)]];
+			p->h ^= delta;
+			if (j < ptind[3 + 1])  p->h3 ^= delta;
+		}
+		jc->b[c] = board_at(b, c);
+	}
+	return jc;
+}
+
+/* Cached joseki_spatial_hash() and joseki_3x3_spatial_hash() for point @c */
+static joseki_cache_point_t *
+joseki_cache_point(joseki_cache_t *jc, board_t *b, coord_t c, enum stone color)
+{
+	joseki_cache_point_t *p = &jc->p[c];
+	if (p->gen == jc->gen)  return p;
+
+	/* New point, compute hashes (3x3 hash covers the first distances) */
+	enum stone *bt = (color == S_WHITE ? bt_white : bt_black);
+	int cx = coord_x(c), cy = coord_y(c);
+	hash_t h = pthashes[0][0][S_NONE];
+	for (unsigned int j = ptind[2]; j < ptind[JOSEKI_PATTERN_DIST + 1]; j++) {
+		if (j == ptind[3 + 1])  p->h3 = h;
+		ptcoords_at(x, y, cx, cy, j);
+		h ^= pthashes[0][j][bt[board_atxy(b, x, y)]];
+	}
+	p->h = h;
+	p->gen = jc->gen;
+	return p;
+}
+
 /* XXX can be several matches for one move in case multiple prev moves lead here.
  * we only return first match, however prefer strong matches over weak matches
  * and last move matches above all else. */ 
 static josekipat_t*
-joseki_lookup_regular(joseki_dict_t *jd, board_t *b, coord_t coord, enum stone color)
+joseki_lookup_regular_hash(joseki_dict_t *jd, board_t *b, coord_t coord, enum stone color, hash_t h)
 {
-	/* TODO we already computed hashes for spatial patterns, reuse instead ? */
-	hash_t h = joseki_spatial_hash(b, coord, color);
 	uint32_t kh = joseki_dict_hash(h, coord);
 
 	josekipat_t *match_low = NULL, *match_prev = NULL, *match_any = NULL;
@@ -373,6 +497,14 @@ joseki_lookup_regular(joseki_dict_t *jd, board_t *b, coord_t coord, enum stone c
 	return (match_prev ? match_prev : (match_low ? match_low : match_any));
 }
 
+static josekipat_t*
+joseki_lookup_regular(joseki_dict_t *jd, board_t *b, coord_t coord, enum stone color)
+{
+	/* TODO we already computed hashes for spatial patterns, reuse instead ? */
+	hash_t h = joseki_spatial_hash(b, coord, color);
+	return joseki_lookup_regular_hash(jd, b, coord, color, h);
+}
+
 /* same as joseki_lookup_regular(): prefer last move matches above all else. */ 
 josekipat_t*
 joseki_lookup_3x3(joseki_dict_t *jd, board_t *b, coord_t coord, enum stone color)
@@ -413,13 +545,16 @@ joseki_lookup_ignored(joseki_dict_t *jd, board_t *b, coord_t coord, enum stone c
 	return NULL;
 }
 
+/* @jc: hashes cache, or NULL */
 static int
 append_3x3_matches(joseki_dict_t *jd, board_t *b, enum stone color,
-		   coord_t *coords, float *ratings, int matches)
+		   coord_t *coords, float *ratings, int matches, joseki_cache_t *jc)
 {
 	for (josekipat_t *p = jd->pat_3x3[color]; p; p = p->next) {
 		if (board_at(b, p->coord) != S_NONE)  continue;
-		if (p->h != joseki_3x3_spatial_hash(b, p->coord, color))  continue;
+		hash_t h3 = (jc ? joseki_cache_point(jc, b, p->coord, color)->h3 :
+				  joseki_3x3_spatial_hash(b, p->coord, color));
+		if (p->h != h3)  continue;
 		if (!joseki_prev_matches(b, p->prev))  continue;
 		
 		float rating = joseki_rating(b, p);
@@ -452,7 +587,28 @@ joseki_list_moves(joseki_dict_t *jd, board_t *b, enum stone color,
 		ratings[matches++] = joseki_rating(b, p);
 	} foreach_free_point_end;
 
-	return append_3x3_matches(jd, b, color, coords, ratings, matches);
+	return append_3x3_matches(jd, b, color, coords, ratings, matches, NULL);
+}
+
+int
+joseki_list_moves_incremental(joseki_dict_t *jd, board_t *b, enum stone color,
+			      coord_t *coords, float *ratings)
+{
+	assert(using_joseki(b));
+	joseki_cache_t *jc = joseki_cache_update(jd, b, color);
+	int matches = 0;
+
+	foreach_free_point(b) {
+		if (!(jd->colors[c] & (1 << color)))  continue;  /* No pattern here */
+		hash_t h = joseki_cache_point(jc, b, c, color)->h;
+		josekipat_t *p = joseki_lookup_regular_hash(jd, b, c, color, h);
+		if (!p)  continue;
+
+		coords[matches] = c;
+		ratings[matches++] = joseki_rating(b, p);
+	} foreach_free_point_end;
+
+	return append_3x3_matches(jd, b, color, coords, ratings, matches, jc);
 }
 
 void
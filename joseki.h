@@ -36,6 +36,8 @@ typedef struct {
 	josekipat_t *hash[1 << joseki_hash_bits];  /* regular patterns hashtable */
 	josekipat_t *pat_3x3[S_MAX];               /* 3x3 only patterns */
 	josekipat_t *ignored;                      /* ignored patterns (linked list) */
+
+	uint8_t colors[BOARD_MAX_COORDS];          /* colors with regular patterns at each point (bitmask) */
 } joseki_dict_t;
 
 extern joseki_dict_t *joseki_dict;
@@ -52,6 +54,10 @@ josekipat_t *joseki_lookup(joseki_dict_t *jd, board_t *b, coord_t coord, enum st
 josekipat_t *joseki_lookup_ignored(joseki_dict_t *jd, board_t *b, coord_t coord, enum stone color);
 josekipat_t *joseki_lookup_3x3(joseki_dict_t *jd, board_t *b, coord_t coord, enum stone color);
 int  joseki_list_moves(joseki_dict_t *jd, board_t *b, enum stone color, coord_t *coords, float *ratings);
+/* Same as joseki_list_moves(), incremental: spatial hashes come from a
+ * per-thread cache which only recomputes the vicinity of stones that
+ * changed since the last position seen. */
+int  joseki_list_moves_incremental(joseki_dict_t *jd, board_t *b, enum stone color, coord_t *coords, float *ratings);
 void joseki_rate_moves(joseki_dict_t *jd, board_t *b, enum stone color, float *map);
 void get_joseki_best_moves(board_t *b, coord_t *coords, float *ratings, int matches, coord_t *best_c, float *best_r, int nbest);
 void print_joseki_best_moves(board_t *b, coord_t *best_c, float *best_r, int nbest);
@@ -54,6 +54,20 @@ str2coord_for(char *str, int size)
 	return xc - 'a' - (xc > 'i') + 1 + atoi(str + 1) * stride;
 }
 
+/* Sgf point ("dd", "" or "tt" for pass) on a @size board.
+ * Returns resign if it isn't on the board. */
+coord_t
+sgf2coord_for(char *str, int size)
+{
+	if (strlen(str) < 2 || (size <= 19 && !strcmp(str, "tt")))  return pass;
+
+	int x = str[0] - 'a' + 1;
+	int y = size - (str[1] - 'a');
+	if (x < 1 || x > size || y < 1 || y > size)  return resign;
+	int stride = size + 2;
+	return x + y * stride;
+}
+
 coord_t
 str2coord(char *str)
 {
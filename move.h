@@ -35,6 +35,7 @@ char *coord2str(coord_t c);
 char *coord2sstr(coord_t c);
 coord_t str2coord(char *str);
 coord_t str2coord_for(char *str, int size);
+coord_t sgf2coord_for(char *str, int size);
 /* Rotate coordinate according to rot: [0-7] for 8 board symmetries. */
 coord_t rotate_coord(coord_t c, int rot);
 
@@ -54,6 +54,17 @@ ownermap_fill(ownermap_t *ownermap, board_t *b)
 	} foreach_point_end;
 }
 
+/* Add @src counts to @dest. */
+void
+ownermap_merge(board_t *b, ownermap_t *dest, ownermap_t *src)
+{
+	dest->playouts += src->playouts;
+	foreach_point(b) {
+		for (int j = 0; j < S_MAX; j++)
+			dest->map[c][j] += src->map[c][j];
+	} foreach_point_end;
+}
+
 float
 ownermap_estimate_point(ownermap_t *ownermap, coord_t c)
 {
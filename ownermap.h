@@ -47,6 +47,7 @@ typedef struct ownermap {
 void ownermap_init(ownermap_t *ownermap);
 void board_print_ownermap(board_t *b, FILE *f, ownermap_t *ownermap);
 void ownermap_fill(ownermap_t *ownermap, board_t *b);
+void ownermap_merge(board_t *b, ownermap_t *dest, ownermap_t *src);
 
 /* Coord ownermap status: dame / black / white / unclear */
 enum point_judgement ownermap_judge_point(ownermap_t *ownermap, coord_t c, floating_t thres);
@@ -7,6 +7,7 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "batch.h"
 #include "board.h"
 #include "pachi.h"
 #include "debug.h"
@@ -20,6 +21,7 @@
 #include "engines/josekiplay.h"
 #include "engines/dcnn.h"
 #include "t-unit/test.h"
+#include "t-bench/bench.h"
 #include "uct/uct.h"
 #include "distributed/distributed.h"
 #include "gtp.h"
@@ -28,6 +30,7 @@
 #include "random.h"
 #include "version.h"
 #include "network.h"
+#include "server.h"
 #include "uct/tree.h"
 #include "fifo.h"
 #include "dcnn.h"
@@ -36,6 +39,7 @@
 #include "patternsp.h"
 #include "patternprob.h"
 #include "joseki.h"
+#include "telemetry.h"
 
 static void main_loop(gtp_t *gtp, board_t *b, engine_t *e, time_info_t *ti, time_info_t *ti_default);
 
@@ -134,6 +138,14 @@ usage()
 		"  -h, --help                        show usage \n"
 		"  -s, --seed RANDOM_SEED            set random seed \n"
 		"  -u, --unit-test FILE              run unit tests \n"
+		"      --analyze-batch FILE          analyze games in FILE (sgf/gtp game or list of games, one per line) \n"
+		"                                    and exit. json output on stdout, one line per move \n"
+		"      --analyze-jobs N              worker processes for --analyze-batch (default 1) \n"
+		"      --harvest FILE                scan games in FILE for mm training and exit (-e patternscan, \n"
+		"                                    see pattern/README) \n"
+		"      --bench[=THREADS]             run benchmarks and exit. json output on stdout, one line per \n"
+		"                                    result. uct search with 1, 2, 4 ... THREADS (default #cores) \n"
+		"                                    for each thread model (tree, root, hybrid) \n"
 		"  -v, --version                     show version \n"
 		"      --version=VERSION             version to return to gtp frontend \n"
 		"      --name=NAME                   name to return to gtp frontend \n"
@@ -159,8 +171,16 @@ usage()
 		"                                    listen on given port if HOST not given, otherwise \n"
 		"                                    connect to remote host. \n"
 		"  -l, --log-port [HOST:]LOG_PORT    log to remote host instead of stderr \n"
+		"      --server PORT                 gtp server: serve many games at once, one session per \n"
+		"                                    connection. sessions share dictionaries and use \n"
+		"                                    threads=1 unless specified \n"
+		"      --server-sessions N           max concurrent sessions (default 64) \n"
+		"      --server-cpus N               max search threads running at the same time, all \n"
+		"                                    sessions together (default: #cores) \n"
 #endif
 		"  -o  --log-file FILE               log to FILE instead of stderr \n"
+		"      --telemetry FILE[:SECS]       append search telemetry to FILE every SECS seconds (json, \n"
+		"                                    default 10s). see also gtp command pachi-telemetry \n"
 		"      --verbose-caffe               enable caffe logging \n"
 		" \n"
 		"Engine components: \n"
@@ -172,6 +192,11 @@ usage()
 		"Deep learning: \n"
 		"      --dcnn=name                   choose which dcnn to load (default detlef) \n"
 		"      --dcnn=file                   \n"
+		"      --dcnn-cache MB               dcnn evaluation cache size (default 64, 0: disable) \n"
+		"      --dcnn-int8 FILE              use int8 quantized net FILE instead of caffe \n"
+		"      --dcnn-int8-check             run both, report int8 agreement and speed on exit \n"
+		"      --dcnn-quantize FILE          calibrate on positions evaluated during session, \n"
+		"                                    save int8 net to FILE on exit (see t-predict/README) \n"
 		"      --list-dcnns                  show supported networks \n"
 		" \n"
 #endif
@@ -240,13 +265,34 @@ show_version(FILE *s)
 #define OPT_LIST_DCNNS	      270
 #define OPT_ACCURATE_SCORING  271
 #define OPT_KGS_CHAT	      272
+#define OPT_ANALYZE_BATCH     273
+#define OPT_ANALYZE_JOBS      274
+#define OPT_HARVEST           275
+#define OPT_TELEMETRY         276
+#define OPT_BENCH             277
+#define OPT_SERVER            278
+#define OPT_SERVER_SESSIONS   279
+#define OPT_SERVER_CPUS       280
+#define OPT_DCNN_CACHE        281
+#define OPT_DCNN_INT8         282
+#define OPT_DCNN_INT8_CHECK   283
+#define OPT_DCNN_QUANTIZE     284
 
 static struct option longopts[] = {
 	{ "accurate-scoring",   no_argument,       0, OPT_ACCURATE_SCORING },	
+	{ "analyze-batch",      required_argument, 0, OPT_ANALYZE_BATCH },
+	{ "analyze-jobs",       required_argument, 0, OPT_ANALYZE_JOBS },
+	{ "bench",              optional_argument, 0, OPT_BENCH },
 	{ "chatfile",           required_argument, 0, 'c' },
 	{ "compile-flags",      no_argument,       0, OPT_COMPILE_FLAGS },
 	{ "debug-level",        required_argument, 0, 'd' },
 	{ "dcnn",               optional_argument, 0, OPT_DCNN },
+#ifdef DCNN
+	{ "dcnn-cache",         required_argument, 0, OPT_DCNN_CACHE },
+	{ "dcnn-int8",          required_argument, 0, OPT_DCNN_INT8 },
+	{ "dcnn-int8-check",    no_argument,       0, OPT_DCNN_INT8_CHECK },
+	{ "dcnn-quantize",      required_argument, 0, OPT_DCNN_QUANTIZE },
+#endif
 	{ "engine",             required_argument, 0, 'e' },
 	{ "fbook",              required_argument, 0, 'f' },
 	{ "fuseki-time",        required_argument, 0, OPT_FUSEKI_TIME },
@@ -255,6 +301,7 @@ static struct option longopts[] = {
 	{ "gtp-port",           required_argument, 0, 'g' },
 	{ "log-port",           required_argument, 0, 'l' },
 #endif
+	{ "harvest",            required_argument, 0, OPT_HARVEST },
 	{ "help",               no_argument,       0, 'h' },
 	{ "joseki",             no_argument,       0, OPT_JOSEKI },	
 	{ "kgs",                no_argument,       0, OPT_KGS },
@@ -272,6 +319,10 @@ static struct option longopts[] = {
 	{ "patterns",           no_argument,       0, OPT_PATTERNS },
 	{ "rules",              required_argument, 0, 'r' },
 	{ "seed",               required_argument, 0, 's' },
+	{ "server",             required_argument, 0, OPT_SERVER },
+	{ "server-cpus",        required_argument, 0, OPT_SERVER_CPUS },
+	{ "server-sessions",    required_argument, 0, OPT_SERVER_SESSIONS },
+	{ "telemetry",          required_argument, 0, OPT_TELEMETRY },
 	{ "time",               required_argument, 0, 't' },
 	{ "unit-test",          required_argument, 0, 'u' },
 	{ "verbose-caffe",      no_argument,       0, OPT_VERBOSE_CAFFE },
@@ -288,7 +339,15 @@ int main(int argc, char *argv[])
 	time_info_t ti_default = ti_none;
 	int  seed = time(NULL) ^ getpid();
 	char *testfile = NULL;
+	char *batchfile = NULL;
+	char *harvestfile = NULL;
+	int   batch_jobs = 1;
+	bool  bench = false;
+	int   bench_threads = 0;
 	char *log_port = NULL;
+	char *server_port = NULL;
+	int   server_sessions = 64;
+	int   server_cpus = get_nprocessors();
 	char *chatfile = NULL;
 	char *fbookfile = NULL;
 	FILE *file = NULL;
@@ -310,6 +369,19 @@ int main(int argc, char *argv[])
 			case OPT_ACCURATE_SCORING:
 				accurate_scoring_wanted = 2; /* required */
 				break;
+			case OPT_ANALYZE_BATCH:
+				batchfile = strdup(optarg);
+				break;
+			case OPT_ANALYZE_JOBS:
+				batch_jobs = atoi(optarg);
+				break;
+			case OPT_HARVEST:
+				harvestfile = strdup(optarg);
+				break;
+			case OPT_BENCH:
+				bench = true;
+				if (optarg)  bench_threads = atoi(optarg);
+				break;
 			case 'c':
 				chatfile = strdup(optarg);
 				break;
@@ -343,6 +415,19 @@ int main(int argc, char *argv[])
 				if (optarg)  set_dcnn(optarg);
 				require_dcnn();
 				break;
+			case OPT_DCNN_CACHE:
+				if (atoi(optarg) < 0)  die("%s: Invalid --dcnn-cache argument %s\n", argv[0], optarg);
+				dcnn_cache_set_size(atoi(optarg));
+				break;
+			case OPT_DCNN_INT8:
+				dcnn_int8(optarg);
+				break;
+			case OPT_DCNN_INT8_CHECK:
+				dcnn_int8_check();
+				break;
+			case OPT_DCNN_QUANTIZE:
+				dcnn_quantize(optarg);
+				break;
 			case 'f':
 				fbookfile = strdup(optarg);
 				break;
@@ -405,6 +490,26 @@ int main(int argc, char *argv[])
 			case 's':
 				seed = atoi(optarg);
 				break;
+			case OPT_SERVER:
+				server_port = strdup(optarg);
+				break;
+			case OPT_SERVER_CPUS:
+				server_cpus = atoi(optarg);
+				if (server_cpus <= 0)  die("%s: Invalid --server-cpus argument %s\n", argv[0], optarg);
+				break;
+			case OPT_SERVER_SESSIONS:
+				server_sessions = atoi(optarg);
+				if (server_sessions <= 0)  die("%s: Invalid --server-sessions argument %s\n", argv[0], optarg);
+				break;
+			case OPT_TELEMETRY: {
+				char *dumpfile = strdup(optarg), *secs = strrchr(dumpfile, ':');
+				int interval = 10;
+				if (secs) {  *secs = 0;  interval = atoi(secs + 1);  }
+				if (interval <= 0)  die("%s: Invalid --telemetry argument %s\n", argv[0], optarg);
+				telemetry_dump_start(dumpfile, interval);
+				free(dumpfile);
+				break;
+			}
 			case 't':
 				/* Time settings to follow; if specified,
 				 * GTP time information is ignored. Useful
@@ -477,11 +582,38 @@ int main(int argc, char *argv[])
 
 	/* Extra cmdline args are engine parameters */
 	strbuf(buf, 1000);
+	if (server_port && engine_id == E_UCT)	/* Sessions share cpus, see --server-cpus */
+		sbprintf(buf, "threads=1%s", (optind < argc ? "," : ""));
 	for (int i = optind; i < argc; i++)
 		sbprintf(buf, "%s%s", (i == optind ? "" : ","), argv[i]);
 	char *engine_args = buf->str;
 	
+	if (bench) {
+		int r = bench_run(b, bench_threads, engine_args);
+		board_delete(&b);
+		return r;
+	}
 	engine_t e;  engine_init(&e, engine_id, engine_args, b);
+
+	if (batchfile) {
+		int r = batch_analyze(batchfile, batch_jobs, b, &e, &ti_default);
+		engine_done(&e);
+		board_delete(&b);
+		free(batchfile);
+		return r;
+	}
+	if (harvestfile) {
+		int r = patternscan_harvest(&e, b, harvestfile);
+		engine_done(&e);
+		board_delete(&b);
+		free(harvestfile);
+		return r;
+	}
+	if (server_port) {
+		if (gtp_port)  die("--server and --gtp-port are mutually exclusive\n");
+		server_start(server_port, server_sessions, server_cpus);
+		/* Session process from now on. */
+	}
 	network_init();
 
 	while (1) {
@@ -492,9 +624,11 @@ int main(int argc, char *argv[])
 
 	engine_done(&e);
 	board_delete(&b);
+	dcnn_done();
 	chat_done();
 	free(testfile);
 	free(gtp_port);
+	free(server_port);
 	free(log_port);
 	free(chatfile);
 	free(fbookfile);
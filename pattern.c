@@ -2,6 +2,7 @@
 #include <assert.h>
 #include <ctype.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -195,6 +196,8 @@ patterns_init(pattern_config_t *pc, char *arg, bool create, bool load_prob)
 	DEFAULT_PATTERN_CONFIG.spat_min = 3;
 	DEFAULT_PATTERN_CONFIG.spat_max = 10;
 	DEFAULT_PATTERN_CONFIG.spat_largest = false;
+	DEFAULT_PATTERN_CONFIG.incremental = true;
+	DEFAULT_PATTERN_CONFIG.verify_incremental = false;
 	
 	*pc = DEFAULT_PATTERN_CONFIG;
 
@@ -218,6 +221,8 @@ patterns_init(pattern_config_t *pc, char *arg, bool create, bool load_prob)
 			else if (!strcasecmp(optname, "spat_min") && optval)	pc->spat_min = atoi(optval);
 			else if (!strcasecmp(optname, "spat_max") && optval)	pc->spat_max = atoi(optval);
 			else if (!strcasecmp(optname, "spat_largest"))		pc->spat_largest = !optval || atoi(optval);
+			else if (!strcasecmp(optname, "incremental"))		pc->incremental = !optval || atoi(optval);
+			else if (!strcasecmp(optname, "verify_incremental"))	pc->verify_incremental = !optval || atoi(optval);
 			else if (!strcasecmp(optname, "pdict_file") && optval)	pdict_file = optval;
 			else die("patterns: Invalid argument %s or missing value\n", optname);
 		}
@@ -875,6 +880,11 @@ pattern_match_double_snapback(board_t *b, move_t *m)
 #define BOARD_SPATHASH_MAXD 1
 #endif
 
+/* We record all spatial patterns black-to-play; simply
+ * reverse all colors if we are white-to-play. */
+static enum stone bt_black[4] = { S_NONE, S_BLACK, S_WHITE, S_OFFBOARD };
+static enum stone bt_white[4] = { S_NONE, S_WHITE, S_BLACK, S_OFFBOARD };
+
 /* Match spatial features that are too distant to be pre-matched
  * incrementally. Most expensive part of pattern matching, on some
  * archs this is almost 20% genmove time. Any optimization here
@@ -900,10 +910,6 @@ pattern_match_spatial_outer(pattern_config_t *pc,
 			(f++, p->n++);
 	}
 #else  
-	/* We record all spatial patterns black-to-play; simply
-	 * reverse all colors if we are white-to-play. */
-	static enum stone bt_black[4] = { S_NONE, S_BLACK, S_WHITE, S_OFFBOARD };
-	static enum stone bt_white[4] = { S_NONE, S_WHITE, S_BLACK, S_OFFBOARD };
 	enum stone *bt = m->color == S_WHITE ? bt_white : bt_black;
 	int cx = coord_x(m->coord), cy = coord_y(m->coord);
 
@@ -951,6 +957,154 @@ pattern_match_spatial(pattern_config_t *pc,
 	return f;
 }
 
+
+/* Incremental spatial matching: per-thread cache of outer spatial hashes
+ * and matches for each point of the last position seen (one cache for
+ * each color to play). When the next position differs by a few stones
+ * only we patch hashes of points around them and look up again distances
+ * that changed, otherwise cache starts over. Points get matched lazily. */
+
+/* More changes than that and we start over. */
+#define SPATIAL_CACHE_MAX_CHANGES 10
+
+typedef struct {
+	unsigned int gen;			/* Valid if same as cache generation */
+	unsigned int dirty;			/* Look up again from this distance */
+	hash_t       h[MAX_PATTERN_DIST + 1];	/* Outer spatial hash for each distance */
+	spatial_t   *s[MAX_PATTERN_DIST + 1];	/* Matching spatial for each distance (or NULL) */
+} spatial_cache_point_t;
+
+typedef struct {
+	unsigned int gen;
+	int size;
+	unsigned int spat_min, spat_max;
+	spatial_dict_t *dict;
+	enum stone b[BOARD_MAX_COORDS];		/* Position cached points belong to */
+	spatial_cache_point_t p[BOARD_MAX_COORDS];
+} spatial_cache_t;
+
+static __thread spatial_cache_t *spatial_caches = NULL;	/* Black, white to play */
+static pthread_key_t  spatial_cache_key;
+static pthread_once_t spatial_cache_once = PTHREAD_ONCE_INIT;
+
+static void
+spatial_cache_key_init(void)
+{
+	pthread_key_create(&spatial_cache_key, free);	/* Free on thread exit */
+}
+
+static spatial_cache_t *
+spatial_cache(enum stone color)
+{
+	if (unlikely(!spatial_caches)) {
+		pthread_once(&spatial_cache_once, spatial_cache_key_init);
+		spatial_caches = calloc2(2, spatial_cache_t);
+		pthread_setspecific(spatial_cache_key, spatial_caches);
+	}
+	return &spatial_caches[color == S_WHITE];
+}
+
+static void
+spatial_cache_reset(spatial_cache_t *sc, pattern_config_t *pc, board_t *b)
+{
+	sc->gen++;
+	sc->size = board_rsize(b);
+	sc->spat_min = pc->spat_min;
+	sc->spat_max = pc->spat_max;
+	sc->dict = spat_dict;
+	memcpy(sc->b, b->b, sizeof(sc->b));
+}
+
+/* Bring @color cache up to date with @b. */
+static void
+spatial_cache_update(pattern_config_t *pc, board_t *b, enum stone color)
+{
+	spatial_cache_t *sc = spatial_cache(color);
+	if (sc->size != board_rsize(b) || sc->dict != spat_dict ||
+	    sc->spat_min != pc->spat_min || sc->spat_max != pc->spat_max) {
+		spatial_cache_reset(sc, pc, b);
+		return;
+	}
+
+	coord_t changed[SPATIAL_CACHE_MAX_CHANGES];
+	int n = 0;
+	foreach_point(b) {
+		if (sc->b[c] == board_at(b, c))  continue;
+		if (n == SPATIAL_CACHE_MAX_CHANGES) {  spatial_cache_reset(sc, pc, b);  return;  }
+		changed[n++] = c;
+	} foreach_point_end;
+
+	enum stone *bt = (color == S_WHITE ? bt_white : bt_black);
+	for (int i = 0; i < n; i++) {
+		coord_t c = changed[i];
+		int cx = coord_x(c), cy = coord_y(c);
+		for (unsigned int d = BOARD_SPATHASH_MAXD + 1; d <= pc->spat_max; d++)
+			for (unsigned int j = ptind[d]; j < ptind[d + 1]; j++) {
+				/* Point which sees c at offset j */
+				int x = cx - ptcoords[j].x, y = cy - ptcoords[j].y;
+				if (x < 1 || x > sc->size || y < 1 || y > sc->size)  continue;
+				spatial_cache_point_t *p = &sc->p[coord_xy(x, y)];
+				if (p->gen != sc->gen)  continue;
+
+				hash_t delta = pthashes[0][j][bt[sc->b[c]]] ^ pthashes[0][j][bt[board_at(b, c)]];
+				for (unsigned int d2 = d; d2 <= pc->spat_max; d2++)
+					p->h[d2] ^= delta;
+				p->dirty = MIN(p->dirty, d);
+			}
+		sc->b[c] = board_at(b, c);
+	}
+}
+
+/* Same as pattern_match_spatial(), using the cache. */
+static feature_t *
+pattern_match_spatial_cached(pattern_config_t *pc,
+			     pattern_t *pattern, feature_t *f,
+			     board_t *b, move_t *m)
+{
+	if (pc->spat_max <= 0 || !spat_dict)  return f;
+	assert(pc->spat_min > 0);
+	feature_t *orig_f = f;
+	f->id = FEAT_NO_SPATIAL;
+	f->payload = 0;
+
+	spatial_cache_t *sc = spatial_cache(m->color);
+	spatial_cache_point_t *p = &sc->p[m->coord];
+	if (p->gen != sc->gen) {  /* New point, compute hashes */
+		enum stone *bt = (m->color == S_WHITE ? bt_white : bt_black);
+		int cx = coord_x(m->coord), cy = coord_y(m->coord);
+		hash_t h = pthashes[0][0][S_NONE];
+		for (unsigned int d = BOARD_SPATHASH_MAXD + 1; d <= pc->spat_max; d++) {
+			for (unsigned int j = ptind[d]; j < ptind[d + 1]; j++) {
+				ptcoords_at(x, y, cx, cy, j);
+				h ^= pthashes[0][j][bt[board_atxy(b, x, y)]];
+			}
+			p->h[d] = h;
+		}
+		p->gen = sc->gen;
+		p->dirty = 0;
+	}
+
+	unsigned int dmin = MAX(BOARD_SPATHASH_MAXD + 1, pc->spat_min);
+	unsigned int dirty = MAX(dmin, p->dirty);
+	for (unsigned int d = dirty; d <= pc->spat_max; d++)
+		p->s[d] = spatial_dict_lookup(spat_dict, d, p->h[d]);
+	p->dirty = MAX_PATTERN_DIST + 1;
+
+	for (unsigned int d = dmin; d <= pc->spat_max; d++) {
+		spatial_t *s = p->s[d];
+		if (!s)  continue;
+
+		/* Record spatial feature, one per distance. */
+		f->id = (enum feature_id)(FEAT_SPATIAL3 + d - 3);
+		f->payload = spatial_id(s, spat_dict);
+		if (!pc->spat_largest)
+			(f++, pattern->n++);
+	}
+	if (pc->spat_largest && f->id >= FEAT_SPATIAL)		(f++, pattern->n++);
+	if (f == orig_f) /* FEAT_NO_SPATIAL */			(f++, pattern->n++);
+	return f;
+}
+
 static int
 pattern_match_mcowner(board_t *b, move_t *m, ownermap_t *o)
 {
@@ -963,15 +1117,27 @@ static void
 mcowner_playouts_(board_t *b, enum stone color, ownermap_t *ownermap, int playouts)
 {
 	static playout_policy_t *policy = NULL;
+	static pthread_mutex_t policy_lock = PTHREAD_MUTEX_INITIALIZER;
 	playout_setup_t setup = playout_setup(MAX_GAMELEN, 0);
 	
-	if (!policy)  policy = playout_moggy_init(NULL, b);
+	/* May be called from multiple threads (patternscan harvest):
+	 * policy must be fully initialized before other threads see it. */
+	playout_policy_t *p = __atomic_load_n(&policy, __ATOMIC_ACQUIRE);
+	if (!p) {
+		pthread_mutex_lock(&policy_lock);
+		p = policy;
+		if (!p) {
+			p = playout_moggy_init(NULL, b);
+			__atomic_store_n(&policy, p, __ATOMIC_RELEASE);
+		}
+		pthread_mutex_unlock(&policy_lock);
+	}
 	ownermap_init(ownermap);
 	
 	for (int i = 0; i < playouts; i++)  {
 		board_t b2;
 		board_copy(&b2, b);		
-		playout_play_game(&setup, &b2, color, NULL, ownermap, policy);
+		playout_play_game(&setup, &b2, color, NULL, ownermap, p);
 		board_done(&b2);
 	}
 	//fprintf(stderr, "pattern ownermap:\n");
@@ -1083,7 +1249,7 @@ pattern_match_vanilla(pattern_config_t *pc, pattern_t *pattern, board_t *b,
 /* TODO: We should match pretty much all of these features incrementally. */
 static void
 pattern_match_internal(pattern_config_t *pc, pattern_t *pattern, board_t *b,
-		       move_t *m, ownermap_t *ownermap, bool locally)
+		       move_t *m, ownermap_t *ownermap, bool locally, bool cached)
 {
 #ifdef PATTERN_FEATURE_STATS
 	dump_feature_stats(pc);
@@ -1133,14 +1299,90 @@ pattern_match_internal(pattern_config_t *pc, pattern_t *pattern, board_t *b,
 	}
 	check_feature(pattern_match_mcowner(b, m, ownermap), FEAT_MCOWNER);
 
-	f = pattern_match_spatial(pc, pattern, f, b, m);
+	if (cached)  f = pattern_match_spatial_cached(pc, pattern, f, b, m);
+	else         f = pattern_match_spatial(pc, pattern, f, b, m);
+}
+
+/* Quiet move: enough liberties for the new stone and no group with less
+ * than 4 liberties around. All tactical features need a group short of
+ * liberties next to the move (or diagonal for net) to match, or a ko,
+ * so they can't match here. */
+static bool
+move_is_quiet(board_t *b, move_t *m)
+{
+	coord_t coord = m->coord;
+	if (coord == b->last_ko.coord)  return false;
+
+	int libs = immediate_liberty_count(b, coord);
+	if (libs < 2)  return false;
+	if (libs == 2 && !neighbor_count_at(b, coord, m->color))  return false;
+
+	int x = coord_x(coord), y = coord_y(coord);
+	for (int dx = -2; dx <= 2; dx++)
+		for (int dy = abs(dx) - 2; dy <= 2 - abs(dx); dy++) {
+			if (x + dx < 0 || x + dx >= board_stride(b) ||
+			    y + dy < 0 || y + dy >= board_stride(b))  continue;
+			coord_t c = coord_xy(x + dx, y + dy);
+			if (board_at(b, c) != S_BLACK && board_at(b, c) != S_WHITE)  continue;
+			if (board_group_info(b, group_at(b, c)).libs < 4)  return false;
+		}
+	return true;
+}
+
+static void
+pattern_match_quiet(pattern_config_t *pc, pattern_t *pattern, board_t *b,
+		    move_t *m, ownermap_t *ownermap, bool locally)
+{
+	feature_t *f = &pattern->f[0];
+	int p;  /* payload */
+	pattern->n = 0;
+
+	check_feature(pattern_match_border(b, m, pc), FEAT_BORDER);
+	if (locally) {
+		check_feature(pattern_match_distance(b, m), FEAT_DISTANCE);
+		check_feature(pattern_match_distance2(b, m), FEAT_DISTANCE2);
+	}
+	check_feature(pattern_match_mcowner(b, m, ownermap), FEAT_MCOWNER);
+
+	f = pattern_match_spatial_cached(pc, pattern, f, b, m);
+}
+
+void
+pattern_match_incremental_begin(pattern_config_t *pc, board_t *b, enum stone color)
+{
+	spatial_cache_update(pc, b, color);
+}
+
+void
+pattern_match_incremental(pattern_config_t *pc, pattern_t *p, board_t *b,
+			  move_t *m, ownermap_t *ownermap, bool locally)
+{
+	assert(!is_pass(m->coord));   assert(!is_resign(m->coord));
+	if (move_is_quiet(b, m))  pattern_match_quiet(pc, p, b, m, ownermap, locally);
+	else                      pattern_match_internal(pc, p, b, m, ownermap, locally, true);
+
+	if (pc->verify_incremental) {
+		pattern_t p2;
+		pattern_match_internal(pc, &p2, b, m, ownermap, locally, false);
+		if (!pattern_eq(p, &p2)) {
+			char s1[512], s2[512];
+			pattern2str(s1, p);  pattern2str(s2, &p2);
+			board_print(b, stderr);
+			die("pattern_match_incremental(): %s %s: got %s, expected %s\n",
+			    stone2str(m->color), coord2sstr(m->coord), s1, s2);
+		}
+	}
+
+#ifdef PATTERN_FEATURE_STATS
+	add_feature_stats(p);
+#endif
 }
 
 void
 pattern_match(pattern_config_t *pc, pattern_t *p, board_t *b,
 	      move_t *m, ownermap_t *ownermap, bool locally)
 {
-	pattern_match_internal(pc, p, b, m, ownermap, locally);
+	pattern_match_internal(pc, p, b, m, ownermap, locally, false);
 	
 	/* Debugging */
 	//if (pattern_has_feature(p, FEAT_ATARI, PF_ATARI_AND_CAP))  show_move(b, m, "atari_and_cap");
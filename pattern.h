@@ -158,6 +158,14 @@ typedef struct {
 	/* Produce only a single spatial feature per pattern, corresponding
 	 * to the largest matched spatial pattern. */
 	bool spat_largest;
+
+	/* Incremental matching in pattern_rate_moves_fast(): reuse spatial
+	 * matches of the last position the thread saw, and skip tactical
+	 * features for quiet moves (see pattern_match_incremental()). */
+	bool incremental;
+	/* Check each incremental match against full matching, die if
+	 * they differ. Slow, for testing. */
+	bool verify_incremental;
 } pattern_config_t;
 
 
@@ -187,6 +195,14 @@ static bool pattern_eq(pattern_t *p1, pattern_t *p2);
 /* Initialize p and fill it with features matched by the given board move. 
  * @locally: Looking for local moves ? Distance features disabled if false. */
 void pattern_match(pattern_config_t *pc, pattern_t *p, board_t *b, move_t *m, ownermap_t *ownermap, bool locally);
+/* Same as pattern_match(), but incremental: spatial features are matched
+ * from a per-thread cache which only recomputes the vicinity of stones
+ * that changed since the last position seen, and tactical features are
+ * skipped for quiet moves (no group short of liberties around) where they
+ * can't match. Gives the same patterns as pattern_match().
+ * pattern_match_incremental_begin() must be called for each new position. */
+void pattern_match_incremental_begin(pattern_config_t *pc, board_t *b, enum stone color);
+void pattern_match_incremental(pattern_config_t *pc, pattern_t *p, board_t *b, move_t *m, ownermap_t *ownermap, bool locally);
 /* For testing purposes: no prioritized features, check every feature. */
 void pattern_match_vanilla(pattern_config_t *pc, pattern_t *p, board_t *b, move_t *m, ownermap_t *ownermap);
 
@@ -11,132 +11,176 @@
 #include <iomanip>
 #include <sstream>
 #include <vector>
-#include <map>
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <thread>
+#include <chrono>
+#include <unistd.h>
 #include <assert.h>
 
 const double PriorVictories = 1.0;
 const double PriorGames = 2.0;
 const double PriorOpponentGamma = 1.0;
 
-/////////////////////////////////////////////////////////////////////////////
-// One "team": product of gammas
-/////////////////////////////////////////////////////////////////////////////
-class CTeam
-{
- private: ///////////////////////////////////////////////////////////////////
-  static std::vector<int> vi;
-  int Index;
-  int Size;
-
- public: ////////////////////////////////////////////////////////////////////
-  CTeam(): Index(vi.size()), Size(0) {}
-  int GetSize() const {return Size;}
-  int GetIndex(int i) const {return vi[Index+i];}
-  void Append(int i) {vi.push_back(i); Size++;}
-};
-
-std::vector<int> CTeam::vi;
-
-int
-gamma_to_feature(int gamma, std::vector<int> &vFeatureIndex)
-{
-	for (unsigned int i = 0; i < vFeatureIndex.size(); i++) {
-		if (vFeatureIndex[i] > gamma)
-			return i;
-	}
-	return vFeatureIndex.size();
-}
-
-/////////////////////////////////////////////////////////////////////////////
-// Read a team
-/////////////////////////////////////////////////////////////////////////////
-CTeam ReadTeam(std::string &s, std::vector<int> &vFeatureIndex, int Gammas)
-{
- std::istringstream in(s);
- CTeam team;
- int Index;
- while(1)
- {
-  in >> Index;
-  if (Index < 0 || Index >= Gammas) {
-	  std::cerr << '\n' << s << '\n';
-	  fprintf(stderr, "invalid gamma: %i\n", Index);
-	  assert(0);
-  }
-  if (in) {
-	  int feature = gamma_to_feature(Index, vFeatureIndex);
-	  for (int i = team.GetSize(); --i >= 0;) {
-		  if (feature == gamma_to_feature(team.GetIndex(i), vFeatureIndex)) {
-			  std::cerr << '\n' << s << '\n';
-			  fprintf(stderr, "%i and %i are same feature !\n", Index, team.GetIndex(i));
-			  assert(0);
-		  }
-	  }
-	  team.Append(Index);
-  }
-  else
-   break;
- }
- return team;
-}
+//
+// Binary team format (see WriteBinaryHeader() / WriteBinaryGame())
+//
+const char BinaryMagic[8] = {'M', 'M', 'T', 'E', 'A', 'M', 'S', '1'};
 
 /////////////////////////////////////////////////////////////////////////////
-// One "Game": One winner team out of several participants
+// One "Game": One winner team out of several participants.
+// Only used while reading, teams are flattened into gammas + team sizes.
 /////////////////////////////////////////////////////////////////////////////
 class CGame
 {
  public: ////////////////////////////////////////////////////////////////////
-  CTeam Winner;
-  std::vector<CTeam> vParticipants;
+  std::vector<int> vIndex;      // gammas of all teams, winner first
+  std::vector<int> vTeamSize;   // size of each team, winner first
+
+  void Clear() {vIndex.clear(); vTeamSize.clear();}
+  int GetTeams() const {return vTeamSize.size();}
 };
 
 /////////////////////////////////////////////////////////////////////////////
-// Game Collection:
+// Game Collection, columnar layout:
+//  team t has gammas vIndex[vTeamStart[t] .. vTeamStart[t + 1] - 1]
+//  game g has winner team vGameStart[g], and participants
+//  vGameStart[g] + 1 .. vGameStart[g + 1] - 1
 /////////////////////////////////////////////////////////////////////////////
 class CGameCollection
 {
  public: ////////////////////////////////////////////////////////////////////
-  std::vector<CGame> vgame;
+  std::vector<int> vIndex;
+  std::vector<unsigned> vTeamStart;
+  std::vector<unsigned> vGameStart;
   std::vector<double> vGamma;
   std::vector<int> vFeatureIndex;
+  std::vector<int> vGammaFeature;
   std::vector<std::string> vFeatureName;
   std::vector<double> vVictories;
   std::vector<int> vParticipations;
   std::vector<int> vPresences;
+  int Threads;
+
+  CGameCollection(): vTeamStart(1, 0), vGameStart(1, 0), Threads(1) {}
+
+  int GetGames() const {return vGameStart.size() - 1;}
+  void SetGammas(int Gammas);
+  void AddFeature(int Gammas, const std::string &sName);
+  void CheckGame(const CGame &game) const;
+  void AddGame(const CGame &game);
 
   void ComputeVictories();
   void MM(int Feature);
   double LogLikelihood() const;
 
-  double GetTeamGamma(const CTeam &team) const
+  //
+  // Run f(Thread, Begin, End) over games, one slice per thread
+  //
+  template<class F> void Parallel(F f) const
   {
-   double Result = 1.0;
-   for (int i = team.GetSize(); --i >= 0;)
-    Result *= vGamma[team.GetIndex(i)];
-   return Result;
+   long long Games = GetGames();
+   std::vector<std::thread> vThread;
+   for (int t = 1; t < Threads; t++)
+    vThread.push_back(std::thread(f, t, int(Games * t / Threads),
+                                        int(Games * (t + 1) / Threads)));
+   f(0, 0, int(Games / Threads));
+   for (unsigned t = 0; t < vThread.size(); t++)
+    vThread[t].join();
   }
 };
 
+void CGameCollection::SetGammas(int Gammas)
+{
+ vGamma.assign(Gammas, 1.0);
+ vGammaFeature.assign(Gammas, -1);
+ vFeatureIndex.assign(1, 0);
+}
+
+void CGameCollection::AddFeature(int Gammas, const std::string &sName)
+{
+ int Min = vFeatureIndex.back();
+ vFeatureIndex.push_back(Min + Gammas);
+ vFeatureName.push_back(sName);
+ for (int i = Min; i < Min + Gammas && i < int(vGamma.size()); i++)
+  vGammaFeature[i] = vFeatureName.size() - 1;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Check gammas are valid and there's at most one gamma per feature in
+// each team.
+/////////////////////////////////////////////////////////////////////////////
+void CGameCollection::CheckGame(const CGame &game) const
+{
+ int Start = 0;
+ for (int t = 0; t < game.GetTeams(); t++)
+ {
+  int End = Start + game.vTeamSize[t];
+  for (int i = Start; i < End; i++)
+  {
+   int Index = game.vIndex[i];
+   if (Index < 0 || Index >= int(vGamma.size()))
+   {
+    fprintf(stderr, "invalid gamma: %i\n", Index);
+    assert(0);
+    exit(1);
+   }
+   for (int j = Start; j < i; j++)
+    if (vGammaFeature[Index] == vGammaFeature[game.vIndex[j]])
+    {
+     fprintf(stderr, "%i and %i are same feature !\n", Index, game.vIndex[j]);
+     assert(0);
+     exit(1);
+    }
+  }
+  Start = End;
+ }
+}
+
+void CGameCollection::AddGame(const CGame &game)
+{
+ vIndex.insert(vIndex.end(), game.vIndex.begin(), game.vIndex.end());
+ for (int t = 0; t < game.GetTeams(); t++)
+  vTeamStart.push_back(vTeamStart.back() + game.vTeamSize[t]);
+ vGameStart.push_back(vTeamStart.size() - 1);
+}
+
 /////////////////////////////////////////////////////////////////////////////
 // Compute log likelihood
 /////////////////////////////////////////////////////////////////////////////
 double CGameCollection::LogLikelihood() const
 {
- double L = 0;
+ std::vector<double> vL(Threads, 0.0);
 
- for (int i = vgame.size(); --i >= 0;)
+ Parallel([&](int Thread, int Begin, int End)
  {
-  const CGame &game = vgame[i];
-  double Opponents = 0; 
-  const std::vector<CTeam> &v = game.vParticipants;
-  for (int j = v.size(); --j >= 0;)
-   Opponents += GetTeamGamma(v[j]);
-  L += std::log(GetTeamGamma(game.Winner));
-  L -= std::log(Opponents);
- }
+  double L = 0;
+  for (int g = Begin; g < End; g++)
+  {
+   double Opponents = 0;
+   double Winner = 0;
+   for (unsigned t = vGameStart[g]; t < vGameStart[g + 1]; t++)
+   {
+    double Product = 1.0;
+    for (unsigned i = vTeamStart[t]; i < vTeamStart[t + 1]; i++)
+     Product *= vGamma[vIndex[i]];
+    if (t == vGameStart[g])
+     Winner = Product;
+    else
+     Opponents += Product;
+   }
+   L += std::log(Winner);
+   L -= std::log(Opponents);
+  }
+  vL[Thread] = L;
+ });
 
+ double L = 0;
+ for (int t = 0; t < Threads; t++)
+  L += vL[t];
  return L;
 }
 
@@ -145,44 +189,50 @@ double CGameCollection::LogLikelihood() const
 /////////////////////////////////////////////////////////////////////////////
 void CGameCollection::ComputeVictories()
 {
- vVictories.resize(vGamma.size());
- vParticipations.resize(vGamma.size());
- vPresences.resize(vGamma.size());
-
- for (int i = vVictories.size(); --i >= 0;)
- {
-  vVictories[i] = 0;
-  vParticipations[i] = 0;
-  vPresences[i] = 0;
- }
+ int Gammas = vGamma.size();
+ std::vector<std::vector<double> > vThreadVictories(Threads);
+ std::vector<std::vector<int> > vThreadParticipations(Threads);
+ std::vector<std::vector<int> > vThreadPresences(Threads);
 
- for (int i = vgame.size(); --i >= 0;)
+ Parallel([&](int Thread, int Begin, int End)
  {
-  const CTeam &Winner = vgame[i].Winner;
-  for (int j = Winner.GetSize(); --j >= 0;)
-   vVictories[Winner.GetIndex(j)]++;
-
-  int tParticipations[vGamma.size()];
-  for (int j = vGamma.size(); --j >= 0;)
-   tParticipations[j] = 0;
+  std::vector<double> &vV = vThreadVictories[Thread];
+  std::vector<int> &vP = vThreadParticipations[Thread];
+  std::vector<int> &vPr = vThreadPresences[Thread];
+  vV.assign(Gammas, 0.0);
+  vP.assign(Gammas, 0);
+  vPr.assign(Gammas, 0);
+  std::vector<int> vLastGame(Gammas, -1);
+
+  for (int g = Begin; g < End; g++)
+  {
+   unsigned Winner = vGameStart[g];
+   for (unsigned i = vTeamStart[Winner]; i < vTeamStart[Winner + 1]; i++)
+    vV[vIndex[i]]++;
 
-  for (int k = vgame[i].vParticipants.size(); --k >= 0;)
-   for (int j = vgame[i].vParticipants[k].GetSize(); --j >= 0;)
+   for (unsigned i = vTeamStart[Winner + 1]; i < vTeamStart[vGameStart[g + 1]]; i++)
    {
-    int Index = vgame[i].vParticipants[k].GetIndex(j);
-    vParticipations[Index]++;
-    tParticipations[Index]++;
+    int Index = vIndex[i];
+    vP[Index]++;
+    if (vLastGame[Index] != g)
+    {
+     vLastGame[Index] = g;
+     vPr[Index]++;
+    }
    }
+  }
+ });
 
-  for (int i = vGamma.size(); --i >= 0;)
-   if (tParticipations[i])
-    vPresences[i]++;
- }
-
-#if 0
- for (int i = vGamma.size(); --i >= 0;)
-  std::cerr << i << ' ' << vVictories[i] << '\n';
-#endif
+ vVictories.assign(Gammas, 0.0);
+ vParticipations.assign(Gammas, 0);
+ vPresences.assign(Gammas, 0);
+ for (int t = 0; t < Threads; t++)
+  for (int i = 0; i < Gammas; i++)
+  {
+   vVictories[i] += vThreadVictories[t][i];
+   vParticipations[i] += vThreadParticipations[t][i];
+   vPresences[i] += vThreadPresences[t][i];
+  }
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -195,89 +245,105 @@ void CGameCollection::MM(int Feature)
  //
  int Max = vFeatureIndex[Feature + 1];
  int Min = vFeatureIndex[Feature];
+ int Size = Max - Min;
 
  //
- // Compute denominator for each gamma
+ // Compute denominator for each gamma, one partial sum per thread
  //
- std::vector<double> vDen(vGamma.size());
- for (int i = vDen.size(); --i >= 0;)
-  vDen[i] = 0.0;
+ std::vector<std::vector<double> > vThreadDen(Threads);
 
  //
  // Main loop over games
  //
- std::map<int,double> tMul;
- for (int i = vgame.size(); --i >= 0;)
+ Parallel([&](int Thread, int Begin, int End)
  {
-  //double tMul[vGamma.size()];
-  //{
-  // for (int i = vGamma.size(); --i >= 0;)
-  //  tMul[i] = 0.0;
-  //}
-  tMul.clear();
+  std::vector<double> &vDen = vThreadDen[Thread];
+  vDen.assign(Size, 0.0);
+  std::vector<double> tMul(Size, 0.0);
+  std::vector<int> vTouched;
 
-  double Den = 0.0;
-
-  std::vector<CTeam> &v = vgame[i].vParticipants;
-  for (int i = v.size(); --i >= 0;)
+  for (int g = Begin; g < End; g++)
   {
-   const CTeam &team = v[i];
+   double Den = 0.0;
 
-   double Product = 1.0;
-   int FeatureIndex = -1;
-
-   for (int i = 0; i < team.GetSize(); i++)
+   for (unsigned t = vGameStart[g] + 1; t < vGameStart[g + 1]; t++)
    {
-    int Index = team.GetIndex(i);
-    if (Index >= Min && Index < Max)
-     FeatureIndex = Index;
-    else
-     Product *= vGamma[Index];
+    double Product = 1.0;
+    int FeatureIndex = -1;
+
+    for (unsigned i = vTeamStart[t]; i < vTeamStart[t + 1]; i++)
+    {
+     int Index = vIndex[i];
+     if (Index >= Min && Index < Max)
+      FeatureIndex = Index;
+     else
+      Product *= vGamma[Index];
+    }
+
+    if (FeatureIndex >= 0)
+    {
+     int k = FeatureIndex - Min;
+     if (tMul[k] == 0.0)
+      vTouched.push_back(k);
+     tMul[k] += Product;
+     Product *= vGamma[FeatureIndex];
+    }
+
+    Den += Product;
    }
 
-   if (FeatureIndex >= 0)
+   for (unsigned j = 0; j < vTouched.size(); j++)
    {
-    //tMul[FeatureIndex] += Product;
-    if (tMul.count(FeatureIndex))
-    	tMul[FeatureIndex] += Product;
-    else
-	tMul[FeatureIndex]=Product;
-    
-    Product *= vGamma[FeatureIndex];
+    int k = vTouched[j];
+    vDen[k] += tMul[k] / Den;
+    tMul[k] = 0.0;
    }
-
-   Den += Product;
+   vTouched.clear();
   }
-
-  //for (int i = Max; --i >= Min;)
-  // vDen[i] += tMul[i] / Den;
-  for (std::map<int,double>::iterator it=tMul.begin();it!=tMul.end();++it)
-  {
-   int key=it->first;
-   vDen[key]+=it->second / Den;
-  }
- }
+ });
 
  //
  // Update Gammas
  //
  for (int i = Max; --i >= Min;)
  {
+  double Den = 0.0;
+  for (int t = 0; t < Threads; t++)
+   Den += vThreadDen[t][i - Min];
   double NewGamma = (vVictories[i] + PriorVictories) /
-                    (vDen[i] + PriorGames / (vGamma[i] + PriorOpponentGamma));
+                    (Den + PriorGames / (vGamma[i] + PriorOpponentGamma));
   vGamma[i] = NewGamma;
  }
 }
 
 /////////////////////////////////////////////////////////////////////////////
-// Read game collection
+// Read a team
 /////////////////////////////////////////////////////////////////////////////
-void ReadGameCollection(CGameCollection &gcol, std::istream &in)
+static void ReadTeam(const std::string &s, CGame &game)
+{
+ const char *p = s.c_str();
+ int Size = 0;
+ while (1)
+ {
+  char *End;
+  long Index = strtol(p, &End, 10);
+  if (End == p)
+   break;
+  game.vIndex.push_back(Index);
+  Size++;
+  p = End;
+ }
+ game.vTeamSize.push_back(Size);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Read text game collection header
+/////////////////////////////////////////////////////////////////////////////
+static void ReadTextHeader(CGameCollection &gcol, std::istream &in)
 {
  //
  // Read number of gammas in the first line
  //
- int MaxGamma;
  {
   std::string sLine;
   std::getline(in, sLine);
@@ -285,34 +351,32 @@ void ReadGameCollection(CGameCollection &gcol, std::istream &in)
   std::string s;
   int Gammas = 0;
   is >> s >> Gammas;
-  MaxGamma = Gammas;
-  gcol.vGamma.resize(Gammas);
-  for (int i = Gammas; --i >= 0;)
-   gcol.vGamma[i] = 1.0;
+  gcol.SetGammas(Gammas);
  }
 
  //
  // Features
  //
  {
-  gcol.vFeatureIndex.push_back(0);
   int Features = 0;
   in >> Features;
   for (int i = 0; i < Features; i++)
   {
    int Gammas;
    in >> Gammas;
-   int Min = gcol.vFeatureIndex.back();
-   gcol.vFeatureIndex.push_back(Min + Gammas);
    std::string sName;
    in >> sName;
-   gcol.vFeatureName.push_back(sName);
+   gcol.AddFeature(Gammas, sName);
   }
  }
+}
 
- //
- // Main loop over games
- //
+/////////////////////////////////////////////////////////////////////////////
+// Read text games one at a time, call Sink(game) for each
+/////////////////////////////////////////////////////////////////////////////
+template<class F> static void ReadTextGames(const CGameCollection &gcol, std::istream &in, F Sink)
+{
+ CGame game;
  std::string sLine;
  std::getline(in, sLine);
 
@@ -323,13 +387,13 @@ void ReadGameCollection(CGameCollection &gcol, std::istream &in)
   //
   if (sLine == "#")
   {
-   CGame game;
+   game.Clear();
 
    //
    // Winner
    //
    std::getline(in, sLine);
-   game.Winner = ReadTeam(sLine, gcol.vFeatureIndex, MaxGamma);
+   ReadTeam(sLine, game);
 
    //
    // Participants
@@ -337,12 +401,12 @@ void ReadGameCollection(CGameCollection &gcol, std::istream &in)
    std::getline(in, sLine);
    while (sLine[0] != '#' && sLine[0] != '!' && in)
    {
-    CTeam team = ReadTeam(sLine, gcol.vFeatureIndex, MaxGamma);
-    game.vParticipants.push_back(team);
+    ReadTeam(sLine, game);
     std::getline(in, sLine);
    }
 
-   gcol.vgame.push_back(game);
+   gcol.CheckGame(game);
+   Sink(game);
   }
   else
   {
@@ -353,6 +417,191 @@ void ReadGameCollection(CGameCollection &gcol, std::istream &in)
  std::cerr << '\n';
 }
 
+/////////////////////////////////////////////////////////////////////////////
+// Binary format:
+//  magic, int32 gammas, int32 features,
+//  for each feature: int32 gammas, int32 name length, name
+//  then for each game: varint teams, and for each team (winner first):
+//  varint size, followed by varint gammas.
+/////////////////////////////////////////////////////////////////////////////
+static void WriteVarint(std::ostream &out, unsigned v)
+{
+ char buf[5];
+ int n = 0;
+ while (v >= 0x80)
+ {
+  buf[n++] = char(v | 0x80);
+  v >>= 7;
+ }
+ buf[n++] = char(v);
+ out.write(buf, n);
+}
+
+static void WriteInt32(std::ostream &out, int v)
+{
+ out.write((const char*)&v, sizeof(v));
+}
+
+static void WriteBinaryHeader(const CGameCollection &gcol, std::ostream &out)
+{
+ out.write(BinaryMagic, sizeof(BinaryMagic));
+ WriteInt32(out, gcol.vGamma.size());
+ WriteInt32(out, gcol.vFeatureName.size());
+ for (unsigned i = 0; i < gcol.vFeatureName.size(); i++)
+ {
+  WriteInt32(out, gcol.vFeatureIndex[i + 1] - gcol.vFeatureIndex[i]);
+  WriteInt32(out, gcol.vFeatureName[i].size());
+  out.write(gcol.vFeatureName[i].data(), gcol.vFeatureName[i].size());
+ }
+}
+
+static void WriteBinaryGame(const CGame &game, std::ostream &out)
+{
+ WriteVarint(out, game.GetTeams());
+ int i = 0;
+ for (int t = 0; t < game.GetTeams(); t++)
+ {
+  WriteVarint(out, game.vTeamSize[t]);
+  for (int End = i + game.vTeamSize[t]; i < End; i++)
+   WriteVarint(out, game.vIndex[i]);
+ }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Buffered reader for binary input
+/////////////////////////////////////////////////////////////////////////////
+class CBinaryReader
+{
+ private: ///////////////////////////////////////////////////////////////////
+  std::istream &in;
+  std::vector<char> vBuffer;
+  size_t Pos, Len;
+
+  bool Fill()
+  {
+   in.read(&vBuffer[0], vBuffer.size());
+   Len = in.gcount();
+   Pos = 0;
+   return Len > 0;
+  }
+
+ public: ////////////////////////////////////////////////////////////////////
+  CBinaryReader(std::istream &is): in(is), vBuffer(1 << 20), Pos(0), Len(0) {}
+
+  bool Read(void *p, size_t n)
+  {
+   char *s = (char*)p;
+   while (n)
+   {
+    if (Pos == Len && !Fill())
+     return false;
+    size_t k = std::min(n, Len - Pos);
+    memcpy(s, &vBuffer[Pos], k);
+    Pos += k; s += k; n -= k;
+   }
+   return true;
+  }
+
+  int ReadInt32()
+  {
+   int v = 0;
+   if (!Read(&v, sizeof(v)))
+   {
+    fprintf(stderr, "truncated binary input\n");
+    exit(1);
+   }
+   return v;
+  }
+
+  bool ReadVarint(unsigned &v)
+  {
+   v = 0;
+   for (int Shift = 0; ; Shift += 7)
+   {
+    if (Pos == Len && !Fill())
+     return false;
+    unsigned char c = vBuffer[Pos++];
+    v |= unsigned(c & 0x7f) << Shift;
+    if (!(c & 0x80))
+     return true;
+   }
+  }
+};
+
+static void ReadBinaryHeader(CGameCollection &gcol, CBinaryReader &reader)
+{
+ char Magic[sizeof(BinaryMagic)];
+ if (!reader.Read(Magic, sizeof(Magic)) || memcmp(Magic, BinaryMagic, sizeof(Magic)))
+ {
+  fprintf(stderr, "bad binary input\n");
+  exit(1);
+ }
+
+ gcol.SetGammas(reader.ReadInt32());
+ int Features = reader.ReadInt32();
+ for (int i = 0; i < Features; i++)
+ {
+  int Gammas = reader.ReadInt32();
+  std::string sName(reader.ReadInt32(), ' ');
+  reader.Read(&sName[0], sName.size());
+  gcol.AddFeature(Gammas, sName);
+ }
+}
+
+template<class F> static void ReadBinaryGames(const CGameCollection &gcol, CBinaryReader &reader, F Sink)
+{
+ CGame game;
+ unsigned Teams;
+ while (reader.ReadVarint(Teams))
+ {
+  game.Clear();
+  for (unsigned t = 0; t < Teams; t++)
+  {
+   unsigned Size, Index;
+   if (!reader.ReadVarint(Size))
+   {
+    fprintf(stderr, "truncated binary input\n");
+    exit(1);
+   }
+   game.vTeamSize.push_back(Size);
+   for (unsigned i = 0; i < Size; i++)
+   {
+    if (!reader.ReadVarint(Index))
+    {
+     fprintf(stderr, "truncated binary input\n");
+     exit(1);
+    }
+    game.vIndex.push_back(Index);
+   }
+  }
+  gcol.CheckGame(game);
+  Sink(game);
+ }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Read game collection (text or binary format)
+/////////////////////////////////////////////////////////////////////////////
+template<class F> static void ReadGames(CGameCollection &gcol, std::istream &in, F Sink)
+{
+ if (in.peek() == BinaryMagic[0])
+ {
+  CBinaryReader reader(in);
+  ReadBinaryHeader(gcol, reader);
+  ReadBinaryGames(gcol, reader, Sink);
+ }
+ else
+ {
+  ReadTextHeader(gcol, in);
+  ReadTextGames(gcol, in, Sink);
+ }
+}
+
+void ReadGameCollection(CGameCollection &gcol, std::istream &in)
+{
+ ReadGames(gcol, in, [&](const CGame &game) {gcol.AddGame(game);});
+}
+
 /////////////////////////////////////////////////////////////////////////////
 // Write ratings
 /////////////////////////////////////////////////////////////////////////////
@@ -373,24 +622,152 @@ void WriteRatings(const CGameCollection &gcol,
  }
 }
 
+/////////////////////////////////////////////////////////////////////////////
+// Checkpoint: training state after each MM iteration
+/////////////////////////////////////////////////////////////////////////////
+static void WriteCheckpoint(const CGameCollection &gcol, const char *pszFile,
+                            int k, const double *tDelta)
+{
+ std::string sTmp = std::string(pszFile) + ".tmp";
+ {
+  std::ofstream ofs(sTmp.c_str());
+  ofs << std::setprecision(17);
+  ofs << "mm-checkpoint " << gcol.vGamma.size() << ' ' << gcol.vFeatureName.size() << ' ' << k << '\n';
+  for (unsigned i = 0; i < gcol.vFeatureName.size(); i++)
+   ofs << tDelta[i] << '\n';
+  for (unsigned i = 0; i < gcol.vGamma.size(); i++)
+   ofs << gcol.vGamma[i] << '\n';
+  if (!ofs)
+  {
+   fprintf(stderr, "couldn't write checkpoint %s\n", sTmp.c_str());
+   return;
+  }
+ }
+ if (rename(sTmp.c_str(), pszFile))
+  perror(pszFile);
+}
+
+static bool ReadCheckpoint(CGameCollection &gcol, const char *pszFile,
+                           int &k, double *tDelta)
+{
+ std::ifstream ifs(pszFile);
+ if (!ifs)
+  return false;
+
+ std::string s;
+ unsigned Gammas, Features;
+ ifs >> s >> Gammas >> Features >> k;
+ if (s != "mm-checkpoint" || Gammas != gcol.vGamma.size() || Features != gcol.vFeatureName.size())
+ {
+  fprintf(stderr, "checkpoint %s doesn't match input\n", pszFile);
+  exit(1);
+ }
+ for (unsigned i = 0; i < Features; i++)
+  ifs >> tDelta[i];
+ for (unsigned i = 0; i < Gammas; i++)
+  ifs >> gcol.vGamma[i];
+ if (!ifs)
+ {
+  fprintf(stderr, "bad checkpoint %s\n", pszFile);
+  exit(1);
+ }
+ return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Convert input to binary team format
+/////////////////////////////////////////////////////////////////////////////
+static int WriteBinary(const char *pszFile)
+{
+ std::ofstream ofs(pszFile, std::ios::binary);
+ if (!ofs)
+ {
+  perror(pszFile);
+  return 1;
+ }
+
+ CGameCollection gcol;
+ bool fHeader = false;
+ int Games = 0;
+ ReadGames(gcol, std::cin, [&](const CGame &game)
+ {
+  if (!fHeader)
+   WriteBinaryHeader(gcol, ofs);
+  fHeader = true;
+  WriteBinaryGame(game, ofs);
+  Games++;
+ });
+ if (!fHeader)
+  WriteBinaryHeader(gcol, ofs);
+
+ std::cerr << "Games = " << Games << '\n';
+ return ofs ? 0 : 1;
+}
+
+static void Usage()
+{
+ std::cerr << "usage: mm [-t threads] [-c checkpoint] <input.dat >output.dat\n"
+              "       mm -b output.bin <input.dat\n"
+              "\n"
+              "  -t threads     number of threads (default: number of cores)\n"
+              "  -c checkpoint  save state after each iteration, resume from it if present\n"
+              "  -b file        convert input to binary team format and exit\n"
+              "\n"
+              "input can be text or binary team format.\n";
+ exit(1);
+}
+
 /////////////////////////////////////////////////////////////////////////////
 // main function
 /////////////////////////////////////////////////////////////////////////////
-int main()
+int main(int argc, char *argv[])
 {
+ int Threads = std::thread::hardware_concurrency();
+ const char *pszCheckpoint = 0;
+ const char *pszBinary = 0;
+
+ int opt;
+ while ((opt = getopt(argc, argv, "b:c:t:")) != -1)
+  switch (opt)
+  {
+   case 'b': pszBinary = optarg; break;
+   case 'c': pszCheckpoint = optarg; break;
+   case 't': Threads = atoi(optarg); break;
+   default: Usage();
+  }
+ if (optind != argc)
+  Usage();
+
+ std::ios::sync_with_stdio(false);
+ if (pszBinary)
+  return WriteBinary(pszBinary);
+
+ auto Start = std::chrono::steady_clock::now();
  CGameCollection gcol;
+ gcol.Threads = std::max(Threads, 1);
  ReadGameCollection(gcol, std::cin);
  gcol.ComputeVictories();
- std::cerr << "Games = " << gcol.vgame.size() << '\n';
- double LogLikelihood = gcol.LogLikelihood() / gcol.vgame.size();
+ std::cerr << "Games = " << gcol.GetGames() << '\n';
 
  const int Features = gcol.vFeatureName.size();
  double tDelta[Features];
 
- for (int k = 2; --k >= 0;)
+ //
+ // Resume from checkpoint
+ //
+ int kStart = 1;
+ bool fResumed = pszCheckpoint && ReadCheckpoint(gcol, pszCheckpoint, kStart, tDelta);
+ if (fResumed)
+  std::cerr << "Resuming from " << pszCheckpoint << '\n';
+
+ double LogLikelihood = gcol.LogLikelihood() / gcol.GetGames();
+
+ for (int k = kStart + 1; --k >= 0;)
  {
-  for (int i = Features; --i >= 0;)
-   tDelta[i] = 10.0;
+  if (!fResumed)
+   for (int i = Features; --i >= 0;)
+    tDelta[i] = 10.0;
+  fResumed = false;
 
   while(1)
   {
@@ -404,7 +781,7 @@ int main()
      MaxDelta = tDelta[Feature = j];
    if (MaxDelta < 0.0001)
     break;
-   
+
    //
    // Run one MM iteration over this feature
    //
@@ -412,11 +789,14 @@ int main()
    std::cerr << std::setw(9) << LogLikelihood << ' ';
    std::cerr << std::setw(9) << std::exp(-LogLikelihood) << ' ';
    gcol.MM(Feature);
-   double NewLogLikelihood = gcol.LogLikelihood() / gcol.vgame.size();
+   double NewLogLikelihood = gcol.LogLikelihood() / gcol.GetGames();
    double Delta = NewLogLikelihood - LogLikelihood;
    tDelta[Feature] = Delta;
    std::cerr << std::setw(9) << Delta << '\n';
    LogLikelihood = NewLogLikelihood;
+
+   if (pszCheckpoint)
+    WriteCheckpoint(gcol, pszCheckpoint, k, tDelta);
   }
  }
 
@@ -426,6 +806,8 @@ int main()
   std::ofstream ofs("mm-with-freq.dat");
   WriteRatings(gcol, ofs, 1);
  }
- 
+
+ std::chrono::duration<double> Elapsed = std::chrono::steady_clock::now() - Start;
+ std::cerr << "Done in " << Elapsed.count() << "s, " << gcol.Threads << " threads\n";
  return 0;
 }
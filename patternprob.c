@@ -54,6 +54,20 @@ prob_dict_init(char *filename, pattern_config_t *pc)
 
 	fclose(f);
 	if (DEBUGL(1))  fprintf(stderr, "Loaded %d gammas.\n", i);
+
+	/* Direct lookup for non-spatial features (all in last chain) */
+	for (int id = 0; id < FEAT_SPATIAL; id++) {
+		int n = feature_payloads(id);
+		prob_dict->gammas[id] = calloc2(n, floating_t);
+		for (int p = 0; p < n; p++) {
+			feature_t ft = feature(id, p);
+			pattern_prob_t *pb = prob_dict->table[spat_dict->nspatials];
+			for (; pb && !feature_eq(&ft, &pb->p.f[0]); pb = pb->next) ;
+			if (!pb)  break;	/* check_pattern_gammas() will complain */
+			prob_dict->gammas[id][p] = pb->gamma;
+			prob_dict->payloads[id] = p + 1;
+		}
+	}
 }
 
 void
@@ -63,6 +77,8 @@ prob_dict_done()
 
 	for (unsigned int id = 0; id < spat_dict->nspatials; id++)
 		free(prob_dict->table[id]);
+	for (int id = 0; id < FEAT_SPATIAL; id++)
+		free(prob_dict->gammas[id]);
 	free(prob_dict->table);
 	free(prob_dict);
 	prob_dict = NULL;
@@ -139,6 +155,20 @@ pattern_max_rating(pattern_config_t *pc,
 	return max;
 }
 
+static floating_t
+pattern_rate_move_incremental(pattern_config_t *pc,
+			      board_t *b, move_t *m,
+			      pattern_t *pat, ownermap_t *ownermap, bool locally)
+{
+	floating_t prob = NAN;
+
+	if (is_pass(m->coord))	return prob;
+	if (!board_is_valid_play_no_suicide(b, m->color, m->coord)) return prob;
+
+	pattern_match_incremental(pc, pat, b, m, ownermap, locally);
+	return pattern_gamma(pc, pat);
+}
+
 static floating_t
 pattern_max_rating_fast(pattern_config_t *pc,
 			board_t *b, enum stone color,
@@ -149,7 +179,10 @@ pattern_max_rating_fast(pattern_config_t *pc,
 	for (int f = 0; f < b->flen; f++) {
 		move_t m = move(b->f[f], color);
 		pattern_t pat;
-		probs[f] = pattern_rate_move(pc, b, &m, &pat, ownermap, locally);
+		if (pc->incremental)
+			probs[f] = pattern_rate_move_incremental(pc, b, &m, &pat, ownermap, locally);
+		else
+			probs[f] = pattern_rate_move(pc, b, &m, &pat, ownermap, locally);
 		if (!isnan(probs[f])) {  max = MAX(probs[f], max);  }
 	}
 
@@ -189,6 +222,9 @@ pattern_rate_moves_fast(pattern_config_t *pc,
 	pattern_stats_new_position();
 #endif
 
+	if (pc->incremental)
+		pattern_match_incremental_begin(pc, b, color);
+
 	/* Try local moves first. */
 	floating_t max = pattern_max_rating_fast(pc, b, color, probs, ownermap, true);
 
@@ -230,6 +266,8 @@ pattern_matching_locally(pattern_config_t *pc,
 			 ownermap_t *ownermap)
 {
 	floating_t probs[b->flen];
+	if (pc->incremental)
+		pattern_match_incremental_begin(pc, b, color);
 	floating_t max = pattern_max_rating_fast(pc, b, color, probs, ownermap, true);
 	return (max >= LOW_PATTERN_RATING);
 }
@@ -25,6 +25,8 @@ typedef struct pattern_prob {
 
 typedef struct {
 	pattern_prob_t **table; /* [pc->spat_dict->nspatials + 1] */
+	floating_t *gammas[FEAT_SPATIAL];	/* Non-spatial features gammas, by payload */
+	int payloads[FEAT_SPATIAL];
 } prob_dict_t;
 
 /* The patterns probability dictionary */
@@ -89,6 +91,9 @@ static uint32_t feature2spatial(pattern_config_t *pc, feature_t *f);
 static inline floating_t
 feature_gamma(pattern_config_t *pc, feature_t *f)
 {
+	if (f->id < FEAT_SPATIAL && (int)f->payload < prob_dict->payloads[f->id])
+		return prob_dict->gammas[f->id][f->payload];
+
 	uint32_t spi = feature2spatial(pc, f);
 	for (pattern_prob_t *pb = prob_dict->table[spi]; pb; pb = pb->next)
 		if (feature_eq(f, &pb->p.f[0]))
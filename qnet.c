@@ -0,0 +1,355 @@
+#define DEBUG
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "debug.h"
+#include "util.h"
+#include "qnet.h"
+
+/* Activations are quantized to 7 bits: u8 x s8 pairs then fit in 16 bits,
+ * so plain avx2 maddubs can't saturate and gives same results as vnni. */
+#define QNET_ACT_MAX  127
+#define QNET_ALIGN    32
+#define QNET_MAGIC    "pachi qnet 1\n"
+
+
+qnet_t *
+qnet_new(bool softmax)
+{
+	qnet_t *net = calloc2(1, qnet_t);
+	net->softmax = softmax;
+	return net;
+}
+
+void
+qnet_delete(qnet_t **net)
+{
+	qnet_t *n = *net;
+	for (int i = 0; i < n->nlayers; i++) {
+		qnet_layer_t *l = &n->layers[i];
+		free(l->w);  free(l->bias);  free(l->qw);  free(l->qw_scale);
+	}
+	free(n->layers);
+	free(n);
+	*net = NULL;
+}
+
+static qnet_layer_t *
+qnet_new_layer(qnet_t *net, int in_c, int out_c, int k, bool relu)
+{
+	assert(k & 1);  /* Same padding */
+	net->layers = realloc(net->layers, (net->nlayers + 1) * sizeof(qnet_layer_t));
+	if (!net->layers)  fail("realloc");
+	qnet_layer_t *l = &net->layers[net->nlayers++];
+	memset(l, 0, sizeof(*l));
+	l->in_c = in_c;  l->out_c = out_c;  l->k = k;  l->relu = relu;
+	l->in_cp = (in_c + QNET_ALIGN - 1) / QNET_ALIGN * QNET_ALIGN;
+	l->bias = calloc2(out_c, float);
+	l->in_min = l->in_max = 0;
+	return l;
+}
+
+void
+qnet_add_layer(qnet_t *net, int in_c, int out_c, int k, float *w, float *bias, bool relu)
+{
+	assert(!net->quantized);
+	if (net->nlayers)  assert(in_c == net->layers[net->nlayers - 1].out_c);
+	qnet_layer_t *l = qnet_new_layer(net, in_c, out_c, k, relu);
+	size_t n = (size_t)out_c * in_c * k * k;
+	l->w = cmalloc(n * sizeof(float));
+	memcpy(l->w, w, n * sizeof(float));
+	if (bias)  memcpy(l->bias, bias, out_c * sizeof(float));
+}
+
+
+/**********************************************************************************/
+/* fp32 */
+
+static void
+conv_fp32(qnet_layer_t *l, float *in, int size, float *out)
+{
+	int pad = l->k / 2;
+	int size2 = size * size;
+	for (int o = 0; o < l->out_c; o++) {
+		float *op = out + o * size2;
+		for (int i = 0; i < size2; i++)
+			op[i] = l->bias[o];
+
+		for (int c = 0; c < l->in_c; c++)
+		for (int ky = 0; ky < l->k; ky++)
+		for (int kx = 0; kx < l->k; kx++) {
+			float w = l->w[((o * l->in_c + c) * l->k + ky) * l->k + kx];
+			float *ip = in + c * size2 + (kx - pad);
+			int x0 = (kx < pad ? pad - kx : 0);
+			int x1 = (kx > pad ? size - (kx - pad) : size);
+			for (int y = 0; y < size; y++) {
+				int iy = y + ky - pad;
+				if (iy < 0 || iy >= size)  continue;
+				for (int x = x0; x < x1; x++)
+					op[y * size + x] += w * ip[iy * size + x];
+			}
+		}
+
+		if (l->relu)
+			for (int i = 0; i < size2; i++)
+				if (op[i] < 0)  op[i] = 0;
+	}
+}
+
+static int
+qnet_max_channels(qnet_t *net)
+{
+	int n = net->layers[0].in_c;
+	for (int i = 0; i < net->nlayers; i++)
+		if (net->layers[i].out_c > n)  n = net->layers[i].out_c;
+	return n;
+}
+
+static void
+qnet_output(qnet_t *net, float *last, int size, float *out)
+{
+	int size2 = size * size;
+	memcpy(out, last, size2 * sizeof(float));  /* First channel */
+	if (!net->softmax)  return;
+
+	float max = out[0], sum = 0;
+	for (int i = 1; i < size2; i++)
+		if (out[i] > max)  max = out[i];
+	for (int i = 0; i < size2; i++)
+		sum += (out[i] = expf(out[i] - max));
+	for (int i = 0; i < size2; i++)
+		out[i] /= sum;
+}
+
+void
+qnet_forward_fp32(qnet_t *net, float *in, int size, float *out, bool calibrate)
+{
+	assert(net->nlayers && net->layers[0].w);
+	int n = qnet_max_channels(net) * size * size;
+	float *buf[2] = {  cmalloc(n * sizeof(float)), cmalloc(n * sizeof(float))  };
+	float *cur = in;
+
+	for (int i = 0; i < net->nlayers; i++) {
+		qnet_layer_t *l = &net->layers[i];
+		if (calibrate)
+			for (int j = 0; j < l->in_c * size * size; j++) {
+				if (cur[j] > l->in_max)  l->in_max = cur[j];
+				if (cur[j] < l->in_min)  l->in_min = cur[j];
+			}
+		float *next = buf[i & 1];
+		conv_fp32(l, cur, size, next);
+		cur = next;
+	}
+
+	qnet_output(net, cur, size, out);
+	free(buf[0]);  free(buf[1]);
+}
+
+
+/**********************************************************************************/
+/* Int8 */
+
+void
+qnet_quantize(qnet_t *net)
+{
+	assert(!net->quantized);
+	for (int i = 0; i < net->nlayers; i++) {
+		qnet_layer_t *l = &net->layers[i];
+		if (l->in_min < 0)
+			die("qnet: layer %i input not rectified (min %f), can't quantize\n", i, l->in_min);
+		if (i && !net->layers[i - 1].relu)
+			die("qnet: layer %i input has no relu, can't quantize\n", i);
+		l->in_scale = (l->in_max > 0 ? l->in_max / QNET_ACT_MAX : 1);
+
+		int k2 = l->k * l->k;
+		l->qw = calloc2((size_t)l->out_c * k2 * l->in_cp, int8_t);
+		l->qw_scale = calloc2(l->out_c, float);
+		for (int o = 0; o < l->out_c; o++) {
+			float *w = l->w + (size_t)o * l->in_c * k2;
+			float max = 0;
+			for (int j = 0; j < l->in_c * k2; j++)
+				if (fabsf(w[j]) > max)  max = fabsf(w[j]);
+			float scale = l->qw_scale[o] = (max > 0 ? max / 127 : 1);
+
+			/* [in_c][ky][kx] -> [ky][kx][in_cp] */
+			for (int c = 0; c < l->in_c; c++)
+			for (int j = 0; j < k2; j++)
+				l->qw[((size_t)o * k2 + j) * l->in_cp + c] = (int8_t)lrintf(w[c * k2 + j] / scale);
+		}
+	}
+	net->quantized = true;
+}
+
+char *
+qnet_simd(void)
+{
+#if defined(__AVXVNNI__)
+	return "avx-vnni";
+#elif defined(__AVX512VNNI__) && defined(__AVX512VL__)
+	return "avx512-vnni";
+#elif defined(__AVX2__)
+	return "avx2";
+#else
+	return "none";
+#endif
+}
+
+/* Dot product of @n (multiple of QNET_ALIGN) activations and weights */
+static inline int32_t
+dot_u8s8(const uint8_t *a, const int8_t *w, int n)
+{
+#if defined(__AVX2__)
+	__m256i acc = _mm256_setzero_si256();
+	for (int i = 0; i < n; i += 32) {
+		__m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+		__m256i vw = _mm256_loadu_si256((const __m256i*)(w + i));
+#if defined(__AVXVNNI__)
+		acc = _mm256_dpbusd_avx_epi32(acc, va, vw);
+#elif defined(__AVX512VNNI__) && defined(__AVX512VL__)
+		acc = _mm256_dpbusd_epi32(acc, va, vw);
+#else
+		__m256i p = _mm256_maddubs_epi16(va, vw);
+		acc = _mm256_add_epi32(acc, _mm256_madd_epi16(p, _mm256_set1_epi16(1)));
+#endif
+	}
+	__m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+	return _mm_cvtsi128_si32(s);
+#else
+	int32_t acc = 0;
+	for (int i = 0; i < n; i++)
+		acc += a[i] * w[i];
+	return acc;
+#endif
+}
+
+/* Quantize layer input [in_c][size][size] to padded [ps][ps][in_cp] */
+static void
+quantize_input(qnet_layer_t *l, float *in, int size, uint8_t *q)
+{
+	int pad = l->k / 2, ps = size + 2 * pad;
+	memset(q, 0, (size_t)ps * ps * l->in_cp);
+	float inv = 1 / l->in_scale;
+	for (int c = 0; c < l->in_c; c++)
+	for (int y = 0; y < size; y++)
+	for (int x = 0; x < size; x++) {
+		int v = lrintf(in[(c * size + y) * size + x] * inv);
+		if (v > QNET_ACT_MAX)  v = QNET_ACT_MAX;
+		if (v < 0)             v = 0;
+		q[((y + pad) * ps + x + pad) * l->in_cp + c] = v;
+	}
+}
+
+static void
+conv_int8(qnet_layer_t *l, uint8_t *q, int size, float *out)
+{
+	int k = l->k, pad = k / 2, ps = size + 2 * pad;
+	int cp = l->in_cp, row = k * cp;
+	for (int y = 0; y < size; y++)
+	for (int x = 0; x < size; x++) {
+		/* Receptive field rows are contiguous: (y+ky, x..x+k-1) */
+		uint8_t *a = q + ((size_t)y * ps + x) * cp;
+		for (int o = 0; o < l->out_c; o++) {
+			int8_t *w = l->qw + (size_t)o * k * row;
+			int32_t acc = 0;
+			for (int ky = 0; ky < k; ky++)
+				acc += dot_u8s8(a + (size_t)ky * ps * cp, w + ky * row, row);
+			float v = acc * l->in_scale * l->qw_scale[o] + l->bias[o];
+			if (l->relu && v < 0)  v = 0;
+			out[(o * size + y) * size + x] = v;
+		}
+	}
+}
+
+void
+qnet_forward(qnet_t *net, float *in, int size, float *out)
+{
+	assert(net->quantized);
+	int n = qnet_max_channels(net) * size * size;
+	float *buf[2] = {  cmalloc(n * sizeof(float)), cmalloc(n * sizeof(float))  };
+	size_t qsize = 0;
+	for (int i = 0; i < net->nlayers; i++) {
+		qnet_layer_t *l = &net->layers[i];
+		int ps = size + l->k - 1;
+		if ((size_t)ps * ps * l->in_cp > qsize)  qsize = (size_t)ps * ps * l->in_cp;
+	}
+	uint8_t *q = cmalloc(qsize);
+	float *cur = in;
+
+	for (int i = 0; i < net->nlayers; i++) {
+		qnet_layer_t *l = &net->layers[i];
+		float *next = buf[i & 1];
+		quantize_input(l, cur, size, q);
+		conv_int8(l, q, size, next);
+		cur = next;
+	}
+
+	qnet_output(net, cur, size, out);
+	free(buf[0]);  free(buf[1]);  free(q);
+}
+
+
+/**********************************************************************************/
+/* Load / save */
+
+#define qnet_write(f, p, n)  do {  if (fwrite((p), sizeof(*(p)), (n), f) != (size_t)(n))  fail("fwrite");  } while (0)
+#define qnet_read(f, p, n)   do {  if (fread((p), sizeof(*(p)), (n), f) != (size_t)(n))  die("qnet: %s: truncated file\n", filename);  } while (0)
+
+void
+qnet_save(qnet_t *net, char *filename)
+{
+	assert(net->quantized);
+	FILE *f = fopen(filename, "wb");
+	if (!f)  fail(filename);
+
+	fputs(QNET_MAGIC, f);
+	int header[2] = {  net->nlayers, net->softmax  };
+	qnet_write(f, header, 2);
+	for (int i = 0; i < net->nlayers; i++) {
+		qnet_layer_t *l = &net->layers[i];
+		int dims[4] = {  l->in_c, l->out_c, l->k, l->relu  };
+		qnet_write(f, dims, 4);
+		qnet_write(f, &l->in_scale, 1);
+		qnet_write(f, l->bias, l->out_c);
+		qnet_write(f, l->qw_scale, l->out_c);
+		qnet_write(f, l->qw, (size_t)l->out_c * l->k * l->k * l->in_cp);
+	}
+	fclose(f);
+}
+
+qnet_t *
+qnet_load(char *filename)
+{
+	FILE *f = fopen(filename, "rb");
+	if (!f)  fail(filename);
+
+	char magic[sizeof(QNET_MAGIC)] = { 0, };
+	qnet_read(f, magic, strlen(QNET_MAGIC));
+	if (strcmp(magic, QNET_MAGIC))  die("qnet: %s: not a quantized net\n", filename);
+
+	int header[2];
+	qnet_read(f, header, 2);
+	qnet_t *net = qnet_new(header[1]);
+	for (int i = 0; i < header[0]; i++) {
+		int dims[4];
+		qnet_read(f, dims, 4);
+		qnet_layer_t *l = qnet_new_layer(net, dims[0], dims[1], dims[2], dims[3]);
+		qnet_read(f, &l->in_scale, 1);
+		qnet_read(f, l->bias, l->out_c);
+		l->qw_scale = calloc2(l->out_c, float);
+		qnet_read(f, l->qw_scale, l->out_c);
+		size_t n = (size_t)l->out_c * l->k * l->k * l->in_cp;
+		l->qw = cmalloc(n);
+		qnet_read(f, l->qw, n);
+	}
+	fclose(f);
+	net->quantized = true;
+	return net;
+}
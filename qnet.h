@@ -0,0 +1,54 @@
+#ifndef PACHI_QNET_H
+#define PACHI_QNET_H
+
+/* Int8 quantized inference for plain convolutional policy networks:
+ * stack of same-padded convolutions (+ relu), output is first channel
+ * of last layer (optional softmax over the board).
+ * Weights are quantized per output channel, layer inputs per layer using
+ * ranges collected by running the fp32 net on sample positions first. */
+
+#include <stdint.h>
+
+typedef struct {
+	int     in_c, out_c, k;
+	bool    relu;
+	float  *w;		/* fp32 weights [out_c][in_c][k][k] (NULL if loaded from file) */
+	float  *bias;		/* [out_c] */
+	float   in_min, in_max;	/* Calibration: input activations range */
+
+	/* Quantized */
+	int     in_cp;		/* in_c rounded up for simd */
+	float   in_scale;
+	int8_t *qw;		/* [out_c][k][k][in_cp] */
+	float  *qw_scale;	/* [out_c] */
+} qnet_layer_t;
+
+typedef struct qnet {
+	int  nlayers;
+	qnet_layer_t *layers;
+	bool softmax;
+	bool quantized;
+} qnet_t;
+
+qnet_t *qnet_new(bool softmax);
+void    qnet_delete(qnet_t **net);
+/* Add layer, @w and @bias are copied (@bias can be NULL) */
+void    qnet_add_layer(qnet_t *net, int in_c, int out_c, int k, float *w, float *bias, bool relu);
+
+/* Quantized nets only. */
+qnet_t *qnet_load(char *filename);
+void    qnet_save(qnet_t *net, char *filename);
+
+/* fp32 reference forward pass, @in: [in_c][size][size], @out: [size][size]
+ * If @calibrate is set record activations range for qnet_quantize(). */
+void    qnet_forward_fp32(qnet_t *net, float *in, int size, float *out, bool calibrate);
+/* Quantize weights and activations once calibrated. */
+void    qnet_quantize(qnet_t *net);
+/* Int8 forward pass. */
+void    qnet_forward(qnet_t *net, float *in, int size, float *out);
+
+/* Which int8 dot product implementation is compiled in. */
+char   *qnet_simd(void);
+
+
+#endif
@@ -0,0 +1,248 @@
+#define DEBUG
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+
+#include "debug.h"
+#include "util.h"
+#include "network.h"
+#include "server.h"
+
+/* Per session slot cpu usage */
+typedef struct {
+	int held;		/* Cpus held */
+	int waiting;		/* Threads waiting for cpus */
+} budget_slot_t;
+
+/* Cpu budget, in shared memory: server and all sessions see it.
+ * Lock is robust: a session dying while holding it doesn't block the others,
+ * reaper cleans up its slot afterwards. */
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t  cond;
+	int cpus;
+	int free_cpus;
+	budget_slot_t slot[];
+} budget_t;
+
+static budget_t *budget = NULL;
+
+/* Session side */
+static int  session_id = -1;
+
+/* Server side */
+static pid_t *sessions;		/* Session slots: pid, 0 if free */
+static int    max_sessions;
+static int    nsessions;
+static pthread_mutex_t sessions_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  sessions_cond = PTHREAD_COND_INITIALIZER;
+
+
+/* Lock owner died: state is still usable, session_free() will fix its slot. */
+static void
+budget_recover(int r)
+{
+	if (r == EOWNERDEAD)  pthread_mutex_consistent(&budget->lock);
+	else if (r)           { errno = r;  fail("pthread_mutex_lock"); }
+}
+
+static void
+budget_lock(void)
+{
+	budget_recover(pthread_mutex_lock(&budget->lock));
+}
+
+static void
+budget_wait(void)
+{
+	budget_recover(pthread_cond_wait(&budget->cond, &budget->lock));
+}
+
+static bool
+cpus_take(int cpus, bool wait)
+{
+	if (!budget)  return true;
+	if (cpus > budget->cpus)  cpus = budget->cpus;
+
+	budget_lock();
+	budget_slot_t *slot = &budget->slot[session_id];
+	int need = cpus - slot->held;
+	if (need > budget->free_cpus && !wait) {
+		pthread_mutex_unlock(&budget->lock);
+		return false;
+	}
+	if (need > budget->free_cpus) {
+		if (DEBUGL(2))  fprintf(stderr, "session %d: waiting for %d cpus\n", session_id, need);
+		slot->waiting++;
+		while (need > budget->free_cpus)
+			budget_wait();
+		slot->waiting--;
+	}
+	if (need > 0) {
+		budget->free_cpus -= need;
+		slot->held += need;
+	}
+	pthread_mutex_unlock(&budget->lock);
+	return true;
+}
+
+void
+server_cpus_take(int cpus)
+{
+	cpus_take(cpus, true);
+}
+
+bool
+server_cpus_try_take(int cpus)
+{
+	return cpus_take(cpus, false);
+}
+
+void
+server_cpus_release(void)
+{
+	if (!budget)  return;
+
+	budget_lock();
+	budget->free_cpus += budget->slot[session_id].held;
+	budget->slot[session_id].held = 0;
+	pthread_cond_broadcast(&budget->cond);
+	pthread_mutex_unlock(&budget->lock);
+}
+
+/* Racy read, fine for a hint. */
+bool
+server_cpus_wanted(void)
+{
+	if (!budget)  return false;
+	for (int i = 0; i < max_sessions; i++)
+		if (budget->slot[i].waiting)  return true;
+	return false;
+}
+
+/* Session @id is gone, give back cpus it may still hold (crash ...)
+ * and forget its waiting threads. */
+static void
+session_free(int id)
+{
+	budget_lock();
+	budget->free_cpus += budget->slot[id].held;
+	budget->slot[id].held = 0;
+	budget->slot[id].waiting = 0;
+	pthread_cond_broadcast(&budget->cond);
+	pthread_mutex_unlock(&budget->lock);
+	sessions[id] = 0;
+}
+
+static void *
+reaper_thread(void *data)
+{
+	while (1) {
+		pthread_mutex_lock(&sessions_lock);
+		while (!nsessions)
+			pthread_cond_wait(&sessions_cond, &sessions_lock);
+		pthread_mutex_unlock(&sessions_lock);
+
+		int status;
+		pid_t pid = wait(&status);
+		if (pid < 0) {
+			if (errno != EINTR)  fail("wait");
+			continue;
+		}
+
+		pthread_mutex_lock(&sessions_lock);
+		int id;
+		for (id = 0; id < max_sessions; id++)
+			if (sessions[id] == pid)  break;
+		assert(id < max_sessions);
+		session_free(id);
+		nsessions--;
+		if (DEBUGL(2))  fprintf(stderr, "server: session %d done, status %d (%d active)\n",
+					id, (WIFEXITED(status) ? WEXITSTATUS(status) : -1), nsessions);
+		pthread_cond_broadcast(&sessions_cond);
+		pthread_mutex_unlock(&sessions_lock);
+	}
+	return NULL;
+}
+
+static void
+budget_init(int cpus)
+{
+	size_t size = sizeof(budget_t) + max_sessions * sizeof(budget_slot_t);
+	budget = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (budget == MAP_FAILED)  fail("mmap");
+	memset(budget, 0, size);
+
+	pthread_mutexattr_t mattr;
+	pthread_mutexattr_init(&mattr);
+	pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&mattr, PTHREAD_MUTEX_ROBUST);
+	pthread_mutex_init(&budget->lock, &mattr);
+	pthread_mutexattr_destroy(&mattr);
+
+	pthread_condattr_t cattr;
+	pthread_condattr_init(&cattr);
+	pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+	pthread_cond_init(&budget->cond, &cattr);
+	pthread_condattr_destroy(&cattr);
+
+	budget->cpus = budget->free_cpus = cpus;
+}
+
+void
+server_start(char *port, int max, int cpus)
+{
+	assert(max > 0 && cpus > 0);
+	max_sessions = max;
+	sessions = calloc2(max_sessions, pid_t);
+	budget_init(cpus);
+
+	int sock = port_listen(port, max_sessions);
+	if (DEBUGL(1))  fprintf(stderr, "server: listening on port %s (%d sessions max, %d cpus)\n",
+				port, max_sessions, cpus);
+
+	pthread_t thread;
+	pthread_create(&thread, NULL, reaper_thread, NULL);
+
+	while (1) {
+		pthread_mutex_lock(&sessions_lock);
+		while (nsessions == max_sessions)
+			pthread_cond_wait(&sessions_cond, &sessions_lock);
+		pthread_mutex_unlock(&sessions_lock);
+
+		struct in_addr client;
+		int fd = open_server_connection(sock, &client);
+
+		pthread_mutex_lock(&sessions_lock);
+		int id = 0;
+		while (sessions[id])  id++;
+
+		fflush(stdout);  fflush(stderr);
+		pid_t pid = fork();
+		if (pid < 0)  fail("fork");
+		if (!pid) {
+			/* Session: caller takes over, talking gtp to client. */
+			session_id = id;
+			close(sock);
+			if (dup2(fd, STDIN_FILENO) < 0 || dup2(fd, STDOUT_FILENO) < 0)
+				fail("dup2");
+			close(fd);
+			clearerr(stdin);
+			if (DEBUGL(1))  fprintf(stderr, "session %d: connection from %s\n", id, inet_ntoa(client));
+			return;
+		}
+
+		sessions[id] = pid;
+		nsessions++;
+		pthread_cond_broadcast(&sessions_cond);
+		pthread_mutex_unlock(&sessions_lock);
+		close(fd);
+	}
+}
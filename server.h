@@ -0,0 +1,41 @@
+#ifndef PACHI_SERVER_H
+#define PACHI_SERVER_H
+
+/* Multi-game gtp server: many gtp sessions over the network from one
+ * pachi instance. Engine and dictionaries (patterns, joseki, dcnn) are
+ * loaded once, then each connection is served by its own forked session
+ * process with its own board (any board size) and engine state, read-only
+ * data stays shared copy-on-write.
+ * Sessions share a budget of @cpus cpus: a search takes one per search
+ * thread for as long as it runs (genmove, pondering, analysis ...),
+ * others wait their turn. Pondering after genmove doesn't wait and stops
+ * when other sessions are waiting. */
+
+#ifdef NETWORK
+
+/* Listen on @port and fork a session for each connection, at most
+ * @max_sessions at a time. Only returns in session processes, with
+ * stdin / stdout connected to the client. */
+void server_start(char *port, int max_sessions, int cpus);
+
+/* Session side: make sure we hold @cpus cpus, waiting for them if needed.
+ * Nothing to do outside of server mode. */
+void server_cpus_take(int cpus);
+/* Same without waiting, returns false if not available. */
+bool server_cpus_try_take(int cpus);
+/* Give back all cpus we hold. */
+void server_cpus_release(void);
+/* Another session waiting for cpus ? */
+bool server_cpus_wanted(void);
+
+#else
+
+#define server_start(port, max_sessions, cpus)  die("network code not compiled in, enable NETWORK in Makefile\n");
+#define server_cpus_take(cpus)      ((void)0)
+#define server_cpus_try_take(cpus)  (true)
+#define server_cpus_release()       ((void)0)
+#define server_cpus_wanted()        (false)
+
+#endif /* NETWORK */
+
+#endif
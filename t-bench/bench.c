@@ -0,0 +1,380 @@
+#define DEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "board.h"
+#include "debug.h"
+#include "engine.h"
+#include "move.h"
+#include "ownermap.h"
+#include "pattern.h"
+#include "patternsp.h"
+#include "patternprob.h"
+#include "playout.h"
+#include "playout/moggy.h"
+#include "random.h"
+#include "tactics/ladder.h"
+#include "telemetry.h"
+#include "timeinfo.h"
+#include "version.h"
+#include "uct/internal.h"
+#include "uct/tree.h"
+#include "t-bench/bench.h"
+
+/* Benchmark suite: fixed corpus, fixed seed and fixed workloads so that
+ * results are comparable across builds (as long as corpus and workloads
+ * below don't change, bump BENCH_VERSION if they do). Only uct search
+ * with multiple threads isn't fully deterministic. */
+
+#define BENCH_VERSION 1
+#define BENCH_SEED    29264
+
+typedef struct {
+	int   size;
+	char *moves;	/* Alternating moves, black first */
+} bench_game_t;
+
+static bench_game_t corpus[] = {
+	/* t-regress/games/2010-12-05-pachi-CzechBot.sgf */
+	{ 9, "e5 e7 f7 f6 e6 g7 f8 d7 c6 g6 g8 g4 c7 h8 f3 f4 e4 c8 e9 d8 b8 b7 b9 e8 g3 d3 e3 b4 c4 c3 "
+	       "b5 e2 f2 e1 b2 b3 c1 c2 d2 f9 f1 b1 a1 d1 d2 a4 b1 d6 b6 a7 d5 a5 c5 a6 g9 h9 d4 a8 a3 a2 "
+	       "d1 f9 a3 h2 a9 h3 f5 g5 h1 j1 j2 c9 j1 g1 g2 h4 g1 j3 f8 f7 g9 j6 b7 j9 f9 d9 j7 h7 j5 j8 "
+	       "h5 g8 h6 f9 j7 d3 c3 j6 b4 j4 a8 e1 e2 h5 pass" },
+	/* pachi self-play */
+	{ 9, "f6 b2 c5 c4 d5 d4 e4 e3 f4 f3 g4 g7 f7 f8 e8 h6 g8 h8 f9 h4 g3 h3 h2 g2 f2 e2 g1 b5 g6 h7 "
+	       "h5 g5 j5 b6 d7 c6 d6 j6 f5 c8 h9" },
+	/* pachi self-play */
+	{ 13, "k10 d11 k3 d4 c6 c8 e6 l8 l6 j8 h10 g8 e8 c5 b6 g6 b5 k4 l4 j3 j4 k5 h3 j2 h2 l3 k2 l5 m5 "
+	       "m4 m6 j5 h4 f5 e5 e4 f4 f3 g4 f2 c3 l2 j1 d2 d3 e3 c2 c1 b1 d6 d7 c7 d5 c4 b4 b2 b3 a1 f11 "
+	       "g2 g1 f1 m10 g10 g11 h9 j10 f7 f6 g5 h5 h6 a3 e7 d6 j2 j3 e1 a2 d8 f8 f9 g7 j7 e9 c10 j6 "
+	       "k6 h7 j6 f10 b12 b1 d1 g3 h1 l1 m1 l11 e10 a11 g9 b11 c11 h12 d9 f12 a12 m8 l9 g12 m9 l10 "
+	       "n9 k12 k1 g1 e7 f7 h1 l1 n10 m12 k1 g1" },
+	/* pachi self-play */
+	{ 13, "k11 c4 d11 k4 h3 f3 h5 k6 l3 k3 k2 j2 l2 j3 m5 d9 c9 c8 c10 d8 l8 j7 k5 l5 l4 j5 h6 m6 m4 "
+	       "e11 e12 d10 c12 h2 h7 j8 h8 j10 j9 h9 k9 g9 e10 f8 f11 d6 h10 j6 j11 g10 f9 g8 e8 e9 e7 "
+	       "f10 h11 l10 d7 c7 k10 b6 g11 a4 l7 l6 m7 h4 n6 a8 b9 b8 a9 b3" },
+	/* t-regress/games/2011-06-05-Zen19-pachi2.sgf */
+	{ 19, "p17 q4 q6 o4 r9 d16 c5 d3 e4 e3 f4 g3 f17 c14 c12 r17 g4 h3 h4 q15 j3 m17 k17 e13 n16 m16 "
+	       "m15 k16 j16 l15 n17 m14 n15 m18 l14 k14 l13 k13 l12 k12 l11 j17 h17 j18 j15 h18 k15 l16 "
+	       "h13 k11 k10 g17 g16 h16 h15 l10 n12 j10 k9 g12 d13 d14 e12 f12 e14 f13 j9 e11 c10 h12 f15 "
+	       "d9 g18 h17 c17 d12 c13 d17 e18 g14 g15 g19 d18 f18 e17 h9 j11 h10 j12 c9 d10 e10 b11 j8 k8 "
+	       "k7 j7 h8 j14 l8 j13 l9 k11 b9 m4 j2 k2 j6 l7 k6 k4 b13 n6 o6 n5 p6 b12 b14 q8 m7 n7 r11 "
+	       "q12 r12 r13 q13 s13 r14 p13 q14 q11 r3 s11 s14 l6 b3 o2 n3 f3 f2 e2 g2 m2 r6 r7 s6 c2 d2 "
+	       "c3 d4 c4 d5 d6 c1 q5 r5 p3 p5 e5 e1 q7 b2 p4 e6 q3 r4 g7 e7 n18 e15 l18 m19 n19 b17 c16 "
+	       "b16 s12 g6 t14 l5 m6 l3 k3 t15 s15 t13 b18 n2 r2 s2 q2 s1 h7 h6 s17 q17 r16 l4 m3 q16 r18 "
+	       "q18 s18 t16 f6 f7 s16 r19 s19 q19 t18 l2 l1 r15 b1 a1 s3 f14 l19 k18 s4 s5 t2 t4 r1 t3 s3 "
+	       "s4 t7 k19 l17 k5 h19 f19 e8 d7 d8 c7 c8 b8 b15 c15 a17 c18 h1 j1 k1 h2 c19 p18 p15 p14 m1 "
+	       "p16 g8 o17 f8 f5 h11 g10 g11 f11 b7 b6 g9 f10 c6 a7 g5 f6 o16 o18 o19 o14 o15 n14 b10 d11 "
+	       "c17 e16 a16 a15 c16 c18 t6 c17 m13 f16 n13 d19 t12 t14 o13 t17" },
+	/* t-regress/games/2011-07-28-pachi2-Novicer.sgf */
+	{ 19, "q16 d4 q3 d16 f3 c6 f17 h17 f15 d14 j16 j17 k16 h16 h15 k17 l16 m17 n15 g15 g14 g16 h14 "
+	       "f16 k4 r10 r7 q8 q7 p8 p7 o8 n7 o7 o6 n6 o5 m6 m8 l8 l9 m7 n8 k9 l10 k7 k10 n10 j9 m9 k8 "
+	       "n9 c17 n4 f5 c9 c3 d3 d2 e2 c2 e3 f2 c4 e1 d1 f1 d17 b16 o4 p4 p3 p2 o3 q4 c18 b18 c16 b17 "
+	       "d18 b14 b15 c15 c14 a15 b13 b19 f12 l17 l18 n18 m18 o17 h7 f9 h4 h3 o2 g12 j3 j4 h2 g3 k3 "
+	       "l3 l2 l4 m2 h5 e6 b4 b5 a3 r13 r15 r8 q12 r12 q13 d15 b15 g11 h11 g13 h12 b2 b1 f14 f11 "
+	       "e11 f10 n12 q11 r14 q14 g6 g5 r11 s7 m16 m15 l15 j15 h13 j13 f13 m13 k14 j14 f6 e8 g8 d10 "
+	       "j12 k13 g10 g9 h10 h9 j11 l12 c10 d11 l11 k11 d9 e10 q2 r2 q1 s3 c12 m11 n11 s14 s13 s15 "
+	       "f8 e9 d8 t10 j5 a2 n17 o18 p17 o16 s9 t9 s8 t8 k5 c19 d19 a13 b12 a12 a11 a14 c11 n13 e5 "
+	       "o12 q10 o11 l5 e7 e12 d7 m3 g4 c7 r1 p1 p10 t14 t15 m4 h4 n19 o19 p6 p5 s10 t11 j8 k9 t13 "
+	       "d12 h6 j2 k2 d13 p9 h8 o10 f7 p11 g7 p12 o13 t7 t6 p13 p14 p10 d6 j7 d5 c5 m19 s11 k19 k18 "
+	       "l19 t12 j19 t7 g18 q15 p15 f18 f19 e19 e18 h19 h18 t9 s6 j18 g19 s17 n19 r18 q18 q17 q19 "
+	       "p19 p18 r4 r3 r5 q5 r19 s16 t17 c1 l13 l14 m12 m10 a17 a18 r6 a5 q6 s4 t5 s5 j6 a6 k12 a8 "
+	       "b9 a10 b11 a9 e17 f18 g17 h19 r17 j10 h12 h1" },
+};
+
+#define CORPUS_GAMES     (int)(sizeof(corpus) / sizeof(corpus[0]))
+#define CORPUS_MAX_MOVES 400
+
+/* Benchmark positions: every POSITION_STEP moves of each corpus game. */
+#define POSITION_STEP 10
+
+typedef struct {
+	int size;
+	int replays;		/* board_play():               corpus games replays */
+	int playouts;		/* moggy:                      playouts per position */
+	int pattern_reps;	/* pattern_rate_moves_fast():  calls per position */
+	int ladder_reps;	/* ladder checks:              passes per position */
+	int expand_children;	/* tree_expand_node():         root children expanded per position */
+	int uct_playouts;	/* uct:                        playouts per genmove */
+} bench_workload_t;
+
+static bench_workload_t workloads[] = {
+	{  9, 40000, 200, 50, 50000, 40, 10000 },
+	{ 13, 30000, 100, 30, 20000, 40,  5000 },
+	{ 19, 10000,  50, 20, 10000, 20,  3000 },
+};
+
+/* Parsed corpus game. */
+typedef struct {
+	int	moves;
+	coord_t	move[CORPUS_MAX_MOVES];
+} bench_moves_t;
+
+
+static void
+bench_report(char *name, int size, int threads, unsigned long long count, double secs)
+{
+	printf("{\"bench\": \"%s\", \"size\": %i, \"threads\": %i, \"count\": %llu, \"secs\": %.3f, \"rate\": %.1f}\n",
+	       name, size, threads, count, secs, (secs > 0 ? count / secs : 0));
+	fflush(stdout);
+	if (DEBUGL(2))
+		fprintf(stderr, "bench %-10s %2ix%-2i  %2i threads  %9llu in %6.2fs  %10.1f/s\n",
+			name, size, size, threads, count, secs, (secs > 0 ? count / secs : 0));
+}
+
+/* Board must be resized already. */
+static void
+bench_parse_game(bench_game_t *game, bench_moves_t *m)
+{
+	char *str = strdup(game->moves), *save = NULL;
+	m->moves = 0;
+	for (char *s = strtok_r(str, " ", &save); s; s = strtok_r(NULL, " ", &save)) {
+		assert(m->moves < CORPUS_MAX_MOVES);
+		m->move[m->moves++] = str2coord(s);
+	}
+	free(str);
+}
+
+/* Setup board with first @n moves of @m. */
+static void
+bench_setup(board_t *b, bench_moves_t *m, int n)
+{
+	board_clear(b);
+	for (int i = 0; i < n; i++) {
+		move_t mv = move(m->move[i], (i % 2 ? S_WHITE : S_BLACK));
+		int r = board_play(b, &mv);
+		if (r < 0)  die("bench: corpus game: illegal move %s\n", coord2sstr(mv.coord));
+	}
+}
+
+#define foreach_bench_position(games, ngames) \
+	for (int g_ = 0; g_ < (ngames); g_++) \
+		for (int n_ = POSITION_STEP; n_ < (games)[g_].moves; n_ += POSITION_STEP) { \
+			bench_setup(b, &(games)[g_], n_);
+#define foreach_bench_position_end  }
+
+
+static void
+bench_board_play(board_t *b, bench_workload_t *w, bench_moves_t *games, int ngames)
+{
+	unsigned long long count = 0;
+	double time_start = time_now();
+	for (int r = 0; r < w->replays; r++)
+		for (int g = 0; g < ngames; g++) {
+			bench_setup(b, &games[g], games[g].moves);
+			count += games[g].moves;
+		}
+	bench_report("board_play", w->size, 1, count, time_now() - time_start);
+}
+
+static void
+bench_moggy(board_t *b, bench_workload_t *w, bench_moves_t *games, int ngames)
+{
+	playout_policy_t *policy = playout_moggy_init(NULL, b);
+	playout_setup_t setup = playout_setup(MAX_GAMELEN, 0);
+	unsigned long long count = 0;
+	double secs = 0;
+
+	foreach_bench_position(games, ngames) {
+		enum stone color = board_to_play(b);
+		double time_start = time_now();
+		for (int i = 0; i < w->playouts; i++) {
+			board_t b2;
+			board_copy(&b2, b);
+			playout_play_game(&setup, &b2, color, NULL, NULL, policy);
+			board_done(&b2);
+		}
+		secs += time_now() - time_start;
+		count += w->playouts;
+	} foreach_bench_position_end;
+
+	playout_policy_done(policy);
+	bench_report("moggy", w->size, 1, count, secs);
+}
+
+static void
+bench_patterns(board_t *b, bench_workload_t *w, bench_moves_t *games, int ngames, pattern_config_t *pc)
+{
+	unsigned long long count = 0;
+	double secs = 0;
+
+	foreach_bench_position(games, ngames) {
+		enum stone color = board_to_play(b);
+		ownermap_t ownermap;
+		mcowner_playouts_fast(b, color, &ownermap);
+		floating_t probs[b->flen];
+
+		double time_start = time_now();
+		for (int i = 0; i < w->pattern_reps; i++)
+			pattern_rate_moves_fast(pc, b, color, probs, &ownermap);
+		secs += time_now() - time_start;
+		count += w->pattern_reps;
+	} foreach_bench_position_end;
+
+	bench_report("patterns", w->size, 1, count, secs);
+}
+
+/* Ladder checks for every group in atari and every 2-lib group. */
+static void
+bench_ladders(board_t *b, bench_workload_t *w, bench_moves_t *games, int ngames)
+{
+	unsigned long long count = 0;
+	double secs = 0;
+
+	foreach_bench_position(games, ngames) {
+		double time_start = time_now();
+		for (int i = 0; i < w->ladder_reps; i++)
+			foreach_point(b) {
+				group_t g = group_at(b, c);
+				if (!g || g != c)  continue;
+
+				int libs = board_group_info(b, g).libs;
+				if (libs == 1) {
+					is_ladder(b, g, true);
+					count++;
+				} else if (libs == 2) {
+					for (int j = 0; j < 2; j++)
+						wouldbe_ladder(b, g, board_group_info(b, g).lib[j]);
+					count += 2;
+				}
+			} foreach_point_end;
+		secs += time_now() - time_start;
+	} foreach_bench_position_end;
+
+	bench_report("ladders", w->size, 1, count, secs);
+}
+
+/* Expand root node and some of its children for each position. */
+static void
+bench_expand(board_t *b, bench_workload_t *w, bench_moves_t *games, int ngames, char *engine_args)
+{
+	strbuf(buf, 1024);
+	sbprintf(buf, "threads=1,pondering=0%s%s", (*engine_args ? "," : ""), engine_args);
+	engine_t e;  engine_init(&e, E_UCT, buf->str, b);
+	uct_t *u = (uct_t*)e.data;
+	unsigned long long count = 0;
+	double secs = 0;
+
+	foreach_bench_position(games, ngames) {
+		enum stone color = board_to_play(b);
+		if (using_patterns())  uct_mcowner_playouts(u, b, color);
+		tree_t *t = tree_init(b, color, 256 * 1024 * 1024, 0, 0, 0);
+
+		double time_start = time_now();
+		tree_expand_node(t, t->root, b, color, u, 1);
+		count++;
+		int children = 0;
+		for (tree_node_t *ni = t->root->children; ni && children < w->expand_children; ni = ni->sibling) {
+			if (is_pass(node_coord(ni)))  continue;
+			children++;
+			board_t b2;
+			board_copy(&b2, b);
+			move_t m = move(node_coord(ni), color);
+			if (board_play(&b2, &m) >= 0) {
+				tree_expand_node(t, ni, &b2, stone_other(color), u, -1);
+				count++;
+			}
+			board_done(&b2);
+		}
+		secs += time_now() - time_start;
+		tree_done(t);
+	} foreach_bench_position_end;
+
+	engine_done(&e);
+	bench_report("expand", w->size, 1, count, secs);
+}
+
+/* Thread models for uct scaling runs. Default one first (reported as "uct"). */
+static char *thread_models[] = { NULL, "root", "hybrid" };
+
+/* Uct genmove from first and middle position of each game.
+ * @model: uct thread model, NULL for default. */
+static void
+bench_uct(board_t *b, bench_workload_t *w, bench_moves_t *games, int ngames, int threads, char *model, char *engine_args)
+{
+	char tstr[32];
+	sprintf(tstr, "=%i", w->uct_playouts);
+	time_info_t ti;
+	if (!time_parse(&ti, tstr))  die("bench: bad time settings %s\n", tstr);
+
+	strbuf(buf, 1024);
+	sbprintf(buf, "threads=%i,pondering=0", threads);
+	if (model)         sbprintf(buf, ",thread_model=%s", model);
+	if (*engine_args)  sbprintf(buf, ",%s", engine_args);
+	engine_t e;  engine_init(&e, E_UCT, buf->str, b);
+
+	unsigned long long count = 0;
+	double secs = 0;
+	for (int g = 0; g < ngames; g++)
+		for (int k = 0; k < 2; k++) {
+			bench_setup(b, &games[g], (k ? games[g].moves / 2 : POSITION_STEP));
+			engine_reset(&e, b);
+			enum stone color = board_to_play(b);
+			time_info_t ti_genmove = ti;
+
+			/* Playouts actually done, search may stop early. */
+			telemetry_t tm;  telemetry_collect(&tm);
+			unsigned long long playouts = tm.counter[TM_PLAYOUTS];
+			double time_start = time_now();
+			e.genmove(&e, b, &ti_genmove, color, false);
+			secs += time_now() - time_start;
+			telemetry_collect(&tm);
+			count += tm.counter[TM_PLAYOUTS] - playouts;
+		}
+
+	engine_done(&e);
+	char name[32];
+	sprintf(name, "uct%s%s", (model ? "-" : ""), (model ? model : ""));
+	bench_report(name, w->size, threads, count, secs);
+}
+
+int
+bench_run(board_t *b, int max_threads, char *engine_args)
+{
+	if (max_threads <= 0)  max_threads = get_nprocessors();
+	printf("{\"bench\": \"info\", \"bench_version\": %i, \"version\": \"%s\", \"git\": \"%s\", \"seed\": %i, \"max_threads\": %i}\n",
+	       BENCH_VERSION, PACHI_VERSION_FULL, PACHI_VERGIT, BENCH_SEED, max_threads);
+
+	int nmodels = (strstr(engine_args, "thread_model") ? 1 : sizeof(thread_models) / sizeof(thread_models[0]));
+	pattern_config_t pc;
+	patterns_init(&pc, NULL, false, true);
+	pc.incremental = false;		/* Same position over and over, measure full matching */
+	double time_start = time_now();
+
+	for (unsigned int i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++) {
+		bench_workload_t *w = &workloads[i];
+		board_resize(b, w->size);
+		board_clear(b);
+
+		bench_moves_t games[CORPUS_GAMES];
+		int ngames = 0;
+		for (int g = 0; g < CORPUS_GAMES; g++)
+			if (corpus[g].size == w->size)
+				bench_parse_game(&corpus[g], &games[ngames++]);
+
+		fast_srandom(BENCH_SEED);  bench_board_play(b, w, games, ngames);
+		fast_srandom(BENCH_SEED);  bench_moggy(b, w, games, ngames);
+		if (prob_dict) {
+			fast_srandom(BENCH_SEED);  bench_patterns(b, w, games, ngames, &pc);
+		}
+		fast_srandom(BENCH_SEED);  bench_ladders(b, w, games, ngames);
+		fast_srandom(BENCH_SEED);  bench_expand(b, w, games, ngames, engine_args);
+		/* 1, 2, 4 ... max_threads threads, for each thread model
+		 * (only given one if set in engine args). Single thread is
+		 * the same for all. */
+		for (int m = 0; m < nmodels; m++) {
+			char *model = thread_models[m];
+			for (int threads = (model ? 2 : 1); threads < max_threads; threads *= 2) {
+				fast_srandom(BENCH_SEED);  bench_uct(b, w, games, ngames, threads, model, engine_args);
+			}
+			if (max_threads > 1 || !model) {
+				fast_srandom(BENCH_SEED);  bench_uct(b, w, games, ngames, max_threads, model, engine_args);
+			}
+		}
+	}
+
+	if (DEBUGL(2))  fprintf(stderr, "bench done in %.1fs\n", time_now() - time_start);
+	return 0;
+}
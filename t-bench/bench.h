@@ -0,0 +1,10 @@
+#ifndef PACHI_BENCH_BENCH_H
+#define PACHI_BENCH_BENCH_H
+
+/* Run benchmark suite on built-in corpus and exit: board, playout, patterns,
+ * ladders, tree expansion and uct search speed for 9x9, 13x13 and 19x19.
+ * Uct search is run with 1, 2, 4 ... @max_threads threads for each thread
+ * model (tree, root, hybrid), @engine_args are passed to uct engine. One json line per result on stdout. */
+int bench_run(board_t *b, int max_threads, char *engine_args);
+
+#endif
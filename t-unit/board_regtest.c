@@ -63,6 +63,61 @@ hash_board_statics(board_t *b)
 	return md;
 }
 
+/* Liberties of group @g, in coord order. Returns count. */
+static int
+group_real_libs(board_t *b, group_t g, coord_t *libs)
+{
+	bool is_lib[BOARD_MAX_COORDS] = { 0, };
+	foreach_in_group(b, g) {
+		coord_t stone = c;
+		foreach_neighbor(b, stone, {
+			if (board_at(b, c) == S_NONE)
+				is_lib[c] = true;
+		});
+	} foreach_in_group_end;
+
+	int n = 0;
+	for (coord_t c = 0; c < board_max_coords(b); c++)
+		if (is_lib[c])  libs[n++] = c;
+	return n;
+}
+
+/* lib[] must hold distinct liberties of the group, all of them if
+ * there are few. */
+static void
+check_group_libs(board_t *b, group_t g, coord_t *libs, int n)
+{
+	group_info_t *gi = &board_group_info(b, g);
+	assert(gi->libs <= n);
+	if (n <= GROUP_REFILL_LIBS)  assert(gi->libs == n);
+	for (int i = 0; i < gi->libs; i++) {
+		assert(board_at(b, gi->lib[i]) == S_NONE);
+		bool found = false;
+		for (int j = 0; j < n && !found; j++)
+			found = (libs[j] == gi->lib[i]);
+		assert(found);
+		for (int j = 0; j < i; j++)
+			assert(gi->lib[j] != gi->lib[i]);
+	}
+}
+
+#ifdef BOARD_LIBSETS
+/* Liberty bitset must have exactly the group's liberties. */
+static void
+check_libset(board_t *b, group_t g)
+{
+	libset_t libs = { { 0, } };
+	foreach_in_group(b, g) {
+		coord_t stone = c;
+		foreach_neighbor(b, stone, {
+			if (board_at(b, c) == S_NONE)
+				libset_add(&libs, c);
+		});
+	} foreach_in_group_end;
+	assert(!memcmp(&libs, &board_group_info(b, g).libset, sizeof(libs)));
+}
+#endif
+
 static unsigned char*
 hash_board(board_t *b)
 {
@@ -116,8 +171,22 @@ hash_board(board_t *b)
 		if (!g || g != c)  continue;  /* foreach group really */
 		
 		hash_int(c);
+		coord_t libs[BOARD_MAX_COORDS];
+		int n = group_real_libs(b, g, libs);
+		check_group_libs(b, g, libs, n);  /* sanity check ... */
+#ifndef BOARD_LIBSETS
 		for (int i = 0; i < board_group_info(b, g).libs; i++)
 			hash_int(board_group_info(b, g).lib[i]);
+#else
+		/* Which liberties lib[] keeps after a refill, and in what order,
+		 * isn't the same with libsets: hash real liberties instead
+		 * (compared against regtest-libsets.ref). */
+		for (int i = 0; i < n; i++)
+			hash_int(libs[i]);
+#endif
+#ifdef BOARD_LIBSETS
+		check_libset(b, g);  /* sanity check ... */
+#endif
 	} foreach_point_end;
 
 
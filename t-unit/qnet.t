@@ -0,0 +1,40 @@
+% Int8 quantized inference: calibrated on some positions, agrees with fp32 on others
+
+% Random nets, sizes similar to policy nets (layers, filters)
+boardsize 19
+. . . . . . . . . . . . . . . . . . .
+. . . . . . . . . . . . . . . . . . .
+. . . O . . . . . . . . . . . . . . .
+. . X . . . . . . . . . . . . X . . .
+. . . . . . . . . . . . . . . . . . .
+. . X . . . . . . . . . . . . . . . .
+. . . . . . . . . . . . . . . . . . .
+. . . . . . . . . . . . . . . . . . .
+. . . . . . . . . . . . . . . . . . .
+. . . . . . . . . . . . . . . . . . .
+. . . . . . . . . . . . . . . . . . .
+. . . . . . . . . . . . . . . . . . .
+. . . . . . . . . . . . . . . . . . .
+. . . . . . . . . . . . . . . . . . .
+. . . . . . . . . . . . . . . . . . .
+. . . O . . . . . . . . . . . O)X . .
+. . . . . . . . . . . . . . . . O . .
+. . . . . . . . . . . . . . . . . . .
+. . . . . . . . . . . . . . . . . . .
+
+qnet 3 32
+qnet 6 64
+qnet 12 128
+
+boardsize 9
+. . . . . . . . .
+. . . . . . . . .
+. . O . . X . . .
+. . . . . . . . .
+. . . . X). . . .
+. . . . . . . . .
+. . X . . . O . .
+. . . . . . . . .
+. . . . . . . . .
+
+qnet 4 48
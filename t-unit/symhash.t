@@ -0,0 +1,42 @@
+% Symmetric hashes: transformed positions, canonical hash, fbook lookups
+
+% Empty board, sequence with a capture
+boardsize 19
+. . . . . . . . . . . . . . . . . . .
+. . . . . . . . . . . . . . . . . . .
+. . . . . . . . . . . . . . . . . . .
+. . . . . . . . . . . . . . . . . . .
+. . . . . . . . . . . . . . . . . . .
+. . . . . . . . . . . . . . . . . . .
+. . . . . . . . . . . . . . . . . . .
+. . . . . . . . . . . . . . . . . . .
+. . . . . . . . . . . . . . . . . . .
+. . . . . . . . . . . . . . . . . . .
+. . . . . . . . . . . . . . . . . . .
+. . . . . . . . . . . . . . . . . . .
+. . . . . . . . . . . . . . . . . . .
+. . . . . . . . . . . . . . . . . . .
+. . . . . . . . . . . . . . . . . . .
+. . . . . . . . . . . . . . . . . . .
+. . . . . . . . . . . . . . . . . . .
+. . . . . . . . . . . . . . . . . . .
+. . . . . . . . . . . . . . . . . . .
+
+symhash Q16 D4 R4 C16 | E3
+symhash C3 D3 R16 C4 D16 B3 Q4 C2 | K10
+symhash K10 D4 Q16 D16 | C6
+
+% Setup stones
+boardsize 9
+. . . . . . . . .
+. . . . . . . . .
+. . O . . X . . .
+. . . . . . . . .
+. . . . X). . . .
+. . . . . . . . .
+. . X . . . O . .
+. . . . . . . . .
+. . . . . . . . .
+
+symhash D5 F5 | E4
+symhash G6 | C7
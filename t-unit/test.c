@@ -3,6 +3,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
+#include <unistd.h>
 #include <assert.h>
 
 #include "board.h"
@@ -20,6 +22,9 @@
 #include "playout/moggy.h"
 #include "engines/replay.h"
 #include "ownermap.h"
+#include "qnet.h"
+#include "dcnn.h"
+#include "fbook.h"
 
 
 /* Running tests over gtp ? */
@@ -578,6 +583,281 @@ test_moggy_status(board_t *b, char *arg)
 	return ret;
 }
 
+/* Deterministic weights in [-a, a] */
+static float
+qnet_test_weight(unsigned int *seed, float a)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return a * (2.0 * ((*seed >> 8) & 0xffff) / 0xffff - 1);
+}
+
+/* Play @n random legal moves on @b (deterministic, from @seed). */
+static void
+qnet_test_moves(board_t *b, unsigned int *seed, int n)
+{
+	int size = board_rsize(b);
+	for (int i = 0; i < n; i++) {
+		enum stone color = board_to_play(b);
+		for (int tries = 0; tries < 100; tries++) {
+			*seed = *seed * 1103515245 + 12345;
+			coord_t c = coord_xy(1 + (*seed >> 8) % size, 1 + (*seed >> 20) % size);
+			if (!board_is_valid_play(b, color, c))  continue;
+			move_t m = move(c, color);
+			board_play(b, &m);
+			break;
+		}
+	}
+}
+
+/* Input planes: to play, other color, empty, ones */
+#define QNET_TEST_PLANES 4
+
+static void
+qnet_test_input(board_t *b, float *in)
+{
+	int size = board_rsize(b), size2 = size * size;
+	enum stone color = board_to_play(b);
+	memset(in, 0, QNET_TEST_PLANES * size2 * sizeof(float));
+	for (int y = 0; y < size; y++)
+	for (int x = 0; x < size; x++) {
+		enum stone s = board_at(b, coord_xy(x + 1, y + 1));
+		int p = (s == color ? 0 : (s == stone_other(color) ? 1 : 2));
+		in[p * size2 + y * size + x] = 1;
+		in[3 * size2 + y * size + x] = 1;
+	}
+}
+
+#define QNET_CALIB 8	/* Calibration positions */
+#define QNET_HELD  8	/* Held out positions */
+
+/* Random policy net with @layers conv layers, calibrated on some positions
+ * derived from @b: int8 inference should agree with fp32 on other positions
+ * (int8 top move is fp32 top move or within 10% of it, small max diff),
+ * and survive save / load. */
+static bool
+test_qnet(board_t *b, char *arg)
+{
+	next_arg(arg);
+	int layers = atoi(arg);
+	next_arg(arg);
+	int filters = atoi(arg);
+	args_end();
+
+	PRINT_TEST(b, "qnet %i %i...\t", layers, filters);
+	assert(layers >= 2);
+
+	int size = board_rsize(b), size2 = size * size, planes = QNET_TEST_PLANES;
+	int npos = QNET_CALIB + QNET_HELD;
+	float *in = calloc2(npos * planes * size2, float);
+	unsigned int seed = 1;
+	for (int k = 0; k < npos; k++) {
+		board_t b2;
+		board_copy(&b2, b);
+		qnet_test_moves(&b2, &seed, 2 + 2 * k);
+		qnet_test_input(&b2, in + k * planes * size2);
+		board_done(&b2);
+	}
+
+	seed = 1;
+	qnet_t *net = qnet_new(true);
+	for (int i = 0; i < layers; i++) {
+		int in_c = (i ? filters : planes);
+		int out_c = (i == layers - 1 ? 1 : filters);
+		int k = (!i ? 5 : (i == layers - 1 ? 1 : 3));
+		int n = out_c * in_c * k * k;
+		float w[n], bias[out_c];
+		for (int j = 0; j < n; j++)      w[j] = qnet_test_weight(&seed, sqrt(6.0 / (in_c * k * k)));
+		for (int j = 0; j < out_c; j++)  bias[j] = qnet_test_weight(&seed, 0.1);
+		qnet_add_layer(net, in_c, out_c, k, w, bias, i != layers - 1);
+	}
+
+	float r32[size2], r8[size2], r8b[size2];
+	for (int k = 0; k < QNET_CALIB; k++)
+		qnet_forward_fp32(net, in + k * planes * size2, size, r32, true);
+	qnet_quantize(net);
+
+	char *file = "qnet_test.tmp";
+	qnet_save(net, file);
+	qnet_t *net2 = qnet_load(file);
+	unlink(file);
+
+	float maxdiff = 0;
+	int same = 0, close = 0;
+	bool same_file = true;
+	for (int k = QNET_CALIB; k < npos; k++) {
+		float *pin = in + k * planes * size2;
+		qnet_forward_fp32(net, pin, size, r32, false);
+		qnet_forward(net, pin, size, r8);
+		qnet_forward(net2, pin, size, r8b);
+
+		int best32 = 0, best8 = 0;
+		for (int i = 0; i < size2; i++) {
+			if (fabs(r32[i] - r8[i]) > maxdiff)  maxdiff = fabs(r32[i] - r8[i]);
+			if (r32[i] > r32[best32])  best32 = i;
+			if (r8[i] > r8[best8])     best8 = i;
+		}
+		same += (best32 == best8);
+		close += (r32[best8] >= 0.9 * r32[best32]);  /* Random nets have many near ties */
+		same_file &= !memcmp(r8, r8b, sizeof(r8));
+	}
+	if (DEBUGL(2))  fprintf(stderr, "(%s, top move %i/%i, close %i/%i, max diff %.4f) ",
+				qnet_simd(), same, QNET_HELD, close, QNET_HELD, maxdiff);
+
+	qnet_delete(&net);  qnet_delete(&net2);
+	free(in);
+	bool rres = (same >= QNET_HELD / 2 && close == QNET_HELD && maxdiff < 0.01 && same_file);
+	PRINT_RES(rres);
+	return   rres;
+}
+
+#ifdef DCNN
+/* Evaluating @n positions derived from @b in one dcnn batch must give the
+ * same results as evaluating them one at a time. Reports batch speedup. */
+static bool
+test_dcnn_batch(board_t *b, char *arg)
+{
+	next_arg(arg);
+	int n = atoi(arg);
+	args_end();
+
+	dcnn_init(b);
+	PRINT_TEST(b, "dcnn_batch %i...\t", n);
+	assert(n >= 1);
+
+	if (!using_dcnn(b)) {
+		if (DEBUGL(2))  fprintf(stderr, "(dcnn not available) ");
+		PRINT_RES(false);
+		return false;
+	}
+	dcnn_cache_set_size(0);  /* Evaluate everything */
+
+	int size2 = board_rsize(b) * board_rsize(b);
+	board_t *boards[n];
+	enum stone colors[n];
+	float *single[n], *batch[n];
+	unsigned int seed = 1;
+	for (int k = 0; k < n; k++) {
+		boards[k] = malloc2(board_t);
+		board_copy(boards[k], b);
+		qnet_test_moves(boards[k], &seed, 2 + 2 * k);
+		colors[k] = board_to_play(boards[k]);
+		single[k] = calloc2(size2, float);
+		batch[k] = calloc2(size2, float);
+	}
+
+	double time_start = time_now();
+	for (int k = 0; k < n; k++)
+		dcnn_evaluate_quiet(boards[k], colors[k], single[k]);
+	double single_time = time_now() - time_start;
+
+	time_start = time_now();
+	dcnn_evaluate_batch(boards, colors, batch, n);
+	double batch_time = time_now() - time_start;
+
+	float maxdiff = 0;
+	for (int k = 0; k < n; k++)
+		for (int i = 0; i < size2; i++)
+			if (fabs(single[k][i] - batch[k][i]) > maxdiff)  maxdiff = fabs(single[k][i] - batch[k][i]);
+	if (DEBUGL(2))  fprintf(stderr, "(single %.1fms, batch %.1fms per position, speedup %.2fx, max diff %g) ",
+				single_time * 1000 / n, batch_time * 1000 / n, single_time / batch_time, maxdiff);
+
+	for (int k = 0; k < n; k++) {
+		board_done(boards[k]);  free(boards[k]);
+		free(single[k]);  free(batch[k]);
+	}
+	bool rres = (maxdiff < 1e-5);
+	PRINT_RES(rres);
+	return   rres;
+}
+#endif
+
+/* Transformed boards must have hashes given by symhash[] of
+ * identity board, and same canonical hash. */
+static bool
+symhash_check(board_t **bt, char *where)
+{
+	bool ok = true;
+	for (int t = 0; t < 8; t++) {
+		if (bt[t]->hash != bt[0]->symhash[t]) {
+			if (DEBUGL(1))  fprintf(stderr, "symhash[%i] mismatch %s ", t, where);
+			ok = false;
+		}
+		if (bt[t]->canonical_hash != bt[0]->canonical_hash) {
+			if (DEBUGL(1))  fprintf(stderr, "transform %i: canonical hash mismatch %s ", t, where);
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+/* Play "MOVES... | NEXT" from @b on the 8 transforms of @b: symhash[] must
+ * give the transformed boards hashes, canonical hashes must match, and an
+ * fbook entry for NEXT must map back to the transformed move on each. */
+static bool
+test_symhash(board_t *b, char *arg)
+{
+	PRINT_TEST(b, "symhash %s...\t", arg);
+
+	board_t *bt[8];
+	enum stone to_play = board_to_play(b);
+	for (int t = 0; t < 8; t++) {
+		bt[t] = board_new(board_rsize(b), NULL);
+		foreach_point(b) {
+			enum stone color = board_at(b, c);
+			if (color != S_BLACK && color != S_WHITE)  continue;
+			move_t m = move(board_sym_coord(c, t), color);
+			check_play_move(bt[t], &m);
+		} foreach_point_end;
+		last_move(bt[t]).color = stone_other(to_play);
+	}
+	bool ok = symhash_check(bt, "in setup");
+
+	coord_t next_move = pass;
+	while (*next) {
+		char *str;
+		next_arg(str);
+		if (!strcmp(str, "|")) {
+			next_arg(str);
+			next_move = str2coord(str);
+			break;
+		}
+		coord_t c = str2coord(str);
+		enum stone color = board_to_play(bt[0]);
+		for (int t = 0; t < 8; t++) {
+			move_t m = move(board_sym_coord(c, t), color);
+			check_play_move(bt[t], &m);
+		}
+		ok &= symhash_check(bt, str);
+	}
+	args_end();
+	assert(!is_pass(next_move));
+
+	/* Store NEXT like fbook_init() does, look it up on each transform. */
+	fbook_t *fbook = calloc2(1, fbook_t);
+	for (int i = 0; i < 1 << fbook_hash_bits; i++)
+		fbook->moves[i] = pass;
+	hash_t hash = bt[0]->canonical_hash;
+	fbook->moves[hash & fbook_hash_mask] = board_sym_coord(next_move, bt[0]->canonical_sym);
+	fbook->hashes[hash & fbook_hash_mask] = hash;
+
+	for (int t = 0; t < 8 && ok; t++) {
+		bt[t]->fbook = fbook;
+		coord_t c = fbook_check(bt[t]);  /* Frees fbook on miss */
+		bt[t]->fbook = NULL;
+		if (c != board_sym_coord(next_move, t)) {
+			if (DEBUGL(1))  fprintf(stderr, "transform %i: fbook gave %s instead of %s ", t,
+						coord2sstr(c), coord2sstr(board_sym_coord(next_move, t)));
+			ok = false;
+			fbook = NULL;
+		}
+	}
+	if (fbook)  fbook_done(fbook);
+
+	for (int t = 0; t < 8; t++)  board_delete(&bt[t]);
+	PRINT_RES(ok);
+	return   ok;
+}
+
 bool board_undo_stress_test(board_t *orig, char *arg);
 bool board_regression_test(board_t *orig, char *arg);
 bool moggy_regression_test(board_t *orig, char *arg);
@@ -606,6 +886,11 @@ static t_unit_cmd commands[] = {
 	{ "moggy status",           test_moggy_status,      0 },
 	{ "corner_seki",            test_corner_seki,       1 },
 	{ "false_eye_seki",         test_false_eye_seki,    1 },
+	{ "qnet",                   test_qnet,              1 },
+	{ "symhash",                test_symhash,           1 },
+#ifdef DCNN
+	{ "dcnn_batch",             test_dcnn_batch,        1 },
+#endif
 #ifdef BOARD_TESTS
 	{ "board_undo_stress_test", board_undo_stress_test, 0 },
 	{ "board_regtest",          board_regression_test,  0 },
@@ -48,6 +48,30 @@ board_quick_cmp(struct board *b1, struct board *b2)
 	return 0;
 }
 
+/* Like board_cmp() but ignore stale entries in f[], fmap[] and c[],
+ * board_full_undo() doesn't restore those. */
+static int
+board_full_cmp(board_t *b1, board_t *b2)
+{
+	board_t *b[2] = { malloc2(board_t), malloc2(board_t) };
+	board_copy(b[0], b1);
+	board_copy(b[1], b2);
+	for (int i = 0; i < 2; i++) {
+		for (int j = b[i]->flen; j < BOARD_MAX_COORDS; j++)
+			b[i]->f[j] = 0;
+		foreach_point(b[i]) {
+			if (board_at(b[i], c) != S_NONE)  b[i]->fmap[c] = 0;
+		} foreach_point_end;
+#ifdef WANT_BOARD_C
+		for (int j = b[i]->clen; j < BOARD_MAX_GROUPS; j++)
+			b[i]->c[j] = 0;
+#endif
+	}
+	int r = board_cmp(b[0], b[1]);
+	free(b[0]);  free(b[1]);
+	return r;
+}
+
 static void
 board_dump_group(board_t *b, group_t g)
 {
@@ -123,7 +147,8 @@ show_suicide_info(board_t *b, board_t *orig, coord_t c, enum stone color)
 }
 
 
-/* Play move and check board states after quick_play() / quick_undo() match */
+/* Play move and check board states after quick_play() / quick_undo() and
+ * full_play() / full_undo() match */
 static coord_t
 test_undo(board_t *orig, coord_t c, enum stone color)
 {
@@ -151,13 +176,75 @@ test_undo(board_t *orig, coord_t c, enum stone color)
 		assert(0);
 	}
 
+	/* Same with board_full_play() / board_full_undo(), on a board
+	 * keeping hashes */
+	board_t full, b3;
+	board_copy(&full, orig);
+	full.playout_board = false;
+	board_done(&b);
+	board_copy(&b, &full);
+	board_copy(&b3, &full);
+	r = board_play(&b, &m);  assert(r >= 0);
+	board_full_undo_t u;
+	r = board_full_play(&b3, &m, &u);  assert(r >= 0);
+	assert(!board_cmp(&b3, &b));
+	board_full_undo(&b3, &m, &u);
+	if (board_full_cmp(&b3, &full)) {
+		board_dump(&full);
+		board_dump(&b3);
+		assert(0);
+	}
+
 	board_done(&b);
 	board_done(&b2);
+	board_done(&b3);
+	board_done(&full);
 	
 	return c;
 }
 
 
+/* Play random game with board_full_play(), then undo it all and check we
+ * are back to start. */
+static void
+test_full_undo_game(board_t *orig, enum stone color)
+{
+	board_t *b = malloc2(board_t), *start = malloc2(board_t);
+	board_copy(start, orig);
+	start->playout_board = false;
+	board_copy(b, start);
+
+	move_t *moves = calloc2(MAX_GAMELEN, move_t);
+	board_full_undo_t *u = calloc2(MAX_GAMELEN, board_full_undo_t);
+	int n = 0, passes = 0;
+	while (n < MAX_GAMELEN && passes < 2) {
+		move_t m = move(pass, color);
+		for (int i = 0; i < 10 && b->flen; i++) {
+			coord_t c = b->f[fast_random(b->flen)];
+			if (board_is_valid_play(b, color, c) && !board_is_one_point_eye(b, c, color)) {
+				m.coord = c;  break;
+			}
+		}
+		if (board_full_play(b, &m, &u[n]) < 0)  continue;
+		passes = (is_pass(m.coord) ? passes + 1 : 0);
+		moves[n++] = m;
+		color = stone_other(color);
+	}
+
+	while (n--)
+		board_full_undo(b, &moves[n], &u[n]);
+	if (board_full_cmp(b, start)) {
+		board_dump(start);
+		board_dump(b);
+		assert(0);
+	}
+
+	free(moves);  free(u);
+	board_done(b);  free(b);
+	board_done(start);  free(start);
+}
+
+
 static playoutp_permit policy_permit = NULL;
 
 static bool
@@ -196,6 +283,8 @@ board_undo_stress_test(board_t *board, char *arg)
 		board_copy(&b, board);		
 		playout_play_game(&setup, &b, color, NULL, NULL, policy);
 		board_done(&b);
+
+		test_full_undo_game(board, color);
 	}
 	
 	printf("All good.\n\n");
@@ -242,6 +242,19 @@ static int
 foreach_lib_handler(board_t *b, enum stone color, group_t g, void *data)
 {
 	foreach_lib_data_t *d = (foreach_lib_data_t*)data;
+#ifdef BOARD_LIBSETS
+	/* All liberties, not just the ones in lib[] */
+	libset_t *s = &board_group_info(b, g).libset;
+	for (int i = 0; i < LIBSET_WORDS; i++)
+		for (uint64_t w = s->w[i]; w; w &= w - 1) {
+			coord_t lib = i * 64 + __builtin_ctzll(w);
+			if (d->visited[lib])
+				continue;
+			d->visited[lib] = 1;
+			if (d->f(b, color, lib, d->data) == -1)
+				return -1;
+		}
+#else
 	for (int i = 0; i < board_group_info(b, g).libs; i++) {
 		coord_t lib = board_group_info(b, g).lib[i];
 		if (d->visited[lib])
@@ -250,6 +263,7 @@ foreach_lib_handler(board_t *b, enum stone color, group_t g, void *data)
 		if (d->f(b, color, lib, d->data) == -1)
 			return -1;
 	}
+#endif
 	return 0;			
 }
 
@@ -546,6 +560,31 @@ neighbor_is_safe(board_t *b, group_t g)
 }
 
 
+#ifdef BOARD_LIBSETS
+
+static int
+merge_libs(board_t *b, enum stone color, group_t g, void *data)
+{
+	libset_t *libs = (libset_t*)data;
+	for (int i = 0; i < LIBSET_WORDS; i++)
+		libs->w[i] |= board_group_info(b, g).libset.w[i];
+	return 0;
+}
+
+int
+dragon_liberties(board_t *b, enum stone color, coord_t to)
+{
+	libset_t libs = { { 0, } };
+	foreach_connected_group(b, color, to, merge_libs, &libs);
+
+	int n = 0;
+	for (int i = 0; i < LIBSET_WORDS; i++)
+		n += __builtin_popcountll(libs.w[i]);
+	return n;
+}
+
+#else
+
 static int
 count_libs(board_t *b, enum stone color, coord_t c, void *data)
 {	
@@ -561,6 +600,8 @@ dragon_liberties(board_t *b, enum stone color, coord_t to)
 	return libs;
 }
 
+#endif
+
 
 static int
 dragon_at_handler(board_t *b, enum stone color, group_t g, void *data)
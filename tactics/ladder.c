@@ -13,6 +13,7 @@
 #include "tactics/selfatari.h"
 #include "tactics/dragon.h"
 #include "tactics/ladder.h"
+#include "telemetry.h"
 
 
 /* Read out middle ladder countercap sequences ? Otherwise we just
@@ -219,6 +220,7 @@ is_middle_ladder(board_t *b, group_t laddered)
 	/* A fair chance for a ladder. Group in atari, with some but limited
 	 * space to escape. Time for the expensive stuff - play it out and
 	 * start selective 2-liberty search. */
+	telemetry_inc(TM_LADDER_READS);
 	length = middle_ladder_walk(b, laddered, lcolor, pass, 0);
 
 	if (DEBUGL(6) && length)  fprintf(stderr, "is_ladder(): stones: %i  length: %i\n",
@@ -232,6 +234,7 @@ is_middle_ladder_any(board_t *b, group_t laddered)
 {
 	enum stone lcolor = board_at(b, group_base(laddered));
 	
+	telemetry_inc(TM_LADDER_READS);
 	length = middle_ladder_walk(b, laddered, lcolor, pass, 0);
 	return (length != 0);
 }
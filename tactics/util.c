@@ -41,9 +41,11 @@ cfg_distances(board_t *b, coord_t start, int *distances, int maxdist)
 #define qinc(x) (x = ((x + 1) >= board_max_coords(b) ? ((x) + 1 - board_max_coords(b)) : (x) + 1))
 	coord_t queue[board_max_coords(b)]; int qstart = 0, qstop = 0;
 
-	foreach_point(b) {
-		distances[c] = board_at(b, c) == S_OFFBOARD ? maxdist + 1 : -1;
-	} foreach_point_end;
+	/* Everything starts out of reach, points within maxdist get
+	 * overwritten as we go: saves a second pass over the board. */
+	for (coord_t c = 0; c < board_max_coords(b); c++)
+		distances[c] = maxdist + 1;
+#define unvisited(c)  (distances[c] > maxdist && board_at(b, c) != S_OFFBOARD)
 
 	queue[qstop++] = start;
 	for (int d = 0; d <= maxdist; d++) {
@@ -55,14 +57,14 @@ cfg_distances(board_t *b, coord_t start, int *distances, int maxdist)
 #define cfg_one(coord, grp) do {\
 	distances[coord] = d; \
 	foreach_neighbor (b, coord, { \
-		if (distances[c] < 0 && (!grp || group_at(b, coord) != grp)) { \
+		if (unvisited(c) && (!grp || group_at(b, coord) != grp)) { \
 			queue[qstop] = c; \
 			qinc(qstop); \
 		} \
 	}); \
 } while (0)
 			coord_t cq = queue[q];
-			if (distances[cq] >= 0)
+			if (!unvisited(cq))
 				continue; /* We already looked here. */
 			if (board_at(b, cq) == S_NONE) {
 				cfg_one(cq, 0);
@@ -75,11 +77,8 @@ cfg_distances(board_t *b, coord_t start, int *distances, int maxdist)
 #undef cfg_one
 		}
 	}
-
-	foreach_point(b) {
-		if (distances[c] < 0)
-			distances[c] = maxdist + 1;
-	} foreach_point_end;
+#undef unvisited
+#undef qinc
 }
 
 
@@ -0,0 +1,272 @@
+#define DEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "debug.h"
+#include "timeinfo.h"
+#include "telemetry.h"
+
+/* Live threads use slots [0, TM_MAX_SLOTS), if we run out extra threads
+ * share the overflow slot (counts may get slightly wrong then). */
+#define TM_MAX_SLOTS 256
+
+static telemetry_slot_t slots[TM_MAX_SLOTS + 1];
+static telemetry_slot_t *overflow_slot = &slots[TM_MAX_SLOTS];
+static bool slot_used[TM_MAX_SLOTS];
+static telemetry_slot_t retired;	/* Totals from threads that exited */
+static int nthreads;
+
+static uint64_t gauges[TM_GAUGES];
+static double start_time;
+
+static pthread_mutex_t tm_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t tm_key;
+static pthread_once_t tm_once = PTHREAD_ONCE_INIT;
+
+__thread telemetry_slot_t *telemetry_thread_slot = NULL;
+
+
+static void
+timer_merge(telemetry_timer_t *dest, telemetry_timer_t *src)
+{
+	dest->count += src->count;
+	dest->total += src->total;
+	if (src->max > dest->max)  dest->max = src->max;
+	for (int i = 0; i < TM_HIST_BUCKETS; i++)
+		dest->hist[i] += src->hist[i];
+}
+
+static void
+slot_merge(telemetry_slot_t *dest, telemetry_slot_t *src)
+{
+	for (int i = 0; i < TM_COUNTERS; i++)
+		dest->counter[i] += src->counter[i];
+	for (int i = 0; i < TM_TIMERS; i++)
+		timer_merge(&dest->timer[i], &src->timer[i]);
+}
+
+/* Thread exit: keep its numbers and release slot. */
+static void
+slot_release(void *data)
+{
+	telemetry_slot_t *s = data;
+	if (s == overflow_slot)  return;
+
+	pthread_mutex_lock(&tm_mutex);
+	slot_merge(&retired, s);
+	memset(s, 0, sizeof(*s));
+	slot_used[s - slots] = false;
+	pthread_mutex_unlock(&tm_mutex);
+}
+
+static void
+telemetry_init(void)
+{
+	pthread_key_create(&tm_key, slot_release);
+	start_time = time_now();
+}
+
+telemetry_slot_t *
+telemetry_slot_register(void)
+{
+	pthread_once(&tm_once, telemetry_init);
+
+	telemetry_slot_t *s = overflow_slot;
+	pthread_mutex_lock(&tm_mutex);
+	for (int i = 0; i < TM_MAX_SLOTS; i++)
+		if (!slot_used[i]) {
+			slot_used[i] = true;
+			s = &slots[i];
+			break;
+		}
+	nthreads++;
+	pthread_mutex_unlock(&tm_mutex);
+
+	if (s == overflow_slot && DEBUGL(2))
+		fprintf(stderr, "telemetry: out of slots, sharing overflow slot\n");
+	pthread_setspecific(tm_key, s);
+	telemetry_thread_slot = s;
+	return s;
+}
+
+void
+telemetry_time(enum telemetry_timer t, double seconds)
+{
+	telemetry_timer_t *tm = &telemetry_slot()->timer[t];
+	tm->count++;
+	tm->total += seconds;
+	if (seconds > tm->max)  tm->max = seconds;
+
+	/* log2 bucket of duration in microseconds */
+	uint64_t us = seconds * 1000000;
+	int i = (us ? 64 - __builtin_clzll(us) : 0);
+	if (i >= TM_HIST_BUCKETS)  i = TM_HIST_BUCKETS - 1;
+	tm->hist[i]++;
+}
+
+void
+telemetry_set(enum telemetry_gauge g, uint64_t value)
+{
+	gauges[g] = value;
+}
+
+void
+telemetry_collect(telemetry_t *tm)
+{
+	pthread_once(&tm_once, telemetry_init);
+
+	telemetry_slot_t sum;
+	pthread_mutex_lock(&tm_mutex);
+	sum = retired;
+	for (int i = 0; i < TM_MAX_SLOTS + 1; i++)
+		slot_merge(&sum, &slots[i]);
+	tm->threads = nthreads;
+	pthread_mutex_unlock(&tm_mutex);
+
+	tm->uptime = time_now() - start_time;
+	memcpy(tm->counter, sum.counter, sizeof(tm->counter));
+	memcpy(tm->timer, sum.timer, sizeof(tm->timer));
+	memcpy(tm->gauge, gauges, sizeof(tm->gauge));
+}
+
+/* Live slots are reset without synchronization: a concurrent update may
+ * survive the reset, no big deal. */
+void
+telemetry_reset(void)
+{
+	pthread_once(&tm_once, telemetry_init);
+
+	pthread_mutex_lock(&tm_mutex);
+	memset(&retired, 0, sizeof(retired));
+	for (int i = 0; i < TM_MAX_SLOTS + 1; i++)
+		memset(&slots[i], 0, sizeof(slots[i]));
+	start_time = time_now();
+	pthread_mutex_unlock(&tm_mutex);
+}
+
+
+static char *counter_names[TM_COUNTERS] = {
+	[TM_PLAYOUTS] = "playouts",
+	[TM_DESCENTS] = "descents",
+	[TM_EXPANSIONS] = "expansions",
+	[TM_EXPAND_FAILED] = "expand_failed",
+	[TM_BOARD_PLAY] = "board_play",
+	[TM_LADDER_READS] = "ladder_reads",
+	[TM_DCNN_EVALS] = "dcnn_evals",
+	[TM_DCNN_CACHE_HITS] = "dcnn_cache_hits",
+};
+
+static char *timer_names[TM_TIMERS] = {
+	[TM_GC] = "gc",
+	[TM_PRUNE] = "prune",
+	[TM_PRIOR_PATTERN] = "prior_pattern",
+	[TM_PRIOR_JOSEKI] = "prior_joseki",
+	[TM_PRIOR_DCNN] = "prior_dcnn",
+	[TM_MCOWNER] = "mcowner",
+};
+
+static char *gauge_names[TM_GAUGES] = {
+	[TM_TREE_BYTES] = "tree_bytes",
+	[TM_TREE_MAX_BYTES] = "tree_max_bytes",
+};
+
+/* Approximate percentile (upper bound of histogram bucket), in seconds. */
+static double
+timer_percentile(telemetry_timer_t *t, double p)
+{
+	if (!t->count)  return 0;
+	uint64_t n = 0, want = t->count * p;
+	for (int i = 0; i < TM_HIST_BUCKETS; i++)
+		if ((n += t->hist[i]) > want) {
+			double s = (double)(1ULL << i) / 1000000;
+			return (s < t->max ? s : t->max);
+		}
+	return t->max;
+}
+
+void
+telemetry_print(strbuf_t *buf, telemetry_t *tm)
+{
+	sbprintf(buf, "uptime %.1fs  threads %i\n", tm->uptime, tm->threads);
+	for (int i = 0; i < TM_COUNTERS; i++)
+		sbprintf(buf, "%-16s %llu\n", counter_names[i], (unsigned long long)tm->counter[i]);
+	for (int i = 0; i < TM_GAUGES; i++)
+		sbprintf(buf, "%-16s %llu\n", gauge_names[i], (unsigned long long)tm->gauge[i]);
+	for (int i = 0; i < TM_TIMERS; i++) {
+		telemetry_timer_t *t = &tm->timer[i];
+		sbprintf(buf, "%-16s count %llu  total %.3fs  avg %.3fms  p50 %.3fms  p99 %.3fms  max %.3fms\n",
+			 timer_names[i], (unsigned long long)t->count, t->total,
+			 (t->count ? t->total * 1000 / t->count : 0),
+			 timer_percentile(t, 0.5) * 1000, timer_percentile(t, 0.99) * 1000, t->max * 1000);
+	}
+}
+
+void
+telemetry_print_json(strbuf_t *buf, telemetry_t *tm)
+{
+	sbprintf(buf, "{\"time\": %.3f, \"uptime\": %.3f, \"threads\": %i, ", time_now(), tm->uptime, tm->threads);
+	for (int i = 0; i < TM_COUNTERS; i++)
+		sbprintf(buf, "\"%s\": %llu, ", counter_names[i], (unsigned long long)tm->counter[i]);
+	for (int i = 0; i < TM_GAUGES; i++)
+		sbprintf(buf, "\"%s\": %llu, ", gauge_names[i], (unsigned long long)tm->gauge[i]);
+	sbprintf(buf, "\"timers\": {");
+	for (int i = 0; i < TM_TIMERS; i++) {
+		telemetry_timer_t *t = &tm->timer[i];
+		sbprintf(buf, "%s\"%s\": {\"count\": %llu, \"total\": %.6f, \"p50\": %.6f, \"p99\": %.6f, \"max\": %.6f, \"hist\": [",
+			 (i ? ", " : ""), timer_names[i], (unsigned long long)t->count, t->total,
+			 timer_percentile(t, 0.5), timer_percentile(t, 0.99), t->max);
+		/* Skip empty tail */
+		int n = TM_HIST_BUCKETS;
+		while (n && !t->hist[n - 1])  n--;
+		for (int j = 0; j < n; j++)
+			sbprintf(buf, "%s%u", (j ? ", " : ""), t->hist[j]);
+		sbprintf(buf, "]}");
+	}
+	sbprintf(buf, "}}");
+}
+
+
+typedef struct {
+	char *filename;
+	int interval;
+} telemetry_dump_t;
+
+static void *
+telemetry_dump_thread(void *data)
+{
+	telemetry_dump_t *d = data;
+	while (1) {
+		sleep(d->interval);
+
+		telemetry_t tm;
+		telemetry_collect(&tm);
+		strbuf(buf, 8192);
+		telemetry_print_json(buf, &tm);
+
+		FILE *f = fopen(d->filename, "a");
+		if (!f) {  perror(d->filename);  continue;  }
+		fprintf(f, "%s\n", buf->str);
+		fclose(f);
+	}
+	return NULL;
+}
+
+void
+telemetry_dump_start(char *filename, int interval)
+{
+	assert(interval > 0);
+	telemetry_dump_t *d = malloc2(telemetry_dump_t);
+	d->filename = strdup(filename);
+	d->interval = interval;
+
+	pthread_t thread;
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	pthread_create(&thread, &attr, telemetry_dump_thread, d);
+	pthread_attr_destroy(&attr);
+}
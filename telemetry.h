@@ -0,0 +1,107 @@
+#ifndef PACHI_TELEMETRY_H
+#define PACHI_TELEMETRY_H
+
+#include <stdint.h>
+#include "util.h"
+
+/* Search telemetry: event counters and latency histograms, cheap enough
+ * to be always on. Each thread gets its own cache-line aligned slot and
+ * updates it without atomics or locks, readers sum up all slots on demand
+ * (values read while search is running may be a little behind).
+ * Slots of exiting threads are folded into a shared total and reused. */
+
+enum telemetry_counter {
+	TM_PLAYOUTS,
+	TM_DESCENTS,		/* Tree nodes descended by playouts */
+	TM_EXPANSIONS,
+	TM_EXPAND_FAILED,	/* Nodes whose expansion ran out of tree memory */
+	TM_BOARD_PLAY,
+	TM_LADDER_READS,
+	TM_DCNN_EVALS,
+	TM_DCNN_CACHE_HITS,	/* Evaluations served from dcnn cache */
+	TM_COUNTERS
+};
+
+enum telemetry_timer {
+	TM_GC,			/* Tree nodes reclaim */
+	TM_PRUNE,		/* Tree garbage collection after promotion */
+	TM_PRIOR_PATTERN,
+	TM_PRIOR_JOSEKI,
+	TM_PRIOR_DCNN,
+	TM_MCOWNER,
+	TM_TIMERS
+};
+
+/* Single value, last one set wins. */
+enum telemetry_gauge {
+	TM_TREE_BYTES,
+	TM_TREE_MAX_BYTES,
+	TM_GAUGES
+};
+
+/* Latency histogram: bucket i counts durations in [2^(i-1), 2^i) us. */
+#define TM_HIST_BUCKETS 28
+
+typedef struct {
+	uint64_t count;
+	double   total;		/* seconds */
+	double   max;
+	uint32_t hist[TM_HIST_BUCKETS];
+} telemetry_timer_t;
+
+typedef struct {
+	uint64_t	  counter[TM_COUNTERS];
+	telemetry_timer_t timer[TM_TIMERS];
+} __attribute__((aligned(64))) telemetry_slot_t;
+
+extern __thread telemetry_slot_t *telemetry_thread_slot;
+telemetry_slot_t *telemetry_slot_register(void);
+
+static inline telemetry_slot_t *
+telemetry_slot(void)
+{
+	telemetry_slot_t *s = telemetry_thread_slot;
+	if (unlikely(!s))  s = telemetry_slot_register();
+	return s;
+}
+
+static inline void
+telemetry_add(enum telemetry_counter c, uint64_t n)
+{
+	telemetry_slot()->counter[c] += n;
+}
+
+static inline void
+telemetry_inc(enum telemetry_counter c)
+{
+	telemetry_slot()->counter[c]++;
+}
+
+/* Record @seconds spent in @t. Callers time themselves with time_now():
+ *   double time_start = time_now();  ...
+ *   telemetry_time(TM_PRIOR_PATTERN, time_now() - time_start); */
+void telemetry_time(enum telemetry_timer t, double seconds);
+void telemetry_set(enum telemetry_gauge g, uint64_t value);
+
+/* Aggregated view of all threads. */
+typedef struct {
+	double		  uptime;
+	int		  threads;	/* Threads which reported something so far */
+	uint64_t	  counter[TM_COUNTERS];
+	telemetry_timer_t timer[TM_TIMERS];
+	uint64_t	  gauge[TM_GAUGES];
+} telemetry_t;
+
+void telemetry_collect(telemetry_t *tm);
+void telemetry_reset(void);
+
+/* Human readable summary, one line per item. */
+void telemetry_print(strbuf_t *buf, telemetry_t *tm);
+/* Same as one json line (no '\n'). */
+void telemetry_print_json(strbuf_t *buf, telemetry_t *tm);
+
+/* Append json summary to @filename every @interval seconds from a
+ * background thread, until program exits. */
+void telemetry_dump_start(char *filename, int interval);
+
+#endif
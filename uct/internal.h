@@ -31,6 +31,8 @@ typedef enum uct_reporting {
 typedef enum uct_thread_model {
 	TM_TREE, /* Tree parallelization w/o virtual loss. */
 	TM_TREEVL, /* Tree parallelization with virtual loss. */
+	TM_ROOT, /* Root parallelization: one tree per thread, stats merged periodically. */
+	TM_HYBRID, /* Groups of threads share a tree (with virtual loss), trees merged periodically. */
 } uct_thread_model_t;
 
 /* Internal engine state. */
@@ -50,6 +52,8 @@ typedef struct uct {
 	bool allow_losing_pass;
 	bool territory_scoring;
 	int expand_p;
+	int widening_min;
+	floating_t widening_k;
 	bool playout_amaf;
 	bool amaf_prior;
 	int playout_amaf_cutoff;
@@ -62,6 +66,9 @@ typedef struct uct {
 	size_t tree_size;
 	size_t max_tree_size_opt;
 	size_t max_mem;
+	int tree_cache;
+	size_t tree_cache_mem;
+	bool reclaim;
 	
 	int mercymin;
 	int significant_threshold;
@@ -70,6 +77,12 @@ typedef struct uct {
 	int threads;
 	enum uct_thread_model thread_model;
 	int virtual_loss;
+	int tree_groups;             /* Hybrid thread model: number of trees */
+	int tree_merge_depth;        /* Root / hybrid: merge stats of nodes up to this depth */
+	double tree_merge_interval;  /* Root / hybrid: time between merges (seconds) */
+	bool deterministic;
+	int deterministic_batch;
+	bool descent_undo;
 	enum stone my_color;
 
 	/* Current search flags */
@@ -78,6 +91,7 @@ typedef struct uct {
 	bool pondering_opt;                /* User wants pondering */
 	int     dcnn_pondering_prior;      /* Prior next move guesses */
 	int     dcnn_pondering_mcts;       /* Genmove next move guesses */
+	bool    dcnn_pondering_keep_tree;  /* Keep genmove tree, add dcnn priors */
 	coord_t dcnn_pondering_mcts_c[20];
 	
 	int fuseki_end;
@@ -139,7 +153,9 @@ typedef struct uct {
 
 	/* Game state - maintained by setup_state(), reset_state(). */
 	tree_t *t;
+	tree_t **xtrees;	/* Root / hybrid thread models: other search trees, reused */
 	bool tree_ready;
+	struct uct_det *det;	/* Deterministic search state, see walk.c */
 } uct_t;
 
 /* Limit pruning temp space to 20% of memory. Beyond this we discard
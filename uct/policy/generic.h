@@ -23,12 +23,15 @@ void uctp_generic_winner(uct_policy_t *p, tree_t *tree, uct_descent_t *descent);
 #endif
 
 #define uctd_try_node_children(tree, descent, allow_pass, parity, tenuki_d, di, urgency) \
+	/* Children may get reclaimed while we look at them: load once, \
+	 * descent->node is NULL afterwards if there were none. */ \
+	tree_node_t *children__ = descent->node->children; \
 	/* Information abound best children. */ \
 	/* XXX: We assume board <=25x25. */ \
-	uct_descent_t dbest[BOARD_MAX_MOVES + 1] = { uct_descent(descent->node->children) }; int dbests = 1; \
+	uct_descent_t dbest[BOARD_MAX_MOVES + 1] = { uct_descent(children__) }; int dbests = 1; \
 	floating_t best_urgency = -9999; \
 	/* Descent children iterator. */ \
-	uct_descent_t dci = uct_descent(descent->node->children); \
+	uct_descent_t dci = uct_descent(children__); \
 	\
 	for (; dci.node; dci.node = dci.node->sibling) { \
 		floating_t urgency; \
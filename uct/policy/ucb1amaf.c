@@ -231,6 +231,68 @@ static inline int ko_length(bool *ko_capture_map, int map_length)
 	return length;
 }
 
+/* Per-thread first move table for amaf updates: for each intersection
+ * coord, first[coord] is the index in map->game of the first move at this
+ * coordinate. Entries are valid only if stamped with current generation,
+ * so the table never needs a full reset. played[] lists coords with a valid
+ * entry (except pass). */
+typedef struct {
+	unsigned int gen;
+	unsigned int stamp[BOARD_MAX_COORDS + 1];
+	int first[BOARD_MAX_COORDS + 1];
+	coord_t played[BOARD_MAX_COORDS];
+	int nplayed;
+} amaf_first_moves_t;
+
+static __thread amaf_first_moves_t first_moves;
+
+static inline void
+amaf_set_first_move(amaf_first_moves_t *fm, coord_t c, int move)
+{
+	if (fm->stamp[c + 1] != fm->gen) {
+		fm->stamp[c + 1] = fm->gen;
+		if (!is_pass(c))  fm->played[fm->nplayed++] = c;
+	}
+	fm->first[c + 1] = move;
+}
+
+/* Returns INT_MAX if the move was not played. */
+static inline int
+amaf_first_move(amaf_first_moves_t *fm, coord_t c)
+{
+	return (fm->stamp[c + 1] == fm->gen ? fm->first[c + 1] : INT_MAX);
+}
+
+static inline void
+ucb1amaf_update_child(ucb1_policy_amaf_t *b, tree_node_t *ni, int first, int move, int max_threat_dist,
+		      playout_amafmap_t *map, board_t *final_board, enum stone winner_color, floating_t result)
+{
+	/* Use the child move only if it was first played by the same color. */
+	assert(first > move && first < map->gamelen);
+	int distance = first - (move + 1);
+	if (distance & 1) return;
+
+	int weight = 1;
+	floating_t res = result;
+
+	/* Don't give amaf bonus to a ko threat before taking the ko.
+	 * http://www.grappa.univ-lille3.fr/~coulom/Aja_PhD_Thesis.pdf
+	 */
+	if (distance <= max_threat_dist && distance % 6 == 4) {
+		weight = - b->threat_rave;
+		res = 1.0 - res;
+	} else if (b->distance_rave != 0) {
+		/* Give more weight to moves played earlier */
+		weight += b->distance_rave * (map->gamelen - first) / (map->gamelen - move);
+	}
+	stats_add_result(&ni->amaf, res, weight);
+
+	if (b->crit_amaf) {
+		stats_add_result(&ni->winner_owner, board_local_value(b->crit_lvalue, final_board, node_coord(ni), winner_color), 1);
+		stats_add_result(&ni->black_owner, board_local_value(b->crit_lvalue, final_board, node_coord(ni), S_BLACK), 1);
+	}
+}
+
 void
 ucb1amaf_update(uct_policy_t *p, tree_t *tree, tree_node_t *node,
 		enum stone node_color, enum stone player_color,
@@ -239,14 +301,15 @@ ucb1amaf_update(uct_policy_t *p, tree_t *tree, tree_node_t *node,
 {
 	ucb1_policy_amaf_t *b = (ucb1_policy_amaf_t*)p->data;
 	enum stone winner_color = result > 0.5 ? S_BLACK : S_WHITE;
+	int max_coords = board_max_coords(final_board);
 
-	/* Record of the random playout - for each intersection coord,
-	 * first_move[coord] is the index map->game of the first move
-	 * at this coordinate, or INT_MAX if the move was not played.
-	 * The parity gives the color of this move.
-	 */
-	int first_map[board_max_coords(final_board)+1];
-	int *first_move = &first_map[1]; // +1 for pass
+	/* Record of the random playout, new generation. */
+	amaf_first_moves_t *fm = &first_moves;
+	if (!++fm->gen) {
+		memset(fm->stamp, 0, sizeof(fm->stamp));
+		fm->gen = 1;
+	}
+	fm->nplayed = 0;
 
 #if 0
 	board_t bb; bb.size = 9+2;
@@ -257,11 +320,10 @@ ucb1amaf_update(uct_policy_t *p, tree_t *tree, tree_node_t *node,
 #endif
 
 	/* Initialize first_move */
-	for (int i = pass; i < board_max_coords(final_board); i++) first_move[i] = INT_MAX;
 	int move;
 	assert(map->gamelen > 0);
 	for (move = map->gamelen - 1; move >= map->game_baselen; move--)
-		first_move[map->game[move]] = move;
+		amaf_set_first_move(fm, map->game[move], move);
 
 	while (node) {
 		if (!b->crit_amaf && !is_pass(node_coord(node))) {
@@ -276,46 +338,30 @@ ucb1amaf_update(uct_policy_t *p, tree_t *tree, tree_node_t *node,
 		/* This loop ignores symmetry considerations, but they should
 		 * matter only at a point when AMAF doesn't help much. */
 		assert(map->game_baselen >= 0);
-		for (tree_node_t *ni = node->children; ni; ni = ni->sibling) {
-			if (is_pass(node_coord(ni))) continue;
-
-			/* Use the child move only if it was first played by the same color. */
-			int first = first_move[node_coord(ni)];
-			if (first == INT_MAX) continue;
-			assert(first > move && first < map->gamelen);
-			int distance = first - (move + 1);
-			if (distance & 1) continue;
-
-			int weight = 1;
-			floating_t res = result;
-
-			/* Don't give amaf bonus to a ko threat before taking the ko.
-			 * http://www.grappa.univ-lille3.fr/~coulom/Aja_PhD_Thesis.pdf
-			 */
-			if (distance <= max_threat_dist && distance % 6 == 4) {
-				weight = - b->threat_rave;
-				res = 1.0 - res;
-			} else if (b->distance_rave != 0) {
-				/* Give more weight to moves played earlier */
-				weight += b->distance_rave * (map->gamelen - first) / (map->gamelen - move);
+		tree_node_t *children = node->children;
+		tree_child_index_t *index = (children ? tree_child_index(node, children, max_coords) : NULL);
+		if (index) {
+			/* Only look at children that were played. */
+			for (int i = 0; i < fm->nplayed; i++) {
+				coord_t c = fm->played[i];
+				int k = index->child[c + 1];
+				if (!k) continue;
+				ucb1amaf_update_child(b, &children[k - 1], fm->first[c + 1], move, max_threat_dist,
+						      map, final_board, winner_color, result);
 			}
-			stats_add_result(&ni->amaf, res, weight);
-
-			if (b->crit_amaf) {
-				stats_add_result(&ni->winner_owner, board_local_value(b->crit_lvalue, final_board, node_coord(ni), winner_color), 1);
-				stats_add_result(&ni->black_owner, board_local_value(b->crit_lvalue, final_board, node_coord(ni), S_BLACK), 1);
+		} else {
+			for (tree_node_t *ni = children; ni; ni = ni->sibling) {
+				if (is_pass(node_coord(ni))) continue;
+				int first = amaf_first_move(fm, node_coord(ni));
+				if (first == INT_MAX) continue;
+				ucb1amaf_update_child(b, ni, first, move, max_threat_dist,
+						      map, final_board, winner_color, result);
 			}
-#if 0
-			board_t bb; bb.size = 9+2;
-			fprintf(stderr, "* %s<%" PRIhash "> -> %s<%" PRIhash "> [%d/%f => %d/%f]\n",
-				coord2sstr(node_coord(node)), node->hash,
-				coord2sstr(node_coord(ni)), ni->hash,
-				player_color, result, move, res);
-#endif
 		}
+
 		if (node->parent) {
-			assert(move >= 0 && map->game[move] == node_coord(node) && first_move[node_coord(node)] > move);
-			first_move[node_coord(node)] = move;
+			assert(move >= 0 && map->game[move] == node_coord(node) && amaf_first_move(fm, node_coord(node)) > move);
+			amaf_set_first_move(fm, node_coord(node), move);
 			move--;
 		}
 		node = node->parent;
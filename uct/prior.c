@@ -17,8 +17,11 @@
 #include "uct/internal.h"
 #include "uct/plugins.h"
 #include "uct/prior.h"
+#include "uct/search.h"
 #include "uct/tree.h"
 #include "dcnn.h"
+#include "telemetry.h"
+#include "timeinfo.h"
 
 #define PRIOR_BEST_N 20
 
@@ -123,7 +126,7 @@ uct_prior_eye(uct_t *u, tree_node_t *node, prior_map_t *map)
 }
 
 
-static void
+void
 uct_prior_dcnn(uct_t *u, tree_node_t *node, prior_map_t *map)
 {
 #ifdef DCNN
@@ -213,6 +216,27 @@ uct_prior_cfgd(uct_t *u, tree_node_t *node, prior_map_t *map)
 	} foreach_free_point_end;
 }
 
+/* Check joseki matches against full matching. */
+static void
+verify_joseki_matches(board_t *b, enum stone color, coord_t *coords, float *ratings, int matches)
+{
+	coord_t coords2[BOARD_MAX_COORDS];
+	float ratings2[BOARD_MAX_COORDS];
+	int matches2 = joseki_list_moves(joseki_dict, b, color, coords2, ratings2);
+
+	float map[BOARD_MAX_COORDS] = { 0, };
+	for (int i = 0; i < matches2; i++)
+		map[coords2[i]] = ratings2[i];
+	bool ok = (matches == matches2);
+	for (int i = 0; i < matches; i++)
+		if (map[coords[i]] != ratings[i])  ok = false;
+	if (ok)  return;
+
+	board_print(b, stderr);
+	die("joseki: incremental matches differ from full matching (%s to play: %i vs %i matches)\n",
+	    stone2str(color), matches, matches2);
+}
+
 static void
 uct_prior_joseki(uct_t *u, tree_node_t *node, prior_map_t *map)
 {
@@ -223,7 +247,13 @@ uct_prior_joseki(uct_t *u, tree_node_t *node, prior_map_t *map)
 	enum stone color = map->to_play;
 	coord_t coords[BOARD_MAX_COORDS];
 	float ratings[BOARD_MAX_COORDS];
-	matches = joseki_list_moves(joseki_dict, b, color, coords, ratings);
+	if (u->prior->joseki_incremental)
+		matches = joseki_list_moves_incremental(joseki_dict, b, color, coords, ratings);
+	else
+		matches = joseki_list_moves(joseki_dict, b, color, coords, ratings);
+
+	if (u->prior->verify_joseki)
+		verify_joseki_matches(b, color, coords, ratings, matches);
 	
 	for (int i = 0; i < matches; i++)
 		add_prior_value(map, coords[i], 1.0, ratings[i] * u->prior->joseki_eqex);
@@ -296,11 +326,18 @@ uct_prior(uct_t *u, tree_node_t *node, prior_map_t *map)
 
 	if (u->prior->even_eqex)			uct_prior_even(u, node, map);
 	
-	/* Use dcnn for root priors */
-	if (u->prior->dcnn_eqex && !u->tree_ready)	uct_prior_dcnn(u, node, map);
+	/* Use dcnn for root priors (and dcnn pondering guesses) */
+	if (u->prior->dcnn_eqex && (!u->tree_ready || dcnn_expand_thread)) {
+		double time_start = time_now();
+		uct_prior_dcnn(u, node, map);
+		telemetry_time(TM_PRIOR_DCNN, time_now() - time_start);
+	}
 
-	if (u->prior->pattern_eqex)			uct_prior_pattern(u, node, map);
-	else {  /* Fallback to old prior features if patterns are off. */
+	if (u->prior->pattern_eqex) {
+		double time_start = time_now();
+		uct_prior_pattern(u, node, map);
+		telemetry_time(TM_PRIOR_PATTERN, time_now() - time_start);
+	} else {  /* Fallback to old prior features if patterns are off. */
 		if (u->prior->eye_eqex)			uct_prior_eye(u, node, map);
 		if (u->prior->ko_eqex)			uct_prior_ko(u, node, map);
 		if (u->prior->b19_eqex)			uct_prior_b19(u, node, map);		
@@ -308,7 +345,11 @@ uct_prior(uct_t *u, tree_node_t *node, prior_map_t *map)
 		if (u->prior->cfgd_eqex)		uct_prior_cfgd(u, node, map);
 	}
 
-	if (u->prior->joseki_eqex)			uct_prior_joseki(u, node, map);
+	if (u->prior->joseki_eqex) {
+		double time_start = time_now();
+		uct_prior_joseki(u, node, map);
+		telemetry_time(TM_PRIOR_JOSEKI, time_now() - time_start);
+	}
 
 #ifdef PACHI_PLUGINS
 	if (u->prior->plugin_eqex)			plugin_prior(u->plugins, node, map, u->prior->plugin_eqex);
@@ -342,6 +383,7 @@ uct_prior_init(char *arg, board_t *b, uct_t *u)
 	p->eqex = board_large(b) ? 20 : 14;
 
 	p->prune_ladders = true;
+	p->joseki_incremental = true;
 
 	if (arg) {
 		char *optspec, *next = arg;
@@ -385,6 +427,10 @@ uct_prior_init(char *arg, board_t *b, uct_t *u)
 
 			} else if (!strcasecmp(optname, "joseki") && optval) {
 				p->joseki_eqex = atoi(optval);
+			} else if (!strcasecmp(optname, "joseki_incremental")) {
+				p->joseki_incremental = !optval || atoi(optval);
+			} else if (!strcasecmp(optname, "verify_joseki")) {
+				p->verify_joseki = !optval || atoi(optval);
 			} else if (!strcasecmp(optname, "eye") && optval) {
 				p->eye_eqex = atoi(optval);
 			} else if (!strcasecmp(optname, "ko") && optval) {
@@ -22,6 +22,12 @@ typedef struct {
 	int cfgdn; int *cfgd_eqex;
 	bool prune_ladders;
 	bool boost_pass;
+	/* Joseki matches from per-thread cache of per-point hashes, patched
+	 * where stones changed (see joseki_list_moves_incremental()). */
+	bool joseki_incremental;
+	/* Check each incremental joseki match against full matching,
+	 * die if they differ. Slow, for testing. */
+	bool verify_joseki;
 } uct_prior_t;
 
 typedef struct prior_map {
@@ -43,6 +49,8 @@ typedef struct prior_map {
 static void add_prior_value(prior_map_t *map, coord_t c, floating_t value, int playouts);
 
 void uct_prior(struct uct *u, tree_node_t *node, prior_map_t *map);
+/* Dcnn priors only (for nodes expanded without dcnn). */
+void uct_prior_dcnn(struct uct *u, tree_node_t *node, prior_map_t *map);
 
 uct_prior_t *uct_prior_init(char *arg, board_t *b, struct uct *u);
 void uct_prior_done(uct_prior_t *p);
@@ -27,6 +27,11 @@
 #include "uct/prior.h"
 #include "dcnn.h"
 #include "pachi.h"
+#include "telemetry.h"
+#include "server.h"
+#ifdef DISTRIBUTED
+#include "uct/slave.h"
+#endif
 
 static int
 checked_pthread_join(pthread_t thread, void **retval)
@@ -98,9 +103,25 @@ static pthread_cond_t finish_cond = PTHREAD_COND_INITIALIZER;
 static volatile int finish_thread;
 static pthread_mutex_t finish_serializer = PTHREAD_MUTEX_INITIALIZER;
 
-static void  uct_expand_next_best_moves(uct_t *u, tree_t *t, board_t *b, enum stone color);
+/* Workers wait for root node expansion. */
+static pthread_mutex_t tree_ready_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t tree_ready_cond = PTHREAD_COND_INITIALIZER;
+
+/* Set while thread 0 expands dcnn pondering guesses (search running). */
+__thread bool dcnn_expand_thread = false;
+
+static void  uct_expand_next_best_moves(uct_t *u, tree_t *t, board_t *b, enum stone color, uct_search_state_t *s);
+static void  uct_tree_ready(uct_t *u, uct_search_state_t *s);
 static void *logger_thread(void *ctx_);
 
+/* Nodes expanded without dcnn priors get them added when search starts ?
+ * Only if genmove tree is kept for dcnn pondering and dcnn priors are used. */
+static bool
+dcnn_retrofit(uct_t *u, board_t *b)
+{
+	return (u->dcnn_pondering_keep_tree && u->prior->dcnn_eqex && using_dcnn(b));
+}
+
 static void *
 worker_thread(void *ctx_)
 {
@@ -113,10 +134,12 @@ worker_thread(void *ctx_)
 	fast_srandom(ctx->seed);
 	int restarted = search_restarted(u);
 
-	/* Fill ownermap for mcowner pattern feature. */
-	if (using_patterns()) {
+	/* Fill ownermap for mcowner pattern feature.
+	 * Deterministic search: thread 0 only, same ownermap every time. */
+	if (using_patterns() && (!u->det || !ctx->tid)) {
 		double time_start = time_now();
 		uct_mcowner_playouts(u, b, color);
+		if (!ctx->tid)  telemetry_time(TM_MCOWNER, time_now() - time_start);
 		
 		if (!ctx->tid && !restarted) {
 			if (DEBUGL(2))  fprintf(stderr, "mcowner %.2fs\n", time_now() - time_start);
@@ -139,7 +162,8 @@ worker_thread(void *ctx_)
 	}
 
 	/* Expand root node (dcnn). Other threads wait till it's ready. 
-	 * For dcnn pondering we also need dcnn values for opponent's best moves. */
+	 * For dcnn pondering we also need dcnn values for opponent's best moves,
+	 * workers get going as soon as root is ready though. */
 	tree_t *t = ctx->t;
 	tree_node_t *n = t->root;
 	if (!ctx->tid) {
@@ -149,21 +173,34 @@ worker_thread(void *ctx_)
 		
 		if (tree_leaf_node(n) && !__sync_lock_test_and_set(&n->is_expanded, 1))
 			tree_expand_node(t, n, b, color, u, 1);
-		if (genmove_pondering(u) && using_dcnn(b))
-			uct_expand_next_best_moves(u, t, b, color);
+		else if (dcnn_retrofit(u, b) && !(n->hints & TREE_HINT_DCNN) && n->children)
+			tree_retrofit_dcnn_priors(t, n, b, color, u, 1);  /* Kept tree (dcnn pondering) */
+		for (int i = 1; i < s->trees; i++) {  /* Root / hybrid thread models */
+			tree_node_t *root = s->tree[i]->root;
+			if (!__sync_lock_test_and_set(&root->is_expanded, 1))
+				tree_expand_node(s->tree[i], root, b, color, u, 1);
+		}
 		
 		if (DEBUGL(2) && already_have && !restarted) {  /* Show previously computed priors */
 			print_joseki_moves(joseki_dict, b, color);
 			print_node_prior_best_moves(b, n);
 		}
-		u->tree_ready = true;
+		if (genmove_pondering(u) && using_dcnn(b))
+			uct_expand_next_best_moves(u, t, b, color, s);
+		uct_tree_ready(u, s);
+	}
+	else {
+		pthread_mutex_lock(&tree_ready_mutex);
+		while (!u->tree_ready)
+			pthread_cond_wait(&tree_ready_cond, &tree_ready_mutex);
+		pthread_mutex_unlock(&tree_ready_mutex);
 	}
-	else while (!u->tree_ready)
-		     usleep(100 * 1000);
 
 	/* Run */
-	if (!ctx->tid)  s->mcts_time_start = s->last_print_time = time_now();
-	ctx->games = uct_playouts(ctx->u, ctx->b, ctx->color, ctx->t, ctx->ti);
+	if (u->det)
+		ctx->games = uct_playouts_deterministic(ctx->u, ctx->b, ctx->color, ctx->t, ctx->ti, ctx->tid, s);
+	else
+		ctx->games = uct_playouts(ctx->u, ctx->b, ctx->color, ctx->t, ctx->ti, ctx->tid / s->trees);
 	
 	/* Finish */
 	pthread_mutex_lock(&finish_serializer);
@@ -211,7 +248,8 @@ thread_manager(void *ctx_)
 	for (int ti = 0; ti < u->threads; ti++) {
 		uct_thread_ctx_t *ctx = calloc2(1, uct_thread_ctx_t);
 		ctx->u = u; ctx->b = mctx->b; ctx->color = mctx->color;
-		mctx->t = ctx->t = t;
+		mctx->t = t;
+		ctx->t = (mctx->s->trees > 1 ? mctx->s->tree[ti % mctx->s->trees] : t);
 		ctx->tid = ti; ctx->seed = fast_random(65536) + ti;
 		ctx->ti = mctx->ti;
 		ctx->s = mctx->s;
@@ -281,6 +319,24 @@ pondering_fullmem_handler(void *ctx_)
 	return NULL;
 }
 
+/* Detached thread to stop pondering when other sessions need cpus
+ * (server mode). */
+static void *
+pondering_yield_handler(void *ctx_)
+{
+	uct_thread_ctx_t *ctx = (uct_thread_ctx_t*)ctx_;
+	uct_t *u = ctx->u;
+	ctx = NULL;
+
+	int r = pthread_detach(pthread_self());  if (r) fail("pthread_detach");
+
+	if (!thread_manager_running)  return NULL;
+
+	if (UDEBUGL(2))  fprintf(stderr, "cpus needed by other sessions, stopping pondering\n");
+	uct_pondering_stop(u);
+	return NULL;
+}
+
 /* Logger thread, keeps track of progress when pondering.
  * Similar to uct_search() when pondering. */
 static void *
@@ -310,37 +366,41 @@ logger_thread(void *ctx_)
 			pthread_t tid;
 			pthread_create(&tid, NULL, pondering_fullmem_handler, ctx);
 			return NULL;
-		}		
+		}
+
+		/* Server mode: leave cpus to sessions waiting for them. */
+		if (genmove_pondering(u) && server_cpus_wanted()) {
+			pthread_t tid;
+			pthread_create(&tid, NULL, pondering_yield_handler, ctx);
+			return NULL;
+		}
 	}
 	return NULL;
 }
 
-/* Expand next move node (dcnn pondering) */
+/* Root node is ready, let worker threads run. */
 static void
-uct_expand_next_move(uct_t *u, tree_t *t, board_t *board, enum stone color, coord_t c)
+uct_tree_ready(uct_t *u, uct_search_state_t *s)
 {
-	tree_node_t *n = tree_get_node(t->root, c);
-	
-	board_t b;
-	board_copy(&b, board);
-
-	move_t m = move(c, color);
-	int res = board_play(&b, &m);
-	if (res < 0) goto done;
-		
-	if (!__sync_lock_test_and_set(&n->is_expanded, 1))
-		tree_expand_node(t, n, &b, stone_other(color), u, -1);
-
- done:  board_done(&b);
+	if (u->tree_ready)  return;
+	s->mcts_time_start = s->last_print_time = time_now();
+	pthread_mutex_lock(&tree_ready_mutex);
+	u->tree_ready = true;
+	pthread_cond_broadcast(&tree_ready_cond);
+	pthread_mutex_unlock(&tree_ready_mutex);
 }
 
-/* For pondering with dcnn we need dcnn values for next move as well before
- * search starts. Can't evaluate all of them, so guess from prior best moves +
- * genmove's best moves for opponent. If we guess right all is well. If we
- * guess wrong pondering will not be useful for this move, search results
- * will be discarded. */
+/* For pondering with dcnn we need dcnn values for next move as well.
+ * Can't evaluate all of them, so guess from prior best moves + genmove's
+ * best moves for opponent. If we guess right all is well. If we guess
+ * wrong pondering will not be useful for this move, search results will
+ * be discarded.
+ * Guesses are evaluated in one dcnn batch. Unexpanded guess nodes are
+ * claimed first so workers can start searching right away without
+ * expanding them (playouts stop there meanwhile). Nodes of a kept tree
+ * need dcnn priors retrofitted, search must wait for these. */
 static void
-uct_expand_next_best_moves(uct_t *u, tree_t *t, board_t *b, enum stone color)
+uct_expand_next_best_moves(uct_t *u, tree_t *t, board_t *b, enum stone color, uct_search_state_t *s)
 {
 	assert(using_dcnn(b));
 	move_queue_t q;  mq_init(&q);
@@ -372,23 +432,178 @@ uct_expand_next_best_moves(uct_t *u, tree_t *t, board_t *b, enum stone color)
 		fflush(stderr);
 	}
 
-	for (unsigned int i = 0; i < q.moves && !uct_halt; i++) { /* Don't hang if genmove comes in. */
-		uct_expand_next_move(u, t, b, color, q.move[i]);
-		if (DEBUGL(2)) {  fprintf(stderr, ".");  fflush(stderr);  }
+	int n = 0;
+	tree_node_t *nodes[q.moves];
+	board_t     *boards[q.moves];
+	enum stone   colors[q.moves];
+	bool         claimed[q.moves];
+	bool         retrofit = false;
+	for (unsigned int i = 0; i < q.moves; i++) {
+		tree_node_t *node = tree_widen_node_at(t, t->root, q.move[i]);
+		if (!node || (node->hints & TREE_HINT_DCNN))  continue;
+
+		claimed[n] = !__sync_lock_test_and_set(&node->is_expanded, 1);
+		if (!claimed[n] && !node->children)  continue;  /* Shouldn't happen */
+		if (!claimed[n] && !dcnn_retrofit(u, b))  continue;
+
+		board_t *b2 = boards[n] = malloc2(board_t);
+		board_copy(b2, b);
+		move_t m = move(q.move[i], color);
+		if (board_play(b2, &m) < 0) {
+			board_done(b2);  free(b2);
+			if (claimed[n])  node->is_expanded = false;
+			continue;
+		}
+		retrofit |= !claimed[n];
+		nodes[n] = node;
+		colors[n++] = stone_other(color);
+	}
+
+	if (!retrofit)  uct_tree_ready(u, s);
+
+	dcnn_evaluate_batch(boards, colors, NULL, n);  /* Fill dcnn cache */
+	if (DEBUGL(2)) {  fprintf(stderr, ".");  fflush(stderr);  }
+
+	dcnn_expand_thread = true;
+	for (int i = 0; i < n; i++) {
+		if (uct_halt) {  /* Don't hang if genmove comes in. */
+			if (claimed[i])  nodes[i]->is_expanded = false;
+		} else if (claimed[i])
+			tree_expand_node(t, nodes[i], boards[i], colors[i], u, -1);
+		else
+			tree_retrofit_dcnn_priors(t, nodes[i], boards[i], colors[i], u, -1);
+		board_done(boards[i]);  free(boards[i]);
 	}
+	dcnn_expand_thread = false;
 	if (DEBUGL(2)) fprintf(stderr, "\n");
 }
 
 
 /*** THREAD MANAGER end */
 
+/*** Root / hybrid thread models: */
+
+/* Number of trees searched in parallel. */
+static int
+search_trees(uct_t *u)
+{
+	int trees = 1;
+	if (u->thread_model == TM_ROOT)    trees = u->threads;
+	if (u->thread_model == TM_HYBRID)  trees = u->tree_groups;
+	return (trees < u->threads ? trees : u->threads);
+}
+
+/* Memory for each search tree: @tree_size is split between all trees
+ * searched in parallel, main tree included. */
+size_t
+uct_search_tree_size(uct_t *u, size_t tree_size)
+{
+	return tree_size / search_trees(u);
+}
+
+/* Free extra trees kept between searches. */
+void
+uct_search_trees_free(uct_t *u)
+{
+	if (!u->xtrees)  return;
+	for (int i = 0; u->xtrees[i]; i++)
+		tree_done(u->xtrees[i]);
+	free(u->xtrees);
+	u->xtrees = NULL;
+}
+
+/* Setup extra trees, same size as main tree. They're allocated once
+ * and cleared for each search. Only stats from this search get exchanged. */
+static void
+uct_search_trees_init(uct_t *u, enum stone color, tree_t *t, uct_search_state_t *s)
+{
+	s->trees = search_trees(u);
+	s->tree = NULL;
+	if (s->trees == 1)  return;
+
+	if (u->xtrees && u->xtrees[0]->max_tree_size != t->max_tree_size)
+		uct_search_trees_free(u);  /* Tree got reallocated */
+	if (!u->xtrees) {
+		u->xtrees = calloc2(s->trees, tree_t*);  /* NULL terminated */
+		for (int i = 0; i < s->trees - 1; i++) {
+			u->xtrees[i] = tree_init(t->board, color, t->max_tree_size, 0, 0, 0);
+			if (!u->xtrees[i])  die("uct: not enough memory for %i search trees\n", s->trees);
+		}
+	}
+
+	s->tree = calloc2(s->trees, tree_t*);
+	s->tree[0] = t;
+	for (int i = 1; i < s->trees; i++) {
+		tree_t *t2 = s->tree[i] = u->xtrees[i - 1];
+		t2->board = t->board;
+		tree_clear(t2, color);
+		t2->use_extra_komi = t->use_extra_komi;
+		t2->extra_komi = t->extra_komi;
+		t2->untrustworthy_tree = t->untrustworthy_tree;
+	}
+	tree_merge_reset(t, u->tree_merge_depth);
+	s->last_merge_time = time_now();
+}
+
+/* Tree searched by thread @tid is s->tree[tid % s->trees], as its
+ * (tid / s->trees)th thread. Enable node recycling on all trees. */
+static void
+uct_search_reclaim_init(uct_t *u, uct_search_state_t *s)
+{
+	int threads = (u->threads + s->trees - 1) / s->trees;
+	tree_reclaim_init(s->ctx->t, threads);
+	for (int i = 1; i < s->trees; i++)
+		tree_reclaim_init(s->tree[i], threads);
+}
+
+/* Recycle nodes before memory gets full. */
+static void
+uct_search_reclaim(tree_t *t)
+{
+	size_t max_nodes = t->max_tree_size / sizeof(tree_node_t);
+	if (t->reclaim)
+		tree_reclaim(t, max_nodes / 10, max_nodes / 5);
+}
+
+/* Exchange stats between all trees. Must not run concurrently
+ * with itself (main thread, or logger thread when pondering). */
+static void
+uct_search_merge_trees(uct_t *u, uct_search_state_t *s)
+{
+	tree_merge_stats(s->tree, s->trees, u->tree_merge_depth);
+
+	/* Dynkomi is adjusted on main tree. */
+	for (int i = 1; i < s->trees; i++)
+		s->tree[i]->extra_komi = s->tree[0]->extra_komi;
+	s->last_merge_time = time_now();
+}
+
+/* Search stopped: gather everything in main tree. */
+static void
+uct_search_trees_done(uct_t *u, uct_search_state_t *s)
+{
+	if (s->trees == 1)  return;
+	uct_search_merge_trees(u, s);
+	free(s->tree);
+	s->tree = NULL;
+	s->trees = 1;
+}
+
+
 /*** Search infrastructure: */
 
 
+/* Playouts so far. Root / hybrid thread models: main tree gets other
+ * trees' playouts only when merging, count those not merged yet too. */
 int
 uct_search_games(uct_search_state_t *s)
 {
-	return s->ctx->t->root->u.playouts;
+	int games = s->ctx->t->root->u.playouts;
+	for (int i = 1; i < s->trees; i++) {
+		tree_node_t *root = s->tree[i]->root;
+		games += root->u.playouts - root->pu.playouts;
+	}
+	return games;
 }
 
 void
@@ -401,6 +616,7 @@ uct_search_start(uct_t *u, board_t *b, enum stone color,
 	/* Set up search state. */
 	s->base_playouts = s->last_dynkomi = s->last_print_playouts = t->root->u.playouts;
 	s->fullmem = false;
+	uct_search_trees_init(u, color, t, s);
 
 	/* If restarted timers are already setup, reuse stop condition in s */
 	if (ti && !search_restarted(u)) {
@@ -415,18 +631,28 @@ uct_search_start(uct_t *u, board_t *b, enum stone color,
 	 * spawn the searching threads. */
 	assert(u->threads > 0);
 	assert(!thread_manager_running);
+	if (!search_restarted(u))  /* Server mode: one cpu per thread (see --server-cpus) */
+		server_cpus_take(u->threads);
 	static uct_thread_ctx_t mctx;
 	mctx = (uct_thread_ctx_t) { 0, u, b, color, t, fast_random(65536), 0, ti, s };
 	s->ctx = &mctx;
+	if (u->reclaim && !u->slave && !u->deterministic)
+		uct_search_reclaim_init(u, s);
+	if (u->deterministic)
+		uct_det_init(u, mctx.seed);
+#ifdef DISTRIBUTED
+	if (u->slave)
+		uct_slave_dirty_reset(u);
+#endif
 	pthread_mutex_lock(&finish_serializer);
 	pthread_mutex_lock(&finish_mutex);
 	pthread_create(&thread_manager_id, NULL, thread_manager, s->ctx);
 	thread_manager_running = true;
 }
 
-/* Stop current search. Clears search flags. */
-uct_thread_ctx_t *
-uct_search_stop(void)
+/* Stop search threads. Clears search flags. */
+static uct_thread_ctx_t *
+uct_search_stop_threads(void)
 {
 	assert(thread_manager_running);
 	thread_manager_running = false;
@@ -444,11 +670,25 @@ uct_search_stop(void)
 	uct_t *u = pctx->u;
 	uct_search_state_t *s = pctx->s;
 	u->mcts_time += time_now() - s->mcts_time_start;
+	for (int i = 1; i < s->trees; i++)
+		tree_reclaim_stop(s->tree[i]);
+	uct_search_trees_done(u, s);
+	tree_reclaim_stop(pctx->t);
+	if (u->det)  uct_det_done(u);
 	u->search_flags = 0;  /* Reset search flags */
 	
 	return pctx;
 }
 
+/* Stop current search. Clears search flags. */
+uct_thread_ctx_t *
+uct_search_stop(void)
+{
+	uct_thread_ctx_t *ctx = uct_search_stop_threads();
+	server_cpus_release();
+	return ctx;
+}
+
 static void
 fullmem_warning(uct_t *u, char *msg)
 {
@@ -484,12 +724,13 @@ uct_search_realloc_tree(uct_t *u, board_t *b, enum stone color, time_info_t *ti,
 	/* Can't simply use tree_realloc(), need to check if we can allocate
 	 * memory before stopping search otherwise we can't recover. */
 	tree_t *t  = u->t;
-	tree_t *t2 = tree_init(t->board, stone_other(t->root_color), new_size, pruned_size(new_size),
-			       pruning_threshold(new_size), tree_hbits(t));
+	size_t size = uct_search_tree_size(u, new_size);
+	tree_t *t2 = tree_init(t->board, stone_other(t->root_color), size, pruned_size(size),
+			       pruning_threshold(size), tree_hbits(t));
 	if (!t2)  return 0;		/* Not enough memory */
 	
 	int flags = u->search_flags;	/* Save flags ! */
-	uct_search_stop();
+	uct_search_stop_threads();	/* Keep cpus */
 	
 	uct_tree_size_init(u, new_size);
 	
@@ -504,24 +745,37 @@ uct_search_realloc_tree(uct_t *u, board_t *b, enum stone color, time_info_t *ti,
 	return 1;
 }
 
+/* Adjust dynkomi? */
 void
-uct_search_progress(uct_t *u, board_t *b, enum stone color,
-		    tree_t *t, time_info_t *ti,
-		    uct_search_state_t *s, int playouts)
+uct_search_dynkomi(uct_t *u, board_t *b, tree_t *t, uct_search_state_t *s, int playouts)
 {
-	uct_thread_ctx_t *ctx = s->ctx;
-
-	/* Adjust dynkomi? */
 	int di = u->dynkomi_interval * u->threads;
-	if (ctx->t->use_extra_komi && u->dynkomi->permove
+	if (t->use_extra_komi && u->dynkomi->permove
 	    && !pondering(u) && di
 	    && playouts > s->last_dynkomi + di) {
 		s->last_dynkomi += di;
-		floating_t old_dynkomi = ctx->t->extra_komi;
-		ctx->t->extra_komi = u->dynkomi->permove(u->dynkomi, b, ctx->t);
-		if (UDEBUGL(3) && old_dynkomi != ctx->t->extra_komi)
-			fprintf(stderr, "dynkomi adjusted (%f -> %f)\n", old_dynkomi, ctx->t->extra_komi);
+		floating_t old_dynkomi = t->extra_komi;
+		t->extra_komi = u->dynkomi->permove(u->dynkomi, b, t);
+		if (UDEBUGL(3) && old_dynkomi != t->extra_komi)
+			fprintf(stderr, "dynkomi adjusted (%f -> %f)\n", old_dynkomi, t->extra_komi);
 	}
+}
+
+void
+uct_search_progress(uct_t *u, board_t *b, enum stone color,
+		    tree_t *t, time_info_t *ti,
+		    uct_search_state_t *s, int playouts)
+{
+	uct_thread_ctx_t *ctx = s->ctx;
+	telemetry_set(TM_TREE_BYTES, ctx->t->nodes_size);
+	telemetry_set(TM_TREE_MAX_BYTES, ctx->t->max_tree_size);
+
+	if (s->trees > 1 && time_now() - s->last_merge_time >= u->tree_merge_interval)
+		uct_search_merge_trees(u, s);
+
+	/* Deterministic search adjusts dynkomi between batches. */
+	if (!u->det)
+		uct_search_dynkomi(u, b, ctx->t, s, playouts);
 
 	/* Print progress ? */
 	if (u->reportfreq_time) { /* Time based */
@@ -536,7 +790,11 @@ uct_search_progress(uct_t *u, board_t *b, enum stone color,
 			uct_progress_status(u, ctx->t, color, s->last_print_playouts, NULL);
 		}
 
-        if (!s->fullmem && ctx->t->nodes_size > ctx->t->max_tree_size) {
+	uct_search_reclaim(ctx->t);
+	for (int i = 1; i < s->trees; i++)
+		uct_search_reclaim(s->tree[i]);
+
+        if (!s->fullmem && tree_full(ctx->t)) {
 		s->fullmem = true;
 		if (!u->auto_alloc)
 			fullmem_warning(u, "WARNING: Tree memory limit reached, stopping search.\n");
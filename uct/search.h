@@ -43,6 +43,7 @@ struct tree_node;
 /* Thread manager state */
 extern volatile sig_atomic_t uct_halt;
 extern bool thread_manager_running;
+extern __thread bool dcnn_expand_thread;
 
 /* Search thread context */
 typedef struct uct_thread_ctx {
@@ -69,6 +70,12 @@ typedef struct uct_search_state {
 	double last_print_time;   /* Last progress print (time) */
 	bool fullmem;		  /* Printed notification about full memory? */
 
+	/* Root / hybrid thread models: trees searched in parallel,
+	 * tree[0] is the main tree (ctx->t). */
+	int      trees;
+	tree_t **tree;
+	double   last_merge_time;
+
 	time_stop_t stop;
 	uct_thread_ctx_t *ctx;
 } uct_search_state_t;
@@ -79,10 +86,15 @@ int uct_search_games(uct_search_state_t *s);
 void uct_search_start(uct_t *u, board_t *b, enum stone color, tree_t *t, time_info_t *ti, uct_search_state_t *s, int flags);
 uct_thread_ctx_t *uct_search_stop(void);
 
+size_t uct_search_tree_size(uct_t *u, size_t tree_size);
+void uct_search_trees_free(uct_t *u);
+
 int uct_search_realloc_tree(uct_t *u, board_t *b, enum stone color, time_info_t *ti, uct_search_state_t *s);
 
 void uct_search_progress(uct_t *u, board_t *b, enum stone color, tree_t *t, time_info_t *ti, uct_search_state_t *s, int playouts);
 
+void uct_search_dynkomi(uct_t *u, board_t *b, tree_t *t, uct_search_state_t *s, int playouts);
+
 bool uct_search_check_stop(uct_t *u, board_t *b, enum stone color, tree_t *t, time_info_t *ti, uct_search_state_t *s, int i);
 
 tree_node_t *uct_search_result(uct_t *u, board_t *b, enum stone color, bool pass_all_alive, int played_games, int base_playouts, coord_t *best_coord);
@@ -14,6 +14,11 @@
  * a root child to a given node. See distributed/distributed.h
  * for the encoding of a path to a 64 bit integer. */
 
+/* To find out which nodes to send, worker threads record nodes up to
+ * shared_levels they update (dirty nodes), so reporting cost depends on
+ * the number of nodes that changed rather than tree size. The tree is
+ * walked only at the start of search or if dirty buffers overflow. */
+
 /* To allow the master to select the best move, slaves also send
  * absolute playout counts for the best top level nodes (children
  * of the root node), including contributions from other slaves. */
@@ -28,6 +33,7 @@
 
 #include <assert.h>
 #include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -129,6 +135,8 @@ tree_find_node(tree_t *t, incr_stats_t *is, tree_node_t *prev)
 		coord_t leaf = leaf_coord(path, t->board);
 		node = (prev && prev->parent == parent ? prev->sibling : parent->children);
 		while (node && node_coord(node) != leaf) node = node->sibling;
+		/* Progressive widening: other slaves may have created it already. */
+		if (!node && (parent->hints & TREE_HINT_PENDING))  node = tree_widen_node_at(t, parent, leaf);
 
 		if (DEBUG_MODE) parent_leaf += !parent->is_expanded;
 	} else {
@@ -299,6 +307,198 @@ append_stats(stats_candidate_t *stats_queue, tree_node_t *node, int stats_count,
 	return stats_count;
 }
 
+
+/* Dirty nodes: one buffer per worker thread. Nodes get recorded once
+ * per report (mostly, seen[] is only a cache), the reporter drains the
+ * buffers and dedups. Nodes which still have some increment after a
+ * report are carried over to the next one. */
+#define DIRTY_SEEN 1024
+
+typedef struct {
+	volatile int lock;
+	int  gen;			/* Bumped when drained, invalidates seen[] */
+	int  n;
+	bool overflow;
+	tree_node_t **node;		/* [dirty_max] */
+	tree_node_t *seen[DIRTY_SEEN];	/* Recently recorded nodes */
+	int  seen_gen[DIRTY_SEEN];
+} dirty_buf_t;
+
+static dirty_buf_t *dirty_bufs = NULL;
+static int  dirty_nbufs = 0;
+static int  dirty_max = 0;
+static int  dirty_next_buf = 0;
+static bool dirty_valid = false;	/* Buffers + carry cover all changes since last report */
+static __thread dirty_buf_t *thread_dirty = NULL;
+
+static tree_node_t **dirty_carry = NULL;
+static int dirty_ncarry = 0;
+
+static void
+dirty_init(uct_t *u)
+{
+	if (dirty_bufs)  return;
+	dirty_nbufs = u->threads;
+	dirty_max = 2 * u->shared_nodes / dirty_nbufs;  /* Overflow isn't fatal, just slower */
+	if (dirty_max < DIRTY_SEEN)  dirty_max = DIRTY_SEEN;
+	dirty_bufs = calloc2(dirty_nbufs, dirty_buf_t);
+	for (int i = 0; i < dirty_nbufs; i++)
+		dirty_bufs[i].node = calloc2(dirty_max, tree_node_t*);
+	dirty_carry = calloc2(3 * u->shared_nodes, tree_node_t*);
+}
+
+static void
+dirty_drop(void)
+{
+	for (int i = 0; i < dirty_nbufs; i++) {
+		dirty_buf_t *d = &dirty_bufs[i];
+		while (__sync_lock_test_and_set(&d->lock, 1))
+			;
+		d->n = 0;  d->overflow = false;  d->gen++;
+		__sync_lock_release(&d->lock);
+	}
+	dirty_ncarry = 0;
+}
+
+/* Search (re)starting, tree may have changed: forget everything,
+ * next report walks the tree. Worker threads must not be running. */
+void
+uct_slave_dirty_reset(uct_t *u)
+{
+	if (!dirty_bufs)  return;
+	dirty_drop();
+	dirty_next_buf = 0;
+	dirty_valid = false;
+}
+
+/* Called by worker threads after updating stats along @descent. */
+void
+uct_slave_record_dirty(uct_t *u, uct_descent_t *descent, int dlen)
+{
+	dirty_buf_t *d = thread_dirty;
+	if (!d)  /* New thread, grab a buffer */
+		d = thread_dirty = &dirty_bufs[__sync_fetch_and_add(&dirty_next_buf, 1) % dirty_nbufs];
+
+	int levels = (dlen - 1 < u->shared_levels ? dlen - 1 : u->shared_levels);
+	for (int i = 1; i <= levels; i++) {
+		tree_node_t *node = descent[i].node;
+		int h = ((uintptr_t)node / sizeof(*node)) & (DIRTY_SEEN - 1);
+		if (d->seen[h] == node && d->seen_gen[h] == d->gen)
+			continue;
+
+		while (__sync_lock_test_and_set(&d->lock, 1))
+			;
+		if (d->n < dirty_max)  d->node[d->n++] = node;
+		else                   d->overflow = true;
+		d->seen[h] = node;
+		d->seen_gen[h] = d->gen;
+		__sync_lock_release(&d->lock);
+	}
+}
+
+/* Coord path of @node, 0 if it can't be sent (pass or invalid
+ * move on the way, not in current tree anymore, deeper than
+ * @max_depth). */
+static path_t
+node_path(tree_node_t *node, tree_node_t *root, int max_depth, board_t *b)
+{
+	coord_t c[8 * sizeof(path_t)];  /* More than path_t can hold */
+	int n = 0;
+	for (; node != root; node = node->parent) {
+		if (!node || n == max_depth || n == (int)(8 * sizeof(path_t)))  return 0;
+		if (is_pass(node_coord(node)) || (node->hints & TREE_HINT_INVALID))  return 0;
+		c[n++] = node_coord(node);
+	}
+
+	path_t path = 0;
+	while (n--)
+		path = append_child(path, c[n], b);
+	return path;
+}
+
+typedef struct {
+	tree_node_t *node;
+	int gen;
+} dirty_seen_t;
+
+/* Add @node to stats_queue if it has new playouts. Uses @seen hash
+ * set to drop duplicates. Returns false if stats_queue is full. */
+static bool
+dirty_add_stats(stats_candidate_t *stats_queue, int *stats_count, int max_count,
+		dirty_seen_t *seen, int seen_bits, int gen,
+		tree_node_t *node, tree_node_t *root, int max_depth, board_t *b)
+{
+	int h = ((uintptr_t)node / sizeof(*node)) & ((1 << seen_bits) - 1);
+	for (; seen[h].gen == gen; h = (h + 1) & ((1 << seen_bits) - 1))
+		if (seen[h].node == node)  return true;
+	seen[h].node = node;
+	seen[h].gen = gen;
+
+	int incr = node->u.playouts - node->pu.playouts;
+	if (incr <= 0)  return true;
+	path_t path = node_path(node, root, max_depth, b);
+	if (!path)  return true;
+	if (*stats_count >= max_count)  return false;
+
+	stats_queue[*stats_count].playout_incr = incr;
+	stats_queue[*stats_count].coord_path = path;
+	stats_queue[(*stats_count)++].node = node;
+
+	if (incr >= MAX_BUCKETS) incr = MAX_BUCKETS - 1;
+	bucket_count[incr]++;
+	return true;
+}
+
+/* Fill stats_queue from dirty buffers and nodes carried over from last
+ * report. Returns stats count, or -1 if some were lost (tree must be
+ * walked then). */
+static int
+dirty_stats(stats_candidate_t *stats_queue, int max_count, tree_node_t *root, int max_depth, board_t *b)
+{
+	/* Hash set for duplicates, twice the max number of entries. */
+	static dirty_seen_t *seen = NULL;
+	static int seen_bits = 0;
+	static int gen = 0;
+	if (!seen) {
+		while ((1 << seen_bits) < 2 * (max_count + dirty_nbufs * dirty_max))  seen_bits++;
+		seen = calloc2(1 << seen_bits, dirty_seen_t);
+	}
+	gen++;
+
+	int stats_count = 0;
+	bool ok = true;
+	for (int i = 0; i < dirty_ncarry && ok; i++)
+		ok = dirty_add_stats(stats_queue, &stats_count, max_count, seen, seen_bits, gen,
+				     dirty_carry[i], root, max_depth, b);
+	dirty_ncarry = 0;
+
+	for (int k = 0; k < dirty_nbufs; k++) {
+		dirty_buf_t *d = &dirty_bufs[k];
+		while (__sync_lock_test_and_set(&d->lock, 1))
+			;
+		for (int i = 0; i < d->n && ok; i++)
+			ok = dirty_add_stats(stats_queue, &stats_count, max_count, seen, seen_bits, gen,
+					     d->node[i], root, max_depth, b);
+		ok &= !d->overflow;
+		d->n = 0;  d->overflow = false;  d->gen++;
+		__sync_lock_release(&d->lock);
+	}
+	return (ok ? stats_count : -1);
+}
+
+/* Keep nodes which still have some increment for next report. */
+static void
+dirty_carry_over(stats_candidate_t *stats_queue, int stats_count, int max_count)
+{
+	dirty_ncarry = 0;
+	for (int i = 0; i < stats_count; i++) {
+		tree_node_t *node = stats_queue[i].node;
+		if (node->u.playouts <= node->pu.playouts)  continue;
+		if (dirty_ncarry == max_count) {  dirty_valid = false;  return;  }
+		dirty_carry[dirty_ncarry++] = node;
+	}
+}
+
 /* Used to sort by coord path the incremental stats to be sent. */
 static int
 coord_cmp(const void *p1, const void *p2)
@@ -308,16 +508,16 @@ coord_cmp(const void *p1, const void *p2)
 	return (int)(diff >> 32) | !!(int)diff;
 }
 
+/* Binary part of genmoves replies: incremental stats then root stats.
+ * Allocated by uct_slave_init(). */
+static incr_stats_t *out_stats = NULL;
+
 /* Select from stats_queue at most shared_nodes candidates with
  * biggest increments. Return a binary array sorted by coord path. */
 static incr_stats_t *
 select_best_stats(stats_candidate_t *stats_queue, int stats_count,
 		  int shared_nodes, int *byte_size)
 {
-	static incr_stats_t *out_stats = NULL;
-	if (!out_stats)
-		out_stats = calloc2(shared_nodes, incr_stats_t);
-
 	/* Find the minimum increment to send. The bucket with minimum
          * increment may be sent only partially. */
 	int out_count = 0;
@@ -383,32 +583,57 @@ report_incr_stats(uct_t *u, int *stats_size)
 
 	memset(bucket_count, 0, sizeof(bucket_count));
 
-	/* Try to fill the output buffer with the most important
-         * nodes (highest increments), while still traversing
-	 * as little of the tree as possible. If we set min_increment
-	 * too low we waste time. If we set it too high we can't
-	 * fill the output buffer with the desired number of nodes.
-	 * The best min_increment results in stats_count just above 
-	 * shared_nodes. However perfect tuning is not necessary:
-	 * if we send too few nodes we just send shorter buffers
-	 * more frequently. */
-	static int min_increment = 1;
-	static int stats_count = 0;
-	if (stats_count > 2 * u->shared_nodes) {
-		min_increment++;
-	} else if (stats_count < u->shared_nodes / 2 && min_increment > 1) {
-		min_increment--;
+	/* Nodes updated since last report are known, except at the start
+	 * of search (or if some were lost). */
+	int stats_count = -1;
+	bool walked = false;
+
+	/* Tree nodes got recycled since last report (reclaim option):
+	 * recorded nodes may be gone, drop them and walk the tree. */
+	static unsigned int epoch = 0;
+	if (tree_reclaim_epoch(u->t) != epoch) {
+		epoch = tree_reclaim_epoch(u->t);
+		dirty_drop();
+		dirty_valid = false;
 	}
 
-	stats_count = append_stats(stats_queue, root, 0, max_nodes, 0,
-				   max_parent_path(u, b), min_increment, b);
+	if (dirty_valid)
+		stats_count = dirty_stats(stats_queue, max_nodes, root, u->shared_levels, b);
+
+	if (stats_count < 0) {
+		/* Walk the tree. Try to fill the output buffer with the most
+		 * important nodes (highest increments), while still traversing
+		 * as little of the tree as possible. If we set min_increment
+		 * too low we waste time. If we set it too high we can't
+		 * fill the output buffer with the desired number of nodes.
+		 * The best min_increment results in stats_count just above 
+		 * shared_nodes. However perfect tuning is not necessary:
+		 * if we send too few nodes we just send shorter buffers
+		 * more frequently. Nodes skipped here get recorded again
+		 * next time they're updated. */
+		static int min_increment = 1;
+		static int walk_count = 0;
+		if (walk_count > 2 * u->shared_nodes) {
+			min_increment++;
+		} else if (walk_count < u->shared_nodes / 2 && min_increment > 1) {
+			min_increment--;
+		}
+
+		/* Drop dirty buffers, walk sees everything. */
+		memset(bucket_count, 0, sizeof(bucket_count));
+		dirty_drop();
+		walk_count = stats_count = append_stats(stats_queue, root, 0, max_nodes, 0,
+							max_parent_path(u, b), min_increment, b);
+		dirty_valid = walked = true;
+	}
 
 	void *buf = select_best_stats(stats_queue, stats_count, u->shared_nodes, stats_size);
+	dirty_carry_over(stats_queue, stats_count, max_nodes);
 
 	if (DEBUGVV(3))
 		fprintf(stderr,
-			"min_incr %d games %d stats_queue %d/%d sending %d/%d in %.3fms\n",
-			min_increment, root->u.playouts - root->pu.playouts, stats_count,
+			"%s games %d stats_queue %d/%d sending %d/%d in %.3fms\n",
+			(walked ? "walk" : "dirty"), root->u.playouts - root->pu.playouts, stats_count,
 			max_nodes, *stats_size / (int)sizeof(incr_stats_t), u->shared_nodes,
 			(time_now() - start_time)*1000);
 	root->pu = root->u;
@@ -416,24 +641,22 @@ report_incr_stats(uct_t *u, int *stats_size)
 }
 
 /* Get stats for the distributed engine. Return a buffer with one
- * line "played_own root_playouts threads keep_looking @size", then
- * a list of lines "coord playouts value" with absolute counts for
- * children of the root node (including contributions from other
- * slaves). The last line must not end with \n.
+ * line "played_own root_playouts threads keep_looking children @size".
+ * Absolute stats for children of the root node (including contributions
+ * from other slaves) are appended to the binary stats, as incr_stats_t
+ * with the move coord as coord_path. *stats_size is updated.
  * If @force is non-zero, add this move with a large weight.
  * This function is called only by the main thread, but may be
  * called while the tree is updated by the worker threads. Keep this
- * code in sync with distributed/distributed.c:select_best_move(). */
+ * code in sync with distributed/distributed.c:root_stats_hook(). */
 static char *
 report_stats(uct_t *u, board_t *b, coord_t force,
-	     bool keep_looking, int bin_size)
+	     bool keep_looking, int *stats_size)
 {
-	static char reply[10240];
-	char *r = reply;
-	char *end = reply + sizeof(reply);
+	static char reply[128];
 	tree_node_t *root = u->t->root;
-	r += snprintf(r, end - r, "%d %d %d %d @%d", u->played_own, root->u.playouts,
-		      u->threads, keep_looking, bin_size);
+	incr_stats_t *rs = (incr_stats_t *)((char *)out_stats + *stats_size);
+	int children = 0;
 	int min_playouts = root->u.playouts / 100;
 	if (min_playouts < GJ_MINGAMES)
 		min_playouts = GJ_MINGAMES;
@@ -453,18 +676,23 @@ report_stats(uct_t *u, board_t *b, coord_t force,
 		/* A book move is only added at the end: */
 		if (node_coord(ni) == force) continue;
 
-		char buf[4];
 		/* We return the values as stored in the tree, so from black's view. */
-		r += snprintf(r, end - r, "\n%s %d %.16f", coord2bstr(buf, node_coord(ni)),
-			      ni->u.playouts, ni->u.value);
+		rs[children].coord_path = node_coord(ni);
+		rs[children++].incr = ni->u;
 	}
 	/* Give a large but not infinite weight to pass, resign or book move, to avoid
 	 * forcing resign if other slaves don't like it. */
 	if (force) {
 		double resign_value = u->t->root_color == S_WHITE ? 0.0 : 1.0;
 		double value = is_resign(force) ? resign_value : 1.0 - resign_value;
-		r += snprintf(r, end - r, "\n%s %d %.1f", coord2sstr(force), 2 * max_playouts, value);
+		rs[children].coord_path = force;
+		rs[children].incr.value = value;
+		rs[children++].incr.playouts = 2 * max_playouts;
 	}
+	*stats_size += children * sizeof(*rs);
+
+	snprintf(reply, sizeof(reply), "%d %d %d %d %d @%d", u->played_own, root->u.playouts,
+		 u->threads, keep_looking, children, *stats_size);
 	return reply;
 }
 
@@ -476,6 +704,9 @@ uct_slave_init(uct_t *u, board_t *b)
 	if (!u->stats_hbits) u->stats_hbits = DEFAULT_STATS_HBITS;
 	if (!u->shared_nodes) u->shared_nodes = DEFAULT_SHARED_NODES;
 	assert(u->shared_levels * board_bits2(b) <= 8 * (int)sizeof(path_t));
+	dirty_init(u);
+	if (!out_stats)
+		out_stats = calloc2(u->shared_nodes + MAX_ROOT_STATS, incr_stats_t);
 
 	static int showed = 0;
 	if (!showed++) {  /* Display once */
@@ -577,6 +808,7 @@ uct_genmoves(engine_t *e, board_t *b, time_info_t *ti, enum stone color,
 		return NULL;
 
 	*stats_size = 0;
+	*stats_buf = out_stats;
 	bool keep_looking = false;
 	coord_t force = (b->fbook ? fbook_check(b) : 0);
 
@@ -587,6 +819,6 @@ uct_genmoves(engine_t *e, board_t *b, time_info_t *ti, enum stone color,
 			*stats_buf = report_incr_stats(u, stats_size);
 	}
 
-	char *reply = report_stats(u, b, force, keep_looking, *stats_size);
+	char *reply = report_stats(u, b, force, keep_looking, stats_size);
 	return reply;
 }
@@ -12,5 +12,9 @@ char *uct_genmoves(engine_t *e, board_t *b, time_info_t *ti, enum stone color,
 struct tree_hash *uct_htable_alloc(int hbits);
 void uct_htable_reset(tree_t *t);
 
+/* Dirty nodes tracking for stats reporting */
+void uct_slave_dirty_reset(uct_t *u);
+void uct_slave_record_dirty(uct_t *u, uct_descent_t *descent, int dlen);
+
 
 #endif
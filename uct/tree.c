@@ -18,27 +18,115 @@
 #include "uct/prior.h"
 #include "uct/tree.h"
 #include "dcnn.h"
+#include "telemetry.h"
 
 #ifdef DISTRIBUTED
 #include "uct/slave.h"
 #endif
 
 
+/* Node recycling (uct "reclaim" option):
+ * When tree memory runs low, tree_reclaim() detaches children of low-visit
+ * nodes whose children are all leaves while search is running. Detached
+ * nodes are retired first: search threads may still be looking at them.
+ * Each search thread announces the current epoch before each playout, once
+ * all threads are past the epoch a node was retired in, its memory goes to
+ * the free lists (indexed by run length in nodes) and can be reused. */
+
+#define TREE_FREE_MAX 512   /* Longer runs get split */
+
+typedef struct tree_free_run {
+	struct tree_free_run *next;
+} tree_free_run_t;
+
+typedef struct {
+	tree_node_t *start;
+	int count;
+	unsigned int epoch;
+} tree_retired_t;
+
+typedef struct tree_reclaim {
+	pthread_mutex_t lock;
+	volatile unsigned int epoch;
+	int threads;
+	volatile unsigned int *thread_epoch;
+	tree_free_run_t *free[TREE_FREE_MAX + 1];
+	volatile size_t free_nodes;
+	tree_retired_t *retired;
+	int nretired, max_retired;
+	size_t retired_nodes;
+	volatile int failed;       /* Allocations that failed since last tree_reclaim() */
+	volatile int failed_size;  /* Largest of these, in nodes */
+	bool full;                 /* Nothing left to allocate or recycle */
+	size_t reclaimed;  /* stats */
+} tree_reclaim_t;
+
+/* Pop a run of @count nodes from the free lists, splitting a longer one
+ * if needed. Returns NULL if none. */
+static tree_node_t *
+tree_reclaim_alloc(tree_reclaim_t *r, int count)
+{
+	tree_node_t *n = NULL;
+	pthread_mutex_lock(&r->lock);
+	for (int len = count; len <= TREE_FREE_MAX && !n; len++) {
+		if (!r->free[len])  continue;
+		n = (tree_node_t *)r->free[len];
+		r->free[len] = r->free[len]->next;
+		if (len > count) {  /* Give back the rest */
+			tree_free_run_t *rest = (tree_free_run_t *)(n + count);
+			rest->next = r->free[len - count];
+			r->free[len - count] = rest;
+		}
+		r->free_nodes -= count;
+	}
+	pthread_mutex_unlock(&r->lock);
+	return n;
+}
+
+/* Allocate @count contiguous node slots. Returns NULL if not enough memory.
+ * This function may be called by multiple threads in parallel. */
+static void *
+tree_alloc_mem(tree_t *t, int count)
+{
+	if (count <= TREE_FREE_MAX && t->reclaim && t->reclaim->free_nodes >= (size_t)count) {
+		tree_node_t *n = tree_reclaim_alloc(t->reclaim, count);
+		if (n)  return n;
+	}
+
+	/* Only reserve memory if it fits: with node recycling search goes on
+	 * after allocations fail, nodes_size must not keep growing. Tree gets
+	 * marked full instead (nodes_size one past the maximum). */
+	size_t nsize = count * sizeof(tree_node_t);
+	size_t old_size;
+	do {
+		old_size = t->nodes_size;
+		if (old_size + nsize > t->max_tree_size) {
+			if (old_size <= t->max_tree_size)
+				__sync_bool_compare_and_swap(&t->nodes_size, old_size, t->max_tree_size + 1);
+			tree_reclaim_t *r = t->reclaim;
+			if (r) {  /* Let tree_reclaim() know free lists didn't do. */
+				if (r->failed_size < count)  r->failed_size = count;
+				__sync_fetch_and_add(&r->failed, 1);
+			}
+			return NULL;
+		}
+	} while (!__sync_bool_compare_and_swap(&t->nodes_size, old_size, old_size + nsize));
+
+	assert(t->nodes != NULL);
+	return (char*)t->nodes + old_size;
+}
+
 /* Allocate tree node(s). The returned nodes are initialized with zeroes.
  * Returns NULL if not enough memory.
  * This function may be called by multiple threads in parallel. */
 static tree_node_t *
 tree_alloc_node(tree_t *t, int count)
 {
-	tree_node_t *n = NULL;
-	size_t nsize = count * sizeof(*n);
-	size_t old_size = __sync_fetch_and_add(&t->nodes_size, nsize);
-
-	if (old_size + nsize > t->max_tree_size)
+	tree_node_t *n = tree_alloc_mem(t, count);
+	if (!n)
 		return NULL;
-	assert(t->nodes != NULL);
-	n = (tree_node_t *)((char*)t->nodes + old_size);
-	memset(n, 0, nsize);
+	__sync_fetch_and_add(&t->nodes_count, count);
+	memset(n, 0, count * sizeof(*n));
 	return n;
 }
 
@@ -114,9 +202,45 @@ tree_done(tree_t *t)
 #endif
 	assert(t->nodes);
 	free(t->nodes);
+	if (t->reclaim) {
+		pthread_mutex_destroy(&t->reclaim->lock);
+		free((void*)t->reclaim->thread_epoch);
+		free(t->reclaim->retired);
+		free(t->reclaim);
+	}
 	free(t);
 }
 
+/* Forget all nodes, tree memory is empty again. */
+static void
+tree_reset_nodes(tree_t *t)
+{
+	t->nodes_size = 0;
+	t->nodes_count = 0;
+	t->max_depth = 0;
+	if (t->reclaim) {
+		tree_reclaim_t *r = t->reclaim;
+		memset(r->free, 0, sizeof(r->free));
+		r->free_nodes = r->retired_nodes = 0;
+		r->nretired = 0;
+		r->failed = r->failed_size = 0;
+		r->full = false;
+	}
+}
+
+/* Forget all nodes and start over from an empty root, @color to play.
+ * Tree memory is kept for reuse. */
+void
+tree_clear(tree_t *t, enum stone color)
+{
+	tree_reset_nodes(t);
+	t->root = tree_init_node(t, pass, 0);
+	t->root_symmetry = t->board->symmetry;
+	t->root_color = stone_other(color);
+	t->extra_komi = 0;
+	memset(&t->avg_score, 0, sizeof(t->avg_score));
+}
+
 
 static void
 tree_node_dump(tree_t *tree, tree_node_t *node, int treeparity, int l, int thres)
@@ -234,6 +358,7 @@ tree_node_load(FILE *f, tree_node_t *node, int *num)
 		node->amaf.playouts = MAX_PLAYOUTS;
 	}
 	memcpy(&node->pu, &node->u, sizeof(node->u));
+	node->hints &= ~(TREE_HINT_INDEXED | TREE_HINT_PENDING);
 
 	tree_node_t *ni = NULL, *ni_prev = NULL;
 	while (fgetc(f)) {
@@ -266,51 +391,134 @@ tree_load(tree_t *tree, board_t *b)
 }
 
 
-/* Copy the subtree rooted at node: all nodes at or below depth
- * or with at least threshold playouts.
- * The code is destructive on src. The relative order of children of
- * a given node is preserved (assumed by tree_get_node in particular).
- * Returns the copy of node in the destination tree, or NULL
- * if we could not copy it. */
+/* Children of nodes close to the root with many children get a coord index
+ * (amaf updates there are frequent and walk long sibling lists). Costs
+ * board_max_coords + 1 shorts per indexed node, ~900 bytes on 19x19. */
+#define TREE_INDEX_MIN_CHILDREN 32
+#define TREE_INDEX_MAX_DEPTH    4
+
+/* Coord index size to use for @nchildren children of @node (0: no index).
+ * @root_depth is depth of tree root. */
+static int
+tree_child_index_coords(board_t *b, tree_node_t *node, int nchildren, int root_depth)
+{
+	if (!b || nchildren < TREE_INDEX_MIN_CHILDREN ||
+	    node->depth - root_depth >= TREE_INDEX_MAX_DEPTH)
+		return 0;
+	return board_max_coords(b);
+}
+
+/* Allocate a block of @count children, with a coord index in front
+ * if @max_coords is set (see tree_child_index_t), or a list of @npending
+ * pending children (see tree_pending_t). Can't have both.
+ * This function may be called by multiple threads in parallel. */
 static tree_node_t *
-tree_prune(tree_t *dest, tree_t *src, tree_node_t *node,
-	   int threshold, int depth)
+tree_alloc_children(tree_t *t, int count, int max_coords, int npending)
 {
-	assert(dest->nodes && node);
-	tree_node_t *n2 = tree_alloc_node(dest, 1);
-	if (!n2)
+	assert(!max_coords || !npending);
+	int extra = (max_coords ? tree_child_index_nodes(max_coords) :
+		     npending   ? tree_pending_nodes(npending) : 0);
+	tree_node_t *n = tree_alloc_node(t, extra + count);
+	if (!n)
 		return NULL;
+	if (!extra)
+		return n;
+
+	__sync_fetch_and_sub(&t->nodes_count, extra);
+	tree_node_t *children = n + extra;
+	if (max_coords) {
+		tree_child_index_t *index = (tree_child_index_t *)n;
+		index->children = children;
+	} else {
+		tree_pending_t *p = tree_pending_get(children);
+		p->children = children;
+		p->c = (tree_pending_child_t *)n;
+		p->n = npending;
+	}
+	return children;
+}
+
+static void
+tree_copy_node(tree_t *dest, tree_node_t *n2, tree_node_t *node)
+{
 	*n2 = *node;
 	if (n2->depth > dest->max_depth)
 		dest->max_depth = n2->depth;
+	n2->sibling = NULL;
 	n2->children = NULL;
 	n2->is_expanded = false;
+	n2->hints &= ~(TREE_HINT_INDEXED | TREE_HINT_PENDING | TREE_HINT_NOMEM);
+}
 
+/* Copy children of @node (and their subtrees) under @n2, see tree_prune(). */
+static void
+tree_prune_children(tree_t *dest, tree_t *src, tree_node_t *node, tree_node_t *n2,
+		    int threshold, int depth, int root_depth)
+{
 	if (node->depth >= depth && node->u.playouts < threshold)
-		return n2;
+		return;
 	/* For deep nodes with many playouts, we must copy all children,
 	 * even those with zero playouts, because partially expanded
 	 * nodes are not supported. Considering them as fully expanded
 	 * would degrade the playing strength. The only exception is
 	 * when dest becomes full, but this should never happen in practice
 	 * if threshold is chosen to limit the number of nodes traversed. */
-	tree_node_t *ni = node->children;
-	if (!ni)
-		return n2;
-	tree_node_t **prev2 = &(n2->children);
-	while (ni) {
-		tree_node_t *ni2 = tree_prune(dest, src, ni, threshold, depth);
-		if (!ni2) break;
-		*prev2 = ni2;
-		prev2 = &(ni2->sibling);
-		ni2->parent = n2;
-		ni = ni->sibling;
+	int count = 0;
+	for (tree_node_t *ni = node->children; ni; ni = ni->sibling)
+		count++;
+	if (!count)
+		return;
+
+	/* Children get copied as a single block, so we can index them
+	 * unless more are coming (progressive widening): copy remaining
+	 * pending children then. */
+	tree_pending_t *p = tree_node_pending(node);
+	int left = (p ? p->n - p->next : 0);
+	int max_coords = (left ? 0 : tree_child_index_coords(dest->board, node, count, root_depth));
+	tree_node_t *children = tree_alloc_children(dest, count, max_coords, left);
+	if (!children)
+		return;  // avoid partially expanded nodes
+	tree_child_index_t *index = (max_coords ? tree_child_index_get(children, max_coords) : NULL);
+	if (left) {
+		tree_pending_t *p2 = tree_pending_get(children);
+		p2->base = p->base + p->next;
+		memcpy(p2->c, &p->c[p->next], left * sizeof(p->c[0]));
 	}
-	if (!ni) {
-		n2->is_expanded = true;
-	} else {
-		n2->children = NULL; // avoid partially expanded nodes
+
+	int k = 0;
+	for (tree_node_t *ni = node->children; ni; ni = ni->sibling, k++) {
+		tree_node_t *ni2 = &children[k];
+		tree_copy_node(dest, ni2, ni);
+		ni2->parent = n2;
+		if (k)  children[k - 1].sibling = ni2;
+		if (index)  index->child[node_coord(ni) + 1] = k + 1;
 	}
+	n2->children = children;
+	n2->is_expanded = true;
+	if (index)  n2->hints |= TREE_HINT_INDEXED;
+	if (left)   n2->hints |= TREE_HINT_PENDING;
+
+	k = 0;
+	for (tree_node_t *ni = node->children; ni; ni = ni->sibling, k++)
+		tree_prune_children(dest, src, ni, &children[k], threshold, depth, root_depth);
+}
+
+/* Copy the subtree rooted at node: all nodes at or below depth
+ * or with at least threshold playouts.
+ * The code is destructive on src. The relative order of children of
+ * a given node is preserved (assumed by tree_get_node in particular).
+ * Returns the copy of node in the destination tree, or NULL
+ * if we could not copy it. */
+static tree_node_t *
+tree_prune(tree_t *dest, tree_t *src, tree_node_t *node,
+	   int threshold, int depth)
+{
+	assert(dest->nodes && node);
+	tree_node_t *n2 = tree_alloc_node(dest, 1);
+	if (!n2)
+		return NULL;
+	tree_copy_node(dest, n2, node);
+	tree_prune_children(dest, src, node, n2, threshold, depth, node->depth);
 	return n2;
 }
 
@@ -348,7 +556,7 @@ tree_garbage_collect(tree_t *tree, tree_node_t *node)
 
 	tree_t *temp_tree = tree_init(tree->board,  tree->root_color,
 					   tree->max_pruned_size, 0, 0, 0);
-	temp_tree->nodes_size = 0; // We do not want the dummy pass node
+	tree_reset_nodes(temp_tree); // We do not want the dummy pass node
         tree_node_t *temp_node;
 
 	/* Find the maximum depth at which we can copy all nodes. */
@@ -376,9 +584,9 @@ tree_garbage_collect(tree_t *tree, tree_node_t *node)
 	assert(temp_node);
 
 	/* Now copy back to original tree. */
-	tree->nodes_size = 0;
-	tree->max_depth = 0;
+	tree_reset_nodes(tree);
 	tree_node_t *new_node = tree_prune(tree, temp_tree, temp_node, 0, temp_tree->max_depth);
+	telemetry_time(TM_PRUNE, time_now() - start_time);
 
 	if (DEBUGL(1)) {
 		double now = time_now();
@@ -407,13 +615,185 @@ tree_garbage_collect(tree_t *tree, tree_node_t *node)
 void
 tree_copy(tree_t *dst, tree_t *src)
 {
-	dst->nodes_size = 0;
-	dst->max_depth = 0;
+	tree_reset_nodes(dst);
 	// just copy everything for now ...
 	dst->root = tree_prune(dst, src, src->root, 0, src->max_depth);
 	assert(dst->root);
 }
 
+/* Copy of @src fitting in @max_size bytes. If the whole tree doesn't fit,
+ * keep root children and deeper nodes with enough playouts, raising the
+ * threshold until it fits. Returned tree is allocated to exact size.
+ * Returns NULL if no copy fits. */
+static tree_t *
+tree_copy_bounded(tree_t *src, size_t max_size)
+{
+	if (max_size < sizeof(tree_node_t))  return NULL;
+	tree_t *tmp = tree_init(src->board, stone_other(src->root_color), max_size, 0, 0, 0);
+	if (!tmp)  return NULL;
+
+	int threshold = 0;
+	int depth = src->max_depth;
+	while (1) {
+		tree_reset_nodes(tmp);
+		tmp->root = tree_prune(tmp, src, src->root, threshold, depth);
+		if (tmp->root && tmp->nodes_size <= tmp->max_tree_size)
+			break;
+
+		/* Overflow, try again with fewer deep nodes. */
+		if (!threshold) {  threshold = 1;  depth = src->root->depth + 1;  }
+		else            threshold *= 2;
+		if (threshold > src->root->u.playouts) {  tree_done(tmp);  return NULL;  }
+	}
+
+	tree_t *t = tree_init(src->board, stone_other(src->root_color), tmp->nodes_size, 0, 0, 0);
+	if (t)  tree_copy(t, tmp);
+	tree_done(tmp);
+	return t;
+}
+
+
+/* Tree cache: keeps copies of recent search trees keyed by position so that
+ * going back to a previous position (undo, analysis navigation) resumes the
+ * search instead of starting from scratch. The cache is global: it must
+ * survive engine resets (undo reloads the engine). Main thread only. */
+
+#define TREE_CACHE_MAX 64
+
+typedef struct {
+	tree_t *tree;             /* NULL if free slot */
+	hash_t hash;              /* board hash (stones only) */
+	move_t ko;
+	enum stone to_play;
+	floating_t komi;
+	int rsize;
+	board_symmetry_t symmetry;
+	int stamp;                /* for lru eviction */
+} tree_cache_entry_t;
+
+static tree_cache_entry_t tree_cache[TREE_CACHE_MAX];
+static size_t tree_cache_mem;
+static int    tree_cache_stamp;
+static int    tree_cache_lookups, tree_cache_hits;
+
+static bool
+tree_cache_match(tree_cache_entry_t *e, board_t *b, enum stone to_play)
+{
+	return (e->tree && e->hash == b->hash && e->to_play == to_play &&
+		e->ko.coord == b->ko.coord && e->ko.color == b->ko.color &&
+		e->komi == b->komi && e->rsize == board_rsize(b) &&
+		e->symmetry.type == b->symmetry.type && e->symmetry.d == b->symmetry.d &&
+		e->symmetry.x1 == b->symmetry.x1 && e->symmetry.x2 == b->symmetry.x2 &&
+		e->symmetry.y1 == b->symmetry.y1 && e->symmetry.y2 == b->symmetry.y2);
+}
+
+static void
+tree_cache_drop(tree_cache_entry_t *e)
+{
+	tree_cache_mem -= e->tree->max_tree_size;
+	tree_done(e->tree);
+	e->tree = NULL;
+}
+
+/* Evict least recently used entries until we're within limits. */
+static void
+tree_cache_evict(int max_entries, size_t max_mem)
+{
+	while (1) {
+		int n = 0;
+		tree_cache_entry_t *lru = NULL;
+		for (int i = 0; i < TREE_CACHE_MAX; i++) {
+			tree_cache_entry_t *e = &tree_cache[i];
+			if (!e->tree)  continue;
+			n++;
+			if (!lru || e->stamp < lru->stamp)  lru = e;
+		}
+		if (!lru || (n <= max_entries && tree_cache_mem <= max_mem))
+			return;
+		tree_cache_drop(lru);
+	}
+}
+
+/* Save copy of @t in the tree cache. @b must match tree root position.
+ * Tree is pruned if needed to stay within @max_mem. */
+void
+tree_cache_store(tree_t *t, board_t *b, int max_entries, size_t max_mem)
+{
+	enum stone to_play = stone_other(t->root_color);
+	if (max_entries > TREE_CACHE_MAX)  max_entries = TREE_CACHE_MAX;
+	if (max_entries <= 0 || !t->root->u.playouts || t->untrustworthy_tree)
+		return;
+
+	double time_start = time_now();
+	tree_cache_entry_t *slot = NULL;
+	for (int i = 0; i < TREE_CACHE_MAX; i++) {
+		tree_cache_entry_t *e = &tree_cache[i];
+		if (tree_cache_match(e, b, to_play))  tree_cache_drop(e);  /* Replace older copy */
+		if (!e->tree && !slot)  slot = e;
+	}
+
+	/* Make room first so we don't use more than max_mem during copy. */
+	tree_cache_evict(max_entries - 1, max_mem - (t->nodes_size < max_mem ? t->nodes_size : max_mem));
+	if (!slot)
+		for (int i = 0; i < TREE_CACHE_MAX && !slot; i++)
+			if (!tree_cache[i].tree)  slot = &tree_cache[i];
+	assert(slot);
+
+	tree_t *copy = tree_copy_bounded(t, max_mem - tree_cache_mem);
+	if (!copy)  return;
+	copy->board = NULL;   /* Board will be gone by the time we restore it. */
+	copy->extra_komi = t->extra_komi;
+	copy->avg_score = t->avg_score;
+
+	*slot = (tree_cache_entry_t) { copy, b->hash, b->ko, to_play, b->komi, board_rsize(b), b->symmetry, ++tree_cache_stamp };
+	tree_cache_mem += copy->max_tree_size;
+
+	if (DEBUGL(3))
+		fprintf(stderr, "tree cache: saved %s to play, %i playouts, %.1fMb (%.1fMb total) in %.3fs\n",
+			stone2str(to_play), copy->root->u.playouts, (float)copy->max_tree_size / 1048576,
+			(float)tree_cache_mem / 1048576, time_now() - time_start);
+}
+
+/* Replace fresh tree @t contents with cached tree for @b if we have it.
+ * Returns true on cache hit. */
+bool
+tree_cache_restore(tree_t *t, board_t *b)
+{
+	enum stone to_play = stone_other(t->root_color);
+	tree_cache_lookups++;
+
+	tree_cache_entry_t *e = NULL;
+	for (int i = 0; i < TREE_CACHE_MAX && !e; i++)
+		if (tree_cache_match(&tree_cache[i], b, to_play))
+			e = &tree_cache[i];
+	if (!e || e->tree->nodes_size > t->max_tree_size) {
+		if (DEBUGL(2))  fprintf(stderr, "tree cache: miss (hit rate %i/%i)\n", tree_cache_hits, tree_cache_lookups);
+		return false;
+	}
+	tree_cache_hits++;
+
+	tree_copy(t, e->tree);
+	t->root->coord = last_move(b).coord;
+	t->extra_komi = e->tree->extra_komi;
+	t->avg_score = e->tree->avg_score;
+	e->stamp = ++tree_cache_stamp;
+
+	if (DEBUGL(2))
+		fprintf(stderr, "tree cache: hit, resuming from %i playouts (hit rate %i/%i)\n",
+			t->root->u.playouts, tree_cache_hits, tree_cache_lookups);
+	return true;
+}
+
+/* Print tree cache hit rate so far. */
+void
+tree_cache_report(void)
+{
+	if (tree_cache_lookups && DEBUGL(1))
+		fprintf(stderr, "tree cache: %i hits / %i lookups (%i%%)\n", tree_cache_hits, tree_cache_lookups,
+			tree_cache_hits * 100 / tree_cache_lookups);
+}
+
+
 /* Realloc internal tree memory so it can accomodate bigger search tree
  * Expensive: needs to allocate a new tree and copy it over.
  * returns 1 if successful
@@ -458,12 +838,149 @@ tree_get_node(tree_node_t *parent, coord_t c)
 }
 
 
+/* Root parallelization: several trees search the same position and
+ * periodically exchange stats of shallow nodes through the main tree:
+ * increments of each tree since last merge are added to the main tree,
+ * then each tree gets main tree totals back. node->pu holds the stats
+ * already accounted for: in extra trees, own increment since last merge
+ * is u - pu. In main tree, pu is the stats it had when search started,
+ * those are not sent to other trees. */
+
+static void
+tree_merge_reset_node(tree_node_t *node, int depth, int max_depth)
+{
+	node->pu = node->u;
+	if (depth == max_depth)  return;
+	for (tree_node_t *ni = node->children; ni; ni = ni->sibling)
+		tree_merge_reset_node(ni, depth + 1, max_depth);
+}
+
+/* Start of search: stats gathered so far are not sent to other trees. */
+void
+tree_merge_reset(tree_t *t, int max_depth)
+{
+	tree_merge_reset_node(t->root, 0, max_depth);
+}
+
+/* Coord -> child map of @node, so that each child of a node in another
+ * tree can be found in constant time. */
+static void
+tree_merge_map(tree_node_t *node, tree_node_t **map, int max_coords)
+{
+	memset(map, 0, (max_coords + 1) * sizeof(*map));
+	for (tree_node_t *ni = node->children; ni; ni = ni->sibling)
+		map[node_coord(ni) + 1] = ni;
+}
+
+/* Child @c of @node using @map, pending children get materialized. */
+static tree_node_t *
+tree_merge_child(tree_t *t, tree_node_t *node, tree_node_t **map, coord_t c)
+{
+	tree_node_t *n = map[c + 1];
+	if (!n && (node->hints & TREE_HINT_PENDING))
+		n = tree_widen_node_at(t, node, c);
+	return n;
+}
+
+/* Add increments of @node since last merge to @mnode in main tree @mt. */
+static void
+tree_merge_gather(tree_t *mt, tree_node_t *mnode, tree_node_t *node, int depth, int max_depth)
+{
+	move_stats_t u = node->u;
+	move_stats_t incr = u;
+	stats_rm_result(&incr, node->pu.value, node->pu.playouts);
+	if (incr.playouts <= 0)  return;  /* Nothing new below either */
+
+	stats_add_result(&mnode->u, incr.value, incr.playouts);
+	node->pu = u;
+	if (depth == max_depth || !mnode->children)  return;
+
+	int max_coords = board_max_coords(mt->board);
+	tree_node_t *map[max_coords + 1];
+	tree_merge_map(mnode, map, max_coords);
+	for (tree_node_t *ni = node->children; ni; ni = ni->sibling) {
+		if (ni->hints & TREE_HINT_INVALID)  continue;
+		tree_node_t *mi = tree_merge_child(mt, mnode, map, node_coord(ni));
+		if (mi)  tree_merge_gather(mt, mi, ni, depth + 1, max_depth);
+	}
+}
+
+/* Add to @node in tree @t what main tree @mnode got since @node was
+ * last updated (increments of all other trees). */
+static void
+tree_merge_scatter(tree_t *t, tree_node_t *node, tree_node_t *mnode, int depth, int max_depth)
+{
+	move_stats_t total = mnode->u;
+	stats_rm_result(&total, mnode->pu.value, mnode->pu.playouts);
+	move_stats_t incr = total;
+	stats_rm_result(&incr, node->pu.value, node->pu.playouts);
+	if (incr.playouts <= 0)  return;  /* Nothing new below either */
+
+	stats_add_result(&node->u, incr.value, incr.playouts);
+	node->pu = total;
+	if (depth == max_depth || !node->children)  return;
+
+	int max_coords = board_max_coords(t->board);
+	tree_node_t *map[max_coords + 1];
+	tree_merge_map(node, map, max_coords);
+	for (tree_node_t *mi = mnode->children; mi; mi = mi->sibling) {
+		if (mi->hints & TREE_HINT_INVALID)  continue;
+		tree_node_t *ni = tree_merge_child(t, node, map, node_coord(mi));
+		if (ni)  tree_merge_scatter(t, ni, mi, depth + 1, max_depth);
+	}
+}
+
+/* Exchange stats of nodes up to @max_depth between main tree @trees[0]
+ * and other trees: O(@ntrees) per node. Pending children get materialized,
+ * nodes missing in a tree are skipped. Only one thread may merge at a time,
+ * searching threads can keep running. */
+void
+tree_merge_stats(tree_t **trees, int ntrees, int max_depth)
+{
+	tree_t *mt = trees[0];
+	for (int i = 1; i < ntrees; i++)
+		tree_merge_gather(mt, mt->root, trees[i]->root, 0, max_depth);
+	for (int i = 1; i < ntrees; i++)
+		tree_merge_scatter(trees[i], trees[i]->root, mt->root, 0, max_depth);
+}
+
+
 /* Tree symmetry: When possible, we will localize the tree to a single part
  * of the board in tree_expand_node() and possibly flip along symmetry axes
  * to another part of the board in tree_promote_at(). We follow b->symmetry
  * guidelines here. */
 
 
+/* Number of children (not counting pass) a node with @playouts
+ * playouts gets with progressive widening. */
+static int
+tree_widening_limit(uct_t *u, int playouts)
+{
+	return u->widening_min + (int)(u->widening_k * sqrt(playouts));
+}
+
+typedef struct {
+	floating_t key;
+	int i;
+} widening_sort_t;
+
+static int
+widening_cmp(const void *a, const void *b)
+{
+	const widening_sort_t *x = a, *y = b;
+	if (x->key != y->key)  return (x->key < y->key ? 1 : -1);
+	return x->i - y->i;   /* Keep playground order for ties (deterministic) */
+}
+
+/* Expansion of @node failed for lack of tree memory. Only counted
+ * once per node, search keeps retrying it. */
+void
+tree_expand_failed(tree_node_t *node)
+{
+	if (!(__sync_fetch_and_or(&node->hints, TREE_HINT_NOMEM) & TREE_HINT_NOMEM))
+		telemetry_inc(TM_EXPAND_FAILED);
+}
+
 /* This function must be thread safe, given that board b is only modified by the calling thread. */
 void
 tree_expand_node(tree_t *t, tree_node_t *node, board_t *b, enum stone color, uct_t *u, int parity)
@@ -493,19 +1010,6 @@ tree_expand_node(tree_t *t, tree_node_t *node, board_t *b, enum stone color, uct
 	} foreach_free_point_end;
 	uct_prior(u, node, &map);
 
-	/* Now, create the nodes (all at once) */
-	tree_node_t *ni = tree_alloc_node(t, child_count);
-	/* We might temporarily run out of nodes but this should be rare. */
-	if (!ni) {
-		node->is_expanded = false;
-		return;
-	}
-	tree_setup_node(t, ni, pass, node->depth + 1);
-
-	tree_node_t *first_child = ni;
-	ni->parent = node;
-	ni->prior = map.prior[pass]; ni->d = TREE_NODE_D_MAX + 1;
-
 	/* The loop considers only the symmetry playground. */
 	if (UDEBUGL(6)) {
 		fprintf(stderr, "expanding %s within [%d,%d],[%d,%d] %d-%d\n",
@@ -514,7 +1018,9 @@ tree_expand_node(tree_t *t, tree_node_t *node, board_t *b, enum stone color, uct
 				b->symmetry.x2, b->symmetry.y2,
 				b->symmetry.type, b->symmetry.d);
 	}
-	int child = 1;
+	coord_t children[child_count];
+	int nchildren = 0;
+	children[nchildren++] = pass;
 	for (int j = b->symmetry.y1; j <= b->symmetry.y2; j++) {
 		for (int i = b->symmetry.x1; i <= b->symmetry.x2; i++) {
 			if (b->symmetry.d) {
@@ -530,16 +1036,519 @@ tree_expand_node(tree_t *t, tree_node_t *node, board_t *b, enum stone color, uct
 			if (!map.consider[c]) // Filter out invalid moves
 				continue;
 			assert(c != node_coord(node)); // I have spotted "C3 C3" in some sequence...
+			children[nchildren++] = c;
+		}
+	}
 
-			tree_node_t *nj = first_child + child++;
-			tree_setup_node(t, nj, c, node->depth + 1);
-			nj->parent = node; ni->sibling = nj; ni = nj;
+	/* Progressive widening: only create best children by prior for now,
+	 * the rest is kept in pending list and materialized as node playouts
+	 * grow (tree_widen_node()). Pass is always created. */
+	int limit = tree_widening_limit(u, node->u.playouts);
+	int npending = 0;
+	tree_pending_child_t pending[nchildren];
+	if (u->widening_min && nchildren - 1 > limit) {
+		widening_sort_t sorted[nchildren - 1];
+		for (int k = 1; k < nchildren; k++) {
+			move_stats_t *prior = &map.prior[children[k]];
+			floating_t value = (map.parity > 0 ? prior->value : 1 - prior->value);
+			sorted[k - 1] = (widening_sort_t){ value * prior->playouts, k };
+		}
+		qsort(sorted, nchildren - 1, sizeof(sorted[0]), widening_cmp);
 
-			ni->prior = map.prior[c];
-			ni->d = distances[c];
+		for (int k = limit; k < nchildren - 1; k++) {
+			coord_t c = children[sorted[k].i];
+			pending[npending++] = (tree_pending_child_t){ c, distances[c], map.prior[c] };
+			children[sorted[k].i] = 0;  /* Not created now */
 		}
+
+		int n = 0;  /* Compact, keeping playground order */
+		for (int k = 0; k < nchildren; k++)
+			if (children[k])  children[n++] = children[k];
+		nchildren = n;
+	}
+
+	/* Now, create the nodes (all at once).
+	 * Index them by coord unless more children are coming. */
+	int max_coords = (npending ? 0 : tree_child_index_coords(b, node, nchildren, t->root->depth));
+	tree_node_t *ni = tree_alloc_children(t, nchildren, max_coords, npending);
+	/* We might temporarily run out of nodes but this should be rare. */
+	if (!ni) {
+		tree_expand_failed(node);
+		node->is_expanded = false;
+		return;
+	}
+
+	tree_node_t *first_child = ni;
+	tree_child_index_t *index = (max_coords ? tree_child_index_get(first_child, max_coords) : NULL);
+	if (npending) {
+		tree_pending_t *p = tree_pending_get(first_child);
+		p->base = limit;
+		memcpy(p->c, pending, npending * sizeof(pending[0]));
+	}
+	for (int k = 0; k < nchildren; k++) {
+		coord_t c = children[k];
+		tree_node_t *nj = first_child + k;
+		tree_setup_node(t, nj, c, node->depth + 1);
+		nj->parent = node;
+		if (k)  ni->sibling = nj;
+		ni = nj;
+
+		ni->prior = map.prior[c];
+		ni->d = (is_pass(c) ? TREE_NODE_D_MAX + 1 : distances[c]);
+		if (index)  index->child[c + 1] = k + 1;
 	}
 	node->children = first_child; // must be done at the end to avoid race
+	if (index)     __sync_fetch_and_or(&node->hints, TREE_HINT_INDEXED);
+	if (npending)  __sync_fetch_and_or(&node->hints, TREE_HINT_PENDING);
+	telemetry_inc(TM_EXPANSIONS);
+}
+
+/* Dcnn pondering: @node was expanded without dcnn priors. Evaluate it now
+ * and merge dcnn priors into its children (pending ones too), same as if
+ * it had been expanded with dcnn in the first place. Stats gathered so far
+ * are kept. Search must not be running. */
+void
+tree_retrofit_dcnn_priors(tree_t *t, tree_node_t *node, board_t *b, enum stone color, uct_t *u, int parity)
+{
+	assert(node->is_expanded && node->children);
+	move_stats_t map_prior[board_max_coords(b) + 1];      memset(map_prior, 0, sizeof(map_prior));
+	bool         map_consider[board_max_coords(b) + 1];   memset(map_consider, 0, sizeof(map_consider));
+	prior_map_t map = { b, color, tree_parity(t, parity), &map_prior[1], &map_consider[1], NULL };
+
+	tree_pending_t *p = tree_node_pending(node);
+	for (tree_node_t *ni = node->children; ni; ni = ni->sibling)
+		map.consider[node_coord(ni)] = true;
+	if (p)  for (int k = p->next; k < p->n; k++)
+		map.consider[p->c[k].coord] = true;
+
+	double time_start = time_now();
+	uct_prior_dcnn(u, node, &map);
+	telemetry_time(TM_PRIOR_DCNN, time_now() - time_start);
+
+	for (tree_node_t *ni = node->children; ni; ni = ni->sibling)
+		if (!is_pass(node_coord(ni)))
+			stats_merge(&ni->prior, &map.prior[node_coord(ni)]);
+	if (!p)  return;
+
+	/* Pending children: update priors and sort them again. */
+	int n = p->n - p->next;
+	widening_sort_t sorted[n];
+	tree_pending_child_t pc[n];
+	for (int k = 0; k < n; k++) {
+		pc[k] = p->c[p->next + k];
+		stats_merge(&pc[k].prior, &map.prior[pc[k].coord]);
+		floating_t value = (map.parity > 0 ? pc[k].prior.value : 1 - pc[k].prior.value);
+		sorted[k] = (widening_sort_t){ value * pc[k].prior.playouts, k };
+	}
+	qsort(sorted, n, sizeof(sorted[0]), widening_cmp);
+	for (int k = 0; k < n; k++)
+		p->c[p->next + k] = pc[sorted[k].i];
+}
+
+/* Insert new child for pending child @pc in @node children.
+ * Caller must hold pending lock. Returns false if out of memory. */
+static bool
+tree_materialize_child(tree_t *t, tree_node_t *node, tree_pending_child_t *pc)
+{
+	tree_node_t *n = tree_init_node(t, pc->coord, node->depth + 1);
+	if (!n)  return false;
+	n->parent = node;
+	n->prior = pc->prior;
+	n->d = pc->d;
+
+	/* Keep children in coord order (pass always first): distributed
+	 * engine relies on siblings being in the same order in all slaves. */
+	tree_node_t *prev = node->children;
+	while (prev->sibling && node_coord(prev->sibling) < pc->coord)
+		prev = prev->sibling;
+	n->sibling = prev->sibling;
+	__sync_synchronize();  /* Node must be complete before other threads can see it */
+	prev->sibling = n;
+	return true;
+}
+
+/* Progressive widening: materialize more children if @node playouts
+ * allow it. If another thread is busy widening the node we just skip it. */
+void
+tree_widen_node(tree_t *t, tree_node_t *node, uct_t *u)
+{
+	tree_pending_t *p = tree_node_pending(node);
+	if (!p)  return;
+	int limit = tree_widening_limit(u, node->u.playouts);
+	if (p->next == p->n || p->base + p->next >= limit ||
+	    __sync_lock_test_and_set(&p->lock, 1))
+		return;
+	if (tree_node_pending(node) != p) {  /* Reclaimed meanwhile */
+		__sync_lock_release(&p->lock);
+		return;
+	}
+
+	while (p->next < p->n && p->base + p->next < limit) {
+		if (!tree_materialize_child(t, node, &p->c[p->next]))
+			break;
+		p->next++;
+	}
+	__sync_lock_release(&p->lock);
+}
+
+/* Progressive widening: materialize child @c of @node if it's pending.
+ * Returns the child node if found. Waits if another thread is widening
+ * the node. */
+tree_node_t *
+tree_widen_node_at(tree_t *t, tree_node_t *node, coord_t c)
+{
+	tree_pending_t *p = tree_node_pending(node);
+	if (!p || p->next == p->n)  return tree_get_node(node, c);
+	while (__sync_lock_test_and_set(&p->lock, 1))
+		;
+	if (tree_node_pending(node) != p) {  /* Reclaimed meanwhile */
+		__sync_lock_release(&p->lock);
+		return tree_get_node(node, c);
+	}
+
+	tree_node_t *n = tree_get_node(node, c);
+	for (int i = p->next; !n && i < p->n; i++) {
+		if (p->c[i].coord != c)  continue;
+		/* Move it to next position, keeping prior order for the others. */
+		tree_pending_child_t pc = p->c[i];
+		memmove(&p->c[p->next + 1], &p->c[p->next], (i - p->next) * sizeof(pc));
+		p->c[p->next] = pc;
+		if (tree_materialize_child(t, node, &p->c[p->next])) {
+			p->next++;
+			n = tree_get_node(node, c);
+		}
+	}
+	__sync_lock_release(&p->lock);
+	return n;
+}
+
+
+/* Enable node recycling for @threads search threads. */
+void
+tree_reclaim_init(tree_t *t, int threads)
+{
+	if (t->reclaim && t->reclaim->threads >= threads)  return;
+	tree_reclaim_t *r = t->reclaim;
+	if (!r) {
+		r = t->reclaim = calloc2(1, tree_reclaim_t);
+		pthread_mutex_init(&r->lock, NULL);
+		r->epoch = 1;
+	}
+	free((void*)r->thread_epoch);
+	r->thread_epoch = calloc2(threads, unsigned int);  /* 0: not started yet */
+	r->threads = threads;
+}
+
+/* Called by search thread @tid before each playout. */
+void
+tree_reclaim_enter(tree_t *t, int tid)
+{
+	tree_reclaim_t *r = t->reclaim;
+	r->thread_epoch[tid] = r->epoch;
+	__sync_synchronize();
+}
+
+static void
+tree_reclaim_free_run(tree_reclaim_t *r, tree_node_t *start, int count)
+{
+	for (; count > 0; start += TREE_FREE_MAX, count -= TREE_FREE_MAX) {
+		int len = MIN(count, TREE_FREE_MAX);
+		tree_free_run_t *run = (tree_free_run_t *)start;
+		run->next = r->free[len];
+		r->free[len] = run;
+		r->free_nodes += len;
+	}
+}
+
+static int
+free_run_cmp(const void *a, const void *b)
+{
+	const tree_retired_t *x = a, *y = b;
+	return (x->start < y->start ? -1 : x->start > y->start);
+}
+
+/* Join adjacent free runs: free lists get fragmented as longer runs are
+ * split for smaller allocations and runs are retired piecewise. */
+static void
+tree_reclaim_coalesce(tree_reclaim_t *r)
+{
+	pthread_mutex_lock(&r->lock);
+	int n = 0;
+	for (int len = 1; len <= TREE_FREE_MAX; len++)
+		for (tree_free_run_t *run = r->free[len]; run; run = run->next)
+			n++;
+	if (n < 2) {
+		pthread_mutex_unlock(&r->lock);
+		return;
+	}
+
+	tree_retired_t *runs = calloc2(n, tree_retired_t);
+	int k = 0;
+	for (int len = 1; len <= TREE_FREE_MAX; len++)
+		for (tree_free_run_t *run = r->free[len]; run; run = run->next)
+			runs[k++] = (tree_retired_t){ (tree_node_t *)run, len, 0 };
+	qsort(runs, n, sizeof(runs[0]), free_run_cmp);
+
+	memset(r->free, 0, sizeof(r->free));
+	r->free_nodes = 0;
+	for (int i = 0; i < n; ) {
+		tree_node_t *start = runs[i].start;
+		int count = 0;
+		for (; i < n && runs[i].start == start + count; i++)
+			count += runs[i].count;
+		tree_reclaim_free_run(r, start, count);
+	}
+	pthread_mutex_unlock(&r->lock);
+	free(runs);
+}
+
+/* Longest run free lists can hand out, in nodes. */
+static int
+tree_reclaim_max_run(tree_reclaim_t *r)
+{
+	int len = TREE_FREE_MAX;
+	while (len && !r->free[len])
+		len--;
+	return len;
+}
+
+/* Move retired nodes no search thread can see anymore to the free lists.
+ * With @all, search must be stopped. */
+static void
+tree_reclaim_collect(tree_reclaim_t *r, bool all)
+{
+	unsigned int min_epoch = r->epoch;
+	for (int i = 0; i < r->threads && !all; i++)
+		min_epoch = MIN(min_epoch, r->thread_epoch[i]);
+
+	pthread_mutex_lock(&r->lock);
+	int k = 0;
+	for (int i = 0; i < r->nretired; i++) {
+		tree_retired_t *e = &r->retired[i];
+		if (all || e->epoch < min_epoch) {
+			tree_reclaim_free_run(r, e->start, e->count);
+			r->retired_nodes -= e->count;
+			r->reclaimed += e->count;
+		} else
+			r->retired[k++] = *e;
+	}
+	bool recycled = (k < r->nretired);
+	r->nretired = k;
+	pthread_mutex_unlock(&r->lock);
+	if (recycled)  __sync_fetch_and_add(&r->epoch, 1);  /* See tree_reclaim_epoch() */
+}
+
+/* Search stopped, all retired nodes can be reused. */
+void
+tree_reclaim_stop(tree_t *t)
+{
+	tree_reclaim_t *r = t->reclaim;
+	if (!r)  return;
+	tree_reclaim_collect(r, true);
+	r->failed = r->failed_size = 0;
+	r->full = false;
+}
+
+static void
+tree_reclaim_retire(tree_reclaim_t *r, tree_node_t *start, int count)
+{
+	if (r->nretired == r->max_retired) {
+		r->max_retired = MAX(1024, r->max_retired * 2);
+		r->retired = realloc(r->retired, r->max_retired * sizeof(*r->retired));
+		if (!r->retired)  fail("realloc");
+	}
+	r->retired[r->nretired++] = (tree_retired_t){ start, count, r->epoch };
+	r->retired_nodes += count;
+}
+
+/* Node whose children are all leaves ? */
+static bool
+tree_frontier_node(tree_node_t *node)
+{
+	if (!node->children)  return false;
+	for (tree_node_t *ni = node->children; ni; ni = ni->sibling)
+		if (ni->children || ni->is_expanded)
+			return false;
+	return true;
+}
+
+/* Number of nodes we'd get back by detaching @node children. */
+static int
+tree_frontier_nodes(tree_node_t *node)
+{
+	int n = 0;
+	for (tree_node_t *ni = node->children; ni; ni = ni->sibling)
+		n++;
+	tree_pending_t *p = tree_node_pending(node);
+	if (p)
+		n += tree_pending_nodes(p->n);
+	return n;
+}
+
+#define RECLAIM_BUCKETS 32
+
+static int
+reclaim_bucket(tree_node_t *node)
+{
+	int b = 0;
+	for (unsigned int p = node->u.playouts; p && b < RECLAIM_BUCKETS - 1; p >>= 1)
+		b++;
+	return b;
+}
+
+/* Histogram of reclaimable nodes by log2(frontier node playouts). */
+static void
+tree_reclaim_scan(tree_node_t *node, tree_node_t *root, size_t *hist)
+{
+	if (node != root && tree_frontier_node(node)) {
+		hist[reclaim_bucket(node)] += tree_frontier_nodes(node);
+		return;
+	}
+	for (tree_node_t *ni = node->children; ni; ni = ni->sibling)
+		tree_reclaim_scan(ni, root, hist);
+}
+
+/* Detach @node children and retire them. Fails if another thread is
+ * working on them. */
+static bool
+tree_reclaim_node(tree_t *t, tree_node_t *node)
+{
+	tree_reclaim_t *r = t->reclaim;
+	tree_pending_t *p = tree_node_pending(node);
+	if (p && __sync_lock_test_and_set(&p->lock, 1))
+		return false;
+
+	/* Make sure children stay leaves. */
+	tree_node_t *ni;
+	for (ni = node->children; ni; ni = ni->sibling)
+		if (ni->children || __sync_lock_test_and_set(&ni->is_expanded, 1))
+			break;
+	if (ni) {  /* Someone is expanding a child, leave it alone. */
+		for (tree_node_t *nj = node->children; nj != ni; nj = nj->sibling)
+			nj->is_expanded = false;
+		if (p)  __sync_lock_release(&p->lock);
+		return false;
+	}
+
+	tree_node_t *children = node->children;
+	tree_child_index_t *index = tree_child_index(node, children, board_max_coords(t->board));
+	__sync_fetch_and_and(&node->hints, ~(TREE_HINT_INDEXED | TREE_HINT_PENDING));
+	node->children = NULL;
+	__sync_synchronize();
+	node->is_expanded = false;  /* Can be expanded again */
+	if (index)
+		tree_reclaim_retire(r, (tree_node_t *)index, tree_child_index_nodes(board_max_coords(t->board)));
+
+	/* Retire contiguous runs. */
+	int count = 0;
+	tree_node_t *start = children;
+	for (ni = children; ni; ni = ni->sibling) {
+		count++;
+		if (ni->sibling == ni + 1)  continue;
+		tree_reclaim_retire(r, start, count);
+		start = ni->sibling;  count = 0;
+	}
+	if (p) {
+		__sync_lock_release(&p->lock);
+		tree_reclaim_retire(r, children - tree_pending_nodes(p->n), tree_pending_nodes(p->n));
+	}
+	return true;
+}
+
+static void
+tree_reclaim_walk(tree_t *t, tree_node_t *node, int max_bucket, size_t *freed, size_t target)
+{
+	if (*freed >= target)  return;
+	if (node != t->root && tree_frontier_node(node)) {
+		if (reclaim_bucket(node) > max_bucket)  return;
+		int n = tree_frontier_nodes(node);
+		tree_pending_t *p = tree_node_pending(node);
+		int children = n - (p ? tree_pending_nodes(p->n) : 0);
+		if (tree_reclaim_node(t, node)) {
+			*freed += n;
+			__sync_fetch_and_sub(&t->nodes_count, children);
+		}
+		return;
+	}
+	for (tree_node_t *ni = node->children; ni; ni = ni->sibling)
+		tree_reclaim_walk(t, ni, max_bucket, freed, target);
+}
+
+/* Changes whenever nodes get retired or recycled: node pointers kept
+ * outside the tree are only valid as long as it stays the same. */
+unsigned int
+tree_reclaim_epoch(tree_t *t)
+{
+	return (t->reclaim ? t->reclaim->epoch : 0);
+}
+
+/* Free tree memory available right now, in nodes. */
+size_t
+tree_free_nodes(tree_t *t)
+{
+	size_t avail = (t->nodes_size < t->max_tree_size ? t->max_tree_size - t->nodes_size : 0);
+	avail /= sizeof(tree_node_t);
+	if (t->reclaim)
+		avail += t->reclaim->free_nodes;
+	return avail;
+}
+
+/* Tree memory exhausted: expansions fail and there is nothing left to
+ * recycle. */
+bool
+tree_full(tree_t *t)
+{
+	if (t->nodes_size <= t->max_tree_size)  return false;
+	tree_reclaim_t *r = t->reclaim;
+	if (!r)  return true;
+	return r->full || (!tree_free_nodes(t) && !r->retired_nodes);
+}
+
+/* Recycle retired nodes that are safe to reuse. If less than @low nodes
+ * are free (or about to be), retire more until we get @high, starting
+ * with children of nodes with fewest playouts. Runs concurrently with
+ * search threads (from a single thread). Returns number of nodes retired. */
+size_t
+tree_reclaim(tree_t *t, size_t low, size_t high)
+{
+	tree_reclaim_t *r = t->reclaim;
+	assert(r);
+	double time_start = time_now();
+	if (r->nretired)  tree_reclaim_collect(r, false);
+
+	/* Allocations failing despite free nodes: free lists are fragmented.
+	 * If joining runs doesn't help count them as used, we need more. */
+	int failed = r->failed;
+	bool fragmented = false;
+	if (failed) {
+		__sync_fetch_and_sub(&r->failed, failed);
+		tree_reclaim_coalesce(r);
+		fragmented = (tree_reclaim_max_run(r) < r->failed_size);
+		r->failed_size = 0;
+	}
+
+	size_t avail = (fragmented ? 0 : tree_free_nodes(t)) + r->retired_nodes;
+	r->full = false;
+	if (avail >= low)  return 0;
+	size_t needed = high - avail;
+
+	size_t hist[RECLAIM_BUCKETS] = { 0, };
+	tree_reclaim_scan(t->root, t->root, hist);
+	int max_bucket = 0;
+	for (size_t sum = 0; max_bucket < RECLAIM_BUCKETS - 1; max_bucket++)
+		if ((sum += hist[max_bucket]) >= needed)  break;
+
+	size_t freed = 0;
+	tree_reclaim_walk(t, t->root, max_bucket, &freed, needed);
+	__sync_fetch_and_add(&r->epoch, 1);
+	r->full = (fragmented && !freed && !r->retired_nodes);
+	telemetry_time(TM_GC, time_now() - time_start);
+
+	if (DEBUGL(3))
+		fprintf(stderr, "tree reclaim: retired %i nodes (nodes with < %i playouts) in %.3fs, %i free, %i recycled total\n",
+			(int)freed, 1 << max_bucket, time_now() - time_start,
+			(int)tree_free_nodes(t), (int)r->reclaimed);
+	return freed;
 }
 
 
@@ -560,6 +1569,11 @@ tree_fix_node_symmetry(board_t *b, tree_node_t *node,
 {
 	if (!is_pass(node_coord(node)))
 		node->coord = flip_coord(b, node_coord(node), flip_horiz, flip_vert, flip_diag);
+	node->hints &= ~TREE_HINT_INDEXED;  /* Children coords change */
+
+	tree_pending_t *p = tree_node_pending(node);
+	for (int i = 0; p && i < p->n; i++)
+		p->c[i].coord = flip_coord(b, p->c[i].coord, flip_horiz, flip_vert, flip_diag);
 
 	for (tree_node_t *ni = node->children; ni; ni = ni->sibling)
 		tree_fix_node_symmetry(b, ni, flip_horiz, flip_vert, flip_diag);
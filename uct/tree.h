@@ -12,7 +12,9 @@
  *   if necessary to fit in this small buffer. We copy by
  *   preference nodes with largest number of playouts.
  *   Then the temporary buffer is copied back to the original
- *   buffer, which has now plenty of space. */
+ *   buffer, which has now plenty of space.
+ * - reclaim: when memory runs low during search, children of nodes
+ *   with few playouts are recycled on the fly (see tree_reclaim()). */
 
 #include <stdbool.h>
 #include <pthread.h>
@@ -42,6 +44,14 @@ struct uct;
  * Currently, rave_update is top source of cache misses, and
  * there is large memory overhead for having all nodes separate. */
 
+/* Progressive widening: children not materialized yet, sorted by
+ * prior (best first). */
+typedef struct {
+	short coord;
+	unsigned char d;
+	move_stats_t prior;
+} tree_pending_child_t;
+
 typedef struct tree_node {
 	hash_t hash;
 	struct tree_node *parent, *sibling, *children;
@@ -75,6 +85,9 @@ typedef struct tree_node {
 
 #define TREE_HINT_INVALID 1 // don't go to this node, invalid move
 #define TREE_HINT_DCNN    2 // node has dcnn priors
+#define TREE_HINT_INDEXED 4 // children block has a coord index, see below
+#define TREE_HINT_NOMEM   8 // expansion ran out of tree memory (counted)
+#define TREE_HINT_PENDING 16 // children block has a pending list, see below
 	unsigned char hints;
 
 	/* In case multiple threads walk the tree, is_expanded is set
@@ -86,7 +99,61 @@ typedef struct tree_node {
 	bool is_expanded;
 } tree_node_t;
 
+/* Coord -> child map of a node whose children were allocated as a single
+ * block, stored in tree memory right before the block (takes
+ * tree_child_index_nodes() nodes). Lets amaf updates find children of
+ * played moves directly instead of walking the sibling list.
+ * Only nodes near the root with many children get one, see tree.c */
+typedef struct {
+	tree_node_t *children;    /* block this index belongs to */
+	unsigned short child[];   /* [c + 1]: 1 + offset of child c in block, 0 if none */
+} tree_child_index_t;
+
+#define tree_child_index_nodes(max_coords) \
+	((sizeof(tree_child_index_t) + ((max_coords) + 1) * sizeof(unsigned short) + sizeof(tree_node_t) - 1) / sizeof(tree_node_t))
+
+#define tree_child_index_get(children, max_coords) \
+	((tree_child_index_t *)((children) - tree_child_index_nodes(max_coords)))
+
+/* Get coord index for @children, first child of @node, or NULL if none. */
+static inline tree_child_index_t *
+tree_child_index(tree_node_t *node, tree_node_t *children, int max_coords)
+{
+	if (!(node->hints & TREE_HINT_INDEXED))  return NULL;
+	tree_child_index_t *index = tree_child_index_get(children, max_coords);
+	return (index->children == children ? index : NULL);
+}
+
+/* Pending children of a node (progressive widening), stored in tree memory
+ * right before its children block like the coord index: pending children
+ * first, then this header (tree_pending_nodes() nodes in total).
+ * A node has either a pending list or a coord index, not both. */
+typedef struct {
+	tree_node_t *children;    /* block this list belongs to */
+	tree_pending_child_t *c;  /* pending children, right before header */
+	int base;                 /* number of materialized children (not counting pass) */
+	int n;                    /* number of pending children */
+	volatile int next;        /* next pending child to materialize */
+	volatile int lock;
+} tree_pending_t;
+
+#define tree_pending_nodes(n) \
+	((sizeof(tree_pending_t) + (n) * sizeof(tree_pending_child_t) + sizeof(tree_node_t) - 1) / sizeof(tree_node_t))
+
+#define tree_pending_get(children)  ((tree_pending_t *)(children) - 1)
+
+/* Get pending list of @node, or NULL if none (or all materialized). */
+static inline tree_pending_t *
+tree_node_pending(tree_node_t *node)
+{
+	tree_node_t *children = node->children;
+	if (!(node->hints & TREE_HINT_PENDING) || !children)  return NULL;
+	tree_pending_t *p = tree_pending_get(children);
+	return (p->children == children ? p : NULL);
+}
+
 struct tree_hash;
+struct tree_reclaim;
 
 typedef struct {
 	board_t *board;
@@ -121,16 +188,20 @@ typedef struct {
 	// Statistics
 	int max_depth;
 	volatile size_t nodes_size; // byte size of all allocated nodes
+	volatile int nodes_count; // number of allocated nodes
 	size_t max_tree_size; // maximum byte size for entire tree
 	size_t max_pruned_size;
 	size_t pruning_threshold;
 	void *nodes; // nodes buffer
+	struct tree_reclaim *reclaim; // node recycling state, or NULL
 } tree_t;
 
-/* Warning: all functions below except tree_expand_node & tree_leaf_node are THREAD-UNSAFE! */
+/* Warning: all functions below except tree_expand_node, tree_widen_node*,
+ * tree_expand_failed & tree_leaf_node are THREAD-UNSAFE! */
 tree_t *tree_init(board_t *board, enum stone color, size_t max_tree_size,
 		  size_t max_pruned_size, size_t pruning_threshold, int hbits);
 void tree_done(tree_t *tree);
+void tree_clear(tree_t *tree, enum stone color);
 void tree_dump(tree_t *tree, double thres);
 void tree_save(tree_t *tree, board_t *b, int thres);
 void tree_load(tree_t *tree, board_t *b);
@@ -138,12 +209,35 @@ void tree_copy(tree_t *dst, tree_t *src);
 void tree_replace(tree_t *tree, tree_t *content);
 int  tree_realloc(tree_t *t, size_t max_tree_size, size_t max_pruned_size, size_t pruning_threshold);
 
+/* Position-keyed tree cache, survives engine resets. */
+void tree_cache_store(tree_t *t, board_t *b, int max_entries, size_t max_mem);
+bool tree_cache_restore(tree_t *t, board_t *b);
+void tree_cache_report(void);
+
 tree_node_t *tree_get_node(tree_node_t *parent, coord_t c);
 tree_node_t *tree_garbage_collect(tree_t *tree, tree_node_t *node);
 void tree_promote_node(tree_t *tree, tree_node_t **node);
 bool tree_promote_at(tree_t *tree, board_t *b, coord_t c, int *reason);
 
 void tree_expand_node(tree_t *tree, tree_node_t *node, board_t *b, enum stone color, struct uct *u, int parity);
+void tree_widen_node(tree_t *tree, tree_node_t *node, struct uct *u);
+void tree_expand_failed(tree_node_t *node);
+void tree_retrofit_dcnn_priors(tree_t *tree, tree_node_t *node, board_t *b, enum stone color, struct uct *u, int parity);
+tree_node_t *tree_widen_node_at(tree_t *tree, tree_node_t *node, coord_t c);
+
+/* Stats exchange between trees searching the same position (root / hybrid
+ * thread models), for nodes up to @max_depth. See tree.c */
+void tree_merge_reset(tree_t *tree, int max_depth);
+void tree_merge_stats(tree_t **trees, int ntrees, int max_depth);
+
+/* Node recycling while searching, see tree.c */
+void   tree_reclaim_init(tree_t *tree, int threads);
+void   tree_reclaim_enter(tree_t *tree, int tid);
+size_t tree_reclaim(tree_t *tree, size_t low, size_t high);
+void   tree_reclaim_stop(tree_t *tree);
+unsigned int tree_reclaim_epoch(tree_t *tree);
+size_t tree_free_nodes(tree_t *tree);
+bool   tree_full(tree_t *tree);
 
 static bool tree_leaf_node(tree_node_t *node);
 
@@ -28,6 +28,7 @@
 #include "uct/uct.h"
 #include "uct/walk.h"
 #include "dcnn.h"
+#include "server.h"
 
 #ifdef DISTRIBUTED
 #include "uct/slave.h"
@@ -44,7 +45,7 @@ static void uct_genmove_pondering_start(uct_t *u, board_t *b, enum stone color,
 static void
 setup_state(uct_t *u, board_t *b, enum stone color)
 {
-	size_t size = u->tree_size;
+	size_t size = uct_search_tree_size(u, u->tree_size);
 	u->t = tree_init(b, color, size, pruned_size(size), pruning_threshold(size), stats_hbits(u));
 	if (u->initial_extra_komi)
 		u->t->extra_komi = u->initial_extra_komi;
@@ -106,6 +107,22 @@ uct_prepare_move(uct_t *u, board_t *b, enum stone color)
 #endif
 }
 
+static void
+uct_tree_cache_store(uct_t *u, tree_t *t, board_t *b)
+{
+	if (!u->tree_cache || u->slave)  return;
+	size_t max_mem = (u->tree_cache_mem ? u->tree_cache_mem : u->tree_size);
+	tree_cache_store(t, b, u->tree_cache, max_mem);
+}
+
+/* Fresh tree: resume search from cached tree if we've been here before. */
+static void
+uct_tree_cache_restore(uct_t *u, board_t *b)
+{
+	if (!u->tree_cache || u->slave)  return;
+	tree_cache_restore(u->t, b);
+}
+
 /* Does the board look like a final position ?
  * And do we win counting, considering that given groups are dead ?
  * (if allow_losing_pass wasn't set) */
@@ -324,7 +341,9 @@ uct_done(engine_t *e)
 
 	free(u->banner);
 	uct_pondering_stop(u);
+	if (u->tree_cache)    tree_cache_report();
 	if (u->t)             reset_state(u);
+	uct_search_trees_free(u);
 	if (u->dynkomi)       u->dynkomi->done(u->dynkomi);
 	if (u->policy)        u->policy->done(u->policy);
 	if (u->random_policy) u->random_policy->done(u->random_policy);
@@ -369,8 +388,12 @@ uct_search(uct_t *u, board_t *b, time_info_t *ti, enum stone color, tree_t *t, b
 			break;
 		}
 		
-		/* Check if we should stop the search. */
-		if (uct_search_check_stop(u, b, color, t, ti, &s, i))
+		/* Check if we should stop the search.
+		 * Deterministic search with fixed playouts stops by itself. */
+		if (u->det && ti->dim == TD_GAMES) {
+			if (uct_det_stopped(u))  break;
+		}
+		else if (uct_search_check_stop(u, b, color, t, ti, &s, i))
 			break;
 	}
 
@@ -381,6 +404,9 @@ uct_search(uct_t *u, board_t *b, time_info_t *ti, enum stone color, tree_t *t, b
 			t->avg_score.value, t->avg_score.playouts,
 			u->dynkomi->score.value, u->dynkomi->score.playouts,
 			u->dynkomi->value.value, u->dynkomi->value.playouts);
+	if (UDEBUGL(3))
+		fprintf(stderr, "(tree %d nodes, %.2f nodes/playout)\n", t->nodes_count,
+			(float)t->nodes_count / (t->root->u.playouts + 1));
 	if (print_progress)
 		uct_progress_status(u, t, color, 0, NULL);
 
@@ -403,7 +429,7 @@ uct_search(uct_t *u, board_t *b, time_info_t *ti, enum stone color, tree_t *t, b
 		u->playout->debug_level = u->debug_after.level;
 		uct_halt = false;
 
-		uct_playouts(u, b, color, t, &debug_ti);
+		uct_playouts(u, b, color, t, &debug_ti, 0);
 		tree_dump(t, u->dumpthres);
 
 		uct_halt = true;
@@ -430,17 +456,22 @@ uct_genmove_pondering_start(uct_t *u, board_t *b, enum stone color, coord_t our_
 
 	/* Dcnn pondering:
 	 * Promoted node wasn't searched with dcnn priors, start from scratch
-	 * so it gets dcnn evaluated (and next move as well). Save opponent
-	 * best moves from genmove search, will need it later on to guess
-	 * next move. */
+	 * so it gets dcnn evaluated (and next move as well), or keep the tree
+	 * and have dcnn priors added to existing nodes when search starts.
+	 * Save opponent best moves from genmove search, will need it later on
+	 * to guess next move. */
 	if (u->pondering_opt && using_dcnn(b) && u->t) {
 		int      nbest =  u->dcnn_pondering_mcts;
 		coord_t *best_c = u->dcnn_pondering_mcts_c;
 		float    best_r[nbest];
 		uct_get_best_moves(u, best_c, best_r, nbest, false, 100);
 
-		u->initial_extra_komi = u->t->extra_komi;
-		reset_state(u);
+		if (u->dcnn_pondering_keep_tree) {
+			if (UDEBUGL(2))  fprintf(stderr, "dcnn pondering: keeping tree (%i playouts)\n", u->t->root->u.playouts);
+		} else {
+			u->initial_extra_komi = u->t->extra_komi;
+			reset_state(u);
+		}
 	}
 
 	if (!u->t)  uct_prepare_move(u, b, other_color);
@@ -454,6 +485,13 @@ uct_genmove_pondering_start(uct_t *u, board_t *b, enum stone color, coord_t our_
 static void
 uct_pondering_start(uct_t *u, board_t *b0, tree_t *t, enum stone color, coord_t our_move, int flags)
 {
+	/* Server mode: don't make other sessions wait for us to ponder. */
+	if ((flags & UCT_SEARCH_GENMOVE_PONDERING) &&
+	    (server_cpus_wanted() || !server_cpus_try_take(u->threads))) {
+		if (UDEBUGL(2))  fprintf(stderr, "no cpus left, not pondering\n");
+		return;
+	}
+
 	if (UDEBUGL(1))
 		fprintf(stderr, "Starting to ponder with color %s\n", stone2str(stone_other(color)));
 	flags |= UCT_SEARCH_PONDERING;
@@ -494,6 +532,7 @@ uct_pondering_stop(uct_t *u)
 	uct_thread_ctx_t *ctx = uct_search_stop();  /* clears search flags */
 	
 	if (UDEBUGL(1))  uct_progress_status(u, ctx->t, ctx->color, 0, NULL);
+	uct_tree_cache_store(u, ctx->t, ctx->b);
 
 	free(ctx->b);
 	u->reporting = u->reporting_opt;
@@ -512,7 +551,9 @@ uct_genmove_setup(uct_t *u, board_t *b, enum stone color)
 		b->superko_violation = false;
 	}
 
+	bool fresh_tree = !u->t;
 	uct_prepare_move(u, b, color);
+	if (fresh_tree)  uct_tree_cache_restore(u, b);
 
 	assert(u->t);
 	u->my_color = color;
@@ -547,7 +588,11 @@ genmove(engine_t *e, board_t *b, time_info_t *ti, enum stone color, bool pass_al
 
         /* Start the Monte Carlo Tree Search! */
 	int base_playouts = u->t->root->u.playouts;
+	bool untimed = (ti->period == TT_NULL || ti->dim == TD_GAMES);  /* uct_search() sets default ti */
 	int played_games = uct_search(u, b, ti, color, u->t, false);
+	/* Copying the tree delays the reply and isn't accounted for by
+	 * time control: only cache it for untimed searches (analysis). */
+	if (untimed)  uct_tree_cache_store(u, u->t, b);
 
 	tree_node_t *best;
 	best = uct_search_result(u, b, color, u->pass_all_alive, played_games, base_playouts, best_coord);
@@ -646,7 +691,10 @@ uct_analyze(engine_t *e, board_t *b, enum stone color, int start)
 	
 	u->reporting = UR_LEELA_ZERO;
 	u->report_fh = stdout;          /* Reset in uct_pondering_stop() */
-	if (!u->t)  uct_prepare_move(u, b, color);
+	if (!u->t) {
+		uct_prepare_move(u, b, color);
+		uct_tree_cache_restore(u, b);
+	}
 	uct_pondering_start(u, b, u->t, color, 0, flags);
 }
 
@@ -699,6 +747,19 @@ uct_best_moves(engine_t *e, board_t *b, time_info_t *ti, enum stone color,
 		reset_state(u);
 }
 
+/* Batch analysis: search position and write final stats to @fh as
+ * a json line (winrate, best sequences, ownermap). The tree is kept
+ * so that it can be reused once next move is played. */
+coord_t
+uct_analyze_json(engine_t *e, board_t *b, time_info_t *ti, enum stone color, FILE *fh)
+{
+	uct_t *u = (uct_t*)e->data;
+	coord_t best_coord;
+	genmove(e, b, ti, color, 0, &best_coord);
+	uct_progress_json(fh, u, u->t, color, u->t->root->u.playouts, &best_coord, true);
+	return best_coord;
+}
+
 bool
 uct_gentbook(engine_t *e, board_t *b, time_info_t *ti, enum stone color)
 {
@@ -1007,6 +1068,18 @@ uct_setoption(engine_t *e, board_t *b, const char *optname, char *optval,
 		 * visited this many times. */
 		u->expand_p = atoi(optval);
 	}
+	else if (!strcasecmp(optname, "widening") && optval) {
+		/* Progressive widening: when expanding a node only create
+		 * this many children (best priors first, plus pass), more
+		 * get added as node playouts grow. Saves memory and makes
+		 * descent faster. 0 expands all children at once (default). */
+		u->widening_min = atoi(optval);
+	}
+	else if (!strcasecmp(optname, "widening_k") && optval) {
+		/* Progressive widening rate: node with n playouts gets
+		 * widening + widening_k * sqrt(n) children. */
+		u->widening_k = atof(optval);
+	}
 	else if (!strcasecmp(optname, "random_policy_chance") && optval) {
 		/* If specified (N), with probability 1/N, random_policy policy
 		 * descend is used instead of main policy descend; useful
@@ -1059,13 +1132,68 @@ uct_setoption(engine_t *e, board_t *b, const char *optname, char *optval,
 			 * rages most threads choosing the
 			 * same tree branches to read. */
 			u->thread_model = TM_TREEVL;
+		} else if (!strcasecmp(optval, "root")) {
+			/* Root parallelization - each thread
+			 * searches its own tree, root and
+			 * shallow nodes stats are merged
+			 * periodically. No contention between
+			 * threads but trees overlap a lot. */
+			u->thread_model = TM_ROOT;
+		} else if (!strcasecmp(optval, "hybrid")) {
+			/* Threads are split in tree_groups
+			 * groups, each group does tree
+			 * parallelization (with virtual loss)
+			 * on its own tree, trees are merged
+			 * like with root parallelization.
+			 * One group per cpu socket for example. */
+			u->thread_model = TM_HYBRID;
 		} else
 			option_error("UCT: Invalid thread model %s\n", optval);
 	}
+	else if (!strcasecmp(optname, "tree_groups") && optval) {
+		/* Hybrid thread model: number of trees (default 2). */
+		u->tree_groups = atoi(optval);
+		if (u->tree_groups < 1)  option_error("UCT: Invalid tree_groups %s\n", optval);
+	}
+	else if (!strcasecmp(optname, "tree_merge_depth") && optval) {
+		/* Root / hybrid thread models: merge stats of nodes
+		 * up to this depth (1: root children only). */
+		u->tree_merge_depth = atoi(optval);
+	}
+	else if (!strcasecmp(optname, "tree_merge_interval") && optval) {
+		/* Root / hybrid thread models: time between merges
+		 * in ms. Trees are also merged at the end of search. */
+		u->tree_merge_interval = 0.001 * atof(optval);
+	}
 	else if (!strcasecmp(optname, "virtual_loss") && optval) {
 		/* Number of virtual losses added before evaluating a node. */
 		u->virtual_loss = atoi(optval);
 	}
+	else if (!strcasecmp(optname, "deterministic")) {
+		/* Reproducible multi-threaded search: same seed and playouts
+		 * give the same tree regardless of thread timing. Playouts run
+		 * in lockstep batches, leaves are picked and results applied
+		 * in playout order by one thread, random playouts run in
+		 * parallel. Only fixed playouts searches (-t =N) are fully
+		 * reproducible, and only as long as tree memory doesn't run out.
+		 * Disables "reclaim". Costs some speed, meant for regression runs. */
+		u->deterministic = !optval || atoi(optval);
+	}
+	else if (!strcasecmp(optname, "deterministic_batch") && optval) {
+		/* Deterministic search: playouts per thread in each batch.
+		 * Default: 4. Higher means less synchronization but more
+		 * leaves picked before their results are known. */
+		u->deterministic_batch = atoi(optval);
+		if (u->deterministic_batch < 1)
+			option_error("UCT: Invalid deterministic_batch %s\n", optval);
+	}
+	else if (!strcasecmp(optname, "descent_undo")) {
+		/* Each thread keeps a board for tree descents and only undoes
+		 * moves back to where a descent leaves the previous one,
+		 * instead of playing it all on a copy of the root board.
+		 * Same search, fewer board_play() per playout. */
+		u->descent_undo = !optval || atoi(optval);
+	}
 	else if (!strcasecmp(optname, "auto_alloc")) {  NEED_RESET
 	        /* Automatically grow tree memory during search (default)
 		 * If tree memory runs out will allocate bigger space and resume
@@ -1106,6 +1234,26 @@ uct_setoption(engine_t *e, board_t *b, const char *optname, char *optval,
 		 * limit global memory usage instead. */
 		u->max_tree_size_opt = (size_t)atoll(optval) * 1048576;  /* long is 4 bytes on windows! */
 	}
+	else if (!strcasecmp(optname, "reclaim")) {
+		/* Recycle nodes with few playouts while searching when tree
+		 * memory gets full, instead of stopping search / reallocating.
+		 * Lets long pondering / analysis sessions run with fixed memory. */
+		u->reclaim = !optval || atoi(optval);
+	}
+	else if (!strcasecmp(optname, "tree_cache") && optval) {
+		/* Keep copies of search trees for the last n positions searched.
+		 * Default: 0 (disabled)
+		 * Going back to a previous position (undo, analysis navigation)
+		 * then resumes the search instead of starting from scratch.
+		 * Genmove trees are only cached for untimed searches. */
+		u->tree_cache = atoi(optval);
+	}
+	else if (!strcasecmp(optname, "tree_cache_mem") && optval) {
+		/* Maximum amount of memory [MiB] used by the tree cache.
+		 * Default: same as "tree_size"
+		 * Cached trees are pruned to fit if needed. */
+		u->tree_cache_mem = (size_t)atoll(optval) * 1048576;  /* long is 4 bytes on windows! */
+	}
 	else if (!strcasecmp(optname, "reset_tree")) {
 		/* Reset tree before each genmove ?
 		 * Default is to reuse previous tree when not using dcnn. 
@@ -1141,6 +1289,14 @@ uct_setoption(engine_t *e, board_t *b, const char *optname, char *optval,
 		size_t n = u->dcnn_pondering_mcts = atoi(optval);
 		assert(n <= sizeof(u->dcnn_pondering_mcts_c) / sizeof(u->dcnn_pondering_mcts_c[0]));
 	}
+	else if (!strcasecmp(optname, "dcnn_pondering_keep_tree")) {
+		/* Dcnn pondering: keep genmove tree instead of starting from scratch.
+		 * Nodes searched without dcnn get dcnn priors added to their
+		 * children before pondering starts (root and next move guesses),
+		 * playouts gathered so far are kept. Saves genmove search effort
+		 * but early search was steered by weaker priors. */
+		u->dcnn_pondering_keep_tree = !optval || atoi(optval);
+	}
 
 	/** Time control */
 
@@ -1379,21 +1535,33 @@ uct_state_init(engine_t *e, board_t *b)
 	u->mercymin = 0;
 	u->significant_threshold = 50;
 	u->expand_p = 8;
+	u->widening_min = 0;
+	u->widening_k = 2.0;
 	u->dumpthres = 0.01;
 	u->playout_amaf = true;
 	u->amaf_prior = false;
 	u->auto_alloc = true;
 	u->tree_size = uct_default_tree_size();
 	u->max_tree_size_opt = 0;   /* unlimited */
+	u->reclaim = false;
+	u->tree_cache = 0;
+	u->tree_cache_mem = 0;      /* same as tree_size */
 	u->genmove_reset_tree = false;
 
 	u->threads = get_nprocessors();
 	u->thread_model = TM_TREEVL;
 	u->virtual_loss = 1;
+	u->tree_groups = 2;
+	u->tree_merge_depth = 2;
+	u->tree_merge_interval = 0.1;
+	u->deterministic = false;
+	u->deterministic_batch = 4;
+	u->descent_undo = false;
 
 	u->pondering_opt = false;
 	u->dcnn_pondering_prior = 5;
 	u->dcnn_pondering_mcts = 3;
+	u->dcnn_pondering_keep_tree = false;
 
 	u->fuseki_end = 20; // max time at 361*20% = 72 moves (our 36th move, still 99 to play)
 	u->yose_start = 40; // (100-40-25)*361/100/2 = 63 moves still to play by us then
@@ -1434,6 +1602,8 @@ uct_state_init(engine_t *e, board_t *b)
 
 	if (!!u->random_policy_chance ^ !!u->random_policy)
 		die("uct: Only one of random_policy and random_policy_chance is set\n");
+	if ((u->thread_model == TM_ROOT || u->thread_model == TM_HYBRID) && (u->deterministic || u->slave))
+		die("uct: root and hybrid thread models don't work with deterministic search or slave mode\n");
 
 	uct_tree_size_init(u, u->tree_size);
 
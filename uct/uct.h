@@ -7,6 +7,7 @@ void engine_uct_init(engine_t *e, board_t *b);
 
 bool   uct_gentbook(engine_t *e, board_t *b, time_info_t *ti, enum stone color);
 void   uct_dumptbook(engine_t *e, board_t *b, enum stone color);
+coord_t uct_analyze_json(engine_t *e, board_t *b, time_info_t *ti, enum stone color, FILE *fh);
 size_t uct_default_tree_size(void);
 
 #endif
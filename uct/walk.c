@@ -10,6 +10,7 @@
 
 #include "debug.h"
 #include "board.h"
+#include "board_undo.h"
 #include "move.h"
 #include "playout.h"
 #include "random.h"
@@ -22,6 +23,10 @@
 #include "uct/walk.h"
 #include "uct/prior.h"
 #include "gogui.h"
+#include "telemetry.h"
+#ifdef DISTRIBUTED
+#include "uct/slave.h"
+#endif
 
 #define DESCENT_DLEN 512
 
@@ -300,7 +305,7 @@ uct_leaf_node(uct_t *u, board_t *b, enum stone player_color,
 	      uct_descent_t *descent, int *dlen,
 	      tree_node_t *significant[2],
               tree_t *t, tree_node_t *n, enum stone node_color,
-	      char *spaces)
+	      char *spaces, ownermap_t *ownermap)
 {
 	enum stone next_color = stone_other(node_color);
 	int parity = (next_color == player_color ? 1 : -1);
@@ -313,7 +318,7 @@ uct_leaf_node(uct_t *u, board_t *b, enum stone player_color,
 	playout_setup_t ps = playout_setup(u->gamelen, u->mercymin);
 	int result = playout_play_game(&ps, b, next_color,
 				       u->playout_amaf ? amaf : NULL,
-				       &u->ownermap, u->playout);
+				       ownermap, u->playout);
 	if (next_color == S_WHITE) {
 		/* We need the result from black's perspective. */
 		result = - result;
@@ -361,14 +366,149 @@ scale_value(uct_t *u, board_t *b, enum stone node_color, tree_node_t *significan
 	return rval;
 }
 
-static tree_node_t *
-uct_playout_descent(uct_t *u, board_t *b, board_t *b2, enum stone player_color, tree_t *t, int *presult)
-{
+/* Persistent descent board ("descent_undo" option): each thread keeps
+ * the board at its last leaf and next descent only undoes moves back to
+ * where it leaves the previous one, instead of replaying the whole
+ * descent on a copy of the root board. Playouts still run on a copy,
+ * made at the leaf. Deeper than DBOARD_MOVES, descent goes on on the
+ * copy. */
+#define DBOARD_MOVES 64
+
+typedef struct {
+	board_t b;
+	int moves;				/* Moves played from root */
+	move_t move[DBOARD_MOVES];
+	bool ko_threat[DBOARD_MOVES];
+	board_full_undo_t undo[DBOARD_MOVES];
+} uct_dboard_t;
+
+/* State of a single playout: tree descent, then random playout from
+ * the leaf node. */
+typedef struct {
+	board_t *b2;			/* Board at leaf node, then final position */
+	uct_dboard_t *db;		/* Persistent descent board if any, */
+	board_t *scratch;		/* and board for the playout then. */
+	bool on_db;			/* Walk still on db->b ? */
+	bool match;			/* Same moves as db so far ? */
+	int depth;
 	playout_amafmap_t amaf;
-	amaf.gamelen = amaf.game_baselen = 0;
+	/* Tree descent history. */
+	/* XXX: This is somewhat messy since @n and descent[dlen-1].node are
+	 * redundant. */
+	uct_descent_t descent[DESCENT_DLEN];
+	int dlen;
+	/* The last "significant" node along the descent (i.e. node
+	 * with higher than configured number of playouts). For black
+	 * and white. */
+	tree_node_t *significant[2];
+	tree_node_t *n;			/* Leaf node */
+	enum stone node_color;
+	int result;
+} uct_walk_t;
+
+static uct_dboard_t *
+dboard_new(board_t *b)
+{
+	uct_dboard_t *db = malloc2(uct_dboard_t);
+	board_copy(&db->b, b);
+	db->moves = 0;
+	return db;
+}
+
+static void
+dboard_done(uct_dboard_t *db)
+{
+	if (!db)  return;
+	board_done(&db->b);
+	free(db);
+}
+
+static void
+dboard_rewind(uct_dboard_t *db, int moves)
+{
+	while (db->moves > moves) {
+		db->moves--;
+		board_full_undo(&db->b, &db->move[db->moves], &db->undo[db->moves]);
+	}
+}
+
+/* Play descent move, reusing the previous descent's moves while they
+ * agree. Returns -1 if move is invalid (suicide or superko too). */
+static int
+uct_walk_play(uct_t *u, uct_walk_t *w, move_t *m, bool *ko_threat)
+{
+	uct_dboard_t *db = w->db;
+	int d = w->depth++;
+
+	if (w->on_db && w->match && d < db->moves && !move_cmp(&db->move[d], m)) {
+		*ko_threat = db->ko_threat[d];
+		return 0;
+	}
+	w->match = false;
+
+	if (w->on_db && d >= DBOARD_MOVES) {	/* Too deep, go on on a copy */
+		dboard_rewind(db, d);
+		board_copy(w->scratch, &db->b);
+		w->b2 = w->scratch;
+		w->on_db = false;
+	}
+
+	board_t *b2 = w->b2;
+	int res;
+	if (w->on_db) {
+		dboard_rewind(db, d);
+		res = board_full_play(b2, m, &db->undo[d]);
+		if (res < 0)  return res;
+		db->move[d] = *m;
+		db->ko_threat[d] = board_playing_ko_threat(b2);
+		db->moves = d + 1;
+	} else
+		res = board_play(b2, m);
+
+	if (res < 0 || (!is_pass(m->coord) && !group_at(b2, m->coord)) /* suicide */
+	    || b2->superko_violation) {
+		if (UDEBUGL(4))
+			fprintf(stderr, "invalid move %s: res %d group %d spk %d\n",
+				coord2sstr(m->coord), res, group_at(b2, m->coord), b2->superko_violation);
+		if (w->on_db && res >= 0)
+			dboard_rewind(db, d);
+		return -1;
+	}
+
+	*ko_threat = board_playing_ko_threat(b2);
+	return res;
+}
+
+/* Board at current walk position. */
+static board_t *
+uct_walk_board(uct_walk_t *w)
+{
+	if (w->on_db)
+		dboard_rewind(w->db, w->depth);
+	return w->b2;
+}
+
+/* debug */
+static char spaces[] = "\0                                                      ";
+/* /debug */
+
+/* Walk the tree until we find a leaf, playing the moves on w->b2 (or
+ * w->db, then w->b2 is the copy for the playout).
+ * Leaves are expanded on the way unless @expand is given, then the walk
+ * stops at a leaf due for expansion and returns it there instead.
+ * Returns false if we hit an invalid move. */
+static bool
+uct_walk_descend(uct_t *u, board_t *b, enum stone player_color, tree_t *t, uct_walk_t *w, tree_node_t **expand)
+{
+	w->depth = 0;
+	w->match = w->on_db = (w->db != NULL);
+	if (w->on_db)  w->b2 = &w->db->b;
+
+	playout_amafmap_t *amaf = &w->amaf;
+	uct_descent_t *descent = w->descent;
+	tree_node_t **significant = w->significant;
+	amaf->gamelen = amaf->game_baselen = 0;
 
-	/* Walk the tree until we find a leaf, then expand it and do
-	 * a random playout. */
 	tree_node_t *n = t->root;
 	enum stone node_color = stone_other(player_color);
 	assert(node_color == t->root_color);
@@ -377,28 +517,17 @@ uct_playout_descent(uct_t *u, board_t *b, board_t *b2, enum stone player_color,
 	 * except direct calls to uct_playout() */
 	if (tree_leaf_node(n) && !__sync_lock_test_and_set(&n->is_expanded, 1))
 		tree_expand_node(t, n, b, player_color, u, 1);
-	
-	/* Tree descent history. */
-	/* XXX: This is somewhat messy since @n and descent[dlen-1].node are
-	 * redundant. */
-	uct_descent_t descent[DESCENT_DLEN];
+
 	descent[0].node = n;
 	int dlen = 1;
 	/* Total value of the sequence. */
 	move_stats_t seq_value = move_stats(0.0, 0);
-	/* The last "significant" node along the descent (i.e. node
-	 * with higher than configured number of playouts). For black
-	 * and white. */
-	tree_node_t *significant[2] = { NULL, NULL };
+	significant[0] = significant[1] = NULL;
 	if (n->u.playouts >= u->significant_threshold)
 		significant[node_color - 1] = n;
 
-	int result;
 	int passes = is_pass(last_move(b).coord) && b->moves > 0;
 
-	/* debug */
-	static char spaces[] = "\0                                                      ";
-	/* /debug */
 	if (UDEBUGL(8))
 		fprintf(stderr, "--- (#%d) UCT walk with color %d\n", t->root->u.playouts, player_color);
 
@@ -416,11 +545,20 @@ uct_playout_descent(uct_t *u, board_t *b, board_t *b2, enum stone player_color,
 		assert(dlen < DESCENT_DLEN);
 		descent[dlen] = descent[dlen - 1];
 
+		if (n->hints & TREE_HINT_PENDING)
+			tree_widen_node(t, n, u);
+
 		if (!u->random_policy_chance || fast_random(u->random_policy_chance))
 			u->policy->descend(u->policy, t, &descent[dlen], parity, u->allow_pass);
 		else
 			u->random_policy->descend(u->random_policy, t, &descent[dlen], parity, u->allow_pass);
 
+		/* Children reclaimed since the leaf check (see tree_reclaim_node()):
+		 * node is a leaf again, walk ends here. */
+		if (unlikely(!descent[dlen].node)) {
+			node_color = stone_other(node_color);
+			break;
+		}
 
 		/*** Perform the descent: */
 
@@ -431,6 +569,7 @@ uct_playout_descent(uct_t *u, board_t *b, board_t *b2, enum stone player_color,
 		seq_value.value += descent[dlen].value.value * descent[dlen].value.playouts;
 		n = descent[dlen++].node;
 		assert(n == t->root || n->parent);
+		telemetry_inc(TM_DESCENTS);
 		if (UDEBUGL(7))
 			fprintf(stderr, "%s+-- UCT sent us to [%s:%d] %d,%f\n",
 			        spaces, coord2sstr(node_coord(n)),
@@ -441,24 +580,21 @@ uct_playout_descent(uct_t *u, board_t *b, board_t *b2, enum stone player_color,
 			__sync_fetch_and_add(&n->descents, u->virtual_loss);
 
 		move_t m = { node_coord(n), node_color };
-		int res = board_play(b2, &m);
-
-		if (res < 0 || (!is_pass(m.coord) && !group_at(b2, m.coord)) /* suicide */
-		    || b2->superko_violation) {
+		bool ko_threat;
+		if (uct_walk_play(u, w, &m, &ko_threat) < 0) {
 			if (UDEBUGL(4)) {
 				for (tree_node_t *ni = n; ni; ni = ni->parent)
 					fprintf(stderr, "%s<%" PRIhash "> ", coord2sstr(node_coord(ni)), ni->hash);
-				fprintf(stderr, "marking invalid %s node %d,%d res %d group %d spk %d\n",
-				        stone2str(node_color), coord_x(node_coord(n)), coord_y(node_coord(n)),
-					res, group_at(b2, m.coord), b2->superko_violation);
+				fprintf(stderr, "marking invalid %s node %d,%d\n",
+				        stone2str(node_color), coord_x(node_coord(n)), coord_y(node_coord(n)));
 			}
 			n->hints |= TREE_HINT_INVALID;
-			*presult = 0;
-			return n;
+			w->n = n;  w->dlen = dlen;  w->node_color = node_color;
+			return false;
 		}
 
 		assert(node_coord(n) >= -1);
-		record_amaf_move(&amaf, node_coord(n), board_playing_ko_threat(b2));
+		record_amaf_move(amaf, node_coord(n), ko_threat);
 
 		if (is_pass(node_coord(n)))  passes++;
 		else                         passes = 0;
@@ -467,21 +603,42 @@ uct_playout_descent(uct_t *u, board_t *b, board_t *b2, enum stone player_color,
 		/* We need to make sure only one thread expands the node. If
 		 * we are unlucky enough for two threads to meet in the same
 		 * node, the latter one will simply do another simulation from
-		 * the node itself, no big deal. t->nodes_size may exceed
-		 * the maximum in multi-threaded case but not by much so it's ok.
+		 * the node itself, no big deal. t->nodes_size goes past
+		 * the maximum once an allocation didn't fit (see tree_alloc_mem()).
 		 * The size test must be before the test&set not after, to allow
 		 * expansion of the node later if enough nodes have been freed. */
 		if (tree_leaf_node(n)
-		    && n->u.playouts - u->virtual_loss >= u->expand_p && t->nodes_size < t->max_tree_size
-		    && !__sync_lock_test_and_set(&n->is_expanded, 1))
-			tree_expand_node(t, n, b2, next_color, u, -parity);
+		    && n->u.playouts - u->virtual_loss >= u->expand_p) {
+			if (t->nodes_size >= t->max_tree_size && !(t->reclaim && tree_free_nodes(t)))
+				tree_expand_failed(n);  /* Out of tree memory */
+			else if (!__sync_lock_test_and_set(&n->is_expanded, 1)) {
+				if (expand)  *expand = n;	/* Still a leaf, walk ends here. */
+				else         tree_expand_node(t, n, uct_walk_board(w), next_color, u, -parity);
+			}
+		}
 	}
 
-	amaf.game_baselen = amaf.gamelen;
+	amaf->game_baselen = amaf->gamelen;
+
+	/* Leaf board for the playout */
+	if (w->on_db) {
+		board_copy(w->scratch, uct_walk_board(w));
+		w->b2 = w->scratch;
+		w->on_db = false;
+	}
+	board_t *b2 = w->b2;
 
 	if (t->use_extra_komi && u->dynkomi->persim)
 		b2->komi += round(u->dynkomi->persim(u->dynkomi, b2, t, n));
 
+	w->n = n;  w->dlen = dlen;  w->node_color = node_color;
+	return true;
+}
+
+/* Random playout from the leaf node. */
+static void
+uct_walk_playout(uct_t *u, enum stone player_color, tree_t *t, uct_walk_t *w, ownermap_t *ownermap)
+{
 	/* !!! !!! !!!
 	 * ALERT: The "result" number is extremely confusing. In some parts
 	 * of the code, it is from white's perspective, but here positive
@@ -491,55 +648,262 @@ uct_playout_descent(uct_t *u, board_t *b, board_t *b2, enum stone player_color,
 	// assert(tree_leaf_node(n));
 	/* In case of parallel tree search, the assertion might
 	 * not hold if two threads chew on the same node. */
-	result = uct_leaf_node(u, b2, player_color, &amaf, descent, &dlen, significant, t, n, node_color, spaces);
+	w->result = uct_leaf_node(u, w->b2, player_color, &w->amaf, w->descent, &w->dlen, w->significant,
+				  t, w->n, w->node_color, spaces, ownermap);
 
+	playout_amafmap_t *amaf = &w->amaf;
 	if (u->policy->wants_amaf && u->playout_amaf_cutoff) {
-		unsigned int cutoff = amaf.game_baselen;
-		cutoff += (amaf.gamelen - amaf.game_baselen) * u->playout_amaf_cutoff / 100;
-		amaf.gamelen = cutoff;
+		unsigned int cutoff = amaf->game_baselen;
+		cutoff += (amaf->gamelen - amaf->game_baselen) * u->playout_amaf_cutoff / 100;
+		amaf->gamelen = cutoff;
 	}
+}
 
-	/* Record the result. */
+/* Record the result. */
+static void
+uct_walk_update(uct_t *u, board_t *b, enum stone player_color, tree_t *t, uct_walk_t *w)
+{
+	tree_node_t *n = w->n;
+	int result = w->result;
 
 	assert(n == t->root || n->parent);
-	floating_t rval = scale_value(u, b, node_color, significant, result);
-	u->policy->update(u->policy, t, n, node_color, player_color, &amaf, b2, rval);
+	floating_t rval = scale_value(u, b, w->node_color, w->significant, result);
+	u->policy->update(u->policy, t, n, w->node_color, player_color, &w->amaf, w->b2, rval);
+#ifdef DISTRIBUTED
+	if (u->slave && u->shared_levels)
+		uct_slave_record_dirty(u, w->descent, w->dlen);
+#endif
 
 	stats_add_result(&t->avg_score, (float)result / 2, 1);
 	if (t->use_extra_komi) {
 		stats_add_result(&u->dynkomi->score, (float)result / 2, 1);
 		stats_add_result(&u->dynkomi->value, rval, 1);
 	}
-
-	*presult = result;
-	return n;
 }
 
-int
-uct_playout(uct_t *u, board_t *b, enum stone player_color, tree_t *t)
+/* We need to undo the virtual loss we added during descend. */
+static void
+uct_walk_undo_virtual_loss(uct_t *u, tree_node_t *n)
 {
-	board_t b2;
-	board_copy(&b2, b);
-	
-	int result;
-	tree_node_t *n = uct_playout_descent(u, b, &b2, player_color, t, &result);
-	
-	/* We need to undo the virtual loss we added during descend. */
 	if (u->virtual_loss) {
 		for (; n->parent; n = n->parent) {
 			__sync_fetch_and_sub(&n->descents, u->virtual_loss);
 		}
 	}
+}
 
-	board_done(&b2);
-	return result;
+static int
+uct_playout_(uct_t *u, board_t *b, enum stone player_color, tree_t *t, uct_dboard_t *db)
+{
+	board_t b2;
+	if (!db)  board_copy(&b2, b);
+
+	uct_walk_t w;
+	w.b2 = w.scratch = &b2;
+	w.db = db;
+	w.result = 0;
+	if (uct_walk_descend(u, b, player_color, t, &w, NULL)) {
+		uct_walk_playout(u, player_color, t, &w, &u->ownermap);
+		uct_walk_update(u, b, player_color, t, &w);
+	}
+
+	uct_walk_undo_virtual_loss(u, w.n);
+
+	if (!w.on_db)  board_done(&b2);	/* Else playout board never made it */
+	telemetry_inc(TM_PLAYOUTS);
+	return w.result;
 }
 
 int
-uct_playouts(uct_t *u, board_t *b, enum stone color, tree_t *t, time_info_t *ti)
+uct_playout(uct_t *u, board_t *b, enum stone player_color, tree_t *t)
+{
+	return uct_playout_(u, b, player_color, t, NULL);
+}
+
+/* Search loop of a search thread, @tid: thread index within threads
+ * searching @t (see tree_reclaim_enter()). */
+int
+uct_playouts(uct_t *u, board_t *b, enum stone color, tree_t *t, time_info_t *ti, int tid)
 {
+	uct_dboard_t *db = (u->descent_undo ? dboard_new(b) : NULL);
+
 	int i;
-	for (i = 0; !uct_halt; i++)
-		uct_playout(u, b, color, t);
+	for (i = 0; !uct_halt; i++) {
+		if (t->reclaim)  tree_reclaim_enter(t, tid);
+		uct_playout_(u, b, color, t, db);
+	}
+
+	dboard_done(db);
 	return i;
 }
+
+
+/**** Deterministic search */
+
+/* Playouts run in lockstep batches of deterministic_batch per thread:
+ * - Thread 0 walks the tree for every playout of the batch, in playout
+ *   order. Virtual loss spreads the walks as usual, leaves due for
+ *   expansion are only marked.
+ * - All threads expand marked leaves and run the random playouts.
+ * - Thread 0 records the results in playout order and decides whether
+ *   to stop (fixed playouts search).
+ * Each playout gets its own random seed derived from the search seed
+ * and playout number, and ownermap counts are kept per thread and summed
+ * up at the end of each batch, so the outcome doesn't depend on thread
+ * timing. It does depend on the number of threads and batch size. */
+
+typedef struct {
+	board_t b2;
+	uct_walk_t w;
+	bool valid;
+	tree_node_t *expand;		/* Leaf to expand before playout */
+} uct_det_slot_t;
+
+typedef struct uct_det {
+	int threads;
+	int nslots;
+	uct_det_slot_t *slots;
+	ownermap_t *ownermaps;		/* Per thread */
+	unsigned long seed;
+	int index;			/* Playout number of first slot */
+	volatile bool stop;
+
+	/* Barrier (no pthread_barrier_t on some platforms) */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int waiting;
+	int generation;
+} uct_det_t;
+
+void
+uct_det_init(uct_t *u, unsigned long seed)
+{
+	uct_det_t *d = calloc2(1, uct_det_t);
+	d->threads = u->threads;
+	d->nslots = u->threads * u->deterministic_batch;
+	d->slots = calloc2(d->nslots, uct_det_slot_t);
+	d->ownermaps = calloc2(d->threads, ownermap_t);
+	d->seed = seed;
+	pthread_mutex_init(&d->lock, NULL);
+	pthread_cond_init(&d->cond, NULL);
+	u->det = d;
+}
+
+void
+uct_det_done(uct_t *u)
+{
+	uct_det_t *d = u->det;
+	pthread_mutex_destroy(&d->lock);
+	pthread_cond_destroy(&d->cond);
+	free(d->ownermaps);
+	free(d->slots);
+	free(d);
+	u->det = NULL;
+}
+
+/* Workers are done (fixed playouts search) */
+bool
+uct_det_stopped(uct_t *u)
+{
+	return u->det->stop;
+}
+
+static void
+det_barrier(uct_det_t *d)
+{
+	pthread_mutex_lock(&d->lock);
+	int generation = d->generation;
+	if (++d->waiting == d->threads) {
+		d->waiting = 0;
+		d->generation++;
+		pthread_cond_broadcast(&d->cond);
+	} else
+		while (generation == d->generation)
+			pthread_cond_wait(&d->cond, &d->lock);
+	pthread_mutex_unlock(&d->lock);
+}
+
+/* Random seed for playout @n, two per playout: tree walk and playout. */
+static unsigned long
+det_seed(uct_det_t *d, int n)
+{
+	uint32_t x = d->seed * 0x9e3779b9 + n;
+	x ^= x >> 16;  x *= 0x85ebca6b;
+	x ^= x >> 13;  x *= 0xc2b2ae35;
+	x ^= x >> 16;
+	return x & 0x7fffffff;
+}
+
+static bool
+det_check_stop(uct_t *u, board_t *b, enum stone color, tree_t *t, time_info_t *ti, uct_search_state_t *s)
+{
+	if (uct_halt)  return true;
+	/* With fixed playouts stop condition is checked here between batches
+	 * instead of main thread, so we always stop at the same point. */
+	if (ti && ti->dim == TD_GAMES && !pondering(u))
+		return uct_search_check_stop(u, b, color, t, ti, s, t->root->u.playouts);
+	return false;
+}
+
+int
+uct_playouts_deterministic(uct_t *u, board_t *b, enum stone color, tree_t *t, time_info_t *ti, int tid,
+			   uct_search_state_t *s)
+{
+	uct_det_t *d = u->det;
+	int games = 0;
+	/* Walks are all done by thread 0, one after the other. */
+	uct_dboard_t *db = (!tid && u->descent_undo ? dboard_new(b) : NULL);
+
+	while (1) {
+		/* Walk the tree, in playout order. */
+		if (!tid) {
+			d->stop = det_check_stop(u, b, color, t, ti, s);
+			for (int i = 0; !d->stop && i < d->nslots; i++) {
+				uct_det_slot_t *slot = &d->slots[i];
+				fast_srandom(det_seed(d, 2 * (d->index + i)));
+				if (!db)  board_copy(&slot->b2, b);
+				slot->w.b2 = slot->w.scratch = &slot->b2;
+				slot->w.db = db;
+				slot->w.result = 0;
+				slot->expand = NULL;
+				slot->valid = uct_walk_descend(u, b, color, t, &slot->w, &slot->expand);
+			}
+		}
+		det_barrier(d);
+		if (d->stop)  break;
+
+		/* Expand and play out, in parallel. */
+		for (int i = tid; i < d->nslots; i += d->threads, games++) {
+			uct_det_slot_t *slot = &d->slots[i];
+			uct_walk_t *w = &slot->w;
+			if (!slot->valid)  continue;
+			fast_srandom(det_seed(d, 2 * (d->index + i) + 1));
+			if (slot->expand)
+				tree_expand_node(t, slot->expand, w->b2, stone_other(w->node_color), u,
+						 (w->node_color == color ? -1 : 1));
+			uct_walk_playout(u, color, t, w, &d->ownermaps[tid]);
+		}
+		det_barrier(d);
+
+		/* Record results, in playout order. */
+		if (!tid) {
+			for (int i = 0; i < d->nslots; i++) {
+				uct_det_slot_t *slot = &d->slots[i];
+				if (slot->valid)
+					uct_walk_update(u, b, color, t, &slot->w);
+				uct_walk_undo_virtual_loss(u, slot->w.n);
+				if (!slot->w.on_db)  board_done(&slot->b2);
+			}
+			telemetry_add(TM_PLAYOUTS, d->nslots);
+
+			for (int i = 0; i < d->threads; i++) {
+				ownermap_merge(b, &u->ownermap, &d->ownermaps[i]);
+				ownermap_init(&d->ownermaps[i]);
+			}
+			d->index += d->nslots;
+			uct_search_dynkomi(u, b, t, s, t->root->u.playouts);
+		}
+	}
+	dboard_done(db);
+	return games;
+}
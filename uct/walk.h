@@ -4,8 +4,17 @@
 #include "uct/internal.h"
 
 void uct_progress_status(uct_t *u, tree_t *t, enum stone color, int playouts, coord_t *final);
+void uct_progress_json(FILE *fh, uct_t *u, tree_t *t, enum stone color, int playouts, coord_t *final, bool big);
 
 int uct_playout(uct_t *u, board_t *b, enum stone player_color, tree_t *t);
-int uct_playouts(uct_t *u, board_t *b, enum stone color, tree_t *t, time_info_t *ti);
+int uct_playouts(uct_t *u, board_t *b, enum stone color, tree_t *t, time_info_t *ti, int tid);
+
+/* Deterministic search (uct "deterministic" option) */
+struct uct_search_state;
+void uct_det_init(uct_t *u, unsigned long seed);
+void uct_det_done(uct_t *u);
+bool uct_det_stopped(uct_t *u);
+int uct_playouts_deterministic(uct_t *u, board_t *b, enum stone color, tree_t *t, time_info_t *ti, int tid,
+			       struct uct_search_state *s);
 
 #endif